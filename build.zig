@@ -24,10 +24,20 @@ pub fn build(b: *std.Build) void {
             "-DBAUD_TOL=3",
             "-Os",
         });
+        object.addFileArg(b.path("glyco/src/analyzer.c"));
+        object.addFileArg(b.path("glyco/src/breakpoint.c"));
         object.addFileArg(b.path("glyco/src/bus.c"));
+        object.addFileArg(b.path("glyco/src/clock.c"));
+        object.addFileArg(b.path("glyco/src/cmd.c"));
+        object.addFileArg(b.path("glyco/src/fetch.c"));
         object.addFileArg(b.path("glyco/src/flash.c"));
+        object.addFileArg(b.path("glyco/src/mailbox.c"));
         object.addFileArg(b.path("glyco/src/main.c"));
+        object.addFileArg(b.path("glyco/src/marker.c"));
+        object.addFileArg(b.path("glyco/src/perf.c"));
+        object.addFileArg(b.path("glyco/src/profile.c"));
         object.addFileArg(b.path("glyco/src/serial.c"));
+        object.addFileArg(b.path("glyco/src/trace.c"));
         object.addPrefixedDirectoryArg("-I", b.path("glyco/src"));
         object.addPrefixedDirectoryArg("-I", b.path("common/include"));
         const elf = object.addPrefixedOutputFileArg("-o", "glyco.elf");
@@ -76,22 +86,43 @@ pub fn build(b: *std.Build) void {
             .root = b.path("glydb/src"),
             .files = &.{
                 "bdbp_util.c",
+                "bridge.c",
                 "buffer.c",
+                "cache.c",
+                "capture.c",
                 "command.c",
                 "connection.c",
                 "debugger.c",
+                "farm.c",
+                "image.c",
+                "jobs.c",
                 "main.c",
                 "parser.c",
+                "replay.c",
+                "stats.c",
+                "symbols.c",
                 "target.c",
                 "value.c",
+                "commands/analyzer.c",
+                "commands/break.c",
+                "commands/bus.c",
+                "commands/cache.c",
+                "commands/capture.c",
                 "commands/commands.c",
                 "commands/connection.c",
                 "commands/disassemble.c",
                 "commands/flash.c",
                 "commands/help.c",
+                "commands/jobs.c",
+                "commands/mailbox.c",
+                "commands/markers.c",
                 "commands/memory.c",
                 "commands/ping.c",
+                "commands/profile.c",
                 "commands/quit.c",
+                "commands/stats.c",
+                "commands/symbols.c",
+                "commands/trace.c",
                 "z80/disassemble.c",
                 "z80/z80.c",
             },
@@ -100,6 +131,7 @@ pub fn build(b: *std.Build) void {
             },
         });
         glydb.linkSystemLibrary("editline");
+        glydb.linkSystemLibrary("pthread");
         glydb.addIncludePath(b.path("common/include"));
         glydb.addIncludePath(b.path("glydb/src"));
         b.installArtifact(glydb);
@@ -122,6 +154,7 @@ pub fn build(b: *std.Build) void {
             .optimize = optimize,
             .link_libc = true,
         });
+        glysim.addIncludePath(b.path("common/include"));
         b.installArtifact(glysim);
     }
 }
@@ -1,6 +1,8 @@
 #ifndef _COMMON_BINARY_DEBUG_PROTOCOL_H
 #define _COMMON_BINARY_DEBUG_PROTOCOL_H
 
+#include <stdint.h>
+
 // General message format:
 //
 // | HDR (1 byte) | DLEN (1 byte) | DATA ('DLEN' bytes) |
@@ -10,6 +12,8 @@
 // If a request was successfully completed, the device will respond with status SUCCESS
 // and request-dependent data. Otherwise, one of the other status codes will be returned
 // and the data field is empty.
+//
+// Multi-byte integer fields (other than addresses, see below) are encoded in little endian.
 
 enum bdbp_cmd {
     // Ping the device to see if it is online. Data field is empty, and length is 0.
@@ -50,8 +54,397 @@ enum bdbp_cmd {
     // | 0x07 | 0x00 |
     // Successful response has no data.
     BDBP_CMD_ERASE_CHIP = 0x07,
+
+    // Retrieve information about the coprocessor firmware and what it supports. Takes no data.
+    // | 0x08 | 0x00 |
+    // Successful response carries the protocol version, the maximum length of a request message
+    // that the device accepts, the sizes of the device's receive and transmit buffers (0 if the
+    // direction is unbuffered), a bitmap of supported commands (see `BDBP_CMD_BIT`) and a
+    // firmware build identifier.
+    // | 0x01 | 0x13 | VERSION (1 byte) | MAX MSG (2 bytes) | RX BUF (2 bytes) | TX BUF (2 bytes) | CMDS (8 bytes) | BUILD ID (4 bytes) |
+    // Devices that do not know this command respond with BDBP_STATUS_UNKNOWN_CMD, and should be
+    // assumed to support commands up to and including BDBP_CMD_ERASE_CHIP.
+    BDBP_CMD_INFO = 0x08,
+
+    // Compute a digest of consecutive blocks of target memory, so that the host can tell which
+    // blocks changed without reading them. Data field consists of 5 bytes: the address of the
+    // first block, the size of each block and the number of blocks.
+    // | 0x09 | 0x05 | ADDR (3 bytes) | BLOCK SIZE (1 byte) | COUNT (1 byte) |
+    // Successful response carries the CRC-16/CCITT of each block (see `bdbp_crc16_update`),
+    // computed with an initial value of 0xFFFF. At most BDBP_DIGEST_MAX_BLOCKS blocks are
+    // digested, further blocks are ignored.
+    // | 0x01 | 2 * COUNT | DIGEST (2 bytes) ... |
+    // The bus is only held while a single block is read, so that the Z80 is never stopped for
+    // long.
+    BDBP_CMD_DIGEST = 0x09,
+
+    // Retrieve the performance counters of the coprocessor, which tell where time goes on the
+    // device side. Data field consists of flags, see `BDBP_STATS_FLAG_RESET`.
+    // | 0x0A | 0x01 | FLAGS (1 byte) |
+    // Successful response carries the clock frequency of the coprocessor and the length of a
+    // timer tick in CPU cycles, followed by the counters. Every counted duration has a count, the
+    // total number of ticks and the largest number of ticks (see `BDBP_STATS_DURATION_LENGTH`).
+    // | 0x01 | BDBP_STATS_DATA_LENGTH | CPU KHZ (2 bytes) | TICK CYCLES (1 byte) |
+    //   BUS ACQUIRE (duration) | BUS HOLD (duration) | RX HIGH WATER (2 bytes) | RX DROPPED (4 bytes) |
+    //   FLASH PROGRAM (duration) | FLASH ERASE (duration) | COMMANDS (1 byte) | CMD (duration) ... |
+    // BUS ACQUIRE is the wait for the Z80 to grant the bus, and BUS HOLD the time for which it
+    // was held. RX HIGH WATER is the most bytes that were waiting in the receive buffer at once,
+    // and RX DROPPED counts bytes lost because it was full. FLASH PROGRAM and FLASH ERASE are
+    // the times the flash chip took for single bytes and for erases. They are followed by one
+    // duration for each of the first COMMANDS command numbers, which covers handling a request
+    // including sending its response. There is no command 0, so its duration counts all other
+    // requests together: those with unknown commands, and those with command numbers of COMMANDS
+    // and above, such as BDBP_CMD_MAILBOX and BDBP_CMD_ANALYZER. BDBP_STATS_DATA_LENGTH leaves
+    // no room for more commands.
+    BDBP_CMD_STATS = 0x0A,
+
+    // Record benchmark markers: reads by the Z80 from GLYCON_MARKER_PORT, which the coprocessor
+    // timestamps with a cycle counter while it waits for requests. Data field consists of
+    // flags, see `BDBP_MARKERS_FLAG_START`.
+    // | 0x0B | 0x01 | FLAGS (1 byte) |
+    // Successful response carries the state of the recording (see
+    // `BDBP_MARKERS_STATE_RECORDING`), the clock frequency of the coprocessor, the number of
+    // markers that were lost because the log was full, and the oldest markers in the log, which
+    // are removed from it. A marker consists of its ID, the upper byte of the port address, and
+    // the coprocessor's cycle counter when it was seen, which wraps around after 2^32 cycles.
+    // | 0x01 | 6 + 5 * COUNT | STATE (1 byte) | CPU KHZ (2 bytes) | DROPPED (2 bytes) | COUNT (1 byte) | ID (1 byte) | CYCLES (4 bytes) | ... |
+    // At most BDBP_MARKERS_MAX_COUNT markers are returned at once. Markers are missed while the
+    // coprocessor handles a request, so the log is best fetched once the measurement is done.
+    BDBP_CMD_MARKERS = 0x0B,
+
+    // Sample the addresses of the Z80's instruction fetches for a statistical profile, without
+    // stopping the Z80. Data field consists of flags (see `BDBP_PROFILE_FLAG_START`) and the
+    // mean time between samples in microseconds, which is only used when starting. Sampling
+    // times are jittered, so that samples don't fall in step with loops on the Z80.
+    // | 0x0C | 0x03 | FLAGS (1 byte) | PERIOD US (2 bytes) |
+    // Successful response carries the state of the sampling (see
+    // `BDBP_PROFILE_STATE_RUNNING`), the number of samples that were lost because the buffer was
+    // full, the number of times that the Z80 did not fetch an instruction in time, because it
+    // was reset or held off the bus, and the oldest samples in the buffer, which are removed
+    // from it. A sample is the address of the first opcode fetch after the sampling time.
+    // | 0x01 | 6 + 3 * COUNT | STATE (1 byte) | DROPPED (2 bytes) | MISSED (2 bytes) | COUNT (1 byte) | ADDR (3 bytes) ... |
+    // At most BDBP_PROFILE_MAX_COUNT samples are returned at once.
+    BDBP_CMD_PROFILE = 0x0C,
+
+    // Trace the addresses of all instruction fetches of the Z80 into a buffer on the device.
+    // While tracing, the coprocessor holds the Z80 off the bus for a moment after every opcode
+    // fetch, which slows it down several times. The trace is started and stopped by fetches
+    // from particular addresses, or by requests. The first byte of the data field is an
+    // operation, see `enum bdbp_trace_op`:
+    // | 0x0D | 0x01 | OP_STATUS |
+    // | 0x0D | 0x08 | OP_START | MODE (1 byte) | START ADDR (3 bytes) | STOP ADDR (3 bytes) |
+    // | 0x0D | 0x01 | OP_STOP |
+    // | 0x0D | 0x02 | OP_READ | BLOCK (1 byte) |
+    // Starting clears the buffer, and MODE selects triggers, see `BDBP_TRACE_MODE_START_TRIGGER`.
+    // Successful response carries the state of the trace (see `enum bdbp_trace_state`), the
+    // number of blocks in the buffer, and the number of fetches traced since the start, which
+    // includes those whose blocks were overwritten. OP_READ also returns up to
+    // BDBP_TRACE_READ_BLOCKS blocks of BDBP_TRACE_BLOCK_SIZE bytes, starting at the given index
+    // from the oldest block. See `BDBP_TRACE_DELTA` for how the blocks are encoded.
+    // | 0x01 | 6 + 64 * N | STATE (1 byte) | BLOCKS (1 byte) | FETCHES (4 bytes) | BLOCK DATA ... |
+    // Fetches are missed while the coprocessor handles a request, so the trace is best read
+    // after it stopped.
+    BDBP_CMD_TRACE = 0x0D,
+
+    // Hardware breakpoints, which need no change to the code. While breakpoints are set, the
+    // coprocessor compares the address of every opcode fetch with them, holding the Z80 for a
+    // moment after each fetch like BDBP_CMD_TRACE does. When one matches, the Z80 is kept
+    // stopped at the end of the fetch, before it executes the instruction, and the device sends
+    // a BDBP_EVENT_BREAKPOINT event. Memory can be accessed as usual while the Z80 is stopped.
+    // The first byte of the data field is an operation, see `enum bdbp_break_op`:
+    // | 0x0E | 0x01 | OP_STATUS |
+    // | 0x0E | 2 + 3 * COUNT | OP_SET | COUNT (1 byte) | ADDR (3 bytes) ... |
+    // | 0x0E | 0x01 | OP_CONTINUE |
+    // | 0x0E | 0x01 | OP_HALT |
+    // OP_SET replaces all breakpoints with at most BDBP_BREAK_MAX_COUNT new ones. OP_CONTINUE
+    // lets a stopped Z80 run again, and OP_HALT stops it wherever it is.
+    // Successful response carries the state of the Z80 (see `enum bdbp_break_state`), the
+    // number of breakpoints, and the index and address of the breakpoint that the Z80 stopped
+    // at. The index is BDBP_BREAK_NO_INDEX if the Z80 runs or was stopped with OP_HALT.
+    // | 0x01 | 0x06 | STATE (1 byte) | COUNT (1 byte) | INDEX (1 byte) | ADDR (3 bytes) |
+    BDBP_CMD_BREAK = 0x0E,
+
+    // Set a budget for how long the commands that access memory may hold the Z80 off the bus
+    // at once, so that it keeps running during large transfers. After BURST bytes, the bus is
+    // released for at least GAP US microseconds before the transfer continues. A BURST of 0
+    // holds the bus for whole requests, which is the default. A data field that is empty or too
+    // short leaves the budget unchanged.
+    // | 0x0F | 0x03 | BURST (1 byte) | GAP US (2 bytes) |
+    // Successful response carries the budget, the clock of the coprocessor like BDBP_CMD_STATS,
+    // and the number of times the bus was held since the counters were last reset, with the
+    // total ticks. Both wrap around, so they are meant to be compared before and after a
+    // transfer.
+    // | 0x01 | BDBP_BUS_DATA_LENGTH | BURST (1 byte) | GAP US (2 bytes) | CPU KHZ (2 bytes) |
+    //   TICK CYCLES (1 byte) | HOLDS (4 bytes) | HOLD TICKS (4 bytes) |
+    // Erasing flash holds the bus for the whole erase regardless of the budget, since the Z80
+    // can't read the flash chip meanwhile.
+    BDBP_CMD_BUS = 0x0F,
+
+    // Exchange bytes with Z80 code through a mailbox in RAM, see GLYCON_MAILBOX_TX_RING. While
+    // the mailbox is open, the coprocessor polls it whenever it waits for requests, holding the
+    // bus only for a moment, and forwards the bytes that the Z80 wrote with BDBP_EVENT_MAILBOX
+    // events. It is not polled while markers are recorded, or while fetches are watched for
+    // BDBP_CMD_TRACE or BDBP_CMD_BREAK. The first byte of the data field is an operation, see
+    // `enum bdbp_mailbox_op`:
+    // | 0x10 | 0x01 | OP_STATUS |
+    // | 0x10 | 0x04 | OP_OPEN | ADDR (3 bytes) |
+    // | 0x10 | 0x01 | OP_CLOSE |
+    // | 0x10 | 1 + N | OP_SEND | DATA ... |
+    // OP_OPEN starts polling the mailbox at ADDR, which the Z80 must have cleared. OP_SEND
+    // writes as many bytes to the ring for the Z80 as fit. Successful response carries whether
+    // the mailbox is open, the number of bytes that OP_SEND wrote, and the address.
+    // | 0x01 | 0x05 | OPEN (1 byte) | SENT (1 byte) | ADDR (3 bytes) |
+    BDBP_CMD_MAILBOX = 0x10,
+
+    // Sample the Z80's bus like a logic analyzer: the address, the data and the M1 and IOREQ
+    // lines are captured into a buffer on the device as fast as the coprocessor can read them,
+    // starting at a trigger. While armed, the coprocessor waits for the trigger instead of
+    // watching fetches, markers or the mailbox, and reports BDBP_EVENT_ANALYZER once the buffer
+    // is full. Requests during the capture make it miss samples, so the host should wait for
+    // the event. The capture shares its buffer with BDBP_CMD_TRACE, so arming discards the
+    // trace and starting a trace discards the capture. The first byte of the data field is an
+    // operation, see `enum bdbp_analyzer_op`:
+    // | 0x11 | 0x01 | OP_STATUS |
+    // | 0x11 | 0x05 | OP_ARM | TRIGGER (1 byte) | VALUE (3 bytes) |
+    // | 0x11 | 0x01 | OP_STOP |
+    // | 0x11 | 0x03 | OP_READ | SAMPLE (2 bytes) |
+    // TRIGGER selects what starts the capture, see `enum bdbp_analyzer_trigger`, and VALUE is
+    // the address or data it matches. Successful response carries the state of the analyzer
+    // (see `enum bdbp_analyzer_state`), the number of samples captured, the clock frequency of
+    // the coprocessor and the number of its cycles that the capture took. OP_READ also returns
+    // up to BDBP_ANALYZER_READ_SAMPLES samples of BDBP_ANALYZER_SAMPLE_SIZE bytes, starting at
+    // the given index, see `BDBP_ANALYZER_SAMPLE_M1` for how they are encoded.
+    // | 0x01 | 9 + 4 * N | STATE (1 byte) | SAMPLES (2 bytes) | CPU KHZ (2 bytes) | CYCLES (4 bytes) | SAMPLE DATA ... |
+    BDBP_CMD_ANALYZER = 0x11,
+};
+
+// The version of the protocol described in this file, as reported by BDBP_CMD_INFO.
+#define BDBP_VERSION (1)
+
+// The bit corresponding to `cmd` in the command bitmap returned by BDBP_CMD_INFO.
+#define BDBP_CMD_BIT(cmd) ((uint64_t) 1 << (cmd))
+
+// The command bitmap of devices that predate BDBP_CMD_INFO.
+#define BDBP_LEGACY_CMDS \
+    (BDBP_CMD_BIT(BDBP_CMD_PING) | BDBP_CMD_BIT(BDBP_CMD_WRITE) | BDBP_CMD_BIT(BDBP_CMD_READ) | \
+    BDBP_CMD_BIT(BDBP_CMD_WRITE_FLASH) | BDBP_CMD_BIT(BDBP_CMD_FLASH_ID) | \
+    BDBP_CMD_BIT(BDBP_CMD_ERASE_SECTOR) | BDBP_CMD_BIT(BDBP_CMD_ERASE_CHIP))
+
+// The length of the data field of a successful BDBP_CMD_INFO response.
+#define BDBP_INFO_DATA_LENGTH (19)
+
+// The maximum number of blocks that a single BDBP_CMD_DIGEST request digests.
+#define BDBP_DIGEST_MAX_BLOCKS (BDBP_MAX_DATA_LENGTH / 2)
+
+// Flag of BDBP_CMD_STATS: clear all counters once they have been reported.
+#define BDBP_STATS_FLAG_RESET (0x01)
+
+// The number of commands that BDBP_CMD_STATS reports durations for. Later commands are counted
+// together, see BDBP_CMD_STATS.
+#define BDBP_STATS_CMDS (16)
+
+// The length of a duration in a BDBP_CMD_STATS response.
+// | COUNT (4 bytes) | TICKS (4 bytes) | MAX TICKS (4 bytes) |
+#define BDBP_STATS_DURATION_LENGTH (12)
+
+// The length of the data field of a successful BDBP_CMD_STATS response.
+#define BDBP_STATS_DATA_LENGTH (2 + 1 + 2 * BDBP_STATS_DURATION_LENGTH + 2 + 4 + 2 * BDBP_STATS_DURATION_LENGTH + 1 + BDBP_STATS_CMDS * BDBP_STATS_DURATION_LENGTH)
+
+// Flags of BDBP_CMD_MARKERS: clear the log and start recording, or stop recording. Without
+// flags, the request just fetches markers.
+#define BDBP_MARKERS_FLAG_START (0x01)
+#define BDBP_MARKERS_FLAG_STOP (0x02)
+
+// State bit of a BDBP_CMD_MARKERS response: markers are being recorded.
+#define BDBP_MARKERS_STATE_RECORDING (0x01)
+
+// The length of the fixed part of a successful BDBP_CMD_MARKERS response, and of each marker.
+#define BDBP_MARKERS_HEADER_LENGTH (6)
+#define BDBP_MARKERS_ENTRY_LENGTH (5)
+
+// The maximum number of markers in a single BDBP_CMD_MARKERS response.
+#define BDBP_MARKERS_MAX_COUNT ((BDBP_MAX_DATA_LENGTH - BDBP_MARKERS_HEADER_LENGTH) / BDBP_MARKERS_ENTRY_LENGTH)
+
+// Flags of BDBP_CMD_PROFILE: clear the buffer and start sampling, or stop sampling. Without
+// flags, the request just fetches samples.
+#define BDBP_PROFILE_FLAG_START (0x01)
+#define BDBP_PROFILE_FLAG_STOP (0x02)
+
+// State bit of a BDBP_CMD_PROFILE response: sampling is running.
+#define BDBP_PROFILE_STATE_RUNNING (0x01)
+
+// The range of the sampling period of BDBP_CMD_PROFILE. Other periods are clamped to it.
+#define BDBP_PROFILE_MIN_PERIOD_US (100)
+#define BDBP_PROFILE_MAX_PERIOD_US (25000)
+
+// The length of the fixed part of a successful BDBP_CMD_PROFILE response.
+#define BDBP_PROFILE_HEADER_LENGTH (6)
+
+// The maximum number of samples in a single BDBP_CMD_PROFILE response.
+#define BDBP_PROFILE_MAX_COUNT ((BDBP_MAX_DATA_LENGTH - BDBP_PROFILE_HEADER_LENGTH) / BDBP_ADDR_SIZE)
+
+// Operations of BDBP_CMD_TRACE.
+enum bdbp_trace_op {
+    BDBP_TRACE_OP_STATUS = 0x00,
+    BDBP_TRACE_OP_START = 0x01,
+    BDBP_TRACE_OP_STOP = 0x02,
+    BDBP_TRACE_OP_READ = 0x03,
+};
+
+// States of the trace in a BDBP_CMD_TRACE response.
+enum bdbp_trace_state {
+    // Not tracing, either because no trace was started or because it was stopped by a request.
+    BDBP_TRACE_STATE_IDLE = 0x00,
+    // Waiting for a fetch from the start address.
+    BDBP_TRACE_STATE_ARMED = 0x01,
+    BDBP_TRACE_STATE_TRACING = 0x02,
+    // Stopped by a fetch from the stop address, or because the buffer was full.
+    BDBP_TRACE_STATE_DONE = 0x03,
 };
 
+// Mode bits of BDBP_CMD_TRACE: start tracing at the first fetch from the start address instead
+// of right away, stop after a fetch from the stop address, and stop when the buffer is full
+// instead of overwriting the oldest blocks.
+#define BDBP_TRACE_MODE_START_TRIGGER (0x01)
+#define BDBP_TRACE_MODE_STOP_TRIGGER (0x02)
+#define BDBP_TRACE_MODE_STOP_WHEN_FULL (0x04)
+
+// The length of the fixed part of a successful BDBP_CMD_TRACE response.
+#define BDBP_TRACE_HEADER_LENGTH (6)
+
+// The trace buffer consists of blocks of this many bytes, and the oldest block is overwritten
+// when it is full.
+#define BDBP_TRACE_BLOCK_SIZE (64)
+
+// The maximum number of blocks in a single BDBP_CMD_TRACE response.
+#define BDBP_TRACE_READ_BLOCKS ((BDBP_MAX_DATA_LENGTH - BDBP_TRACE_HEADER_LENGTH) / BDBP_TRACE_BLOCK_SIZE)
+
+// Entries of a trace block. Most fetches are a few bytes from the previous one, and take a
+// single byte. The first address in a block is always absolute, so that each block can be
+// decoded on its own. Multi-byte entries are stored with the most significant byte first.
+// - 0b0xxxxxxx: the address changed by a 7-bit signed delta.
+// - 0b10xxxxxx xxxxxxxx: the address changed by a 14-bit signed delta.
+// - 0b110000xx xxxxxxxx xxxxxxxx: an absolute address.
+// - BDBP_TRACE_INTERRUPT: the Z80 acknowledged an interrupt.
+// - BDBP_TRACE_GAP: fetches were not traced here, and the next address is absolute.
+// - BDBP_TRACE_END: the rest of the block is unused.
+#define BDBP_TRACE_DELTA (0x00)
+#define BDBP_TRACE_DELTA_MASK (0x80)
+#define BDBP_TRACE_DELTA14 (0x80)
+#define BDBP_TRACE_DELTA14_MASK (0xC0)
+#define BDBP_TRACE_ABSOLUTE (0xC0)
+#define BDBP_TRACE_ABSOLUTE_MASK (0xFC)
+#define BDBP_TRACE_INTERRUPT (0xFD)
+#define BDBP_TRACE_GAP (0xFE)
+#define BDBP_TRACE_END (0xFF)
+
+// Operations of BDBP_CMD_BREAK.
+enum bdbp_break_op {
+    BDBP_BREAK_OP_STATUS = 0x00,
+    BDBP_BREAK_OP_SET = 0x01,
+    BDBP_BREAK_OP_CONTINUE = 0x02,
+    BDBP_BREAK_OP_HALT = 0x03,
+};
+
+// States of the Z80 in a BDBP_CMD_BREAK response.
+enum bdbp_break_state {
+    BDBP_BREAK_STATE_RUNNING = 0x00,
+    // Stopped at a breakpoint or by OP_HALT, until OP_CONTINUE.
+    BDBP_BREAK_STATE_STOPPED = 0x01,
+};
+
+// The maximum number of breakpoints of BDBP_CMD_BREAK.
+#define BDBP_BREAK_MAX_COUNT (8)
+
+// The index of a BDBP_CMD_BREAK response when the Z80 is not stopped at a breakpoint.
+#define BDBP_BREAK_NO_INDEX (0xFF)
+
+// The length of the data field of a successful BDBP_CMD_BREAK response.
+#define BDBP_BREAK_DATA_LENGTH (6)
+
+// The length of the data field of a successful BDBP_CMD_BUS response.
+#define BDBP_BUS_DATA_LENGTH (14)
+
+// Operations of BDBP_CMD_MAILBOX.
+enum bdbp_mailbox_op {
+    BDBP_MAILBOX_OP_STATUS = 0x00,
+    BDBP_MAILBOX_OP_OPEN = 0x01,
+    BDBP_MAILBOX_OP_CLOSE = 0x02,
+    BDBP_MAILBOX_OP_SEND = 0x03,
+};
+
+// The length of the data field of a successful BDBP_CMD_MAILBOX response.
+#define BDBP_MAILBOX_DATA_LENGTH (5)
+
+// Operations of BDBP_CMD_ANALYZER.
+enum bdbp_analyzer_op {
+    BDBP_ANALYZER_OP_STATUS = 0x00,
+    BDBP_ANALYZER_OP_ARM = 0x01,
+    BDBP_ANALYZER_OP_STOP = 0x02,
+    BDBP_ANALYZER_OP_READ = 0x03,
+};
+
+// Triggers of BDBP_CMD_ANALYZER. The coprocessor checks for the trigger in a loop, so an
+// address or data value that is on the bus for less than a few of its cycles may be missed.
+enum bdbp_analyzer_trigger {
+    // Capture right away.
+    BDBP_ANALYZER_TRIGGER_NONE = 0x00,
+    // Capture once the address bus carries VALUE.
+    BDBP_ANALYZER_TRIGGER_ADDRESS = 0x01,
+    // Capture once the data bus carries the lowest byte of VALUE.
+    BDBP_ANALYZER_TRIGGER_DATA = 0x02,
+    // Capture once IOREQ is asserted after it was released.
+    BDBP_ANALYZER_TRIGGER_IOREQ = 0x03,
+};
+
+// States of BDBP_CMD_ANALYZER.
+enum bdbp_analyzer_state {
+    BDBP_ANALYZER_STATE_IDLE = 0x00,
+    BDBP_ANALYZER_STATE_ARMED = 0x01,
+    // The buffer is full and can be read.
+    BDBP_ANALYZER_STATE_DONE = 0x02,
+};
+
+// The length of the fixed part of a successful BDBP_CMD_ANALYZER response.
+#define BDBP_ANALYZER_HEADER_LENGTH (9)
+
+// A sample of BDBP_CMD_ANALYZER is the 18-bit address, with the state of the M1 and IOREQ
+// lines in the upper bits of its third byte, followed by the data bus. The lines are active
+// low on the bus, and their bits are set while they are asserted.
+// | ADDR LOW | ADDR MID | FLAGS + ADDR HIGH | DATA |
+#define BDBP_ANALYZER_SAMPLE_SIZE (4)
+#define BDBP_ANALYZER_SAMPLE_ADDR_HIGH_MASK (0x03)
+#define BDBP_ANALYZER_SAMPLE_M1 (0x40)
+#define BDBP_ANALYZER_SAMPLE_IOREQ (0x80)
+
+// The maximum number of samples in a single BDBP_CMD_ANALYZER response.
+#define BDBP_ANALYZER_READ_SAMPLES ((BDBP_MAX_DATA_LENGTH - BDBP_ANALYZER_HEADER_LENGTH) / BDBP_ANALYZER_SAMPLE_SIZE)
+
+// Events that the device reports with BDBP_STATUS_EVENT packets. The first byte of the data
+// field is the event, followed by data that depends on it.
+enum bdbp_event {
+    // The Z80 stopped at a breakpoint of BDBP_CMD_BREAK.
+    // | 0x06 | 0x05 | 0x01 | INDEX (1 byte) | ADDR (3 bytes) |
+    BDBP_EVENT_BREAKPOINT = 0x01,
+
+    // Bytes that the Z80 wrote to the mailbox of BDBP_CMD_MAILBOX, at most
+    // GLYCON_MAILBOX_RING_SIZE at once.
+    // | 0x06 | 1 + N | 0x02 | DATA ... |
+    BDBP_EVENT_MAILBOX = 0x02,
+
+    // The capture of BDBP_CMD_ANALYZER is done.
+    // | 0x06 | 0x01 | 0x03 |
+    BDBP_EVENT_ANALYZER = 0x03,
+};
+
+// Add a byte to a BDBP_CMD_DIGEST digest. This is the reflected CRC-16/CCITT (polynomial 0x8408),
+// in the formulation of avr-libc's `_crc_ccitt_update`, which needs no table.
+static inline uint16_t bdbp_crc16_update(uint16_t crc, uint8_t data) {
+    data ^= crc & 0xFF;
+    data ^= data << 4;
+    return (((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3);
+}
+
 enum bdbp_status {
     // Request was carried out successfully.
     // Response data depends on request.
@@ -67,6 +460,15 @@ enum bdbp_status {
 
     // The bus ack pin was somehow already low.
     BDBP_STATUS_BUS_ALREADY_ACQUIRED = 0x04,
+
+    // Not a response: sent unsolicited by the device once after it has booted, to signal that
+    // it is ready to receive requests.
+    // Data is empty.
+    BDBP_STATUS_READY = 0x05,
+
+    // Not a response: sent unsolicited by the device to report an event, see `enum bdbp_event`.
+    // It is only ever sent between responses, but may arrive while the host waits for one.
+    BDBP_STATUS_EVENT = 0x06,
 };
 
 // Definitions for offsets of packet fields.
@@ -29,6 +29,37 @@ static inline bool glycon_is_flash_addr(gly_addr_t address) {
     return (address & GLYCON_RAM_MASK) == 0;
 }
 
-#define GLYCON_FLASH_SECTOR_SIZE (0x4000)
+// Sectors of the SST39SF010A flash chip are 4 KiB.
+#define GLYCON_FLASH_SECTOR_SIZE (0x1000)
+
+// The clock frequency of the Z80.
+#define GLYCON_Z80_CLOCK_HZ (6144000)
+
+// The I/O port that Z80 code reads from to emit a benchmark marker, see BDBP_CMD_MARKERS. The
+// marker's ID is the upper byte of the port address, so `ld a, ID` followed by
+// `in a, (GLYCON_MARKER_PORT)` emits marker ID in 18 cycles, clobbering A.
+// I/O devices are selected by A2 and A3 only, so every port reaches one of them. This one is
+// a mirror of CTC channel 3, reading which has no side effects, and it is distinct from the
+// port 0x07 that code uses to access that channel. Writes would reprogram the channel.
+#define GLYCON_MARKER_PORT (0xF7)
+
+// A mailbox in RAM through which Z80 code exchanges bytes with the host, see BDBP_CMD_MAILBOX.
+// It consists of two rings of GLYCON_MAILBOX_RING_SIZE bytes, one for each direction, followed
+// by their head and tail indices. Each index is only written by one side: the writer of a ring
+// stores a byte at its head and then advances the head, and the reader takes the byte at the
+// tail and then advances the tail. A ring is empty when head and tail are equal, and full when
+// the head is one behind the tail. The Z80 clears all indices before the mailbox is used.
+// The mailbox must start at a multiple of 256, so that Z80 code can index the rings with a
+// single register, and it must not cross a 16 KiB page. Offsets from the start:
+#define GLYCON_MAILBOX_TX_RING (0x000) // Bytes from the Z80 to the host.
+#define GLYCON_MAILBOX_RX_RING (0x080) // Bytes from the host to the Z80.
+#define GLYCON_MAILBOX_TX_HEAD (0x100) // Written by the Z80.
+#define GLYCON_MAILBOX_TX_TAIL (0x101) // Written by the coprocessor.
+#define GLYCON_MAILBOX_RX_HEAD (0x102) // Written by the coprocessor.
+#define GLYCON_MAILBOX_RX_TAIL (0x103) // Written by the Z80.
+#define GLYCON_MAILBOX_SIZE (0x104)
+
+#define GLYCON_MAILBOX_RING_SIZE (0x80)
+#define GLYCON_MAILBOX_RING_MASK (GLYCON_MAILBOX_RING_SIZE - 1)
 
 #endif
@@ -16,6 +16,8 @@
         ninja
         avrdude
         pkg-config
+        simavr
+        libelf
         editline.dev
         knightos-scas
         pkgsCross.avr.buildPackages.gcc
@@ -0,0 +1,674 @@
+#include "hal.h"
+#include "marker.h"
+#include "profile.h"
+#include "trace.h"
+#include "breakpoint.h"
+#include "mailbox.h"
+#include "analyzer.h"
+#include "clock.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+// Microbenchmarks of the firmware's command handlers, run natively against the host simulation.
+// For each command, this reports the simulated time it takes on the coprocessor including the
+// serial transfer, the resulting throughput, and how long the Z80 was held off the bus. Results
+// are checked against the simulated memory, so that an optimization can't silently break a
+// command.
+
+// The number of times each command is run.
+#define BENCH_ITERATIONS (64)
+
+// The largest payload that fits in a write request, after the address.
+#define BENCH_WRITE_SIZE (BDBP_MAX_DATA_LENGTH - BDBP_ADDR_SIZE)
+
+// The largest amount of data that can be read with a single request.
+#define BENCH_READ_SIZE (BDBP_MAX_DATA_LENGTH)
+
+// Shape of the digest requests, which cover a little more memory than a read.
+#define BENCH_DIGEST_BLOCK_SIZE (32)
+#define BENCH_DIGEST_BLOCKS (8)
+
+struct bench {
+    const char* name;
+    // The number of payload bytes transferred by a single command.
+    size_t payload;
+    // Build the request for iteration `i`, preparing memory as needed.
+    void (*prepare)(uint8_t* req, size_t i);
+    // Check the response and memory after iteration `i`.
+    bool (*check)(const uint8_t* resp, size_t i);
+};
+
+static uint32_t rng_state = 0x12345678;
+
+static uint8_t bench_random_u8(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint64_t bench_wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void pkt_init(uint8_t* pkt, enum bdbp_cmd cmd) {
+    pkt[BDBP_FIELD_HDR] = cmd;
+    pkt[BDBP_FIELD_DATA_LEN] = 0;
+}
+
+static void pkt_append_u8(uint8_t* pkt, uint8_t value) {
+    pkt[BDBP_FIELD_DATA + pkt[BDBP_FIELD_DATA_LEN]++] = value;
+}
+
+static void pkt_append_addr(uint8_t* pkt, gly_addr_t addr) {
+    pkt_append_u8(pkt, addr & 0xFF);
+    pkt_append_u8(pkt, (addr >> 8) & 0xFF);
+    pkt_append_u8(pkt, (addr >> 16) & 0xFF);
+}
+
+static bool status_ok(const uint8_t* resp) {
+    return resp[BDBP_FIELD_HDR] == BDBP_STATUS_SUCCESS;
+}
+
+// Requests and memory contents of the current iteration, to check the results against.
+static uint8_t expected[BENCH_READ_SIZE];
+
+static gly_addr_t ram_addr(size_t i) {
+    return GLYCON_RAM_START + i * BENCH_READ_SIZE;
+}
+
+static gly_addr_t flash_addr(size_t i) {
+    return GLYCON_FLASH_START + i * BENCH_WRITE_SIZE;
+}
+
+// Sectors of the SST39SF010A are 4 KiB.
+static gly_addr_t sector_addr(size_t i) {
+    return GLYCON_FLASH_START + (i % (GLYCON_FLASH_SIZE / 0x1000)) * 0x1000;
+}
+
+static void prepare_ping(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_PING);
+}
+
+static bool check_empty(const uint8_t* resp, size_t i) {
+    return status_ok(resp) && resp[BDBP_FIELD_DATA_LEN] == 0;
+}
+
+static void prepare_info(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_INFO);
+}
+
+static bool check_info(const uint8_t* resp, size_t i) {
+    return status_ok(resp) && resp[BDBP_FIELD_DATA_LEN] == BDBP_INFO_DATA_LENGTH;
+}
+
+static void prepare_read(uint8_t* req, size_t i) {
+    uint8_t* memory = host_memory();
+    for (size_t j = 0; j < BENCH_READ_SIZE; ++j) {
+        expected[j] = memory[ram_addr(i) + j] = bench_random_u8();
+    }
+
+    pkt_init(req, BDBP_CMD_READ);
+    pkt_append_addr(req, ram_addr(i));
+    pkt_append_u8(req, BENCH_READ_SIZE);
+}
+
+static bool check_read(const uint8_t* resp, size_t i) {
+    return status_ok(resp)
+        && resp[BDBP_FIELD_DATA_LEN] == BENCH_READ_SIZE
+        && memcmp(&resp[BDBP_FIELD_DATA], expected, BENCH_READ_SIZE) == 0;
+}
+
+// Expected digests of the current iteration.
+static uint16_t expected_digests[BENCH_DIGEST_BLOCKS];
+
+static void prepare_digest(uint8_t* req, size_t i) {
+    uint8_t* memory = host_memory();
+    for (size_t b = 0; b < BENCH_DIGEST_BLOCKS; ++b) {
+        uint16_t crc = 0xFFFF;
+        for (size_t j = 0; j < BENCH_DIGEST_BLOCK_SIZE; ++j) {
+            uint8_t value = memory[ram_addr(i) + b * BENCH_DIGEST_BLOCK_SIZE + j] = bench_random_u8();
+            crc = bdbp_crc16_update(crc, value);
+        }
+        expected_digests[b] = crc;
+    }
+
+    pkt_init(req, BDBP_CMD_DIGEST);
+    pkt_append_addr(req, ram_addr(i));
+    pkt_append_u8(req, BENCH_DIGEST_BLOCK_SIZE);
+    pkt_append_u8(req, BENCH_DIGEST_BLOCKS);
+}
+
+static bool check_digest(const uint8_t* resp, size_t i) {
+    if (!status_ok(resp) || resp[BDBP_FIELD_DATA_LEN] != 2 * BENCH_DIGEST_BLOCKS)
+        return false;
+
+    for (size_t b = 0; b < BENCH_DIGEST_BLOCKS; ++b) {
+        const uint8_t* digest = &resp[BDBP_FIELD_DATA + 2 * b];
+        if ((digest[0] | digest[1] << 8) != expected_digests[b])
+            return false;
+    }
+    return true;
+}
+
+static void prepare_write(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_WRITE);
+    pkt_append_addr(req, ram_addr(i));
+    for (size_t j = 0; j < BENCH_WRITE_SIZE; ++j) {
+        expected[j] = bench_random_u8();
+        pkt_append_u8(req, expected[j]);
+    }
+}
+
+static bool check_write(const uint8_t* resp, size_t i) {
+    return check_empty(resp, i) && memcmp(&host_memory()[ram_addr(i)], expected, BENCH_WRITE_SIZE) == 0;
+}
+
+// The budget of the write_budget benchmark, which splits each write into several bursts.
+#define BENCH_BURST (64)
+#define BENCH_GAP_US (100)
+
+// The number of times the bus was acquired before the request of the current iteration.
+static uint64_t bench_acquires;
+
+static void prepare_write_budget(uint8_t* req, size_t i) {
+    uint8_t resp[BDBP_MAX_MSG_LENGTH];
+    pkt_init(req, BDBP_CMD_BUS);
+    pkt_append_u8(req, BENCH_BURST);
+    pkt_append_u8(req, BENCH_GAP_US & 0xFF);
+    pkt_append_u8(req, BENCH_GAP_US >> 8);
+    host_transact(req, resp);
+
+    prepare_write(req, i);
+    bench_acquires = host_stats.bus_acquires;
+}
+
+static bool check_write_budget(const uint8_t* resp, size_t i) {
+    size_t bursts = (BENCH_WRITE_SIZE + BENCH_BURST - 1) / BENCH_BURST;
+    return check_write(resp, i) && host_stats.bus_acquires - bench_acquires == bursts;
+}
+
+static void prepare_write_flash(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_WRITE_FLASH);
+    pkt_append_addr(req, flash_addr(i));
+    for (size_t j = 0; j < BENCH_WRITE_SIZE; ++j) {
+        expected[j] = bench_random_u8();
+        pkt_append_u8(req, expected[j]);
+    }
+}
+
+static bool check_write_flash(const uint8_t* resp, size_t i) {
+    return check_empty(resp, i) && memcmp(&host_memory()[flash_addr(i)], expected, BENCH_WRITE_SIZE) == 0;
+}
+
+static void prepare_flash_id(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_FLASH_ID);
+}
+
+static bool check_flash_id(const uint8_t* resp, size_t i) {
+    return status_ok(resp)
+        && resp[BDBP_FIELD_DATA_LEN] == 2
+        && resp[BDBP_FIELD_DATA + 0] == 0xBF
+        && resp[BDBP_FIELD_DATA + 1] == 0xB5;
+}
+
+static void prepare_erase_sector(uint8_t* req, size_t i) {
+    memset(&host_memory()[sector_addr(i)], 0, BENCH_WRITE_SIZE);
+    pkt_init(req, BDBP_CMD_ERASE_SECTOR);
+    pkt_append_addr(req, sector_addr(i));
+}
+
+static bool check_erased(gly_addr_t addr) {
+    const uint8_t* memory = host_memory();
+    for (size_t j = 0; j < BENCH_WRITE_SIZE; ++j) {
+        if (memory[addr + j] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+static bool check_erase_sector(const uint8_t* resp, size_t i) {
+    return check_empty(resp, i) && check_erased(sector_addr(i));
+}
+
+static void prepare_erase_chip(uint8_t* req, size_t i) {
+    memset(&host_memory()[flash_addr(i)], 0, BENCH_WRITE_SIZE);
+    pkt_init(req, BDBP_CMD_ERASE_CHIP);
+}
+
+static bool check_erase_chip(const uint8_t* resp, size_t i) {
+    return check_empty(resp, i) && check_erased(flash_addr(i));
+}
+
+static void prepare_stats(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_STATS);
+    pkt_append_u8(req, BDBP_STATS_FLAG_RESET);
+}
+
+// After a reset, only the previous stats request has been counted.
+static bool check_stats(const uint8_t* resp, size_t i) {
+    if (!status_ok(resp) || resp[BDBP_FIELD_DATA_LEN] != BDBP_STATS_DATA_LENGTH)
+        return false;
+
+    const uint8_t* cmds = &resp[BDBP_FIELD_DATA + BDBP_STATS_DATA_LENGTH - BDBP_STATS_CMDS * BDBP_STATS_DURATION_LENGTH];
+    const uint8_t* count = &cmds[BDBP_CMD_STATS * BDBP_STATS_DURATION_LENGTH];
+    return (count[0] | count[1] << 8 | count[2] << 16 | (uint32_t) count[3] << 24) == (i > 0 ? 1 : 0);
+}
+
+// The number of markers that the Z80 emits between two requests of the markers benchmark.
+#define BENCH_MARKERS (8)
+
+static void prepare_markers(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_MARKERS);
+    if (i == 0) {
+        pkt_append_u8(req, BDBP_MARKERS_FLAG_START);
+        return;
+    }
+
+    pkt_append_u8(req, 0);
+    for (size_t j = 0; j < BENCH_MARKERS; ++j) {
+        marker_record(j, i * 1000 + j);
+    }
+}
+
+static bool check_markers(const uint8_t* resp, size_t i) {
+    size_t count = i > 0 ? BENCH_MARKERS : 0;
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    if (!status_ok(resp)
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_MARKERS_HEADER_LENGTH + count * BDBP_MARKERS_ENTRY_LENGTH
+        || data[0] != BDBP_MARKERS_STATE_RECORDING
+        || data[5] != count)
+        return false;
+
+    for (size_t j = 0; j < count; ++j) {
+        const uint8_t* entry = &data[BDBP_MARKERS_HEADER_LENGTH + j * BDBP_MARKERS_ENTRY_LENGTH];
+        uint32_t cycles = entry[1] | entry[2] << 8 | entry[3] << 16 | (uint32_t) entry[4] << 24;
+        if (entry[0] != j || cycles != i * 1000 + j)
+            return false;
+    }
+    return true;
+}
+
+// The number of samples that are taken between two requests of the profile benchmark.
+#define BENCH_SAMPLES (BDBP_PROFILE_MAX_COUNT)
+
+static gly_addr_t bench_sample_addr(size_t i, size_t j) {
+    return (i * BENCH_SAMPLES + j) * 37 % GLYCON_ADDRSPACE_SIZE;
+}
+
+static void prepare_profile(uint8_t* req, size_t i) {
+    pkt_init(req, BDBP_CMD_PROFILE);
+    if (i == 0) {
+        pkt_append_u8(req, BDBP_PROFILE_FLAG_START);
+        pkt_append_u8(req, 1000 & 0xFF);
+        pkt_append_u8(req, 1000 >> 8);
+        return;
+    }
+
+    pkt_append_u8(req, 0);
+    for (size_t j = 0; j < BENCH_SAMPLES; ++j) {
+        profile_record(bench_sample_addr(i, j));
+    }
+}
+
+static bool check_profile(const uint8_t* resp, size_t i) {
+    size_t count = i > 0 ? BENCH_SAMPLES : 0;
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    if (!status_ok(resp)
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_PROFILE_HEADER_LENGTH + count * BDBP_ADDR_SIZE
+        || data[0] != BDBP_PROFILE_STATE_RUNNING
+        || data[5] != count)
+        return false;
+
+    for (size_t j = 0; j < count; ++j) {
+        const uint8_t* sample = &data[BDBP_PROFILE_HEADER_LENGTH + j * BDBP_ADDR_SIZE];
+        if ((sample[0] | sample[1] << 8 | (gly_addr_t) sample[2] << 16) != bench_sample_addr(i, j))
+            return false;
+    }
+    return true;
+}
+
+// The number of fetches that are traced before each request of the trace benchmark. At a byte
+// or more each, they take more blocks than fit in a single response.
+#define BENCH_FETCHES (200)
+
+// The traced fetches of the current iteration. Interrupt acknowledges are stored as UINT32_MAX.
+static gly_addr_t bench_fetches[BENCH_FETCHES];
+
+static void prepare_trace(uint8_t* req, size_t i) {
+    trace_start(0, 0, 0);
+    gly_addr_t address = i * 0x1000 % GLYCON_ADDRSPACE_SIZE;
+    for (size_t j = 0; j < BENCH_FETCHES; ++j) {
+        // Mostly straight-line code, with some jumps and calls, and an occasional interrupt.
+        uint8_t r = bench_random_u8();
+        if (r < 4) {
+            bench_fetches[j] = UINT32_MAX;
+            trace_record(0, true);
+            continue;
+        } else if (r < 16) {
+            address = (address + r * 0x1234) % GLYCON_ADDRSPACE_SIZE;
+        } else if (r < 48) {
+            address = (address + r * 16 - 500) % GLYCON_ADDRSPACE_SIZE;
+        } else {
+            address = (address + r % 4) % GLYCON_ADDRSPACE_SIZE;
+        }
+        bench_fetches[j] = address;
+        trace_record(address, false);
+    }
+
+    pkt_init(req, BDBP_CMD_TRACE);
+    pkt_append_u8(req, BDBP_TRACE_OP_READ);
+    pkt_append_u8(req, 0);
+}
+
+static bool check_trace(const uint8_t* resp, size_t i) {
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    if (!status_ok(resp)
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_TRACE_HEADER_LENGTH + BDBP_TRACE_READ_BLOCKS * BDBP_TRACE_BLOCK_SIZE
+        || data[0] != BDBP_TRACE_STATE_TRACING
+        || data[1] <= BDBP_TRACE_READ_BLOCKS)
+        return false;
+
+    // Decode the blocks, and compare them with the start of the fetches.
+    size_t n = 0;
+    gly_addr_t address = 0;
+    for (size_t k = 0; k < BDBP_TRACE_READ_BLOCKS; ++k) {
+        const uint8_t* block = &data[BDBP_TRACE_HEADER_LENGTH + k * BDBP_TRACE_BLOCK_SIZE];
+        size_t pos = 0;
+        while (pos < BDBP_TRACE_BLOCK_SIZE && block[pos] != BDBP_TRACE_END) {
+            uint8_t b = block[pos];
+            gly_addr_t fetch;
+            if ((b & BDBP_TRACE_DELTA_MASK) == BDBP_TRACE_DELTA) {
+                fetch = address = (address + (int8_t) (b << 1) / 2) % GLYCON_ADDRSPACE_SIZE;
+                pos += 1;
+            } else if ((b & BDBP_TRACE_DELTA14_MASK) == BDBP_TRACE_DELTA14) {
+                int16_t delta = (int16_t) ((b << 8 | block[pos + 1]) << 2) / 4;
+                fetch = address = (address + delta) % GLYCON_ADDRSPACE_SIZE;
+                pos += 2;
+            } else if ((b & BDBP_TRACE_ABSOLUTE_MASK) == BDBP_TRACE_ABSOLUTE) {
+                fetch = address = (gly_addr_t) (b & 0x03) << 16 | block[pos + 1] << 8 | block[pos + 2];
+                pos += 3;
+            } else if (b == BDBP_TRACE_INTERRUPT) {
+                fetch = UINT32_MAX;
+                pos += 1;
+            } else {
+                return false;
+            }
+
+            if (n == BENCH_FETCHES || bench_fetches[n++] != fetch)
+                return false;
+        }
+    }
+    return n > 0;
+}
+
+// The breakpoint that is hit in iteration `i` of the breakpoint benchmark.
+static gly_addr_t bench_break_addr(size_t i, size_t j) {
+    return (i * 0x2345 + j * 0x111) % GLYCON_ADDRSPACE_SIZE;
+}
+
+// The event that the firmware reported for the hit, and its expected length.
+#define BENCH_EVENT_LENGTH (2 + 2 + BDBP_ADDR_SIZE)
+static uint8_t bench_event[BENCH_EVENT_LENGTH + 1];
+static size_t bench_event_len;
+
+static void prepare_break(uint8_t* req, size_t i) {
+    breakpoint_continue();
+    breakpoint_clear();
+    for (size_t j = 0; j < BDBP_BREAK_MAX_COUNT; ++j)
+        breakpoint_add(bench_break_addr(i, j));
+
+    // Miss all but the breakpoint of this iteration, which stops the Z80 until the request.
+    breakpoint_check(bench_break_addr(i, 0) + 1);
+    breakpoint_check(bench_break_addr(i, i % BDBP_BREAK_MAX_COUNT));
+    bench_event_len = host_serial_take(sizeof bench_event, bench_event);
+
+    // Every other request asks where the Z80 stopped, the others let it continue.
+    pkt_init(req, BDBP_CMD_BREAK);
+    pkt_append_u8(req, i % 2 == 0 ? BDBP_BREAK_OP_STATUS : BDBP_BREAK_OP_CONTINUE);
+}
+
+static bool check_break(const uint8_t* resp, size_t i) {
+    uint8_t index = i % BDBP_BREAK_MAX_COUNT;
+    gly_addr_t address = bench_break_addr(i, index);
+    if (bench_event_len != BENCH_EVENT_LENGTH
+        || bench_event[BDBP_FIELD_HDR] != BDBP_STATUS_EVENT
+        || bench_event[BDBP_FIELD_DATA_LEN] != BENCH_EVENT_LENGTH - 2
+        || bench_event[BDBP_FIELD_DATA] != BDBP_EVENT_BREAKPOINT
+        || bench_event[BDBP_FIELD_DATA + 1] != index
+        || (bench_event[4] | bench_event[5] << 8 | (gly_addr_t) bench_event[6] << 16) != address)
+        return false;
+
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    bool stopped = i % 2 == 0;
+    if (!status_ok(resp)
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_BREAK_DATA_LENGTH
+        || data[0] != (stopped ? BDBP_BREAK_STATE_STOPPED : BDBP_BREAK_STATE_RUNNING)
+        || data[1] != BDBP_BREAK_MAX_COUNT
+        || data[2] != (stopped ? index : BDBP_BREAK_NO_INDEX))
+        return false;
+    return !stopped || (data[3] | data[4] << 8 | (gly_addr_t) data[5] << 16) == address;
+}
+
+// Where the mailbox benchmark puts the mailbox.
+#define BENCH_MAILBOX_ADDR (GLYCON_RAM_START + 0x4100)
+
+// The most bytes that a ring of the mailbox holds.
+#define BENCH_MAILBOX_BYTES (GLYCON_MAILBOX_RING_SIZE - 1)
+
+// The bytes that the Z80 wrote in the current iteration of the mailbox benchmark, and the
+// event that the firmware forwarded them with.
+static uint8_t bench_mailbox_tx[BENCH_MAILBOX_BYTES];
+static uint8_t bench_mailbox_event[3 + BENCH_MAILBOX_BYTES + 1];
+static size_t bench_mailbox_event_len;
+
+static void prepare_mailbox(uint8_t* req, size_t i) {
+    uint8_t* mailbox = &host_memory()[BENCH_MAILBOX_ADDR];
+    mailbox_open(BENCH_MAILBOX_ADDR);
+
+    // Act as the Z80: fill the ring to the host, starting wherever the last iteration left off,
+    // and take everything that was sent to it.
+    uint8_t head = mailbox[GLYCON_MAILBOX_TX_HEAD];
+    for (size_t j = 0; j < BENCH_MAILBOX_BYTES; ++j) {
+        bench_mailbox_tx[j] = bench_random_u8();
+        mailbox[GLYCON_MAILBOX_TX_RING + head] = bench_mailbox_tx[j];
+        head = (head + 1) & GLYCON_MAILBOX_RING_MASK;
+    }
+    mailbox[GLYCON_MAILBOX_TX_HEAD] = head;
+    mailbox[GLYCON_MAILBOX_RX_TAIL] = mailbox[GLYCON_MAILBOX_RX_HEAD];
+
+    mailbox_forward();
+    bench_mailbox_event_len = host_serial_take(sizeof bench_mailbox_event, bench_mailbox_event);
+
+    pkt_init(req, BDBP_CMD_MAILBOX);
+    pkt_append_u8(req, BDBP_MAILBOX_OP_SEND);
+    for (size_t j = 0; j < BENCH_MAILBOX_BYTES; ++j) {
+        expected[j] = bench_random_u8();
+        pkt_append_u8(req, expected[j]);
+    }
+}
+
+static bool check_mailbox(const uint8_t* resp, size_t i) {
+    const uint8_t* mailbox = &host_memory()[BENCH_MAILBOX_ADDR];
+    if (bench_mailbox_event_len != 3 + BENCH_MAILBOX_BYTES
+        || bench_mailbox_event[BDBP_FIELD_HDR] != BDBP_STATUS_EVENT
+        || bench_mailbox_event[BDBP_FIELD_DATA_LEN] != 1 + BENCH_MAILBOX_BYTES
+        || bench_mailbox_event[BDBP_FIELD_DATA] != BDBP_EVENT_MAILBOX
+        || memcmp(&bench_mailbox_event[BDBP_FIELD_DATA + 1], bench_mailbox_tx, BENCH_MAILBOX_BYTES) != 0
+        || mailbox[GLYCON_MAILBOX_TX_TAIL] != mailbox[GLYCON_MAILBOX_TX_HEAD])
+        return false;
+
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    if (!status_ok(resp)
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_MAILBOX_DATA_LENGTH
+        || data[0] != 1
+        || data[1] != BENCH_MAILBOX_BYTES
+        || (data[2] | data[3] << 8 | (gly_addr_t) data[4] << 16) != BENCH_MAILBOX_ADDR)
+        return false;
+
+    uint8_t tail = mailbox[GLYCON_MAILBOX_RX_TAIL];
+    for (size_t j = 0; j < BENCH_MAILBOX_BYTES; ++j) {
+        if (mailbox[GLYCON_MAILBOX_RX_RING + ((tail + j) & GLYCON_MAILBOX_RING_MASK)] != expected[j])
+            return false;
+    }
+    return mailbox[GLYCON_MAILBOX_RX_HEAD] == ((tail + BENCH_MAILBOX_BYTES) & GLYCON_MAILBOX_RING_MASK);
+}
+
+// The bus in sample `j` after the trigger of iteration `i` of the analyzer benchmark.
+static gly_addr_t bench_analyzer_addr(size_t i, size_t j) {
+    return (i * 0x1357 + j * 3) % GLYCON_ADDRSPACE_SIZE;
+}
+
+static uint8_t bench_analyzer_flags(size_t j) {
+    return j % 7 == 0 ? BDBP_ANALYZER_SAMPLE_IOREQ : j % 5 == 0 ? BDBP_ANALYZER_SAMPLE_M1 : 0;
+}
+
+// The first sample that iteration `i` of the analyzer benchmark reads.
+static uint16_t bench_analyzer_first(size_t i) {
+    return i * BDBP_ANALYZER_READ_SAMPLES % 1024;
+}
+
+static uint8_t bench_analyzer_event[4];
+static size_t bench_analyzer_event_len;
+
+static void prepare_analyzer(uint8_t* req, size_t i) {
+    // Go through all triggers, with a few states of the bus that must not fire them.
+    uint8_t trigger = i % 4;
+    analyzer_arm(trigger, trigger == BDBP_ANALYZER_TRIGGER_DATA ? 0 : bench_analyzer_addr(i, 0));
+    if (trigger != BDBP_ANALYZER_TRIGGER_NONE) {
+        analyzer_record(bench_analyzer_addr(i, 0) + 1, 0x55, BDBP_ANALYZER_SAMPLE_IOREQ);
+        analyzer_record(bench_analyzer_addr(i, 0) + 2, 0xAA, 0);
+    }
+
+    // Act as the bus until the buffer is full, with a cycle of the Z80 every 16 samples.
+    for (size_t j = 0; analyzer_armed(); ++j) {
+        if (j % 16 == 0)
+            host_delay_us(3);
+        analyzer_record(bench_analyzer_addr(i, j), j & 0xFF, bench_analyzer_flags(j));
+    }
+    bench_analyzer_event_len = host_serial_take(sizeof bench_analyzer_event, bench_analyzer_event);
+
+    pkt_init(req, BDBP_CMD_ANALYZER);
+    pkt_append_u8(req, BDBP_ANALYZER_OP_READ);
+    pkt_append_u8(req, bench_analyzer_first(i) & 0xFF);
+    pkt_append_u8(req, bench_analyzer_first(i) >> 8);
+}
+
+static bool check_analyzer(const uint8_t* resp, size_t i) {
+    if (bench_analyzer_event_len != 3
+        || bench_analyzer_event[BDBP_FIELD_HDR] != BDBP_STATUS_EVENT
+        || bench_analyzer_event[BDBP_FIELD_DATA] != BDBP_EVENT_ANALYZER)
+        return false;
+
+    const uint8_t* data = &resp[BDBP_FIELD_DATA];
+    uint16_t samples = data[1] | data[2] << 8;
+    uint32_t cycles = data[5] | data[6] << 8 | (uint32_t) data[7] << 16 | (uint32_t) data[8] << 24;
+    uint16_t first = bench_analyzer_first(i);
+    size_t count = samples - first < BDBP_ANALYZER_READ_SAMPLES ? samples - first : BDBP_ANALYZER_READ_SAMPLES;
+    if (!status_ok(resp)
+        || data[0] != BDBP_ANALYZER_STATE_DONE
+        || samples != 1024
+        || (data[3] | data[4] << 8) != F_CPU / 1000
+        || cycles == 0
+        || resp[BDBP_FIELD_DATA_LEN] != BDBP_ANALYZER_HEADER_LENGTH + count * BDBP_ANALYZER_SAMPLE_SIZE)
+        return false;
+
+    for (size_t j = 0; j < count; ++j) {
+        const uint8_t* sample = &data[BDBP_ANALYZER_HEADER_LENGTH + j * BDBP_ANALYZER_SAMPLE_SIZE];
+        gly_addr_t address = bench_analyzer_addr(i, first + j);
+        if (sample[0] != (address & 0xFF)
+            || sample[1] != ((address >> 8) & 0xFF)
+            || sample[2] != ((address >> 16) | bench_analyzer_flags(first + j))
+            || sample[3] != ((first + j) & 0xFF))
+            return false;
+    }
+    return true;
+}
+
+static const struct bench benches[] = {
+    {"ping", 0, prepare_ping, check_empty},
+    {"info", BDBP_INFO_DATA_LENGTH, prepare_info, check_info},
+    {"read", BENCH_READ_SIZE, prepare_read, check_read},
+    {"digest", BENCH_DIGEST_BLOCK_SIZE * BENCH_DIGEST_BLOCKS, prepare_digest, check_digest},
+    {"write", BENCH_WRITE_SIZE, prepare_write, check_write},
+    {"write_budget", BENCH_WRITE_SIZE, prepare_write_budget, check_write_budget},
+    {"write_flash", BENCH_WRITE_SIZE, prepare_write_flash, check_write_flash},
+    {"flash_id", 2, prepare_flash_id, check_flash_id},
+    {"erase_sector", 0, prepare_erase_sector, check_erase_sector},
+    {"erase_chip", 0, prepare_erase_chip, check_erase_chip},
+    {"stats", BDBP_STATS_DATA_LENGTH, prepare_stats, check_stats},
+    {"markers", BDBP_MARKERS_HEADER_LENGTH + BENCH_MARKERS * BDBP_MARKERS_ENTRY_LENGTH, prepare_markers, check_markers},
+    {"profile", BDBP_PROFILE_HEADER_LENGTH + BENCH_SAMPLES * BDBP_ADDR_SIZE, prepare_profile, check_profile},
+    {"trace", BDBP_TRACE_HEADER_LENGTH + BDBP_TRACE_READ_BLOCKS * BDBP_TRACE_BLOCK_SIZE, prepare_trace, check_trace},
+    {"break", BDBP_BREAK_DATA_LENGTH, prepare_break, check_break},
+    {"mailbox", BENCH_MAILBOX_BYTES, prepare_mailbox, check_mailbox},
+    {"analyzer", BDBP_ANALYZER_HEADER_LENGTH + BDBP_ANALYZER_READ_SAMPLES * BDBP_ANALYZER_SAMPLE_SIZE, prepare_analyzer, check_analyzer},
+};
+
+// Run a single benchmark and print its results. Returns `true` if a check failed.
+static bool bench_run(const struct bench* bench) {
+    host_reset();
+
+    uint64_t sim_ns = 0;
+    uint64_t hold_ns = 0;
+    uint64_t wall_ns = 0;
+    for (size_t i = 0; i < BENCH_ITERATIONS; ++i) {
+        uint8_t req[BDBP_MAX_MSG_LENGTH];
+        uint8_t resp[BDBP_MAX_MSG_LENGTH];
+        bench->prepare(req, i);
+
+        host_stats.bus_hold_ns = 0;
+        uint64_t start = bench_wall_ns();
+        sim_ns += host_transact(req, resp);
+        wall_ns += bench_wall_ns() - start;
+        hold_ns += host_stats.bus_hold_ns;
+
+        if (!bench->check(resp, i)) {
+            fprintf(stderr, "%s: check failed in iteration %zu\n", bench->name, i);
+            return true;
+        }
+    }
+
+    double sim_us = sim_ns / 1000.0 / BENCH_ITERATIONS;
+    double hold_us = hold_ns / 1000.0 / BENCH_ITERATIONS;
+    double kib_per_s = bench->payload / 1024.0 / (sim_us / 1e6);
+    printf(
+        "%-14s %8zu %12.1f %12.1f %12.1f %12.0f\n",
+        bench->name,
+        bench->payload,
+        sim_us,
+        hold_us,
+        kib_per_s,
+        (double) wall_ns / BENCH_ITERATIONS
+    );
+    return false;
+}
+
+int main(void) {
+    printf(
+        "%-14s %8s %12s %12s %12s %12s\n",
+        "command",
+        "payload",
+        "sim us/cmd",
+        "bus us/cmd",
+        "KiB/s",
+        "host ns/cmd"
+    );
+
+    bool failed = false;
+    for (size_t i = 0; i < sizeof benches / sizeof benches[0]; ++i) {
+        failed |= bench_run(&benches[i]);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
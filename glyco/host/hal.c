@@ -0,0 +1,390 @@
+#include "hal.h"
+
+#include "bus.h"
+#include "cmd.h"
+#include "serial.h"
+#include "clock.h"
+#include "perf.h"
+#include "marker.h"
+#include "profile.h"
+#include "trace.h"
+#include "breakpoint.h"
+#include "mailbox.h"
+#include "analyzer.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Time after which the simulated Z80 acknowledges a bus request. The real Z80 finishes its
+// current machine cycle first, which takes longer than the first check in `bus_acquire`, and
+// so the firmware always ends up waiting for one poll interval.
+#define HOST_BUSACK_DELAY_US (10)
+
+// Typical durations of flash operations of the SST39SF010A, during which Data# polling reports
+// that the chip is busy.
+#define HOST_FLASH_PROGRAM_US (14)
+#define HOST_FLASH_ERASE_SECTOR_US (18000)
+#define HOST_FLASH_ERASE_CHIP_US (70000)
+
+// Sectors of the SST39SF010A are 4 KiB.
+#define HOST_FLASH_SECTOR_SIZE (0x1000)
+
+// Capacity of the buffer that collects bytes written by the firmware.
+#define HOST_TX_BUFFER_SIZE (1024)
+
+// State of the flash chip's software command interface.
+enum host_flash_state {
+    HOST_FLASH_IDLE,
+    HOST_FLASH_UNLOCK1,
+    HOST_FLASH_UNLOCK2,
+    HOST_FLASH_PROGRAM,
+    HOST_FLASH_ERASE_SETUP,
+    HOST_FLASH_ERASE_UNLOCK1,
+    HOST_FLASH_ERASE_UNLOCK2,
+};
+
+struct host_stats host_stats;
+
+static uint8_t memory[GLYCON_ADDRSPACE_SIZE];
+
+static struct {
+    enum host_flash_state state;
+    bool software_id;
+    // Until when the current program or erase operation runs, and the value that DQ7 reads as
+    // in the meantime.
+    uint64_t busy_until_ns;
+    uint8_t busy_dq7;
+} flash;
+
+static struct {
+    bool acquired;
+    // Whether the Z80 is kept stopped between acquisitions, see `bus_hold`.
+    bool held;
+    bool mem_output;
+    enum bus_mode mode;
+    gly_addr_t addr;
+    uint8_t data;
+    uint64_t acquired_at;
+} bus;
+
+static struct {
+    uint8_t data[SERIAL_RX_BUFFER_SIZE];
+    size_t read;
+    size_t write;
+    uint16_t high_water;
+    uint32_t dropped;
+} rx;
+
+static struct {
+    uint8_t data[HOST_TX_BUFFER_SIZE];
+    size_t len;
+} tx;
+
+// Abort the simulation if the firmware violates a requirement of the hardware.
+static void host_require(bool condition, const char* what) {
+    if (!condition) {
+        fprintf(stderr, "glyco host: %s\n", what);
+        abort();
+    }
+}
+
+void host_reset(void) {
+    memset(memory, 0xFF, GLYCON_FLASH_SIZE);
+    memset(&memory[GLYCON_RAM_START], 0, GLYCON_RAM_SIZE);
+    memset(&flash, 0, sizeof flash);
+    memset(&bus, 0, sizeof bus);
+    memset(&host_stats, 0, sizeof host_stats);
+    rx.read = rx.write = 0;
+    rx.high_water = 0;
+    rx.dropped = 0;
+    tx.len = 0;
+    perf_reset();
+    cmd_reset();
+    marker_stop();
+    profile_stop();
+    trace_stop();
+    breakpoint_clear();
+    breakpoint_continue();
+    mailbox_close();
+    analyzer_discard();
+}
+
+uint8_t* host_memory(void) {
+    return memory;
+}
+
+void host_delay_us(uint32_t us) {
+    host_stats.time_ns += (uint64_t) us * 1000;
+}
+
+void clock_init(void) {
+}
+
+uint32_t clock_ticks(void) {
+    return host_stats.time_ns * CLOCK_TICKS_PER_US / 1000;
+}
+
+// Start a program or erase operation that takes `us`. `data` is the value being programmed,
+// or 0xFF for erases.
+static void host_flash_busy(uint32_t us, uint8_t data) {
+    flash.busy_until_ns = host_stats.time_ns + (uint64_t) us * 1000;
+    flash.busy_dq7 = ~data & 0x80;
+}
+
+static uint8_t host_flash_read(gly_addr_t addr) {
+    if (host_stats.time_ns < flash.busy_until_ns)
+        return flash.busy_dq7;
+    if (flash.software_id)
+        return (addr & 1) == 0 ? 0xBF : 0xB5;
+    return memory[addr];
+}
+
+static void host_flash_write(gly_addr_t addr, uint8_t value) {
+    host_require(host_stats.time_ns >= flash.busy_until_ns, "flash written while busy");
+    // Only A14-A0 are decoded for command cycles.
+    gly_addr_t cmd_addr = addr & 0x7FFF;
+    enum host_flash_state state = flash.state;
+    // Any unexpected cycle aborts the current command sequence.
+    flash.state = HOST_FLASH_IDLE;
+
+    switch (state) {
+        case HOST_FLASH_IDLE:
+            if (cmd_addr == 0x5555 && value == 0xAA)
+                flash.state = HOST_FLASH_UNLOCK1;
+            else if (value == 0xF0)
+                flash.software_id = false;
+            break;
+        case HOST_FLASH_UNLOCK1:
+            if (cmd_addr == 0x2AAA && value == 0x55)
+                flash.state = HOST_FLASH_UNLOCK2;
+            break;
+        case HOST_FLASH_UNLOCK2:
+            if (cmd_addr != 0x5555)
+                break;
+            if (value == 0xA0)
+                flash.state = HOST_FLASH_PROGRAM;
+            else if (value == 0x80)
+                flash.state = HOST_FLASH_ERASE_SETUP;
+            else if (value == 0x90)
+                flash.software_id = true;
+            else if (value == 0xF0)
+                flash.software_id = false;
+            break;
+        case HOST_FLASH_PROGRAM:
+            // Programming can only clear bits, setting them requires an erase.
+            memory[addr] &= value;
+            host_flash_busy(HOST_FLASH_PROGRAM_US, value);
+            ++host_stats.flash_programs;
+            break;
+        case HOST_FLASH_ERASE_SETUP:
+            if (cmd_addr == 0x5555 && value == 0xAA)
+                flash.state = HOST_FLASH_ERASE_UNLOCK1;
+            break;
+        case HOST_FLASH_ERASE_UNLOCK1:
+            if (cmd_addr == 0x2AAA && value == 0x55)
+                flash.state = HOST_FLASH_ERASE_UNLOCK2;
+            break;
+        case HOST_FLASH_ERASE_UNLOCK2:
+            if (value == 0x30) {
+                gly_addr_t sector = addr - addr % HOST_FLASH_SECTOR_SIZE;
+                memset(&memory[sector], 0xFF, HOST_FLASH_SECTOR_SIZE);
+                host_flash_busy(HOST_FLASH_ERASE_SECTOR_US, 0xFF);
+                ++host_stats.flash_erases;
+            } else if (cmd_addr == 0x5555 && value == 0x10) {
+                memset(memory, 0xFF, GLYCON_FLASH_SIZE);
+                host_flash_busy(HOST_FLASH_ERASE_CHIP_US, 0xFF);
+                ++host_stats.flash_erases;
+            }
+            break;
+    }
+}
+
+enum bus_acquire_status bus_acquire(void) {
+    if (bus.acquired)
+        return BUS_ACQUIRE_ACQUIRED;
+
+    if (!bus.held)
+        host_delay_us(HOST_BUSACK_DELAY_US);
+    bus.acquired = true;
+    bus.mem_output = true;
+    bus.mode = BUS_MODE_READ_MEM;
+    bus.addr = 0;
+    bus.acquired_at = host_stats.time_ns;
+    ++host_stats.bus_acquires;
+    return BUS_ACQUIRE_SUCCESS;
+}
+
+void bus_release(void) {
+    host_require(bus.acquired, "bus released while not acquired");
+    bus.acquired = false;
+    host_stats.bus_hold_ns += host_stats.time_ns - bus.acquired_at;
+}
+
+bool bus_hold(void) {
+    if (!bus.held)
+        host_delay_us(HOST_BUSACK_DELAY_US);
+    bus.held = true;
+    return true;
+}
+
+void bus_resume(void) {
+    host_require(!bus.acquired, "Z80 resumed while bus acquired");
+    bus.held = false;
+}
+
+bool bus_held(void) {
+    return bus.held;
+}
+
+void bus_enable_mem_output(bool enable) {
+    host_require(bus.acquired, "memory output changed while bus not acquired");
+    bus.mem_output = enable;
+}
+
+void bus_set_mode(enum bus_mode mode) {
+    bus_enable_mem_output(mode == BUS_MODE_READ_MEM);
+    bus.mode = mode;
+}
+
+void bus_write(gly_addr_t addr, uint8_t data) {
+    host_require(bus.acquired && bus.mode == BUS_MODE_WRITE_MEM, "bus written while not in write mode");
+    bus.addr = addr % GLYCON_ADDRSPACE_SIZE;
+    bus.data = data;
+    timing_delay();
+}
+
+uint8_t bus_read(gly_addr_t addr) {
+    host_require(bus.acquired && bus.mode == BUS_MODE_READ_MEM, "bus read while not in read mode");
+    host_require(bus.mem_output, "bus read while memory output disabled");
+    bus.addr = addr % GLYCON_ADDRSPACE_SIZE;
+    timing_delay();
+    ++host_stats.bus_cycles;
+    return glycon_is_ram_addr(bus.addr) ? memory[bus.addr] : host_flash_read(bus.addr);
+}
+
+void bus_pulse_ram_write(void) {
+    host_require(bus.acquired && bus.mode == BUS_MODE_WRITE_MEM, "RAM write enable pulsed while not in write mode");
+    // The RAM chip is only selected by RAM addresses.
+    if (glycon_is_ram_addr(bus.addr))
+        memory[bus.addr] = bus.data;
+    timing_delay();
+    timing_delay();
+    ++host_stats.bus_cycles;
+}
+
+void bus_pulse_flash_write(void) {
+    host_require(bus.acquired && bus.mode == BUS_MODE_WRITE_MEM, "flash write enable pulsed while not in write mode");
+    // The flash chip is only selected by flash addresses.
+    if (glycon_is_flash_addr(bus.addr))
+        host_flash_write(bus.addr, bus.data);
+    timing_delay();
+    timing_delay();
+    ++host_stats.bus_cycles;
+}
+
+void host_serial_receive(size_t len, const uint8_t data[]) {
+    for (size_t i = 0; i < len; ++i) {
+        // Like the receive interrupt, drop bytes that don't fit.
+        if (rx.write - rx.read < SERIAL_RX_BUFFER_SIZE) {
+            rx.data[rx.write++ % SERIAL_RX_BUFFER_SIZE] = data[i];
+            if (rx.write - rx.read > rx.high_water)
+                rx.high_water = rx.write - rx.read;
+        } else {
+            ++rx.dropped;
+        }
+        host_stats.time_ns += HOST_SERIAL_BYTE_TIME_NS;
+        ++host_stats.rx_bytes;
+    }
+}
+
+size_t host_serial_take(size_t cap, uint8_t buf[]) {
+    size_t len = tx.len < cap ? tx.len : cap;
+    memcpy(buf, tx.data, len);
+    memmove(tx.data, &tx.data[len], tx.len - len);
+    tx.len -= len;
+    return len;
+}
+
+void serial_init() {
+    rx.read = rx.write = 0;
+    rx.high_water = 0;
+    rx.dropped = 0;
+    tx.len = 0;
+}
+
+uint16_t serial_avail() {
+    return rx.write - rx.read;
+}
+
+void serial_wait_for_data() {
+    host_require(rx.write != rx.read, "firmware waits for serial data that never arrives");
+}
+
+void serial_poll_for_data() {
+    serial_wait_for_data();
+}
+
+int serial_read_u8() {
+    if (rx.write == rx.read)
+        return -1;
+    return rx.data[rx.read++ % SERIAL_RX_BUFFER_SIZE];
+}
+
+uint8_t serial_poll_u8() {
+    serial_poll_for_data();
+    return serial_read_u8();
+}
+
+void serial_rx_stats(uint16_t* high_water, uint32_t* dropped, bool reset) {
+    *high_water = rx.high_water;
+    *dropped = rx.dropped;
+    if (reset) {
+        rx.high_water = 0;
+        rx.dropped = 0;
+    }
+}
+
+void serial_write_u8(uint8_t value) {
+    host_require(tx.len < HOST_TX_BUFFER_SIZE, "transmit buffer overflow");
+    tx.data[tx.len++] = value;
+    // Transmission blocks until the byte is sent.
+    host_stats.time_ns += HOST_SERIAL_BYTE_TIME_NS;
+    ++host_stats.tx_bytes;
+}
+
+void serial_write_u16(uint16_t value) {
+    serial_write_u8(value & 0xFF);
+    serial_write_u8(value >> 8);
+}
+
+void serial_write_u32(uint32_t value) {
+    serial_write_u16(value & 0xFFFF);
+    serial_write_u16(value >> 16);
+}
+
+uint64_t host_transact(const uint8_t* req, uint8_t* resp) {
+    uint64_t start = host_stats.time_ns;
+    host_serial_receive(BDBP_MIN_MSG_LENGTH + req[BDBP_FIELD_DATA_LEN], req);
+
+    // Read the request like the main loop does.
+    serial_wait_for_data();
+    uint8_t cmd = serial_read_u8();
+    uint8_t data_len = serial_poll_u8();
+
+    uint8_t msg_data[BDBP_MAX_DATA_LENGTH];
+    for (size_t i = 0; i < data_len; ++i) {
+        msg_data[i] = serial_poll_u8();
+    }
+
+    cmd_dispatch(cmd, msg_data, data_len);
+
+    size_t len = host_serial_take(BDBP_MAX_MSG_LENGTH, resp);
+    host_require(len >= BDBP_MIN_MSG_LENGTH && len == BDBP_MIN_MSG_LENGTH + resp[BDBP_FIELD_DATA_LEN], "malformed response");
+    host_require(!bus.acquired, "bus still acquired after command");
+    return host_stats.time_ns - start;
+}
@@ -0,0 +1,71 @@
+#ifndef GLYCO_HOST_HAL_H
+#define GLYCO_HOST_HAL_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host backend of the firmware's hardware boundary. This implements bus.h, serial.h, clock.h and
+// the delays of timing.h on top of a simulated Z80 bus with RAM and an SST39SF010A flash chip, so
+// that the real command handlers and flash sequences run natively on the host.
+//
+// Time is simulated as well: delays and serial transfers advance a clock instead of waiting,
+// which gives the time a command would take on the coprocessor. The time spent executing AVR
+// instructions in between is not accounted for; the simavr benchmarks cover that.
+
+#ifndef BAUD
+    #define BAUD 1000000UL
+#endif
+
+// Time it takes to transfer a single byte over the serial link, with 10 bits per byte.
+#define HOST_SERIAL_BYTE_TIME_NS (10 * 1000000000ULL / BAUD)
+
+// Counters of simulated activity. These are cleared by `host_reset`, and may be cleared by
+// the user at any time to measure a particular operation.
+struct host_stats {
+    // Simulated time in nanoseconds.
+    uint64_t time_ns;
+    // The number of times that the bus was acquired from the Z80.
+    uint64_t bus_acquires;
+    // Total time during which the Z80 was held off the bus.
+    uint64_t bus_hold_ns;
+    // The number of read and write cycles on the bus.
+    uint64_t bus_cycles;
+    // The number of bytes programmed into flash.
+    uint64_t flash_programs;
+    // The number of sector and chip erases.
+    uint64_t flash_erases;
+    // The number of bytes transferred over serial, in each direction.
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+};
+
+extern struct host_stats host_stats;
+
+// Reset the simulation: flash is erased, RAM is cleared, the serial buffers are emptied and
+// all statistics are reset, including the firmware's performance counters.
+void host_reset(void);
+
+// Return the simulated memory, indexed by glycon address. This allows inspecting and preparing
+// memory without going through the firmware.
+uint8_t* host_memory(void);
+
+// Advance the simulated clock.
+void host_delay_us(uint32_t us);
+
+// Transfer bytes to the firmware over the simulated serial link. The bytes are placed in the
+// receive buffer, like the receive interrupt would do.
+void host_serial_receive(size_t len, const uint8_t data[]);
+
+// Take at most `cap` bytes that the firmware has written to serial. Returns the number of
+// bytes taken.
+size_t host_serial_take(size_t cap, uint8_t buf[]);
+
+// Run a single request packet through the firmware: the request is transferred over the serial
+// link, read like the main loop does and dispatched. The response packet is stored in `resp`,
+// which must be able to hold BDBP_MAX_MSG_LENGTH bytes. Returns the simulated time from the
+// first byte of the request until the last byte of the response.
+uint64_t host_transact(const uint8_t* req, uint8_t* resp);
+
+#endif
@@ -0,0 +1,715 @@
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <avr_ioport.h>
+#include <avr_uart.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <unistd.h>
+
+// Cycle-accurate benchmarks of the firmware. This runs glyco.elf under simavr, sends it a
+// scripted sequence of BDBP requests over the UART, and measures how many AVR cycles each
+// command takes, from the end of the receive interrupt for the last request byte until the
+// last response byte is written, as well as the cycles per invocation of each interrupt
+// handler. The Z80 side is replaced by a stub bus model that grants the bus immediately and
+// answers reads from a flat memory image, so that only the firmware's own cost is measured.
+// Flash commands are decoded only as far as byte programming.
+//
+// Results can be compared against a baseline file, in which case the benchmark fails if any
+// figure regressed by more than a threshold, or if an entry is only in one of the two. Without
+// a baseline file, the benchmark is reported as skipped.
+
+#define SIMAVR_BENCH_MCU "atmega2560"
+#define SIMAVR_BENCH_FREQUENCY (16000000)
+
+// The number of times each request is sent. The minimum is reported.
+#define SIMAVR_BENCH_ITERATIONS (8)
+
+// Give up on a request after this many cycles (2 seconds).
+#define SIMAVR_BENCH_TIMEOUT_CYCLES (2ULL * SIMAVR_BENCH_FREQUENCY)
+
+// Default allowed regression against the baseline, in percent.
+#define SIMAVR_BENCH_DEFAULT_THRESHOLD (5.0)
+
+// The exit status that Meson reports as a skipped test.
+#define SIMAVR_BENCH_EXIT_SKIP (77)
+
+// The size of the table of results.
+#define SIMAVR_BENCH_MAX_RESULTS (16)
+
+// How long the firmware is left running for the interrupt of timer 1, which overflows every 2^19
+// cycles.
+#define SIMAVR_BENCH_CLOCK_IDLE_CYCLES (1ULL << 20)
+
+// How long the timer interrupts of the benchmark markers and of the profiler are each left
+// running.
+#define SIMAVR_BENCH_IDLE_CYCLES (1ULL << 18)
+
+// The sampling period of the profiler while its interrupt is measured.
+#define SIMAVR_BENCH_PROFILE_PERIOD_US (BDBP_PROFILE_MIN_PERIOD_US)
+
+// Pins, see src/pinout.h.
+#define PIN_BUSACK (0) // PB0
+#define PIN_BUSREQ (2) // PB2
+#define PIN_M1 (3) // PB3
+#define PIN_MEM_OE (1) // PG1
+#define PIN_RAM_WE (2) // PG2
+#define PIN_FLASH_WE (7) // PD7
+
+struct result {
+    char name[32];
+    // The number of payload bytes transferred by the command.
+    size_t payload;
+    uint64_t cycles;
+};
+
+static avr_t* avr;
+
+// The stub bus.
+static struct {
+    uint8_t memory[GLYCON_ADDRSPACE_SIZE];
+    uint8_t port_a, port_c, port_d, port_g, port_l;
+    gly_addr_t addr;
+    // The last flash command cycles, to recognize byte programming.
+    gly_addr_t cmd_addr[3];
+    uint8_t cmd_data[3];
+    avr_irq_t* busack;
+    avr_irq_t* data[8];
+} bus;
+
+// The UART, as seen from the host side.
+static struct {
+    avr_irq_t* input;
+    bool xon;
+    uint8_t pending[BDBP_MAX_MSG_LENGTH];
+    size_t pending_len;
+    size_t pending_pos;
+    uint8_t received[BDBP_MAX_MSG_LENGTH];
+    size_t received_len;
+    uint64_t last_tx_cycle;
+} uart;
+
+// The interrupt handlers that are measured, and their bookkeeping.
+struct isr {
+    // The name of the result.
+    const char* name;
+    // The symbol of the handler, see the vector numbers in the ATmega2560 datasheet.
+    const char* vector;
+    avr_flashaddr_t addr;
+    bool active;
+    uint16_t sp;
+    avr_cycle_count_t start;
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+    // Cycle at which the last invocation returned.
+    avr_cycle_count_t last_end;
+};
+
+enum {
+    ISR_RX,
+    ISR_TIMER1,
+    ISR_TIMER3,
+    ISR_TIMER4,
+    ISR_COUNT,
+};
+
+static struct isr isrs[ISR_COUNT] = {
+    [ISR_RX] = {"rx_isr", "__vector_25"}, // USART0_RX_vect, see serial.c
+    [ISR_TIMER1] = {"timer1_isr", "__vector_20"}, // TIMER1_OVF_vect, see clock.c
+    [ISR_TIMER3] = {"timer3_isr", "__vector_35"}, // TIMER3_OVF_vect, see marker.c
+    [ISR_TIMER4] = {"timer4_isr", "__vector_42"}, // TIMER4_COMPA_vect, see profile.c
+};
+
+// Decode the address bus, like `pinout_read_addr`.
+static gly_addr_t bus_decode_addr(void) {
+    uint8_t a = bus.port_a;
+    uint8_t b = bus.port_c;
+    uint8_t c = bus.port_d;
+
+    gly_addr_t addr = 0;
+    addr |= ((a >> 0) & 0x7) <<  0; // A0-2
+    addr |= ((a >> 3) & 0x1) << 10; // A10
+    addr |= ((a >> 4) & 0x3) <<  3; // A3-4
+    addr |= ((a >> 6) & 0x1) << 11; // A11
+    addr |= ((a >> 7) & 0x1) <<  5; // A5
+
+    addr |= ((b >> 5) & 0x1) << 12; // A12
+    addr |= ((b >> 4) & 0x1) << 13; // A13
+    addr |= ((b >> 3) & 0x1) <<  7; // A7
+    addr |= ((b >> 2) & 0x1) <<  8; // A8
+    addr |= ((b >> 1) & 0x1) <<  6; // A6
+    addr |= ((b >> 0) & 0x1) <<  9; // A9
+
+    addr |= (c & 0x0F) << 14;
+    return addr;
+}
+
+// Drive the data bus with the memory contents at the current address, if memory output is
+// enabled. The data pins are wired in reverse order.
+static void bus_drive_data(void) {
+    if ((bus.port_g & (1 << PIN_MEM_OE)) != 0)
+        return;
+
+    uint8_t value = bus.memory[bus.addr];
+    for (int i = 0; i < 8; ++i) {
+        avr_raise_irq(bus.data[i], (value >> (7 - i)) & 1);
+    }
+}
+
+static uint8_t bus_latched_data(void) {
+    uint8_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= ((bus.port_l >> i) & 1) << (7 - i);
+    }
+    return value;
+}
+
+static void bus_flash_write(gly_addr_t addr, uint8_t data) {
+    if (!glycon_is_flash_addr(addr))
+        return;
+
+    bool program = (bus.cmd_addr[0] & 0x7FFF) == 0x5555 && bus.cmd_data[0] == 0xAA
+        && (bus.cmd_addr[1] & 0x7FFF) == 0x2AAA && bus.cmd_data[1] == 0x55
+        && (bus.cmd_addr[2] & 0x7FFF) == 0x5555 && bus.cmd_data[2] == 0xA0;
+    if (program) {
+        bus.memory[addr] &= data;
+        memset(bus.cmd_data, 0, sizeof bus.cmd_data);
+        return;
+    }
+
+    memmove(&bus.cmd_addr[0], &bus.cmd_addr[1], 2 * sizeof bus.cmd_addr[0]);
+    memmove(&bus.cmd_data[0], &bus.cmd_data[1], 2 * sizeof bus.cmd_data[0]);
+    bus.cmd_addr[2] = addr;
+    bus.cmd_data[2] = data;
+}
+
+static void on_port_b(avr_irq_t* irq, uint32_t value, void* param) {
+    // The stub Z80 grants the bus as soon as it is requested.
+    bool busreq = (value & (1 << PIN_BUSREQ)) != 0;
+    avr_raise_irq(bus.busack, !busreq);
+}
+
+static void on_addr_port(avr_irq_t* irq, uint32_t value, void* param) {
+    *(uint8_t*) param = value;
+    bus.addr = bus_decode_addr();
+    bus_drive_data();
+}
+
+static void on_port_d(avr_irq_t* irq, uint32_t value, void* param) {
+    bool was_high = (bus.port_d & (1 << PIN_FLASH_WE)) != 0;
+    on_addr_port(irq, value, &bus.port_d);
+    // Flash write enable is pulsed high; the flash chip latches the data on the falling edge.
+    if (was_high && (value & (1 << PIN_FLASH_WE)) == 0)
+        bus_flash_write(bus.addr, bus_latched_data());
+}
+
+static void on_port_g(avr_irq_t* irq, uint32_t value, void* param) {
+    bool was_low = (bus.port_g & (1 << PIN_RAM_WE)) == 0;
+    bus.port_g = value;
+    // RAM write enable is pulsed low; the RAM chip latches the data on the rising edge.
+    if (was_low && (value & (1 << PIN_RAM_WE)) != 0 && glycon_is_ram_addr(bus.addr))
+        bus.memory[bus.addr] = bus_latched_data();
+    bus_drive_data();
+}
+
+static void on_port_l(avr_irq_t* irq, uint32_t value, void* param) {
+    bus.port_l = value;
+}
+
+static void on_uart_output(avr_irq_t* irq, uint32_t value, void* param) {
+    if (uart.received_len < sizeof uart.received)
+        uart.received[uart.received_len++] = value;
+    uart.last_tx_cycle = avr->cycle;
+}
+
+static void on_uart_xon(avr_irq_t* irq, uint32_t value, void* param) {
+    uart.xon = true;
+}
+
+static void on_uart_xoff(avr_irq_t* irq, uint32_t value, void* param) {
+    uart.xon = false;
+}
+
+static void connect_port(char port, void (*notify)(avr_irq_t*, uint32_t, void*), void* param) {
+    avr_irq_t* irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), IOPORT_IRQ_REG_PORT);
+    avr_irq_register_notify(irq, notify, param);
+}
+
+static uint16_t avr_sp(void) {
+    return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+// Execute a single instruction, keeping track of the receive interrupt. Returns `true` if the
+// simulation can't continue.
+static bool step(void) {
+    if (uart.xon && uart.pending_pos < uart.pending_len)
+        avr_raise_irq(uart.input, uart.pending[uart.pending_pos++]);
+
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) {
+        fprintf(stderr, "simavr: firmware stopped at pc 0x%05x\n", avr->pc);
+        return true;
+    }
+
+    // The profiler's handler lets other interrupts nest inside it, in which case their cycles
+    // count towards both.
+    for (int i = 0; i < ISR_COUNT; ++i) {
+        struct isr* isr = &isrs[i];
+        if (!isr->active && avr->pc == isr->addr) {
+            isr->active = true;
+            isr->start = avr->cycle;
+            isr->sp = avr_sp();
+        } else if (isr->active && avr_sp() == isr->sp + 3) {
+            // The return address, which was pushed when the interrupt was taken, has been popped.
+            uint64_t cycles = avr->cycle - isr->start;
+            isr->active = false;
+            isr->last_end = avr->cycle;
+            ++isr->count;
+            isr->total_cycles += cycles;
+            if (isr->count == 1 || cycles < isr->min_cycles)
+                isr->min_cycles = cycles;
+            if (cycles > isr->max_cycles)
+                isr->max_cycles = cycles;
+        }
+    }
+
+    return false;
+}
+
+// Run until `len` response bytes have been received. Returns `true` on timeout or crash.
+static bool run_until_received(size_t len) {
+    avr_cycle_count_t deadline = avr->cycle + SIMAVR_BENCH_TIMEOUT_CYCLES;
+    while (uart.received_len < len) {
+        if (step())
+            return true;
+        if (avr->cycle > deadline) {
+            fprintf(stderr, "simavr: timed out waiting for a response\n");
+            return true;
+        }
+    }
+    return false;
+}
+
+// Let the firmware run for `cycles` without any requests. Returns `true` on a crash.
+static bool run_idle(uint64_t cycles) {
+    avr_cycle_count_t end = avr->cycle + cycles;
+    while (avr->cycle < end) {
+        if (step())
+            return true;
+    }
+    return false;
+}
+
+// Send a request and wait for the complete response. Returns the number of cycles from the
+// end of the receive interrupt for the last request byte until the last response byte was
+// written, or 0 on error.
+static uint64_t transact(const uint8_t* req, uint8_t* resp) {
+    size_t len = BDBP_MIN_MSG_LENGTH + req[BDBP_FIELD_DATA_LEN];
+    memcpy(uart.pending, req, len);
+    uart.pending_len = len;
+    uart.pending_pos = 0;
+    uart.received_len = 0;
+
+    struct isr* rx = &isrs[ISR_RX];
+    uint64_t isr_target = rx->count + len;
+    avr_cycle_count_t deadline = avr->cycle + SIMAVR_BENCH_TIMEOUT_CYCLES;
+    while (rx->count < isr_target) {
+        if (step())
+            return 0;
+        if (avr->cycle > deadline) {
+            fprintf(stderr, "simavr: timed out sending a request\n");
+            return 0;
+        }
+    }
+    avr_cycle_count_t start = rx->last_end;
+
+    if (run_until_received(BDBP_MIN_MSG_LENGTH) || run_until_received(BDBP_MIN_MSG_LENGTH + uart.received[BDBP_FIELD_DATA_LEN]))
+        return 0;
+
+    memcpy(resp, uart.received, uart.received_len);
+    if (resp[BDBP_FIELD_HDR] != BDBP_STATUS_SUCCESS) {
+        fprintf(stderr, "simavr: command 0x%02x returned status 0x%02x\n", req[BDBP_FIELD_HDR], resp[BDBP_FIELD_HDR]);
+        return 0;
+    }
+    return uart.last_tx_cycle - start;
+}
+
+static void pkt_init(uint8_t* pkt, enum bdbp_cmd cmd) {
+    pkt[BDBP_FIELD_HDR] = cmd;
+    pkt[BDBP_FIELD_DATA_LEN] = 0;
+}
+
+static void pkt_append_u8(uint8_t* pkt, uint8_t value) {
+    pkt[BDBP_FIELD_DATA + pkt[BDBP_FIELD_DATA_LEN]++] = value;
+}
+
+static void pkt_append_addr(uint8_t* pkt, gly_addr_t addr) {
+    pkt_append_u8(pkt, addr & 0xFF);
+    pkt_append_u8(pkt, (addr >> 8) & 0xFF);
+    pkt_append_u8(pkt, (addr >> 16) & 0xFF);
+}
+
+// Run a request SIMAVR_BENCH_ITERATIONS times and record the fastest run. If `expect` is
+// given, the response data must match it.
+static bool bench(struct result* result, const char* name, size_t payload, const uint8_t* req, const uint8_t* expect) {
+    snprintf(result->name, sizeof result->name, "%s", name);
+    result->payload = payload;
+    result->cycles = UINT64_MAX;
+
+    for (int i = 0; i < SIMAVR_BENCH_ITERATIONS; ++i) {
+        uint8_t resp[BDBP_MAX_MSG_LENGTH];
+        uint64_t cycles = transact(req, resp);
+        if (cycles == 0)
+            return true;
+        if (expect && memcmp(&resp[BDBP_FIELD_DATA], expect, resp[BDBP_FIELD_DATA_LEN]) != 0) {
+            fprintf(stderr, "simavr: %s returned wrong data\n", name);
+            return true;
+        }
+        if (cycles < result->cycles)
+            result->cycles = cycles;
+    }
+
+    return false;
+}
+
+// Run the scripted request sequence. Returns the number of results, or -1 on error.
+static int run_suite(struct result* results) {
+    int n = 0;
+    uint8_t req[BDBP_MAX_MSG_LENGTH];
+    uint8_t expect[BDBP_MAX_DATA_LENGTH];
+    size_t write_size = BDBP_MAX_DATA_LENGTH - BDBP_ADDR_SIZE;
+
+    pkt_init(req, BDBP_CMD_PING);
+    if (bench(&results[n++], "ping", 0, req, NULL))
+        return -1;
+
+    pkt_init(req, BDBP_CMD_INFO);
+    if (bench(&results[n++], "info", BDBP_INFO_DATA_LENGTH, req, NULL))
+        return -1;
+
+    for (size_t i = 0; i < BDBP_MAX_DATA_LENGTH; ++i) {
+        expect[i] = bus.memory[GLYCON_RAM_START + i] = i * 7 + 3;
+    }
+    pkt_init(req, BDBP_CMD_READ);
+    pkt_append_addr(req, GLYCON_RAM_START);
+    pkt_append_u8(req, BDBP_MAX_DATA_LENGTH);
+    if (bench(&results[n++], "read", BDBP_MAX_DATA_LENGTH, req, expect))
+        return -1;
+
+    uint8_t digest_blocks = BDBP_MAX_DATA_LENGTH / 32;
+    for (uint8_t b = 0; b < digest_blocks; ++b) {
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < 32; ++i) {
+            crc = bdbp_crc16_update(crc, bus.memory[GLYCON_RAM_START + b * 32 + i]);
+        }
+        expect[2 * b] = crc & 0xFF;
+        expect[2 * b + 1] = crc >> 8;
+    }
+    pkt_init(req, BDBP_CMD_DIGEST);
+    pkt_append_addr(req, GLYCON_RAM_START);
+    pkt_append_u8(req, 32);
+    pkt_append_u8(req, digest_blocks);
+    if (bench(&results[n++], "digest", digest_blocks * 32, req, expect))
+        return -1;
+
+    pkt_init(req, BDBP_CMD_WRITE);
+    pkt_append_addr(req, GLYCON_RAM_START + 0x1000);
+    for (size_t i = 0; i < write_size; ++i) {
+        pkt_append_u8(req, i ^ 0x5A);
+    }
+    if (bench(&results[n++], "write", write_size, req, NULL))
+        return -1;
+    if (memcmp(&bus.memory[GLYCON_RAM_START + 0x1000], &req[BDBP_FIELD_DATA + BDBP_ADDR_SIZE], write_size) != 0) {
+        fprintf(stderr, "simavr: write did not reach memory\n");
+        return -1;
+    }
+
+    pkt_init(req, BDBP_CMD_WRITE_FLASH);
+    pkt_append_addr(req, GLYCON_FLASH_START + 0x1000);
+    for (size_t i = 0; i < write_size; ++i) {
+        pkt_append_u8(req, i ^ 0xA5);
+    }
+    if (bench(&results[n++], "write_flash", write_size, req, NULL))
+        return -1;
+    if (memcmp(&bus.memory[GLYCON_FLASH_START + 0x1000], &req[BDBP_FIELD_DATA + BDBP_ADDR_SIZE], write_size) != 0) {
+        fprintf(stderr, "simavr: write_flash did not reach memory\n");
+        return -1;
+    }
+
+    pkt_init(req, BDBP_CMD_FLASH_ID);
+    if (bench(&results[n++], "flash_id", 2, req, NULL))
+        return -1;
+
+    pkt_init(req, BDBP_CMD_ERASE_SECTOR);
+    pkt_append_addr(req, GLYCON_FLASH_START);
+    if (bench(&results[n++], "erase_sector", 0, req, NULL))
+        return -1;
+
+    // Let the timer interrupt of the benchmark markers fire for a while.
+    uint8_t resp[BDBP_MAX_MSG_LENGTH];
+    pkt_init(req, BDBP_CMD_MARKERS);
+    pkt_append_u8(req, BDBP_MARKERS_FLAG_START);
+    if (transact(req, resp) == 0 || run_idle(SIMAVR_BENCH_IDLE_CYCLES))
+        return -1;
+    pkt_init(req, BDBP_CMD_MARKERS);
+    pkt_append_u8(req, BDBP_MARKERS_FLAG_STOP);
+    if (transact(req, resp) == 0)
+        return -1;
+
+    // The same for the profiler. The stub Z80 never fetches, so each sample takes the longest
+    // path of its handler.
+    pkt_init(req, BDBP_CMD_PROFILE);
+    pkt_append_u8(req, BDBP_PROFILE_FLAG_START);
+    pkt_append_u8(req, SIMAVR_BENCH_PROFILE_PERIOD_US & 0xFF);
+    pkt_append_u8(req, SIMAVR_BENCH_PROFILE_PERIOD_US >> 8);
+    if (transact(req, resp) == 0 || run_idle(SIMAVR_BENCH_IDLE_CYCLES))
+        return -1;
+    pkt_init(req, BDBP_CMD_PROFILE);
+    pkt_append_u8(req, BDBP_PROFILE_FLAG_STOP);
+    if (transact(req, resp) == 0)
+        return -1;
+
+    // And for the clock.
+    if (run_idle(SIMAVR_BENCH_CLOCK_IDLE_CYCLES))
+        return -1;
+
+    // The worst case of each handler, as that is what delays everything else.
+    for (int i = 0; i < ISR_COUNT; ++i) {
+        if (isrs[i].count == 0) {
+            fprintf(stderr, "simavr: %s never ran\n", isrs[i].vector);
+            return -1;
+        }
+        snprintf(results[n].name, sizeof results[n].name, "%s", isrs[i].name);
+        results[n].payload = 0;
+        results[n].cycles = isrs[i].max_cycles;
+        ++n;
+    }
+
+    return n;
+}
+
+static void print_results(const struct result* results, int n) {
+    printf("%-14s %8s %12s %12s %10s\n", "command", "payload", "cycles", "cycles/byte", "us");
+    for (int i = 0; i < n; ++i) {
+        const struct result* r = &results[i];
+        printf("%-14s %8zu %12llu ", r->name, r->payload, (unsigned long long) r->cycles);
+        if (r->payload > 0)
+            printf("%12.1f ", (double) r->cycles / r->payload);
+        else
+            printf("%12s ", "-");
+        printf("%10.1f\n", r->cycles * 1e6 / SIMAVR_BENCH_FREQUENCY);
+    }
+
+    printf("\n%-14s %12s %8s %8s %8s\n", "interrupt", "invocations", "min", "mean", "max");
+    for (int i = 0; i < ISR_COUNT; ++i) {
+        const struct isr* isr = &isrs[i];
+        printf(
+            "%-14s %12llu %8llu %8.1f %8llu\n",
+            isr->name,
+            (unsigned long long) isr->count,
+            (unsigned long long) isr->min_cycles,
+            isr->count ? (double) isr->total_cycles / isr->count : 0.0,
+            (unsigned long long) isr->max_cycles
+        );
+    }
+}
+
+static bool write_baseline(const char* path, const struct result* results, int n) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return true;
+    }
+
+    fprintf(f, "# glyco cycle counts under simavr, see glyco/host/simavr_bench.c.\n");
+    for (int i = 0; i < n; ++i) {
+        fprintf(f, "%s %llu\n", results[i].name, (unsigned long long) results[i].cycles);
+    }
+    fclose(f);
+    printf("\nWrote baseline to %s\n", path);
+    return false;
+}
+
+// Compare results against the baseline file. Returns `true` if anything regressed by more than
+// `threshold` percent, if an entry is only in one of the two, or if the baseline can't be read.
+static bool compare_baseline(const char* path, const struct result* results, int n, double threshold) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return true;
+    }
+
+    bool regressed = false;
+    bool compared[SIMAVR_BENCH_MAX_RESULTS] = {false};
+    char line[128];
+    printf("\n%-14s %12s %12s %8s\n", "baseline", "before", "after", "change");
+    while (fgets(line, sizeof line, f)) {
+        char name[32];
+        unsigned long long before;
+        if (line[0] == '#' || sscanf(line, "%31s %llu", name, &before) != 2)
+            continue;
+
+        int i = 0;
+        while (i < n && strcmp(results[i].name, name) != 0)
+            ++i;
+        if (i == n) {
+            printf("%-14s %12llu %12s %8s  MISSING\n", name, before, "-", "-");
+            regressed = true;
+            continue;
+        }
+
+        compared[i] = true;
+        double change = before ? (results[i].cycles - (double) before) * 100.0 / before : 0.0;
+        bool bad = change > threshold;
+        printf("%-14s %12llu %12llu %+7.1f%%%s\n", name, before, (unsigned long long) results[i].cycles, change, bad ? "  REGRESSION" : "");
+        regressed = regressed || bad;
+    }
+    fclose(f);
+
+    for (int i = 0; i < n; ++i) {
+        if (!compared[i]) {
+            printf("%-14s %12s %12llu %8s  NOT IN BASELINE\n", results[i].name, "-", (unsigned long long) results[i].cycles, "-");
+            regressed = true;
+        }
+    }
+    return regressed;
+}
+
+static void usage(const char* prog) {
+    fprintf(
+        stderr,
+        "usage: %s [options] <glyco.elf>\n"
+        "\n"
+        "options:\n"
+        "-b, --baseline <file>     Compare results against a baseline file.\n"
+        "-u, --update              Write the results to the baseline file instead.\n"
+        "-t, --threshold <pct>     Allowed regression in percent (default: %.0f).\n",
+        prog,
+        SIMAVR_BENCH_DEFAULT_THRESHOLD
+    );
+}
+
+int main(int argc, char* argv[]) {
+    const char* baseline = NULL;
+    bool update = false;
+    double threshold = SIMAVR_BENCH_DEFAULT_THRESHOLD;
+
+    static const struct option options[] = {
+        {"baseline", required_argument, NULL, 'b'},
+        {"update", no_argument, NULL, 'u'},
+        {"threshold", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "b:ut:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                baseline = optarg;
+                break;
+            case 'u':
+                update = true;
+                break;
+            case 't':
+                threshold = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind + 1 != argc || (update && !baseline)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    elf_firmware_t firmware = {0};
+    if (elf_read_firmware(argv[optind], &firmware) != 0) {
+        fprintf(stderr, "Failed to load '%s'\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < ISR_COUNT; ++i) {
+        for (uint32_t j = 0; j < firmware.symbolcount; ++j) {
+            if (strcmp(firmware.symbol[j]->symbol, isrs[i].vector) == 0)
+                isrs[i].addr = firmware.symbol[j]->addr;
+        }
+        if (isrs[i].addr == 0) {
+            fprintf(stderr, "Symbol %s not found in '%s'\n", isrs[i].vector, argv[optind]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    avr = avr_make_mcu_by_name(SIMAVR_BENCH_MCU);
+    if (!avr) {
+        fprintf(stderr, "simavr does not support %s\n", SIMAVR_BENCH_MCU);
+        return EXIT_FAILURE;
+    }
+    avr_init(avr);
+    avr->frequency = SIMAVR_BENCH_FREQUENCY;
+    avr_load_firmware(avr, &firmware);
+
+    // Keep simavr from echoing UART output to the console.
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    // The UART starts out empty, and so ready to receive.
+    uart.xon = true;
+    uart.input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), on_uart_output, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), on_uart_xon, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), on_uart_xoff, NULL);
+
+    memset(bus.memory, 0xFF, GLYCON_FLASH_SIZE);
+    bus.port_g = 0xFF;
+    bus.busack = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), PIN_BUSACK);
+    avr_raise_irq(bus.busack, 1);
+    // M1 stays inactive, as the stub Z80 never fetches.
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), PIN_M1), 1);
+    for (int i = 0; i < 8; ++i) {
+        bus.data[i] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('L'), i);
+    }
+    connect_port('A', on_addr_port, &bus.port_a);
+    connect_port('B', on_port_b, NULL);
+    connect_port('C', on_addr_port, &bus.port_c);
+    connect_port('D', on_port_d, NULL);
+    connect_port('G', on_port_g, NULL);
+    connect_port('L', on_port_l, NULL);
+
+    // Wait for the firmware to announce itself.
+    if (run_until_received(BDBP_MIN_MSG_LENGTH) || uart.received[BDBP_FIELD_HDR] != BDBP_STATUS_READY) {
+        fprintf(stderr, "simavr: firmware did not report ready\n");
+        return EXIT_FAILURE;
+    }
+
+    struct result results[SIMAVR_BENCH_MAX_RESULTS];
+    int n = run_suite(results);
+    if (n < 0)
+        return EXIT_FAILURE;
+
+    print_results(results, n);
+
+    if (baseline && update)
+        return write_baseline(baseline, results, n) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if (baseline && access(baseline, F_OK) != 0) {
+        fprintf(stderr, "\nNo baseline at %s, nothing was compared. Record one with --update.\n", baseline);
+        return SIMAVR_BENCH_EXIT_SKIP;
+    }
+    if (baseline && compare_baseline(baseline, results, n, threshold))
+        return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,202 @@
+#include "analyzer.h"
+#include "trace.h"
+#include "serial.h"
+#include "clock.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <string.h>
+
+// The buffer holds BDBP_ANALYZER_SAMPLE_SIZE bytes per sample. On the coprocessor, these are
+// the raw values of the address pins of ports A, B and C, with the flags in the upper bits of
+// the third byte, and of the data pins. On the host, samples are stored as they are sent.
+static uint8_t* analyzer_buffer;
+static uint16_t analyzer_capacity;
+static uint16_t analyzer_count;
+static uint32_t analyzer_duration;
+
+static uint8_t analyzer_current;
+static uint8_t analyzer_trigger;
+static gly_addr_t analyzer_value;
+// Whether IOREQ was seen released since arming, for BDBP_ANALYZER_TRIGGER_IOREQ on the host.
+static bool analyzer_ioreq_released;
+
+void analyzer_arm(uint8_t trigger, gly_addr_t value) {
+    uint16_t size;
+    analyzer_buffer = trace_lend_buffer(&size);
+    analyzer_capacity = size / BDBP_ANALYZER_SAMPLE_SIZE;
+    analyzer_count = 0;
+    analyzer_duration = 0;
+    analyzer_trigger = trigger;
+    analyzer_value = value;
+    analyzer_ioreq_released = false;
+    analyzer_current = BDBP_ANALYZER_STATE_ARMED;
+}
+
+void analyzer_stop(void) {
+    if (analyzer_current == BDBP_ANALYZER_STATE_ARMED)
+        analyzer_current = BDBP_ANALYZER_STATE_IDLE;
+}
+
+void analyzer_discard(void) {
+    analyzer_count = 0;
+    analyzer_current = BDBP_ANALYZER_STATE_IDLE;
+}
+
+uint8_t analyzer_state(void) {
+    return analyzer_current;
+}
+
+bool analyzer_armed(void) {
+    return analyzer_current == BDBP_ANALYZER_STATE_ARMED;
+}
+
+uint16_t analyzer_samples(void) {
+    return analyzer_count;
+}
+
+uint32_t analyzer_cycles(void) {
+    return analyzer_duration;
+}
+
+// Mark the buffer as full, and let the host know.
+static void analyzer_finish(uint32_t cycles) {
+    analyzer_count = analyzer_capacity;
+    analyzer_duration = cycles;
+    analyzer_current = BDBP_ANALYZER_STATE_DONE;
+
+    serial_write_u8(BDBP_STATUS_EVENT);
+    serial_write_u8(1);
+    serial_write_u8(BDBP_EVENT_ANALYZER);
+}
+
+#ifdef GLYCO_HOST
+
+// When the capture started.
+static uint32_t analyzer_started_at;
+
+void analyzer_read(uint16_t index, uint8_t* out) {
+    memcpy(out, &analyzer_buffer[index * BDBP_ANALYZER_SAMPLE_SIZE], BDBP_ANALYZER_SAMPLE_SIZE);
+}
+
+void analyzer_record(gly_addr_t address, uint8_t data, uint8_t flags) {
+    if (analyzer_count == 0) {
+        bool triggered = true;
+        if (analyzer_trigger == BDBP_ANALYZER_TRIGGER_ADDRESS) {
+            triggered = address == analyzer_value;
+        } else if (analyzer_trigger == BDBP_ANALYZER_TRIGGER_DATA) {
+            triggered = data == (analyzer_value & 0xFF);
+        } else if (analyzer_trigger == BDBP_ANALYZER_TRIGGER_IOREQ) {
+            triggered = analyzer_ioreq_released && (flags & BDBP_ANALYZER_SAMPLE_IOREQ);
+            analyzer_ioreq_released = !(flags & BDBP_ANALYZER_SAMPLE_IOREQ);
+        }
+        if (!triggered)
+            return;
+        analyzer_started_at = clock_ticks();
+    }
+
+    uint8_t* sample = &analyzer_buffer[analyzer_count * BDBP_ANALYZER_SAMPLE_SIZE];
+    sample[0] = address & 0xFF;
+    sample[1] = (address >> 8) & 0xFF;
+    sample[2] = ((address >> 16) & BDBP_ANALYZER_SAMPLE_ADDR_HIGH_MASK) | flags;
+    sample[3] = data;
+    if (++analyzer_count == analyzer_capacity)
+        analyzer_finish((clock_ticks() - analyzer_started_at) * CLOCK_TICK_CYCLES);
+}
+
+#else
+
+#include "pinout.h"
+#include "util.h"
+
+#include <avr/io.h>
+
+// The address pins of port B without A14 and A15 of the Z80, which `pinout_decode_addr` ignores
+// in favor of the page.
+#define ANALYZER_ADDR_B_MASK (0x3F)
+
+void analyzer_read(uint16_t index, uint8_t* out) {
+    const uint8_t* raw = &analyzer_buffer[index * BDBP_ANALYZER_SAMPLE_SIZE];
+    gly_addr_t address = pinout_decode_addr(raw[0], raw[1], raw[2]);
+    out[0] = address & 0xFF;
+    out[1] = (address >> 8) & 0xFF;
+    out[2] = (address >> 16) | (raw[2] & (BDBP_ANALYZER_SAMPLE_M1 | BDBP_ANALYZER_SAMPLE_IOREQ));
+    out[3] = util_bit_reverse8(raw[3]);
+}
+
+// Wait until `condition` holds, and return from the poll if a byte arrives over serial in the
+// meantime. The flag is only looked at every 256 checks, so that the loop stays tight.
+#define ANALYZER_WAIT_FOR(condition) \
+    do { \
+        uint8_t checks = 0; \
+        while (!(condition)) { \
+            if (++checks == 0 && (GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) != 0) \
+                return; \
+        } \
+    } while (0)
+
+// Store one sample at `p` and advance it. The pins are read one after another, so the lines of
+// a sample are up to 10 cycles apart.
+#define ANALYZER_SAMPLE(p) \
+    do { \
+        (p)[0] = PINOUT_ADDR_A_PIN; \
+        (p)[1] = PINOUT_ADDR_B_PIN; \
+        uint8_t c = PINOUT_ADDR_C_PIN & PINOUT_ADDR_C_MASK; \
+        if ((PINOUT_M1_PIN & PINOUT_M1_MASK) == 0) \
+            c |= BDBP_ANALYZER_SAMPLE_M1; \
+        if ((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) == 0) \
+            c |= BDBP_ANALYZER_SAMPLE_IOREQ; \
+        (p)[2] = c; \
+        (p)[3] = PINOUT_DATA_PIN; \
+        (p) += BDBP_ANALYZER_SAMPLE_SIZE; \
+    } while (0)
+
+void analyzer_poll(void) {
+    GPIOR0 &= ~(1 << SERIAL_RX_FLAG_BIT);
+    if (serial_avail() != 0)
+        return;
+
+    // The trigger is compared against the raw pins, so that each check takes a few cycles.
+    switch (analyzer_trigger) {
+        case BDBP_ANALYZER_TRIGGER_ADDRESS: {
+            uint8_t a, b, c;
+            pinout_encode_addr(analyzer_value, &a, &b, &c);
+            ANALYZER_WAIT_FOR(
+                PINOUT_ADDR_A_PIN == a &&
+                (PINOUT_ADDR_B_PIN & ANALYZER_ADDR_B_MASK) == b &&
+                (PINOUT_ADDR_C_PIN & PINOUT_ADDR_C_MASK) == c
+            );
+            break;
+        }
+        case BDBP_ANALYZER_TRIGGER_DATA: {
+            uint8_t data = util_bit_reverse8(analyzer_value & 0xFF);
+            ANALYZER_WAIT_FOR(PINOUT_DATA_PIN == data);
+            break;
+        }
+        case BDBP_ANALYZER_TRIGGER_IOREQ:
+            ANALYZER_WAIT_FOR((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) != 0);
+            ANALYZER_WAIT_FOR((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) == 0);
+            break;
+        default:
+            break;
+    }
+
+    // Interrupts stay enabled, so that requests that arrive meanwhile aren't lost, at the cost
+    // of a few missed samples around them. The host waits for BDBP_EVENT_ANALYZER instead. The
+    // capture takes far less than an overflow of timer 1 (see clock.c), so its counter alone
+    // gives the duration. The loop is unrolled, and the capacity is a multiple of 4 samples.
+    uint8_t* p = analyzer_buffer;
+    uint8_t* end = p + analyzer_capacity * BDBP_ANALYZER_SAMPLE_SIZE;
+    uint16_t start = TCNT1;
+    do {
+        ANALYZER_SAMPLE(p);
+        ANALYZER_SAMPLE(p);
+        ANALYZER_SAMPLE(p);
+        ANALYZER_SAMPLE(p);
+    } while (p != end);
+    uint16_t ticks = TCNT1 - start;
+
+    analyzer_finish((uint32_t) ticks * CLOCK_TICK_CYCLES);
+}
+
+#endif
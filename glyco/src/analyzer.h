@@ -0,0 +1,55 @@
+#ifndef GLYCO_SRC_ANALYZER_H
+#define GLYCO_SRC_ANALYZER_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A logic analyzer for the Z80's bus, see BDBP_CMD_ANALYZER. While it is armed, the main loop
+// waits for the trigger with `analyzer_poll`, and then fills the buffer with the raw values of
+// the pins as fast as they can be read. Samples are only unscrambled when they are read. When
+// the firmware is built for the host with GLYCO_HOST, there is no bus to sample, and samples
+// are added with `analyzer_record` instead.
+
+// Discard the capture and wait for `trigger` (see `enum bdbp_analyzer_trigger`) with `value`.
+// This takes over the buffer of the trace.
+void analyzer_arm(uint8_t trigger, gly_addr_t value);
+
+// Stop waiting for the trigger. A finished capture is kept.
+void analyzer_stop(void);
+
+// Discard the capture, because its buffer is used by the trace again.
+void analyzer_discard(void);
+
+// Return the state of the analyzer, see `enum bdbp_analyzer_state`.
+uint8_t analyzer_state(void);
+
+// Return whether the analyzer waits for its trigger.
+bool analyzer_armed(void);
+
+// Return the number of samples in the buffer.
+uint16_t analyzer_samples(void);
+
+// Return the number of CPU cycles that the capture took.
+uint32_t analyzer_cycles(void);
+
+// Store sample `index` at `out`, encoded as described at BDBP_ANALYZER_SAMPLE_M1. Requires that
+// `index` is less than `analyzer_samples()`.
+void analyzer_read(uint16_t index, uint8_t* out);
+
+#ifdef GLYCO_HOST
+
+// Handle the state of the bus at one point in time, with BDBP_ANALYZER_SAMPLE_M1 and
+// BDBP_ANALYZER_SAMPLE_IOREQ in `flags`. Requires that the analyzer is armed.
+void analyzer_record(gly_addr_t address, uint8_t data, uint8_t flags);
+
+#else
+
+// Wait for the trigger and capture, until the buffer is full or a byte arrives over serial.
+// Requires that the analyzer is armed.
+void analyzer_poll(void);
+
+#endif
+
+#endif
@@ -0,0 +1,56 @@
+#include "breakpoint.h"
+#include "bus.h"
+#include "serial.h"
+
+#include "common/binary_debug_protocol.h"
+
+static gly_addr_t breakpoint_addresses[BDBP_BREAK_MAX_COUNT];
+static uint8_t breakpoint_len;
+
+// The breakpoint that the Z80 is stopped at, if any.
+static uint8_t breakpoint_hit_index = BDBP_BREAK_NO_INDEX;
+static gly_addr_t breakpoint_hit_address;
+
+void breakpoint_clear(void) {
+    breakpoint_len = 0;
+}
+
+bool breakpoint_add(gly_addr_t address) {
+    if (breakpoint_len == BDBP_BREAK_MAX_COUNT)
+        return false;
+    breakpoint_addresses[breakpoint_len++] = address;
+    return true;
+}
+
+uint8_t breakpoint_count(void) {
+    return breakpoint_len;
+}
+
+bool breakpoint_check(gly_addr_t address) {
+    uint8_t i = 0;
+    while (i < breakpoint_len && breakpoint_addresses[i] != address)
+        ++i;
+    if (i == breakpoint_len || !bus_hold())
+        return false;
+
+    breakpoint_hit_index = i;
+    breakpoint_hit_address = address;
+    serial_write_u8(BDBP_STATUS_EVENT);
+    serial_write_u8(2 + BDBP_ADDR_SIZE);
+    serial_write_u8(BDBP_EVENT_BREAKPOINT);
+    serial_write_u8(i);
+    serial_write_u8(address & 0xFF);
+    serial_write_u16(address >> 8);
+    return true;
+}
+
+uint8_t breakpoint_hit(gly_addr_t* address) {
+    uint8_t index = bus_held() ? breakpoint_hit_index : BDBP_BREAK_NO_INDEX;
+    *address = index != BDBP_BREAK_NO_INDEX ? breakpoint_hit_address : 0;
+    return index;
+}
+
+void breakpoint_continue(void) {
+    breakpoint_hit_index = BDBP_BREAK_NO_INDEX;
+    bus_resume();
+}
@@ -0,0 +1,34 @@
+#ifndef GLYCO_SRC_BREAKPOINT_H
+#define GLYCO_SRC_BREAKPOINT_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Hardware breakpoints, see BDBP_CMD_BREAK. While breakpoints are set, the main loop follows
+// the Z80's opcode fetches with `fetch_poll`, which checks each of them with `breakpoint_check`.
+// The Z80 is stopped with `bus_hold`, so that memory can be accessed as usual until it
+// continues.
+
+// Remove all breakpoints.
+void breakpoint_clear(void);
+
+// Add a breakpoint at `address`. Returns `false` if there are BDBP_BREAK_MAX_COUNT already.
+bool breakpoint_add(gly_addr_t address);
+
+// Return the number of breakpoints.
+uint8_t breakpoint_count(void);
+
+// Check an opcode fetch from `address`, which the Z80 has not finished yet. If there is a
+// breakpoint at it, keep the Z80 stopped, report the event to the host, and return `true`.
+bool breakpoint_check(gly_addr_t address);
+
+// Return the index of the breakpoint that the Z80 is stopped at, or BDBP_BREAK_NO_INDEX, and its
+// address in `address`.
+uint8_t breakpoint_hit(gly_addr_t* address);
+
+// Let the Z80 run again after it was stopped at a breakpoint or with `bus_hold`.
+void breakpoint_continue(void);
+
+#endif
@@ -7,12 +7,12 @@
 // every ms until this amount of polls have been done.
 #define BUS_ACQUIRE_TIMEOUT_US (1000)
 
-enum bus_acquire_status bus_acquire(void) {
-    if ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) == 0) {
-        return BUS_ACQUIRE_ACQUIRED;
-    }
-    // Acquire bus from the Z80: pull the busreq pin low,
-    // and loop until the busack pin is low.
+// Whether the Z80 is kept stopped between acquisitions, see `bus_hold`.
+static bool bus_is_held;
+
+// Pull the busreq pin low, and loop until the busack pin is low. Returns false on timeout, in
+// which case the request is withdrawn.
+static bool bus_request(void) {
     PINOUT_BUSREQ_PORT |= PINOUT_BUSREQ_MASK;
     int delay = 0;
     while ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) != 0 && delay < BUS_ACQUIRE_TIMEOUT_US) {
@@ -21,7 +21,20 @@ enum bus_acquire_status bus_acquire(void) {
     }
     if ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) != 0) {
         PINOUT_BUSREQ_PORT &= ~PINOUT_BUSREQ_MASK;
-        return BUS_ACQUIRE_TIMEOUT;
+        return false;
+    }
+    return true;
+}
+
+enum bus_acquire_status bus_acquire(void) {
+    if (!bus_is_held) {
+        if ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) == 0) {
+            return BUS_ACQUIRE_ACQUIRED;
+        }
+        // Acquire bus from the Z80.
+        if (!bus_request()) {
+            return BUS_ACQUIRE_TIMEOUT;
+        }
     }
 
     pinout_write_data(0);
@@ -60,9 +73,32 @@ void bus_release(void) {
 
     pinout_set_addr_ddr(PIN_INPUT);
 
+    if (bus_is_held)
+        return;
+
     // Release Z80 bus.
     // TODO: Should
     PINOUT_BUSREQ_PORT &= ~PINOUT_BUSREQ_MASK;
     while ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) == 0)
         continue;
 }
+
+bool bus_hold(void) {
+    if (!bus_is_held && !bus_request())
+        return false;
+    bus_is_held = true;
+    return true;
+}
+
+void bus_resume(void) {
+    if (!bus_is_held)
+        return;
+    bus_is_held = false;
+    PINOUT_BUSREQ_PORT &= ~PINOUT_BUSREQ_MASK;
+    while ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) == 0)
+        continue;
+}
+
+bool bus_held(void) {
+    return bus_is_held;
+}
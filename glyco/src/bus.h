@@ -3,10 +3,19 @@
 
 #include "common/glycon.h"
 
-#include "pinout.h"
 #include "timing.h"
 
 #include <stdint.h>
+#include <stdbool.h>
+
+// The bus functions below form the boundary between the firmware and the hardware. On the
+// coprocessor they are inlined and drive the pins directly. When the firmware is built for the
+// host with GLYCO_HOST, they are implemented by the simulation in glyco/host instead.
+#ifdef GLYCO_HOST
+    #define BUS_INLINE
+#else
+    #define BUS_INLINE static inline
+#endif
 
 // Utility enum used to quickly prepare the bus for a certain operation.
 enum bus_mode {
@@ -38,6 +47,19 @@ enum bus_acquire_status bus_acquire(void);
 // the bus is acquired again with `bus_acquire`.
 void bus_release(void);
 
+// Keep the Z80 stopped between bus acquisitions, for example at a breakpoint. This requests
+// the bus and waits for the Z80 to let go of it, but leaves the pins to the Z80 until
+// `bus_acquire`, which then returns without waiting, and `bus_release` keeps the Z80 stopped.
+// Returns `false` if the Z80 did not let go of the bus in time.
+bool bus_hold(void);
+
+// Let the Z80 that was stopped with `bus_hold` run again. Requires that the bus is not
+// acquired.
+void bus_resume(void);
+
+// Return whether the Z80 is kept stopped with `bus_hold`.
+bool bus_held(void);
+
 // Set the memory chip's output-enable status. When the memory chip's output is enabled,
 // it places the data at the location given by the address pins on the data bus, and so
 // this is required to read data from the memory chip.
@@ -47,6 +69,36 @@ void bus_release(void);
 // flash and memory can be read simultaneously while this setting is enabled.
 // Note, that the memory chip's output should be disabled when reading from any other
 // device to prevent the data signals from interfering.
+BUS_INLINE void bus_enable_mem_output(bool enable);
+
+// Set address DDR, data DDR, and mem output DDR based on `mode`, to quickly
+// configure the bus for a particular operation.
+// Requires bus acquired.
+// Note: Address bus is always in output mode when the bus is acquired.
+BUS_INLINE void bus_set_mode(enum bus_mode mode);
+
+// Write a value to the bus at a particular address. Includes delay.
+// Requires BUS_MODE_WRITE_MEM.
+BUS_INLINE void bus_write(gly_addr_t addr, uint8_t data);
+
+// Read a value from the bus at a particular address.
+// Requires BUS_MODE_READ_MEM.
+BUS_INLINE uint8_t bus_read(gly_addr_t addr);
+
+// Momentarily pull the RAM write enable pin low, which writes the data currently
+// on the data bus to address if the address' msb is high.
+// Requires bus acquired.
+BUS_INLINE void bus_pulse_ram_write(void);
+
+// Momentarily pull the FLASH write enable pin high, which writes the data currently
+// on the data bus to address if the address' msb is low.
+// Requires bus acquired.
+BUS_INLINE void bus_pulse_flash_write(void);
+
+#ifndef GLYCO_HOST
+
+#include "pinout.h"
+
 static inline void bus_enable_mem_output(bool enable) {
     if (enable) {
         PINOUT_MEM_OE_PORT &= ~PINOUT_MEM_OE_MASK;
@@ -55,10 +107,6 @@ static inline void bus_enable_mem_output(bool enable) {
     }
 }
 
-// Set address DDR, data DDR, and mem output DDR based on `mode`, to quickly
-// configure the bus for a particular operation.
-// Requires bus acquired.
-// Note: Address bus is always in output mode when the bus is acquired.
 static inline void bus_set_mode(enum bus_mode mode) {
     switch (mode) {
         case BUS_MODE_WRITE_MEM:
@@ -73,25 +121,18 @@ static inline void bus_set_mode(enum bus_mode mode) {
     }
 }
 
-// Write a value to the bus at a particular address. Includes delay.
-// Requires BUS_MODE_WRITE_MEM.
 static inline void bus_write(gly_addr_t addr, uint8_t data) {
     pinout_write_addr(addr);
     pinout_write_data(data);
     timing_delay();
 }
 
-// Read a value from the bus at a particular address.
-// Requires BUS_MODE_READ_MEM.
 static inline uint8_t bus_read(gly_addr_t addr) {
     pinout_write_addr(addr);
     timing_delay();
     return pinout_read_data();
 }
 
-// Momentarily pull the RAM write enable pin low, which writes the data currently
-// on the data bus to address if the address' msb is high.
-// Requires bus acquired.
 static inline void bus_pulse_ram_write(void) {
     PINOUT_RAM_WE_PORT &= ~PINOUT_RAM_WE_MASK;
     timing_delay();
@@ -99,9 +140,6 @@ static inline void bus_pulse_ram_write(void) {
     timing_delay();
 }
 
-// Momentarily pull the FLASH write enable pin high, which writes the data currently
-// on the data bus to address if the address' msb is low.
-// Requires bus acquired.
 static inline void bus_pulse_flash_write(void) {
     PINOUT_FLASH_WE_PORT |= PINOUT_FLASH_WE_MASK;
     timing_delay();
@@ -110,3 +148,5 @@ static inline void bus_pulse_flash_write(void) {
 }
 
 #endif
+
+#endif
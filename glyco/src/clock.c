@@ -0,0 +1,33 @@
+#include "clock.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// The upper half of the tick count, which advances whenever timer 1 overflows.
+static volatile uint16_t clock_high;
+
+void clock_init(void) {
+    // Normal mode, counting up at clk/8 and interrupting on overflow.
+    TCCR1A = 0;
+    TCCR1B = 1 << CS11;
+    TCNT1 = 0;
+    TIMSK1 = 1 << TOIE1;
+    clock_high = 0;
+}
+
+uint32_t clock_ticks(void) {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t low = TCNT1;
+    uint16_t high = clock_high;
+    // The counter may have overflowed after interrupts were disabled, in which case the
+    // interrupt is still pending. A small count means it was read after the overflow.
+    if ((TIFR1 & (1 << TOV1)) != 0 && low < 0x8000)
+        ++high;
+    SREG = sreg;
+    return (uint32_t) high << 16 | low;
+}
+
+ISR(TIMER1_OVF_vect) {
+    ++clock_high;
+}
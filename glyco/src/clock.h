@@ -0,0 +1,26 @@
+#ifndef GLYCO_SRC_CLOCK_H
+#define GLYCO_SRC_CLOCK_H
+
+#include <stdint.h>
+
+// A free-running clock for measuring durations, driven by timer 1. When the firmware is built
+// for the host with GLYCO_HOST, it follows the simulated time instead, see glyco/host/hal.h.
+
+#ifndef F_CPU
+    // The host simulation models the clock of the Arduino Mega.
+    #define F_CPU 16000000UL
+#endif
+
+// The number of CPU cycles per tick. This is the prescaler of timer 1.
+#define CLOCK_TICK_CYCLES (8)
+
+#define CLOCK_TICKS_PER_US (F_CPU / 1000000UL / CLOCK_TICK_CYCLES)
+
+// Start the clock. Requires interrupts to be enabled afterwards.
+void clock_init(void);
+
+// Return the number of ticks since the clock was started. This wraps around after 2^32 ticks,
+// so durations should be computed as the difference of two values.
+uint32_t clock_ticks(void);
+
+#endif
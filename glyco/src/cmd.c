@@ -0,0 +1,588 @@
+#include "cmd.h"
+#include "serial.h"
+#include "flash.h"
+#include "bus.h"
+#include "clock.h"
+#include "timing.h"
+#include "perf.h"
+#include "marker.h"
+#include "profile.h"
+#include "trace.h"
+#include "breakpoint.h"
+#include "mailbox.h"
+#include "analyzer.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Identifier of the firmware build, reported through BDBP_CMD_INFO.
+// Normally passed in by the build system.
+#ifndef GLYCO_BUILD_ID
+    #define GLYCO_BUILD_ID 0
+#endif
+
+// Commands that this firmware implements.
+#define SUPPORTED_CMDS \
+    (BDBP_LEGACY_CMDS | BDBP_CMD_BIT(BDBP_CMD_INFO) | BDBP_CMD_BIT(BDBP_CMD_DIGEST) | BDBP_CMD_BIT(BDBP_CMD_STATS) | \
+    BDBP_CMD_BIT(BDBP_CMD_MARKERS) | BDBP_CMD_BIT(BDBP_CMD_PROFILE) | BDBP_CMD_BIT(BDBP_CMD_TRACE) | BDBP_CMD_BIT(BDBP_CMD_BREAK) | \
+    BDBP_CMD_BIT(BDBP_CMD_BUS) | BDBP_CMD_BIT(BDBP_CMD_MAILBOX) | BDBP_CMD_BIT(BDBP_CMD_ANALYZER))
+
+// When the bus was last acquired, see `release_bus`.
+static uint32_t bus_acquired_at;
+
+// The budget set with CMD_BUS: the number of bytes transferred per acquisition, or 0 for no
+// limit, and the time the Z80 runs between bursts.
+static uint8_t bus_burst;
+static uint16_t bus_gap_us;
+// The bytes left of the current burst.
+static uint8_t bus_burst_left;
+
+// Read an address from a BDBP data buffer.
+static gly_addr_t pkt_read_addr(uint8_t** data_ptr) {
+    uint8_t* data = *data_ptr;
+    gly_addr_t a = *data++;
+    gly_addr_t b = *data++;
+    gly_addr_t c = *data++;
+    *data_ptr = data;
+    return (c << 16) | (b << 8) | a;
+}
+
+// Try to acquire the Z80's bus. If that fails, return false,
+// and return an error status.
+static bool acquire_bus_or_fail(void) {
+    uint32_t start = clock_ticks();
+    enum bus_acquire_status status = bus_acquire();
+    switch (status) {
+        case BUS_ACQUIRE_SUCCESS:
+            bus_acquired_at = clock_ticks();
+            bus_burst_left = bus_burst;
+            perf_record(&perf.bus_acquire, bus_acquired_at - start);
+            return true;
+        case BUS_ACQUIRE_TIMEOUT:
+            serial_write_u8(BDBP_STATUS_BUS_ACQUIRE_TIMEOUT);
+            serial_write_u8(0);
+            return false;
+        case BUS_ACQUIRE_ACQUIRED:
+            serial_write_u8(BDBP_STATUS_BUS_ALREADY_ACQUIRED);
+            serial_write_u8(0);
+            return false;
+        default:
+            __builtin_unreachable();
+    }
+}
+
+// Release the bus that was acquired with `acquire_bus_or_fail`.
+static void release_bus(void) {
+    bus_release();
+    perf_record(&perf.bus_hold, clock_ticks() - bus_acquired_at);
+}
+
+// Count a byte that is about to be transferred on the acquired bus. Once the burst is used up,
+// the bus is released, and acquired again in `mode` after the Z80 ran for the gap. Returns false
+// if that fails, in which case an error status has been written. A Z80 that is stopped at a
+// breakpoint has no use for the gap.
+static bool continue_burst(enum bus_mode mode) {
+    if (bus_burst == 0 || bus_burst_left-- != 0 || bus_held())
+        return true;
+
+    release_bus();
+    timing_delay_us(bus_gap_us);
+    if (!acquire_bus_or_fail())
+        return false;
+    bus_set_mode(mode);
+    --bus_burst_left;
+    return true;
+}
+
+// Handle CMD_WRITE: Write some data to memory.
+static void cmd_write(uint8_t* data, uint8_t* data_end) {
+    if (!acquire_bus_or_fail())
+        return;
+
+    gly_addr_t address = pkt_read_addr(&data);
+    bus_set_mode(BUS_MODE_WRITE_MEM);
+    while (data != data_end) {
+        if (!continue_burst(BUS_MODE_WRITE_MEM))
+            return;
+        bus_write(address++, *data++);
+        bus_pulse_ram_write();
+    }
+    release_bus();
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(0);
+}
+
+// Read `len` bytes starting at `address` into `buf`, holding the bus only for as long as that
+// takes. Returns false if the bus could not be acquired, in which case an error status has been
+// written.
+static bool read_block(gly_addr_t address, uint8_t len, uint8_t* buf) {
+    if (!acquire_bus_or_fail())
+        return false;
+
+    bus_set_mode(BUS_MODE_READ_MEM);
+    for (uint8_t i = 0; i < len; ++i) {
+        if (!continue_burst(BUS_MODE_READ_MEM))
+            return false;
+        buf[i] = bus_read(address + i);
+    }
+    release_bus();
+    return true;
+}
+
+// Handle CMD_READ: Read some data from ram- or rom.
+static void cmd_read(uint8_t* data, uint8_t* data_end) {
+    gly_addr_t address = pkt_read_addr(&data);
+    uint8_t amt = *data++;
+
+    // Transmission is unbuffered and much slower than the bus, so the bus is released before
+    // sending anything.
+    uint8_t buf[BDBP_MAX_DATA_LENGTH];
+    if (!read_block(address, amt, buf))
+        return;
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(amt);
+    for (uint8_t i = 0; i < amt; ++i) {
+        serial_write_u8(buf[i]);
+    }
+}
+
+// Handle CMD_FLASH: Write some data to flash storage.
+static void cmd_flash(uint8_t* data, uint8_t* data_end) {
+    if (!acquire_bus_or_fail())
+        return;
+
+    gly_addr_t address = pkt_read_addr(&data);
+    while (data != data_end) {
+        if (!continue_burst(BUS_MODE_WRITE_MEM))
+            return;
+        flash_byte_program(address++, *data++);
+    }
+    release_bus();
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(0);
+}
+
+// Handle CMD_FLASH_ID: Returns the flash's manufacterer and device identifiers.
+static void cmd_flash_id(void) {
+    if (!acquire_bus_or_fail())
+        return;
+
+    uint8_t mfg, dev;
+    flash_get_software_id(&mfg, &dev);
+    release_bus();
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(2);
+    serial_write_u8(mfg);
+    serial_write_u8(dev);
+}
+
+// Handle CMD_ERASE_SECTOR: Erases a single flash sector.
+static void cmd_erase_sector(uint8_t* data, uint8_t* data_end) {
+    if (!acquire_bus_or_fail())
+        return;
+
+    gly_addr_t address = pkt_read_addr(&data);
+    flash_erase_sector(address);
+    release_bus();
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(0);
+}
+
+// Handle CMD_ERASE_CHIP: Erases the entire flash chip.
+static void cmd_erase_chip(void) {
+    if (!acquire_bus_or_fail())
+        return;
+    flash_erase_chip();
+    release_bus();
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(0);
+}
+
+// Handle CMD_INFO: Returns information about this firmware.
+static void cmd_info(void) {
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_INFO_DATA_LENGTH);
+    serial_write_u8(BDBP_VERSION);
+    serial_write_u16(BDBP_MAX_MSG_LENGTH);
+    serial_write_u16(SERIAL_RX_BUFFER_SIZE);
+    serial_write_u16(SERIAL_TX_BUFFER_SIZE);
+    serial_write_u32(SUPPORTED_CMDS & 0xFFFFFFFF);
+    serial_write_u32(SUPPORTED_CMDS >> 32);
+    serial_write_u32(GLYCO_BUILD_ID);
+}
+
+// Handle CMD_DIGEST: Returns a CRC of each of a number of consecutive blocks.
+static void cmd_digest(uint8_t* data, uint8_t* data_end) {
+    gly_addr_t address = pkt_read_addr(&data);
+    uint8_t block_size = *data++;
+    uint8_t count = *data++;
+    if (count > BDBP_DIGEST_MAX_BLOCKS)
+        count = BDBP_DIGEST_MAX_BLOCKS;
+
+    // The bus is acquired again for every block, and the CRC is computed while the Z80 runs.
+    uint16_t digests[BDBP_DIGEST_MAX_BLOCKS];
+    uint8_t buf[UINT8_MAX];
+    for (uint8_t i = 0; i < count; ++i) {
+        if (!read_block(address, block_size, buf))
+            return;
+        address += block_size;
+
+        uint16_t crc = 0xFFFF;
+        for (uint8_t j = 0; j < block_size; ++j) {
+            crc = bdbp_crc16_update(crc, buf[j]);
+        }
+        digests[i] = crc;
+    }
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(2 * count);
+    for (uint8_t i = 0; i < count; ++i) {
+        serial_write_u16(digests[i]);
+    }
+}
+
+static void write_duration(const struct perf_duration* duration) {
+    serial_write_u32(duration->count);
+    serial_write_u32(duration->ticks);
+    serial_write_u32(duration->max_ticks);
+}
+
+// Handle CMD_STATS: Returns the performance counters.
+static void cmd_stats(uint8_t* data, uint8_t* data_end) {
+    uint8_t flags = data != data_end ? *data : 0;
+    bool reset = (flags & BDBP_STATS_FLAG_RESET) != 0;
+
+    uint16_t rx_high_water;
+    uint32_t rx_dropped;
+    serial_rx_stats(&rx_high_water, &rx_dropped, reset);
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_STATS_DATA_LENGTH);
+    serial_write_u16(F_CPU / 1000);
+    serial_write_u8(CLOCK_TICK_CYCLES);
+    write_duration(&perf.bus_acquire);
+    write_duration(&perf.bus_hold);
+    serial_write_u16(rx_high_water);
+    serial_write_u32(rx_dropped);
+    write_duration(&perf.flash_program);
+    write_duration(&perf.flash_erase);
+    serial_write_u8(BDBP_STATS_CMDS);
+    for (uint8_t i = 0; i < BDBP_STATS_CMDS; ++i) {
+        write_duration(&perf.cmds[i]);
+    }
+
+    // This request itself is counted afterwards, see `cmd_dispatch`.
+    if (reset)
+        perf_reset();
+}
+
+// Handle CMD_MARKERS: Starts or stops recording benchmark markers, and returns the oldest ones.
+static void cmd_markers(uint8_t* data, uint8_t* data_end) {
+    uint8_t flags = data != data_end ? *data : 0;
+    if (flags & BDBP_MARKERS_FLAG_START) {
+        trace_stop();
+        marker_start();
+    }
+    if (flags & BDBP_MARKERS_FLAG_STOP)
+        marker_stop();
+
+    struct marker markers[BDBP_MARKERS_MAX_COUNT];
+    uint8_t count = marker_take(markers, BDBP_MARKERS_MAX_COUNT);
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_MARKERS_HEADER_LENGTH + count * BDBP_MARKERS_ENTRY_LENGTH);
+    serial_write_u8(marker_recording() ? BDBP_MARKERS_STATE_RECORDING : 0);
+    serial_write_u16(F_CPU / 1000);
+    serial_write_u16(marker_dropped());
+    serial_write_u8(count);
+    for (uint8_t i = 0; i < count; ++i) {
+        serial_write_u8(markers[i].id);
+        serial_write_u32(markers[i].cycles);
+    }
+}
+
+// Handle CMD_PROFILE: Starts or stops sampling fetch addresses, and returns the oldest samples.
+static void cmd_profile(uint8_t* data, uint8_t* data_end) {
+    uint8_t flags = data != data_end ? *data++ : 0;
+    if (flags & BDBP_PROFILE_FLAG_START) {
+        uint16_t period = data_end - data >= 2 ? data[0] | data[1] << 8 : 0;
+        if (period < BDBP_PROFILE_MIN_PERIOD_US)
+            period = BDBP_PROFILE_MIN_PERIOD_US;
+        else if (period > BDBP_PROFILE_MAX_PERIOD_US)
+            period = BDBP_PROFILE_MAX_PERIOD_US;
+        trace_stop();
+        profile_start(period);
+    }
+    if (flags & BDBP_PROFILE_FLAG_STOP)
+        profile_stop();
+
+    gly_addr_t samples[BDBP_PROFILE_MAX_COUNT];
+    uint8_t count = profile_take(samples, BDBP_PROFILE_MAX_COUNT);
+    uint16_t dropped, missed;
+    profile_counters(&dropped, &missed);
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_PROFILE_HEADER_LENGTH + count * BDBP_ADDR_SIZE);
+    serial_write_u8(profile_running() ? BDBP_PROFILE_STATE_RUNNING : 0);
+    serial_write_u16(dropped);
+    serial_write_u16(missed);
+    serial_write_u8(count);
+    for (uint8_t i = 0; i < count; ++i) {
+        serial_write_u8(samples[i] & 0xFF);
+        serial_write_u16(samples[i] >> 8);
+    }
+}
+
+// Handle CMD_TRACE: Starts, stops or reads the instruction fetch trace.
+static void cmd_trace(uint8_t* data, uint8_t* data_end) {
+    uint8_t op = data != data_end ? *data++ : BDBP_TRACE_OP_STATUS;
+    uint8_t first = 0;
+    uint8_t count = 0;
+    switch (op) {
+        case BDBP_TRACE_OP_START: {
+            uint8_t mode = *data++;
+            gly_addr_t start = pkt_read_addr(&data);
+            gly_addr_t stop = pkt_read_addr(&data);
+            // Tracing takes over the main loop, and holds the Z80 in a way that would confuse
+            // the other ways of watching it.
+            marker_stop();
+            profile_stop();
+            analyzer_discard();
+            trace_start(mode, start, stop);
+            break;
+        }
+        case BDBP_TRACE_OP_STOP:
+            trace_stop();
+            break;
+        case BDBP_TRACE_OP_READ:
+            first = data != data_end ? *data : 0;
+            if (first < trace_blocks()) {
+                count = trace_blocks() - first;
+                if (count > BDBP_TRACE_READ_BLOCKS)
+                    count = BDBP_TRACE_READ_BLOCKS;
+            }
+            break;
+        default:
+            break;
+    }
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_TRACE_HEADER_LENGTH + count * BDBP_TRACE_BLOCK_SIZE);
+    serial_write_u8(trace_state());
+    serial_write_u8(trace_blocks());
+    serial_write_u32(trace_fetches());
+    for (uint8_t i = 0; i < count; ++i) {
+        const uint8_t* block = trace_block(first + i);
+        for (uint8_t j = 0; j < BDBP_TRACE_BLOCK_SIZE; ++j)
+            serial_write_u8(block[j]);
+    }
+}
+
+// Handle CMD_BREAK: Sets breakpoints, or stops or continues the Z80.
+static void cmd_break(uint8_t* data, uint8_t* data_end) {
+    uint8_t op = data != data_end ? *data++ : BDBP_BREAK_OP_STATUS;
+    switch (op) {
+        case BDBP_BREAK_OP_SET: {
+            uint8_t count = *data++;
+            breakpoint_clear();
+            for (uint8_t i = 0; i < count && breakpoint_add(pkt_read_addr(&data)); ++i)
+                continue;
+            break;
+        }
+        case BDBP_BREAK_OP_CONTINUE:
+            breakpoint_continue();
+            break;
+        case BDBP_BREAK_OP_HALT:
+            if (!bus_hold()) {
+                serial_write_u8(BDBP_STATUS_BUS_ACQUIRE_TIMEOUT);
+                serial_write_u8(0);
+                return;
+            }
+            break;
+        default:
+            break;
+    }
+
+    gly_addr_t address;
+    uint8_t index = breakpoint_hit(&address);
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_BREAK_DATA_LENGTH);
+    serial_write_u8(bus_held() ? BDBP_BREAK_STATE_STOPPED : BDBP_BREAK_STATE_RUNNING);
+    serial_write_u8(breakpoint_count());
+    serial_write_u8(index);
+    serial_write_u8(address & 0xFF);
+    serial_write_u16(address >> 8);
+}
+
+// Handle CMD_BUS: Sets the budget for holding the bus, and returns how long it was held.
+static void cmd_bus(uint8_t* data, uint8_t* data_end) {
+    if (data_end - data >= 3) {
+        bus_burst = *data++;
+        bus_gap_us = *data++;
+        bus_gap_us |= (uint16_t) *data++ << 8;
+    }
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_BUS_DATA_LENGTH);
+    serial_write_u8(bus_burst);
+    serial_write_u16(bus_gap_us);
+    serial_write_u16(F_CPU / 1000);
+    serial_write_u8(CLOCK_TICK_CYCLES);
+    serial_write_u32(perf.bus_hold.count);
+    serial_write_u32(perf.bus_hold.ticks);
+}
+
+// Handle CMD_MAILBOX: Opens or closes the mailbox, or sends bytes to the Z80 through it.
+static void cmd_mailbox(uint8_t* data, uint8_t* data_end) {
+    uint8_t op = data != data_end ? *data++ : BDBP_MAILBOX_OP_STATUS;
+    uint8_t sent = 0;
+    switch (op) {
+        case BDBP_MAILBOX_OP_OPEN:
+            mailbox_open(pkt_read_addr(&data));
+            break;
+        case BDBP_MAILBOX_OP_CLOSE:
+            mailbox_close();
+            break;
+        case BDBP_MAILBOX_OP_SEND:
+            if (!mailbox_active())
+                break;
+            if (!acquire_bus_or_fail())
+                return;
+            sent = mailbox_send(data, data_end - data);
+            release_bus();
+            break;
+        default:
+            break;
+    }
+
+    gly_addr_t address = mailbox_address();
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_MAILBOX_DATA_LENGTH);
+    serial_write_u8(mailbox_active());
+    serial_write_u8(sent);
+    serial_write_u8(address & 0xFF);
+    serial_write_u16(address >> 8);
+}
+
+// Handle CMD_ANALYZER: Arms or stops the logic analyzer, and returns captured samples.
+static void cmd_analyzer(uint8_t* data, uint8_t* data_end) {
+    uint8_t op = data != data_end ? *data++ : BDBP_ANALYZER_OP_STATUS;
+    uint16_t first = 0;
+    uint8_t count = 0;
+    switch (op) {
+        case BDBP_ANALYZER_OP_ARM: {
+            uint8_t trigger = *data++;
+            gly_addr_t value = pkt_read_addr(&data);
+            // The analyzer takes over the main loop and the buffer of the trace.
+            marker_stop();
+            profile_stop();
+            analyzer_arm(trigger, value);
+            break;
+        }
+        case BDBP_ANALYZER_OP_STOP:
+            analyzer_stop();
+            break;
+        case BDBP_ANALYZER_OP_READ:
+            first = data_end - data >= 2 ? data[0] | data[1] << 8 : 0;
+            if (first < analyzer_samples()) {
+                uint16_t left = analyzer_samples() - first;
+                count = left < BDBP_ANALYZER_READ_SAMPLES ? left : BDBP_ANALYZER_READ_SAMPLES;
+            }
+            break;
+        default:
+            break;
+    }
+
+    serial_write_u8(BDBP_STATUS_SUCCESS);
+    serial_write_u8(BDBP_ANALYZER_HEADER_LENGTH + count * BDBP_ANALYZER_SAMPLE_SIZE);
+    serial_write_u8(analyzer_state());
+    serial_write_u16(analyzer_samples());
+    serial_write_u16(F_CPU / 1000);
+    serial_write_u32(analyzer_cycles());
+    for (uint8_t i = 0; i < count; ++i) {
+        uint8_t sample[BDBP_ANALYZER_SAMPLE_SIZE];
+        analyzer_read(first + i, sample);
+        for (uint8_t j = 0; j < BDBP_ANALYZER_SAMPLE_SIZE; ++j)
+            serial_write_u8(sample[j]);
+    }
+}
+
+void cmd_reset(void) {
+    bus_burst = 0;
+    bus_gap_us = 0;
+}
+
+void cmd_dispatch(uint8_t cmd, uint8_t* data, uint8_t data_len) {
+    uint32_t start = clock_ticks();
+    switch (cmd) {
+        case BDBP_CMD_PING:
+            serial_write_u8(BDBP_STATUS_SUCCESS);
+            serial_write_u8(0);
+            break;
+        case BDBP_CMD_WRITE:
+            cmd_write(data, data + data_len);
+            break;
+        case BDBP_CMD_READ:
+            cmd_read(data, data + data_len);
+            break;
+        case BDBP_CMD_WRITE_FLASH:
+            cmd_flash(data, data + data_len);
+            break;
+        case BDBP_CMD_FLASH_ID:
+            cmd_flash_id();
+            break;
+        case BDBP_CMD_ERASE_SECTOR:
+            cmd_erase_sector(data, data + data_len);
+            break;
+        case BDBP_CMD_ERASE_CHIP:
+            cmd_erase_chip();
+            break;
+        case BDBP_CMD_INFO:
+            cmd_info();
+            break;
+        case BDBP_CMD_DIGEST:
+            cmd_digest(data, data + data_len);
+            break;
+        case BDBP_CMD_STATS:
+            cmd_stats(data, data + data_len);
+            break;
+        case BDBP_CMD_MARKERS:
+            cmd_markers(data, data + data_len);
+            break;
+        case BDBP_CMD_PROFILE:
+            cmd_profile(data, data + data_len);
+            break;
+        case BDBP_CMD_TRACE:
+            cmd_trace(data, data + data_len);
+            break;
+        case BDBP_CMD_BREAK:
+            cmd_break(data, data + data_len);
+            break;
+        case BDBP_CMD_BUS:
+            cmd_bus(data, data + data_len);
+            break;
+        case BDBP_CMD_MAILBOX:
+            cmd_mailbox(data, data + data_len);
+            break;
+        case BDBP_CMD_ANALYZER:
+            cmd_analyzer(data, data + data_len);
+            break;
+        default:
+            serial_write_u8(BDBP_STATUS_UNKNOWN_CMD);
+            serial_write_u8(0);
+            break;
+    }
+
+    // Commands past the table are counted together with unknown ones, see BDBP_CMD_STATS.
+    perf_record(&perf.cmds[cmd < BDBP_STATS_CMDS ? cmd : 0], clock_ticks() - start);
+}
@@ -0,0 +1,14 @@
+#ifndef GLYCO_SRC_CMD_H
+#define GLYCO_SRC_CMD_H
+
+#include <stdint.h>
+
+// Handle a single BDBP request with header `cmd` and `data_len` bytes of data, and write
+// the response to serial. The handlers only touch the hardware through bus.h, flash.h
+// and serial.h, so that they can also be run on the host, see glyco/host.
+void cmd_dispatch(uint8_t cmd, uint8_t* data, uint8_t data_len);
+
+// Restore the settings that requests may change, such as the budget of BDBP_CMD_BUS.
+void cmd_reset(void);
+
+#endif
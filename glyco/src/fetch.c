@@ -0,0 +1,91 @@
+#include "fetch.h"
+#include "trace.h"
+#include "breakpoint.h"
+#include "bus.h"
+
+bool fetch_watching(void) {
+    return (trace_active() || breakpoint_count() > 0) && !bus_held();
+}
+
+#ifndef GLYCO_HOST
+
+#include "pinout.h"
+#include "serial.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Check M1 once, and handle the fetch if one started. While M1 is inactive, this is a skip over
+// a jump, which takes 2 cycles.
+#define FETCH_CHECK_M1() \
+    if ((PINOUT_M1_PIN & PINOUT_M1_MASK) == 0) \
+        goto fetch
+
+#define FETCH_CHECK_M1_8() \
+    FETCH_CHECK_M1(); FETCH_CHECK_M1(); FETCH_CHECK_M1(); FETCH_CHECK_M1(); \
+    FETCH_CHECK_M1(); FETCH_CHECK_M1(); FETCH_CHECK_M1(); FETCH_CHECK_M1()
+
+// Opcode fetches may be just 4 Z80 cycles apart, and the address is only on the bus for the
+// first two of them, which is about 5 cycles of the coprocessor. Instead of following that,
+// BUSREQ is asserted as soon as a fetch is seen, so that the Z80 stops at the end of the fetch,
+// and the fetch is handled while it waits. The Z80 is released right before checking M1 again.
+void fetch_poll(void) {
+    GPIOR0 &= ~(1 << SERIAL_RX_FLAG_BIT);
+    if (serial_avail() != 0)
+        goto done;
+
+    // Interrupts are only let through while the Z80 is stopped, so that they never make the
+    // loop miss a fetch.
+    cli();
+    while (true) {
+        // The next fetch begins at most 19 Z80 cycles after the Z80 is released, plus wait
+        // states, which is well within the first 48 checks, so that it is only the end of the
+        // loop that can miss one. That only runs when the Z80 is stuck, such as in reset.
+        FETCH_CHECK_M1_8();
+        FETCH_CHECK_M1_8();
+        FETCH_CHECK_M1_8();
+        FETCH_CHECK_M1_8();
+        FETCH_CHECK_M1_8();
+        FETCH_CHECK_M1_8();
+        sei();
+        __asm__ volatile ("nop");
+        cli();
+        if ((GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) != 0)
+            break;
+        continue;
+
+    fetch:;
+        uint8_t a = PINOUT_ADDR_A_PIN;
+        uint8_t b = PINOUT_ADDR_B_PIN;
+        uint8_t c = PINOUT_ADDR_C_PIN;
+        PINOUT_BUSREQ_PORT |= PINOUT_BUSREQ_MASK;
+
+        // An interrupt acknowledge is a fetch that asserts IOREQ after the address, which is
+        // before the Z80 lets go of the bus.
+        bool interrupt = false;
+        sei();
+        while ((PINOUT_BUSACK_PIN & PINOUT_BUSACK_MASK) != 0 && (GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) == 0) {
+            if ((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) == 0)
+                interrupt = true;
+        }
+        cli();
+
+        gly_addr_t address = pinout_decode_addr(a, b, c);
+        if (trace_active())
+            trace_record(address, interrupt);
+        if (!interrupt && breakpoint_check(address))
+            break;
+
+        PINOUT_BUSREQ_PORT &= ~PINOUT_BUSREQ_MASK;
+        if (!fetch_watching() || (GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) != 0)
+            break;
+    }
+    sei();
+
+done:
+    // The Z80 runs untraced while the request is handled, unless it stopped at a breakpoint.
+    if (!bus_held())
+        trace_mark_gap();
+}
+
+#endif
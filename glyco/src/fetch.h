@@ -0,0 +1,22 @@
+#ifndef GLYCO_SRC_FETCH_H
+#define GLYCO_SRC_FETCH_H
+
+#include <stdbool.h>
+
+// Following the Z80's opcode fetches one by one, for the trace and for breakpoints. The
+// coprocessor is too slow to watch every fetch of a running Z80, so it stops the Z80 for a
+// moment after each fetch instead, which slows it down several times.
+
+// Return whether the main loop should follow fetches with `fetch_poll`, because the trace is
+// active or breakpoints are set, and the Z80 is not stopped.
+bool fetch_watching(void);
+
+#ifndef GLYCO_HOST
+
+// Follow the Z80's opcode fetches until there is nothing to watch anymore, the Z80 stopped at a
+// breakpoint, or a byte arrives over serial. Requires `fetch_watching`.
+void fetch_poll(void);
+
+#endif
+
+#endif
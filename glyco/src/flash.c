@@ -1,7 +1,8 @@
 #include "flash.h"
-#include "pinout.h"
 #include "bus.h"
 #include "timing.h"
+#include "clock.h"
+#include "perf.h"
 
 #include "common/glycon.h"
 
@@ -22,6 +23,24 @@ static void flash_begin_cmd(void) {
     bus_set_mode(BUS_MODE_WRITE_MEM);
 }
 
+// Wait until the program or erase operation that was just started completes, but for no longer
+// than `max_us`, after which the datasheet guarantees that it is done. While the operation
+// runs, DQ7 of `address` reads as the complement of bit 7 of `data`, which is the byte being
+// programmed or 0xFF for erases (Data# polling). Returns the number of ticks that it took.
+static uint32_t flash_wait_done(gly_addr_t address, uint8_t data, uint32_t max_us) {
+    uint32_t start = clock_ticks();
+    uint32_t max_ticks = max_us * CLOCK_TICKS_PER_US;
+    uint32_t elapsed;
+    bus_set_mode(BUS_MODE_READ_MEM);
+    do {
+        uint8_t status = bus_read(address);
+        elapsed = clock_ticks() - start;
+        if (((status ^ data) & 0x80) == 0)
+            break;
+    } while (elapsed < max_ticks);
+    return elapsed;
+}
+
 void flash_byte_program(gly_addr_t address, uint8_t data) {
     if (!glycon_is_flash_addr(address)) // Don't attempt to write to RAM.
         return;
@@ -30,7 +49,7 @@ void flash_byte_program(gly_addr_t address, uint8_t data) {
     flash_cmd(0x2AAA, 0x55);
     flash_cmd(0x5555, 0xA0);
     flash_cmd(address, data);
-    timing_flash_write_delay();
+    perf_record(&perf.flash_program, flash_wait_done(address, data, TIMING_FLASH_WRITE_DELAY_US));
 }
 
 static void flash_enter_software_id_mode(void) {
@@ -65,7 +84,7 @@ void flash_erase_sector(gly_addr_t sector_address) {
     flash_cmd(0x5555, 0xAA);
     flash_cmd(0x2AAA, 0x55);
     flash_cmd(sector_address, 0x30);
-    timing_flash_erase_sector_delay();
+    perf_record(&perf.flash_erase, flash_wait_done(sector_address, 0xFF, TIMING_FLASH_ERASE_SECTOR_MS * 1000UL));
 }
 
 void flash_erase_chip() {
@@ -76,5 +95,5 @@ void flash_erase_chip() {
     flash_cmd(0x5555, 0xAA);
     flash_cmd(0x2AAA, 0x55);
     flash_cmd(0x5555, 0x10);
-    timing_flash_erase_chip_delay();
+    perf_record(&perf.flash_erase, flash_wait_done(0, 0xFF, TIMING_FLASH_ERASE_CHIP_MS * 1000UL));
 }
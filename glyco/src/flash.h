@@ -16,7 +16,7 @@ void flash_byte_program(gly_addr_t address, uint8_t data);
 void flash_get_software_id(uint8_t* mfg, uint8_t* dev);
 
 // Erase a particular flash sector, setting each byte in the target sector to 0xFF.
-// Flash sectors are 0x4000 (16K) bytes in size. The sector in which `sector_address` lies
+// Flash sectors are 0x1000 (4K) bytes in size. The sector in which `sector_address` lies
 // is erased. Erasing a sector takes about 20ms.
 // Requires bus acquired, see bus.h
 void flash_erase_sector(gly_addr_t sector_address);
@@ -0,0 +1,112 @@
+#include "mailbox.h"
+#include "bus.h"
+#include "clock.h"
+#include "perf.h"
+#include "serial.h"
+
+#include "common/binary_debug_protocol.h"
+
+static bool mailbox_is_open;
+static gly_addr_t mailbox_base;
+
+void mailbox_open(gly_addr_t address) {
+    mailbox_base = address;
+    mailbox_is_open = true;
+}
+
+void mailbox_close(void) {
+    mailbox_is_open = false;
+}
+
+bool mailbox_active(void) {
+    return mailbox_is_open;
+}
+
+gly_addr_t mailbox_address(void) {
+    return mailbox_base;
+}
+
+// Read the byte at `offset` in the mailbox, see GLYCON_MAILBOX_TX_RING. Requires that the bus is
+// in BUS_MODE_READ_MEM.
+static uint8_t mailbox_read(uint16_t offset) {
+    return bus_read(mailbox_base + offset);
+}
+
+// Write the byte at `offset` in the mailbox. Requires that the bus is in BUS_MODE_WRITE_MEM.
+static void mailbox_write(uint16_t offset, uint8_t value) {
+    bus_write(mailbox_base + offset, value);
+    bus_pulse_ram_write();
+}
+
+uint8_t mailbox_send(const uint8_t* data, uint8_t len) {
+    bus_set_mode(BUS_MODE_READ_MEM);
+    uint8_t head = mailbox_read(GLYCON_MAILBOX_RX_HEAD) & GLYCON_MAILBOX_RING_MASK;
+    uint8_t tail = mailbox_read(GLYCON_MAILBOX_RX_TAIL) & GLYCON_MAILBOX_RING_MASK;
+    uint8_t space = (tail - head - 1) & GLYCON_MAILBOX_RING_MASK;
+    if (len > space)
+        len = space;
+    if (len == 0)
+        return 0;
+
+    // The bytes must be in place before the Z80 sees the new head.
+    bus_set_mode(BUS_MODE_WRITE_MEM);
+    for (uint8_t i = 0; i < len; ++i) {
+        mailbox_write(GLYCON_MAILBOX_RX_RING + head, data[i]);
+        head = (head + 1) & GLYCON_MAILBOX_RING_MASK;
+    }
+    mailbox_write(GLYCON_MAILBOX_RX_HEAD, head);
+    return len;
+}
+
+bool mailbox_forward(void) {
+    uint32_t start = clock_ticks();
+    if (bus_acquire() != BUS_ACQUIRE_SUCCESS)
+        return false;
+    uint32_t acquired_at = clock_ticks();
+    perf_record(&perf.bus_acquire, acquired_at - start);
+
+    // The bytes are sent once the Z80 runs again, since the serial link is much slower than the
+    // bus.
+    uint8_t buf[GLYCON_MAILBOX_RING_SIZE];
+    uint8_t len = 0;
+    bus_set_mode(BUS_MODE_READ_MEM);
+    uint8_t head = mailbox_read(GLYCON_MAILBOX_TX_HEAD) & GLYCON_MAILBOX_RING_MASK;
+    uint8_t tail = mailbox_read(GLYCON_MAILBOX_TX_TAIL) & GLYCON_MAILBOX_RING_MASK;
+    while (tail != head) {
+        buf[len++] = mailbox_read(GLYCON_MAILBOX_TX_RING + tail);
+        tail = (tail + 1) & GLYCON_MAILBOX_RING_MASK;
+    }
+    if (len > 0) {
+        bus_set_mode(BUS_MODE_WRITE_MEM);
+        mailbox_write(GLYCON_MAILBOX_TX_TAIL, tail);
+    }
+    bus_release();
+    perf_record(&perf.bus_hold, clock_ticks() - acquired_at);
+
+    if (len == 0)
+        return false;
+
+    serial_write_u8(BDBP_STATUS_EVENT);
+    serial_write_u8(1 + len);
+    serial_write_u8(BDBP_EVENT_MAILBOX);
+    for (uint8_t i = 0; i < len; ++i)
+        serial_write_u8(buf[i]);
+    return true;
+}
+
+#ifndef GLYCO_HOST
+
+// When the mailbox was last found empty. This carries over between requests, so that handling
+// them doesn't make the mailbox polled more often.
+static uint32_t mailbox_polled_at;
+
+void mailbox_poll(void) {
+    while (serial_avail() == 0) {
+        if (clock_ticks() - mailbox_polled_at < MAILBOX_POLL_INTERVAL_US * CLOCK_TICKS_PER_US)
+            continue;
+        if (!mailbox_forward())
+            mailbox_polled_at = clock_ticks();
+    }
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef GLYCO_SRC_MAILBOX_H
+#define GLYCO_SRC_MAILBOX_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The mailbox through which Z80 code exchanges bytes with the host, see BDBP_CMD_MAILBOX and
+// GLYCON_MAILBOX_TX_RING. While it is open, the main loop waits for requests with
+// `mailbox_poll`, which forwards the bytes that the Z80 wrote. When the firmware is built for
+// the host with GLYCO_HOST, there is no main loop, and the mailbox is polled with
+// `mailbox_forward` instead.
+
+// How often the mailbox is checked while it is quiet. Every check holds the Z80 off the bus for
+// a few microseconds.
+#define MAILBOX_POLL_INTERVAL_US (1000)
+
+// Start polling the mailbox at `address`.
+void mailbox_open(gly_addr_t address);
+
+// Stop polling the mailbox.
+void mailbox_close(void);
+
+// Return whether the mailbox is open.
+bool mailbox_active(void);
+
+// Return the address of the mailbox.
+gly_addr_t mailbox_address(void);
+
+// Write as many of the `len` bytes at `data` to the ring for the Z80 as fit. Returns the
+// number of bytes written. Requires that the mailbox is open and the bus is acquired.
+uint8_t mailbox_send(const uint8_t* data, uint8_t len);
+
+// Check the mailbox once, and send the bytes that the Z80 wrote to the host with a
+// BDBP_EVENT_MAILBOX event. Acquires the bus for a moment. Returns whether there were any.
+// Requires that the mailbox is open.
+bool mailbox_forward(void);
+
+#ifndef GLYCO_HOST
+
+// Poll the mailbox every MAILBOX_POLL_INTERVAL_US until a byte arrives over serial, and right
+// away again as long as the Z80 keeps writing. Requires that the mailbox is open.
+void mailbox_poll(void);
+
+#endif
+
+#endif
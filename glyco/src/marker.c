@@ -0,0 +1,147 @@
+#include "marker.h"
+
+// The log is a ring buffer, so that markers can be fetched while recording continues.
+static struct marker marker_log[MARKER_LOG_SIZE];
+static uint8_t marker_read;
+static uint8_t marker_len;
+static uint16_t marker_lost;
+static bool marker_active;
+
+#ifndef GLYCO_HOST
+
+#include "pinout.h"
+#include "serial.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// The upper half of the cycle counter, which advances whenever timer 3 overflows.
+static volatile uint16_t marker_cycles_high;
+
+static void marker_timer_start(void) {
+    // Normal mode, counting every CPU cycle and interrupting on overflow.
+    TCCR3A = 0;
+    TCCR3B = 1 << CS30;
+    TCNT3 = 0;
+    TIFR3 = 1 << TOV3;
+    TIMSK3 = 1 << TOIE3;
+    marker_cycles_high = 0;
+}
+
+static void marker_timer_stop(void) {
+    TCCR3B = 0;
+    TIMSK3 = 0;
+}
+
+// Return the cycle counter. See `clock_ticks`, which extends timer 1 the same way.
+static uint32_t marker_cycles(void) {
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t low = TCNT3;
+    uint16_t high = marker_cycles_high;
+    if ((TIFR3 & (1 << TOV3)) != 0 && low < 0x8000)
+        ++high;
+    SREG = sreg;
+    return (uint32_t) high << 16 | low;
+}
+
+// Check IOREQ once, and handle the I/O request if it is active. While IOREQ is inactive, this
+// is a skip over a jump, which takes 2 cycles.
+#define MARKER_CHECK_IOREQ() \
+    if ((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) == 0) \
+        goto io_request
+
+void marker_poll(void) {
+    GPIOR0 &= ~(1 << SERIAL_RX_FLAG_BIT);
+    if (serial_avail() != 0)
+        return;
+
+    while (true) {
+        // IOREQ is active for about 2.5 Z80 cycles of an I/O cycle, which is 6.5 cycles of the
+        // coprocessor, and the address stays valid for half a Z80 cycle after that. The checks
+        // are unrolled so that the loop itself, including looking for requests from the host,
+        // only delays every eighth check.
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        MARKER_CHECK_IOREQ();
+        if ((GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) != 0)
+            return;
+        continue;
+
+    io_request:;
+        uint8_t a = PINOUT_ADDR_A_PIN;
+        uint8_t b = PINOUT_ADDR_B_PIN;
+        // An interrupt acknowledge asserts IOREQ together with M1.
+        bool m1 = (PINOUT_M1_PIN & PINOUT_M1_MASK) == 0;
+        uint32_t cycles = marker_cycles();
+
+        // Wait for the end of the I/O cycle, so that it is only seen once.
+        while ((PINOUT_IOREQ_PIN & PINOUT_IOREQ_MASK) == 0 && (GPIOR0 & (1 << SERIAL_RX_FLAG_BIT)) == 0)
+            continue;
+
+        uint16_t addr = pinout_decode_z80_addr(a, b);
+        if (!m1 && (addr & 0xFF) == GLYCON_MARKER_PORT)
+            marker_record(addr >> 8, cycles);
+    }
+}
+
+ISR(TIMER3_OVF_vect) {
+    ++marker_cycles_high;
+}
+
+#else
+
+static void marker_timer_start(void) {}
+
+static void marker_timer_stop(void) {}
+
+#endif
+
+void marker_start(void) {
+    marker_read = 0;
+    marker_len = 0;
+    marker_lost = 0;
+    marker_active = true;
+    marker_timer_start();
+}
+
+void marker_stop(void) {
+    marker_active = false;
+    marker_timer_stop();
+}
+
+bool marker_recording(void) {
+    return marker_active;
+}
+
+uint16_t marker_dropped(void) {
+    return marker_lost;
+}
+
+uint8_t marker_take(struct marker* out, uint8_t cap) {
+    uint8_t n = marker_len < cap ? marker_len : cap;
+    for (uint8_t i = 0; i < n; ++i) {
+        out[i] = marker_log[marker_read];
+        marker_read = (marker_read + 1) % MARKER_LOG_SIZE;
+    }
+    marker_len -= n;
+    return n;
+}
+
+void marker_record(uint8_t id, uint32_t cycles) {
+    if (marker_len == MARKER_LOG_SIZE) {
+        if (marker_lost != UINT16_MAX)
+            ++marker_lost;
+        return;
+    }
+
+    struct marker* m = &marker_log[(marker_read + marker_len) % MARKER_LOG_SIZE];
+    m->id = id;
+    m->cycles = cycles;
+    ++marker_len;
+}
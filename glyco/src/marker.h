@@ -0,0 +1,49 @@
+#ifndef GLYCO_SRC_MARKER_H
+#define GLYCO_SRC_MARKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Benchmark markers, see BDBP_CMD_MARKERS. While recording, the main loop watches the bus with
+// `marker_poll` instead of sleeping, and logs every read from GLYCON_MARKER_PORT together with
+// the value of a cycle counter driven by timer 3. When the firmware is built for the host with
+// GLYCO_HOST, there is no bus to watch, and markers are added with `marker_record` instead.
+
+// The number of markers that the log holds.
+#define MARKER_LOG_SIZE (128)
+
+struct marker {
+    // The upper byte of the port address.
+    uint8_t id;
+    // The cycle counter when the marker was seen.
+    uint32_t cycles;
+};
+
+// Clear the log and start recording.
+void marker_start(void);
+
+// Stop recording. The log is kept until it is fetched.
+void marker_stop(void);
+
+// Return whether markers are being recorded.
+bool marker_recording(void);
+
+// Return the number of markers that were lost because the log was full since recording started.
+uint16_t marker_dropped(void);
+
+// Move at most `cap` of the oldest markers in the log to `out`. Returns the number of markers
+// moved.
+uint8_t marker_take(struct marker* out, uint8_t cap);
+
+// Append a marker to the log, or count it as dropped if the log is full.
+void marker_record(uint8_t id, uint32_t cycles);
+
+#ifndef GLYCO_HOST
+
+// Watch the bus for markers until a byte arrives over serial. Requires that markers are being
+// recorded.
+void marker_poll(void);
+
+#endif
+
+#endif
@@ -0,0 +1,9 @@
+#include "perf.h"
+
+#include <string.h>
+
+struct perf perf;
+
+void perf_reset(void) {
+    memset(&perf, 0, sizeof perf);
+}
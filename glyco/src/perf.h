@@ -0,0 +1,43 @@
+#ifndef GLYCO_SRC_PERF_H
+#define GLYCO_SRC_PERF_H
+
+#include "common/binary_debug_protocol.h"
+
+#include <stdint.h>
+
+// Performance counters of the firmware, reported through BDBP_CMD_STATS. All durations are in
+// ticks of `clock_ticks`.
+
+// A kind of operation whose duration is counted.
+struct perf_duration {
+    uint32_t count;
+    uint32_t ticks;
+    uint32_t max_ticks;
+};
+
+struct perf {
+    // Waiting for the Z80 to grant the bus, for every time it was acquired.
+    struct perf_duration bus_acquire;
+    // From acquiring the bus until it was released again.
+    struct perf_duration bus_hold;
+    // The time the flash chip took to program a single byte, and to erase a sector or the chip.
+    struct perf_duration flash_program;
+    struct perf_duration flash_erase;
+    // Handling a request, including sending its response, per command.
+    struct perf_duration cmds[BDBP_STATS_CMDS];
+};
+
+extern struct perf perf;
+
+// Count a single operation that took `ticks`.
+static inline void perf_record(struct perf_duration* duration, uint32_t ticks) {
+    ++duration->count;
+    duration->ticks += ticks;
+    if (ticks > duration->max_ticks)
+        duration->max_ticks = ticks;
+}
+
+// Clear all counters.
+void perf_reset(void);
+
+#endif
@@ -41,6 +41,7 @@
 
 #define PINOUT_IOREQ_DDR DDRG
 #define PINOUT_IOREQ_PORT PORTG
+#define PINOUT_IOREQ_PIN PING
 #define PINOUT_IOREQ_MASK (1 << PG0)
 
 #define PINOUT_MEM_OE_DDR DDRG
@@ -103,9 +104,9 @@ static inline uint8_t pinout_read_data(void) {
     return util_bit_reverse8(PINOUT_DATA_PIN);
 }
 
-// Write a value to the address bus.
-// Requires that the address bus DDR is set to output.
-static inline void pinout_write_addr(gly_addr_t addr) {
+// Encode an address into the values of the address pins of ports A, B and C. This is the
+// inverse of `pinout_decode_addr`.
+static inline void pinout_encode_addr(gly_addr_t addr, uint8_t* a_ptr, uint8_t* b_ptr, uint8_t* c_ptr) {
     uint8_t a = 0;
     a |= ((addr >>  0) & 0x7) << 0; // A0-2
     a |= ((addr >> 10) & 0x1) << 3; // A10
@@ -125,26 +126,62 @@ static inline void pinout_write_addr(gly_addr_t addr) {
     uint8_t c = 0;
     c |= (addr >> 14) & 0xF; // A14-17
 
+    *a_ptr = a;
+    *b_ptr = b;
+    *c_ptr = c;
+}
+
+// Write a value to the address bus.
+// Requires that the address bus DDR is set to output.
+static inline void pinout_write_addr(gly_addr_t addr) {
+    uint8_t a, b, c;
+    pinout_encode_addr(addr, &a, &b, &c);
     PINOUT_ADDR_A_PORT = a;
     PINOUT_ADDR_B_PORT = b;
     PINOUT_ADDR_C_PORT = c;
 }
 
+// Decode an address from the values of the address pins of ports A, B and C. See
+// `pinout_read_addr`.
+static inline gly_addr_t pinout_decode_addr(uint8_t a, uint8_t b, uint8_t c) {
+    gly_addr_t addr = 0;
+    addr |= ((a >> 0) & 0x7) <<  0; // A0-2
+    addr |= ((a >> 3) & 0x1) << 10; // A10
+    addr |= ((a >> 4) & 0x3) <<  3; // A3-4
+    addr |= ((a >> 6) & 0x1) << 11; // A11
+    addr |= ((a >> 7) & 0x1) <<  5; // A5
+
+    // addr |= ((b >> 6) & 0x3) << 14; // PG0-1
+    addr |= ((b >> 5) & 0x1) << 12; // A12
+    addr |= ((b >> 4) & 0x1) << 13; // A13
+    addr |= ((b >> 3) & 0x1) <<  7; // A7
+    addr |= ((b >> 2) & 0x1) <<  8; // A8
+    addr |= ((b >> 1) & 0x1) <<  6; // A6
+    addr |= ((b >> 0) & 0x1) <<  9; // A9
+
+    addr |= (gly_addr_t) (c & 0x0F) << 14;
+
+    return addr;
+}
+
 // Read a value from the address bus.
 // Requires that the address bus DDR is set to input.
 static inline gly_addr_t pinout_read_addr(void) {
-    uint8_t a = PINOUT_ADDR_A_PIN;
-    uint8_t b = PINOUT_ADDR_B_PIN;
-    uint8_t c = PINOUT_ADDR_C_PIN;
+    return pinout_decode_addr(PINOUT_ADDR_A_PIN, PINOUT_ADDR_B_PIN, PINOUT_ADDR_C_PIN);
+}
 
-    gly_addr_t addr = 0;
+// Decode the address that the Z80 puts on the bus from the values of the address pins of ports
+// A and B, read while the Z80 owns the bus. Unlike `pinout_read_addr`, this is the Z80's own
+// 16-bit address: A14 and A15 come from the page select lines rather than from the page.
+static inline uint16_t pinout_decode_z80_addr(uint8_t a, uint8_t b) {
+    uint16_t addr = 0;
     addr |= ((a >> 0) & 0x7) <<  0; // A0-2
     addr |= ((a >> 3) & 0x1) << 10; // A10
     addr |= ((a >> 4) & 0x3) <<  3; // A3-4
     addr |= ((a >> 6) & 0x1) << 11; // A11
     addr |= ((a >> 7) & 0x1) <<  5; // A5
 
-    // addr |= ((b >> 6) & 0x3) << 14; // PG0-1
+    addr |= ((b >> 6) & 0x3) << 14; // PG0-1
     addr |= ((b >> 5) & 0x1) << 12; // A12
     addr |= ((b >> 4) & 0x1) << 13; // A13
     addr |= ((b >> 3) & 0x1) <<  7; // A7
@@ -152,8 +189,6 @@ static inline gly_addr_t pinout_read_addr(void) {
     addr |= ((b >> 1) & 0x1) <<  6; // A6
     addr |= ((b >> 0) & 0x1) <<  9; // A9
 
-    addr |= (c & 0x0F) << 14;
-
     return addr;
 }
 
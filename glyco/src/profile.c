@@ -0,0 +1,178 @@
+#include "profile.h"
+
+// The buffer is a ring that is filled by the timer interrupt and drained by requests. With
+// 8-bit indices, one slot stays unused to tell a full ring from an empty one.
+static uint8_t profile_buffer[PROFILE_BUFFER_SIZE + 1][3];
+static volatile uint8_t profile_read;
+static volatile uint8_t profile_write;
+static volatile uint16_t profile_dropped;
+static volatile uint16_t profile_missed;
+static bool profile_active;
+
+#ifndef GLYCO_HOST
+
+#include "pinout.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// Timer 4 counts at clk/8.
+#define PROFILE_TICKS_PER_US (F_CPU / 1000000UL / 8)
+
+// The number of loop iterations that the interrupt waits for an opcode fetch to end or to
+// begin. A fetch comes at least every 23 Z80 cycles, about 4 us, so this gives up after about
+// 20 us, and the Z80 is assumed to be stopped.
+#define PROFILE_WAIT_LIMIT (24)
+
+// The mean number of timer ticks between samples.
+static uint16_t profile_period_ticks;
+static uint16_t profile_rng = 1;
+
+// Set the time until the next sample to the period plus or minus an eighth, at random.
+static void profile_next_period(void) {
+    // xorshift16
+    profile_rng ^= profile_rng << 7;
+    profile_rng ^= profile_rng >> 9;
+    profile_rng ^= profile_rng << 8;
+
+    uint16_t spread = profile_period_ticks / 4;
+    uint16_t offset = spread ? profile_rng % spread : 0;
+    OCR4A = profile_period_ticks - spread / 2 + offset - 1;
+}
+
+static void profile_timer_start(uint16_t period_us) {
+    profile_period_ticks = period_us * PROFILE_TICKS_PER_US;
+    // Clear timer on compare match, counting at clk/8.
+    TCCR4A = 0;
+    TCCR4B = 0;
+    TCNT4 = 0;
+    profile_next_period();
+    TIFR4 = 1 << OCF4A;
+    TIMSK4 = 1 << OCIE4A;
+    TCCR4B = (1 << WGM42) | (1 << CS41);
+}
+
+static void profile_timer_stop(void) {
+    TCCR4B = 0;
+    TIMSK4 = 0;
+}
+
+static uint8_t profile_lock(void) {
+    uint8_t sreg = SREG;
+    cli();
+    return sreg;
+}
+
+static void profile_unlock(uint8_t sreg) {
+    SREG = sreg;
+}
+
+// Check M1 once, and take the sample if an opcode fetch started. While M1 is inactive, this is a
+// skip over a jump, which takes 2 cycles.
+#define PROFILE_CHECK_M1() \
+    if ((PINOUT_M1_PIN & PINOUT_M1_MASK) == 0) \
+        goto fetch
+
+// The address is valid for the first two Z80 cycles of a fetch while M1 is active, which is
+// about 5 cycles of the coprocessor; after that the bus carries the refresh address. The address
+// pins are latched in the same instruction sequence that sees M1, with interrupts disabled so
+// that none can come in between, and decoded afterwards. Interrupts are let through between
+// rounds of checks, so that waiting for the Z80 never delays receiving from the host for long.
+ISR(TIMER4_COMPA_vect, ISR_NOBLOCK) {
+    profile_next_period();
+
+    // Let a fetch that is in progress end first, as it may be too late to catch its address.
+    uint8_t n = 0;
+    while ((PINOUT_M1_PIN & PINOUT_M1_MASK) == 0) {
+        if (++n == PROFILE_WAIT_LIMIT)
+            goto missed;
+    }
+
+    for (n = 0; n < PROFILE_WAIT_LIMIT; ++n) {
+        cli();
+        PROFILE_CHECK_M1();
+        PROFILE_CHECK_M1();
+        PROFILE_CHECK_M1();
+        PROFILE_CHECK_M1();
+        sei();
+        __asm__ volatile ("nop");
+    }
+
+missed:
+    if (profile_missed != UINT16_MAX)
+        ++profile_missed;
+    return;
+
+fetch:;
+    uint8_t a = PINOUT_ADDR_A_PIN;
+    uint8_t b = PINOUT_ADDR_B_PIN;
+    uint8_t c = PINOUT_ADDR_C_PIN;
+    sei();
+    profile_record(pinout_decode_addr(a, b, c));
+}
+
+#else
+
+static void profile_timer_start(uint16_t period_us) {}
+
+static void profile_timer_stop(void) {}
+
+static uint8_t profile_lock(void) {
+    return 0;
+}
+
+static void profile_unlock(uint8_t sreg) {}
+
+#endif
+
+void profile_start(uint16_t period_us) {
+    profile_timer_stop();
+    profile_read = 0;
+    profile_write = 0;
+    profile_dropped = 0;
+    profile_missed = 0;
+    profile_active = true;
+    profile_timer_start(period_us);
+}
+
+void profile_stop(void) {
+    profile_active = false;
+    profile_timer_stop();
+}
+
+bool profile_running(void) {
+    return profile_active;
+}
+
+void profile_counters(uint16_t* dropped, uint16_t* missed) {
+    uint8_t sreg = profile_lock();
+    *dropped = profile_dropped;
+    *missed = profile_missed;
+    profile_unlock(sreg);
+}
+
+uint8_t profile_take(gly_addr_t* out, uint8_t cap) {
+    uint8_t read = profile_read;
+    uint8_t n = 0;
+    while (n < cap && read != profile_write) {
+        const uint8_t* sample = profile_buffer[read++];
+        out[n++] = (gly_addr_t) sample[2] << 16 | (gly_addr_t) sample[1] << 8 | sample[0];
+    }
+    profile_read = read;
+    return n;
+}
+
+void profile_record(gly_addr_t address) {
+    uint8_t write = profile_write;
+    if ((uint8_t) (write + 1) == profile_read) {
+        if (profile_dropped != UINT16_MAX)
+            ++profile_dropped;
+        return;
+    }
+
+    uint8_t* sample = profile_buffer[write];
+    sample[0] = address & 0xFF;
+    sample[1] = (address >> 8) & 0xFF;
+    sample[2] = address >> 16;
+    profile_write = write + 1;
+}
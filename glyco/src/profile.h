@@ -0,0 +1,39 @@
+#ifndef GLYCO_SRC_PROFILE_H
+#define GLYCO_SRC_PROFILE_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A sampling profiler, see BDBP_CMD_PROFILE. While sampling, timer 4 interrupts at jittered
+// intervals, and the interrupt waits for the Z80's next opcode fetch and buffers the address on
+// the bus. When the firmware is built for the host with GLYCO_HOST, there is no bus to watch,
+// and samples are added with `profile_record` instead.
+
+// The number of samples that the buffer holds.
+#define PROFILE_BUFFER_SIZE (255)
+
+// Clear the buffer and the counters, and start taking a sample every `period_us` on average.
+// The period must lie within the range given by BDBP_PROFILE_MIN_PERIOD_US and
+// BDBP_PROFILE_MAX_PERIOD_US.
+void profile_start(uint16_t period_us);
+
+// Stop sampling. The buffer is kept until it is fetched.
+void profile_stop(void);
+
+// Return whether samples are being taken.
+bool profile_running(void);
+
+// Return the number of samples that were lost because the buffer was full, and the number of
+// times that the Z80 did not fetch an instruction in time, since sampling started.
+void profile_counters(uint16_t* dropped, uint16_t* missed);
+
+// Move at most `cap` of the oldest samples in the buffer to `out`. Returns the number of samples
+// moved.
+uint8_t profile_take(gly_addr_t* out, uint8_t cap);
+
+// Append a sample to the buffer, or count it as dropped if the buffer is full.
+void profile_record(gly_addr_t address);
+
+#endif
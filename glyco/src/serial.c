@@ -5,10 +5,7 @@
 #include <avr/sleep.h>
 #include <util/setbaud.h>
 
-// The amount of bytes that can be received at once.
-// Note: must be a power of 2.
-// Note: must be half range of index type (u16).
-#define SERIAL_BUFFER_SIZE 512
+#define SERIAL_BUFFER_SIZE SERIAL_RX_BUFFER_SIZE
 #define SERIAL_BUFFER_MASK (SERIAL_BUFFER_SIZE - 1)
 
 struct ring_buffer {
@@ -26,6 +23,10 @@ struct ring_buffer {
 
 volatile struct ring_buffer rx_buffer;
 
+// See `serial_rx_stats`. Updated by the receive interrupt.
+static volatile uint16_t rx_high_water;
+static volatile uint32_t rx_dropped;
+
 void serial_init() {
     // Set baud rate.
     UBRR0H = UBRRH_VALUE;
@@ -46,6 +47,8 @@ void serial_init() {
 
     // Clear receive buffers.
     rx_buffer.read = rx_buffer.write = 0;
+    rx_high_water = 0;
+    rx_dropped = 0;
 }
 
 uint16_t serial_avail() {
@@ -85,16 +88,43 @@ uint8_t serial_poll_u8() {
     return ring_buffer_read(&rx_buffer);
 }
 
+void serial_rx_stats(uint16_t* high_water, uint32_t* dropped, bool reset) {
+    cli();
+    *high_water = rx_high_water;
+    *dropped = rx_dropped;
+    if (reset) {
+        rx_high_water = 0;
+        rx_dropped = 0;
+    }
+    sei();
+}
+
 void serial_write_u8(uint8_t value) {
     loop_until_bit_is_set(UCSR0A, UDRE0);
     UDR0 = value;
 }
 
+void serial_write_u16(uint16_t value) {
+    serial_write_u8(value & 0xFF);
+    serial_write_u8(value >> 8);
+}
+
+void serial_write_u32(uint32_t value) {
+    serial_write_u16(value & 0xFFFF);
+    serial_write_u16(value >> 16);
+}
+
 ISR(USART0_RX_vect) {
     uint8_t data = UDR0;
+    GPIOR0 |= 1 << SERIAL_RX_FLAG_BIT;
 
     // If full, skip
     if (!ring_buffer_is_full(&rx_buffer)) {
         ring_buffer_write(&rx_buffer, data);
+        uint16_t size = ring_buffer_size(&rx_buffer);
+        if (size > rx_high_water)
+            rx_high_water = size;
+    } else {
+        ++rx_dropped;
     }
 }
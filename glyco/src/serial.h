@@ -4,6 +4,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// The amount of bytes that can be received at once.
+// Note: must be a power of 2.
+// Note: must be half range of index type (u16).
+#define SERIAL_RX_BUFFER_SIZE 512
+
+// The amount of bytes that can be queued for transmission at once.
+// Transmission is currently unbuffered.
+#define SERIAL_TX_BUFFER_SIZE 0
+
+// The receive interrupt sets this bit of GPIOR0 whenever a byte arrives, so that tight polling
+// loops can notice requests with a single instruction. It is only ever cleared by such loops.
+#define SERIAL_RX_FLAG_BIT 0
+
 // Initialize the serial hardware.
 void serial_init();
 
@@ -26,7 +39,18 @@ int serial_read_u8();
 // Block until the next byte is available.
 uint8_t serial_poll_u8();
 
+// Return the largest number of bytes that were waiting in the receive buffer at once, and the
+// number of received bytes that were dropped because the buffer was full. If `reset` is set,
+// both are cleared afterwards.
+void serial_rx_stats(uint16_t* high_water, uint32_t* dropped, bool reset);
+
 // Write one byte to serial. Blocks until the byte is written.
 void serial_write_u8(uint8_t value);
 
+// Write a 16-bit value to serial in little endian. Blocks until the value is written.
+void serial_write_u16(uint16_t value);
+
+// Write a 32-bit value to serial in little endian. Blocks until the value is written.
+void serial_write_u32(uint32_t value);
+
 #endif
@@ -1,13 +1,16 @@
 #ifndef GLYCO_SRC_TIMING_H
 #define GLYCO_SRC_TIMING_H
 
-#include <util/delay.h>
+#include <stdint.h>
 
 // General delay to wait between when a pin is written and when the result has propagated.
 // Delay value was found by experimentation - the minimum delay which
 // produced correct results was about 500ns, double that for safety.
 #define TIMING_PIN_DELAY_US (1)
 
+// Flash operations usually finish before the maximum delays below, which the firmware detects
+// by polling the flash chip, see flash.c.
+
 // Maximim flash write delay (from spec).
 #define TIMING_FLASH_WRITE_DELAY_US (20)
 
@@ -17,16 +20,28 @@
 // Maximum flash chip erase delay (from spec).
 #define TIMING_FLASH_ERASE_CHIP_MS (100)
 
+#ifdef GLYCO_HOST
+
+// On the host, delays don't wait but advance the simulated clock, see glyco/host/hal.h.
+void host_delay_us(uint32_t us);
+
+#define timing_delay() host_delay_us(TIMING_PIN_DELAY_US)
+
+#define timing_delay_us(us) host_delay_us(us)
+
+#else
+
+#include <util/delay.h>
+
 // Wait TIMING_PIN_DELAY_US.
 #define timing_delay() _delay_us(TIMING_PIN_DELAY_US)
 
-// Wait TIMING_FLASH_WRITE_DELAY_US.
-#define timing_flash_write_delay() _delay_us(TIMING_FLASH_WRITE_DELAY_US)
+// Wait at least `us` microseconds, which need not be a constant.
+static inline void timing_delay_us(uint16_t us) {
+    while (us-- > 0)
+        _delay_us(1);
+}
 
-// Wait TIMING_FLASH_ERASE_SECTOR_MS.
-#define timing_flash_erase_sector_delay() _delay_ms(TIMING_FLASH_ERASE_SECTOR_MS)
-
-// Wait TIMING_FLASH_ERASE_CHIP_MS.
-#define timing_flash_erase_chip_delay() _delay_ms(TIMING_FLASH_ERASE_CHIP_MS)
+#endif
 
 #endif
@@ -0,0 +1,160 @@
+#include "trace.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <string.h>
+
+// The buffer is a ring of blocks. The newest block is filled from `trace_pos`, and when an entry
+// doesn't fit, the next block is started, overwriting the oldest one if the ring is full.
+static uint8_t trace_buffer[TRACE_BLOCK_COUNT][BDBP_TRACE_BLOCK_SIZE];
+static uint8_t trace_first;
+static uint8_t trace_len;
+static uint8_t trace_pos;
+static uint32_t trace_count;
+
+// The address of the last traced fetch, and whether the next address has to be stored in full
+// because the decoder can't know it, at the start of a block or after a gap.
+static gly_addr_t trace_last;
+static bool trace_sync;
+// Whether fetches were missed since the last entry.
+static bool trace_gap;
+
+static uint8_t trace_mode;
+static uint8_t trace_current;
+static gly_addr_t trace_start_address;
+static gly_addr_t trace_stop_address;
+
+static uint8_t* trace_newest(void) {
+    return trace_buffer[(trace_first + trace_len - 1) % TRACE_BLOCK_COUNT];
+}
+
+// Start a new block, dropping the oldest one if the ring is full. Returns `false` if the trace
+// stopped instead.
+static bool trace_next_block(void) {
+    if (trace_len == TRACE_BLOCK_COUNT) {
+        if (trace_mode & BDBP_TRACE_MODE_STOP_WHEN_FULL) {
+            trace_current = BDBP_TRACE_STATE_DONE;
+            return false;
+        }
+        trace_first = (trace_first + 1) % TRACE_BLOCK_COUNT;
+        --trace_len;
+    }
+
+    ++trace_len;
+    memset(trace_newest(), BDBP_TRACE_END, BDBP_TRACE_BLOCK_SIZE);
+    trace_pos = 0;
+    trace_sync = true;
+    return true;
+}
+
+static void trace_append_byte(uint8_t value) {
+    if (trace_pos == BDBP_TRACE_BLOCK_SIZE && !trace_next_block())
+        return;
+    trace_newest()[trace_pos++] = value;
+}
+
+static void trace_append_address(gly_addr_t address) {
+    int32_t delta = (int32_t) (address - trace_last);
+    uint8_t size = 3;
+    if (!trace_sync && delta >= -64 && delta < 64)
+        size = 1;
+    else if (!trace_sync && delta >= -8192 && delta < 8192)
+        size = 2;
+
+    if (trace_pos + size > BDBP_TRACE_BLOCK_SIZE) {
+        if (!trace_next_block())
+            return;
+        size = 3;
+    }
+
+    uint8_t* entry = &trace_newest()[trace_pos];
+    if (size == 1) {
+        entry[0] = BDBP_TRACE_DELTA | (delta & 0x7F);
+    } else if (size == 2) {
+        entry[0] = BDBP_TRACE_DELTA14 | ((delta >> 8) & 0x3F);
+        entry[1] = delta & 0xFF;
+    } else {
+        entry[0] = BDBP_TRACE_ABSOLUTE | ((address >> 16) & 0x03);
+        entry[1] = (address >> 8) & 0xFF;
+        entry[2] = address & 0xFF;
+    }
+
+    trace_pos += size;
+    trace_last = address;
+    trace_sync = false;
+    ++trace_count;
+}
+
+void trace_start(uint8_t mode, gly_addr_t start, gly_addr_t stop) {
+    trace_first = 0;
+    trace_len = 0;
+    trace_pos = BDBP_TRACE_BLOCK_SIZE;
+    trace_count = 0;
+    trace_gap = false;
+    trace_mode = mode;
+    trace_start_address = start;
+    trace_stop_address = stop;
+    trace_current = mode & BDBP_TRACE_MODE_START_TRIGGER ? BDBP_TRACE_STATE_ARMED : BDBP_TRACE_STATE_TRACING;
+}
+
+void trace_stop(void) {
+    if (trace_active())
+        trace_current = BDBP_TRACE_STATE_IDLE;
+}
+
+uint8_t trace_state(void) {
+    return trace_current;
+}
+
+bool trace_active(void) {
+    return trace_current == BDBP_TRACE_STATE_ARMED || trace_current == BDBP_TRACE_STATE_TRACING;
+}
+
+uint8_t trace_blocks(void) {
+    return trace_len;
+}
+
+uint32_t trace_fetches(void) {
+    return trace_count;
+}
+
+const uint8_t* trace_block(uint8_t index) {
+    return trace_buffer[(trace_first + index) % TRACE_BLOCK_COUNT];
+}
+
+void trace_mark_gap(void) {
+    if (trace_current == BDBP_TRACE_STATE_TRACING)
+        trace_gap = true;
+}
+
+void trace_record(gly_addr_t address, bool interrupt) {
+    if (trace_current == BDBP_TRACE_STATE_ARMED) {
+        if (interrupt || address != trace_start_address)
+            return;
+        trace_current = BDBP_TRACE_STATE_TRACING;
+    }
+
+    if (trace_gap) {
+        trace_gap = false;
+        trace_append_byte(BDBP_TRACE_GAP);
+        trace_sync = true;
+    }
+
+    if (interrupt) {
+        trace_append_byte(BDBP_TRACE_INTERRUPT);
+        return;
+    }
+
+    trace_append_address(address);
+    if ((trace_mode & BDBP_TRACE_MODE_STOP_TRIGGER) && address == trace_stop_address)
+        trace_current = BDBP_TRACE_STATE_DONE;
+}
+
+uint8_t* trace_lend_buffer(uint16_t* size) {
+    trace_first = 0;
+    trace_len = 0;
+    trace_count = 0;
+    trace_current = BDBP_TRACE_STATE_IDLE;
+    *size = sizeof(trace_buffer);
+    return &trace_buffer[0][0];
+}
@@ -0,0 +1,54 @@
+#ifndef GLYCO_SRC_TRACE_H
+#define GLYCO_SRC_TRACE_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// An instruction fetch trace, see BDBP_CMD_TRACE. While tracing, the main loop follows the Z80's
+// opcode fetches with `fetch_poll` instead of sleeping, which appends their addresses to a ring
+// of blocks, delta-encoded as described at BDBP_TRACE_DELTA. When the firmware is built for the
+// host with GLYCO_HOST, there is no bus to watch, and fetches are added with `trace_record`
+// instead.
+
+// The number of blocks of BDBP_TRACE_BLOCK_SIZE bytes in the ring. At a byte for most fetches,
+// this holds the last few thousand of them.
+#define TRACE_BLOCK_COUNT (64)
+
+// Clear the buffer and start tracing with the given BDBP_TRACE_MODE_* bits. `start` and `stop`
+// are the addresses of the triggers, and are only used if their mode bit is set.
+void trace_start(uint8_t mode, gly_addr_t start, gly_addr_t stop);
+
+// Stop tracing. The buffer is kept until the next start.
+void trace_stop(void);
+
+// Return the state of the trace, see `enum bdbp_trace_state`.
+uint8_t trace_state(void);
+
+// Return whether fetches are being watched, either for the start trigger or for the trace.
+bool trace_active(void);
+
+// Return the number of blocks in the buffer, including the one that is being filled.
+uint8_t trace_blocks(void);
+
+// Return the number of fetches that were traced since the start.
+uint32_t trace_fetches(void);
+
+// Return the block at `index`, counting from the oldest block. Requires that `index` is less
+// than `trace_blocks()`.
+const uint8_t* trace_block(uint8_t index);
+
+// Handle an opcode fetch from `address`, or an interrupt acknowledge if `interrupt` is set.
+// Requires that the trace is active.
+void trace_record(gly_addr_t address, bool interrupt);
+
+// Note that fetches are about to be missed, because the Z80 runs unwatched for a while.
+void trace_mark_gap(void);
+
+// Stop the trace and discard it, and hand its buffer to the logic analyzer, which shares it to
+// save RAM. Stores the size of the buffer in bytes in `size`. The buffer is the trace's again
+// after the next `trace_start`.
+uint8_t* trace_lend_buffer(uint16_t* size);
+
+#endif
@@ -13,11 +13,56 @@ const char* bdbp_status_to_string(enum bdbp_status status) {
             return "Bus acquisition timed out";
         case BDBP_STATUS_BUS_ALREADY_ACQUIRED:
             return "Bus already acquired";
+        case BDBP_STATUS_READY:
+            return "Ready";
+        case BDBP_STATUS_EVENT:
+            return "Event";
         default:
             return "(Invalid status)";
     }
 }
 
+const char* bdbp_cmd_to_string(enum bdbp_cmd cmd) {
+    switch (cmd) {
+        case BDBP_CMD_PING:
+            return "ping";
+        case BDBP_CMD_WRITE:
+            return "write";
+        case BDBP_CMD_READ:
+            return "read";
+        case BDBP_CMD_WRITE_FLASH:
+            return "write_flash";
+        case BDBP_CMD_FLASH_ID:
+            return "flash_id";
+        case BDBP_CMD_ERASE_SECTOR:
+            return "erase_sector";
+        case BDBP_CMD_ERASE_CHIP:
+            return "erase_chip";
+        case BDBP_CMD_INFO:
+            return "info";
+        case BDBP_CMD_DIGEST:
+            return "digest";
+        case BDBP_CMD_STATS:
+            return "stats";
+        case BDBP_CMD_MARKERS:
+            return "markers";
+        case BDBP_CMD_PROFILE:
+            return "profile";
+        case BDBP_CMD_TRACE:
+            return "trace";
+        case BDBP_CMD_BREAK:
+            return "break";
+        case BDBP_CMD_BUS:
+            return "bus";
+        case BDBP_CMD_MAILBOX:
+            return "mailbox";
+        case BDBP_CMD_ANALYZER:
+            return "analyzer";
+        default:
+            return NULL;
+    }
+}
+
 void bdbp_pkt_init(uint8_t* pkt, enum bdbp_cmd cmd) {
     pkt[BDBP_FIELD_HDR] = cmd;
     pkt[BDBP_FIELD_DATA_LEN] = 0;
@@ -47,3 +92,15 @@ void bdbp_pkt_append_addr(uint8_t* pkt, gly_addr_t data) {
     bdbp_pkt_append_u8(pkt, (data >> 8) & 0xFF);
     bdbp_pkt_append_u8(pkt, (data >> 16) & 0xF);
 }
+
+uint16_t bdbp_read_u16(const uint8_t* data) {
+    return data[0] | (uint16_t) data[1] << 8;
+}
+
+uint32_t bdbp_read_u32(const uint8_t* data) {
+    return bdbp_read_u16(data) | (uint32_t) bdbp_read_u16(data + 2) << 16;
+}
+
+uint64_t bdbp_read_u64(const uint8_t* data) {
+    return bdbp_read_u32(data) | (uint64_t) bdbp_read_u32(data + 4) << 32;
+}
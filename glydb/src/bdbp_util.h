@@ -12,6 +12,9 @@
 // Convert a BDBP-status to a human-readable string.
 const char* bdbp_status_to_string(enum bdbp_status status);
 
+// Convert a BDBP-command to a short name, or `NULL` if the command is unknown.
+const char* bdbp_cmd_to_string(enum bdbp_cmd cmd);
+
 // Initialize an empty packet with a particular command type.
 void bdbp_pkt_init(uint8_t* pkt, enum bdbp_cmd cmd);
 
@@ -28,4 +31,9 @@ void bdbp_pkt_append_u8(uint8_t* pkt, uint8_t data);
 // Write a single address into the data part of a packet.
 void bdbp_pkt_append_addr(uint8_t* pkt, gly_addr_t data);
 
+// Read little-endian integers from the data part of a packet.
+uint16_t bdbp_read_u16(const uint8_t* data);
+uint32_t bdbp_read_u32(const uint8_t* data);
+uint64_t bdbp_read_u64(const uint8_t* data);
+
 #endif
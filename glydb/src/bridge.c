@@ -0,0 +1,283 @@
+#include "bridge.h"
+#include "debugger.h"
+#include "target.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// The maximum number of clients that can be connected at once.
+#define BRIDGE_MAX_CLIENTS (16)
+
+// State of a single client of the bridge.
+struct bridge_client {
+    // Socket of this client. -1 if this slot is not in use.
+    int fd;
+    // The request that is currently being received from this client.
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    // The number of bytes of `pkt` that have been received so far.
+    size_t len;
+};
+
+struct bridge {
+    struct debugger* dbg;
+    // The socket that clients connect to.
+    int listen_fd;
+    struct bridge_client clients[BRIDGE_MAX_CLIENTS];
+    // The client to start serving from in the next round, so that no client is favored.
+    size_t next_client;
+};
+
+static volatile sig_atomic_t bridge_quit;
+
+static void bridge_handle_signal(int sig) {
+    (void) sig;
+    bridge_quit = 1;
+}
+
+static bool bridge_client_has_request(const struct bridge_client* client) {
+    return client->len >= BDBP_MIN_MSG_LENGTH && client->len == BDBP_MIN_MSG_LENGTH + client->pkt[BDBP_FIELD_DATA_LEN];
+}
+
+static void bridge_disconnect(struct bridge* b, size_t i) {
+    close(b->clients[i].fd);
+    b->clients[i].fd = -1;
+    printf("Client %zu disconnected.\n", i);
+}
+
+static void bridge_accept(struct bridge* b) {
+    int fd = accept(b->listen_fd, NULL, NULL);
+    if (fd == -1)
+        return;
+
+    for (size_t i = 0; i < BRIDGE_MAX_CLIENTS; ++i) {
+        struct bridge_client* client = &b->clients[i];
+        if (client->fd == -1) {
+            client->fd = fd;
+            client->len = 0;
+            printf("Client %zu connected.\n", i);
+            return;
+        }
+    }
+
+    fprintf(stderr, "warning: refusing client, too many clients connected.\n");
+    close(fd);
+}
+
+// Receive (a part of) the next request from a client. Only the current request is read, so that
+// a client cannot queue up more than one request at a time.
+static void bridge_receive(struct bridge* b, size_t i) {
+    struct bridge_client* client = &b->clients[i];
+    size_t want = client->len < BDBP_MIN_MSG_LENGTH
+        ? BDBP_MIN_MSG_LENGTH - client->len
+        : BDBP_MIN_MSG_LENGTH + client->pkt[BDBP_FIELD_DATA_LEN] - client->len;
+
+    ssize_t r = read(client->fd, &client->pkt[client->len], want);
+    if (r < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (r <= 0) {
+        bridge_disconnect(b, i);
+        return;
+    }
+
+    client->len += r;
+}
+
+// Send a whole packet to a client, and disconnect it if that fails.
+static void bridge_send(struct bridge* b, size_t i, const uint8_t* pkt) {
+    size_t len = BDBP_MIN_MSG_LENGTH + pkt[BDBP_FIELD_DATA_LEN];
+    size_t offset = 0;
+    while (offset < len) {
+        ssize_t w = send(b->clients[i].fd, &pkt[offset], len - offset, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        } else if (w <= 0) {
+            bridge_disconnect(b, i);
+            break;
+        }
+        offset += w;
+    }
+}
+
+// Forward an event from the device to every client, see `debugger.event_handler`. Events can
+// arrive before a response as well as between requests, and clients handle them in both cases.
+static void bridge_forward_event(void* arg, const uint8_t* pkt) {
+    struct bridge* b = arg;
+    for (size_t i = 0; i < BRIDGE_MAX_CLIENTS; ++i) {
+        if (b->clients[i].fd != -1)
+            bridge_send(b, i, pkt);
+    }
+}
+
+// Forward the pending request of a client to the device, and send back the response.
+// Returns `true` if the connection to the device was lost.
+static bool bridge_serve_request(struct bridge* b, size_t i) {
+    struct bridge_client* client = &b->clients[i];
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    memcpy(pkt, client->pkt, client->len);
+    client->len = 0;
+
+    if (target_transact(b->dbg, pkt)) {
+        // The client's request is lost, let it know by hanging up. The device is probably no longer
+        // in sync with us either.
+        if (client->fd != -1)
+            bridge_disconnect(b, i);
+        return target_sync(b->dbg);
+    }
+
+    // Forwarding an event on the way may have disconnected the client.
+    if (client->fd != -1)
+        bridge_send(b, i, pkt);
+    return false;
+}
+
+// Handle data that the device sent outside of any request.
+static void bridge_drain_device(struct bridge* b) {
+    // Events are forwarded on the way, anything else means that the device is out of sync.
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bool failed = target_recv_unsolicited(b->dbg, pkt);
+    if (!failed && pkt[BDBP_FIELD_HDR] == BDBP_STATUS_EVENT) {
+        return;
+    } else if (!failed && pkt[BDBP_FIELD_HDR] == BDBP_STATUS_READY) {
+        puts("Device was reset.");
+    }
+    conn_discard_input(&b->dbg->conn);
+}
+
+static bool bridge_listen(struct bridge* b, const char* socket_path) {
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        debugger_print_error(b->dbg, "Socket path '%s' is too long.", socket_path);
+        return true;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // Remove the socket of a previous bridge that wasn't shut down cleanly.
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    b->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (b->listen_fd == -1) {
+        debugger_print_error(b->dbg, "Failed to create socket: %s.", strerror(errno));
+        return true;
+    }
+
+    if (bind(b->listen_fd, (const struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(b->listen_fd, BRIDGE_MAX_CLIENTS) != 0) {
+        debugger_print_error(b->dbg, "Failed to listen on '%s': %s.", socket_path, strerror(errno));
+        close(b->listen_fd);
+        return true;
+    }
+
+    return false;
+}
+
+bool bridge_serve(struct debugger* dbg, const char* socket_path) {
+    if (debugger_require_connection(dbg))
+        return true;
+
+    struct bridge b = {
+        .dbg = dbg,
+        .next_client = 0,
+    };
+    for (size_t i = 0; i < BRIDGE_MAX_CLIENTS; ++i) {
+        b.clients[i].fd = -1;
+    }
+
+    if (bridge_listen(&b, socket_path))
+        return true;
+
+    dbg->event_handler = bridge_forward_event;
+    dbg->event_arg = &b;
+
+    // Don't restart poll() on these, so that the loop below notices them.
+    struct sigaction sa = {
+        .sa_handler = bridge_handle_signal,
+    };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Keep the log current when it is redirected to a file.
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    printf("Serving '%s' on '%s'.\n", dbg->conn.port, socket_path);
+
+    bool error = false;
+    bridge_quit = 0;
+    while (!bridge_quit && !error) {
+        // Slot 0 is the listening socket, slot 1 is the device, followed by the clients.
+        struct pollfd pfds[2 + BRIDGE_MAX_CLIENTS];
+        size_t owners[2 + BRIDGE_MAX_CLIENTS];
+        size_t n = 0;
+        pfds[n++] = (struct pollfd){.fd = b.listen_fd, .events = POLLIN};
+        pfds[n++] = (struct pollfd){.fd = dbg->conn.fd, .events = POLLIN};
+        for (size_t i = 0; i < BRIDGE_MAX_CLIENTS; ++i) {
+            const struct bridge_client* client = &b.clients[i];
+            if (client->fd == -1 || bridge_client_has_request(client))
+                continue;
+            owners[n] = i;
+            pfds[n++] = (struct pollfd){.fd = client->fd, .events = POLLIN};
+        }
+
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            debugger_print_error(dbg, "Failed to poll: %s.", strerror(errno));
+            error = true;
+            break;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            bridge_accept(&b);
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            bridge_drain_device(&b);
+        } else if (pfds[1].revents & (POLLHUP | POLLERR)) {
+            debugger_print_error(dbg, "Lost connection to the device.");
+            error = true;
+            break;
+        }
+
+        for (size_t j = 2; j < n; ++j) {
+            if (pfds[j].revents & (POLLIN | POLLHUP | POLLERR)) {
+                bridge_receive(&b, owners[j]);
+            }
+        }
+
+        // Serve at most one request of every client per round.
+        for (size_t k = 0; k < BRIDGE_MAX_CLIENTS && !error; ++k) {
+            size_t i = (b.next_client + k) % BRIDGE_MAX_CLIENTS;
+            const struct bridge_client* client = &b.clients[i];
+            if (client->fd != -1 && bridge_client_has_request(client)) {
+                error = bridge_serve_request(&b, i);
+            }
+        }
+        b.next_client = (b.next_client + 1) % BRIDGE_MAX_CLIENTS;
+    }
+
+    for (size_t i = 0; i < BRIDGE_MAX_CLIENTS; ++i) {
+        if (b.clients[i].fd != -1) {
+            close(b.clients[i].fd);
+        }
+    }
+    dbg->event_handler = NULL;
+    dbg->event_arg = NULL;
+    close(b.listen_fd);
+    unlink(socket_path);
+    return error;
+}
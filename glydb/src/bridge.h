@@ -0,0 +1,22 @@
+#ifndef GLYDB_SRC_BRIDGE_H
+#define GLYDB_SRC_BRIDGE_H
+
+#include <stdbool.h>
+
+// The bridge allows multiple glydb instances to share a single coprocessor, and keeps the
+// connection to it open between invocations. It owns the connection to the device, and accepts
+// clients on a Unix socket. Clients speak plain BDBP to the bridge: every request packet is
+// forwarded to the device, and the response is sent back to the client that made the request.
+// Clients with pending requests are served round-robin, one request each at a time. Events that
+// the device sends on its own (see BDBP_STATUS_EVENT) are sent to every client. In particular,
+// every client receives a copy of the bytes that the Z80 writes to the mailbox, and learns when
+// a capture of the logic analyzer is done, whichever client armed it.
+
+struct debugger;
+
+// Serve the device that `dbg` is connected to on a Unix socket at `socket_path`, until
+// interrupted by SIGINT or SIGTERM. Returns `true` if an error occurred, in which case an
+// error message has already been printed.
+bool bridge_serve(struct debugger* dbg, const char* socket_path);
+
+#endif
@@ -0,0 +1,87 @@
+#include "cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+void cache_init(struct cache* cache) {
+    cache->enabled = true;
+    // Nothing in glydb stops the Z80, so assume that it is running until told otherwise.
+    cache->z80_running = true;
+    cache->data = malloc(GLYCON_ADDRSPACE_SIZE);
+    assert(cache->data);
+    memset(cache->valid, 0, sizeof cache->valid);
+    memset(&cache->stats, 0, sizeof cache->stats);
+}
+
+void cache_deinit(struct cache* cache) {
+    free(cache->data);
+}
+
+bool cache_page_valid(const struct cache* cache, gly_addr_t address) {
+    return cache->valid[(address % GLYCON_ADDRSPACE_SIZE) / CACHE_PAGE_SIZE];
+}
+
+void cache_fill(struct cache* cache, gly_addr_t address, size_t len) {
+    assert(address % CACHE_PAGE_SIZE == 0 && len % CACHE_PAGE_SIZE == 0);
+    assert(address + len <= GLYCON_ADDRSPACE_SIZE);
+
+    cache->stats.page_misses += len / CACHE_PAGE_SIZE;
+    cache->stats.bytes_fetched += len;
+    for (gly_addr_t page = address; page < address + len; page += CACHE_PAGE_SIZE) {
+        if (glycon_is_flash_addr(page) || !cache->z80_running)
+            cache->valid[page / CACHE_PAGE_SIZE] = true;
+    }
+}
+
+void cache_update(struct cache* cache, gly_addr_t address, size_t len, const uint8_t buffer[]) {
+    for (size_t i = 0; i < len; ++i) {
+        gly_addr_t addr = (address + i) % GLYCON_ADDRSPACE_SIZE;
+        if (cache->valid[addr / CACHE_PAGE_SIZE])
+            cache->data[addr] = buffer[i];
+    }
+}
+
+static void cache_invalidate_page(struct cache* cache, size_t page) {
+    if (cache->valid[page]) {
+        cache->valid[page] = false;
+        ++cache->stats.invalidations;
+    }
+}
+
+void cache_invalidate(struct cache* cache, gly_addr_t address, size_t len) {
+    if (len == 0)
+        return;
+    if (len >= GLYCON_ADDRSPACE_SIZE) {
+        cache_invalidate_all(cache);
+        return;
+    }
+
+    size_t first = (address % GLYCON_ADDRSPACE_SIZE) / CACHE_PAGE_SIZE;
+    size_t last = ((address + len - 1) % GLYCON_ADDRSPACE_SIZE) / CACHE_PAGE_SIZE;
+    for (size_t page = first;; page = (page + 1) % CACHE_PAGES) {
+        cache_invalidate_page(cache, page);
+        if (page == last)
+            break;
+    }
+}
+
+void cache_invalidate_all(struct cache* cache) {
+    for (size_t page = 0; page < CACHE_PAGES; ++page) {
+        cache_invalidate_page(cache, page);
+    }
+}
+
+void cache_set_z80_running(struct cache* cache, bool running) {
+    if (running && !cache->z80_running)
+        cache_invalidate(cache, GLYCON_RAM_START, GLYCON_RAM_SIZE);
+    cache->z80_running = running;
+}
+
+size_t cache_valid_pages(const struct cache* cache) {
+    size_t count = 0;
+    for (size_t page = 0; page < CACHE_PAGES; ++page) {
+        count += cache->valid[page];
+    }
+    return count;
+}
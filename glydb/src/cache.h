@@ -0,0 +1,75 @@
+#ifndef GLYDB_SRC_CACHE_H
+#define GLYDB_SRC_CACHE_H
+
+#include "common/glycon.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Granularity of the target memory cache. A page fits in a single read request, so that
+// filling a single page takes one round trip.
+#define CACHE_PAGE_SIZE (128)
+
+#define CACHE_PAGES (GLYCON_ADDRSPACE_SIZE / CACHE_PAGE_SIZE)
+
+// Statistics about the effectiveness of the cache.
+struct cache_stats {
+    // The number of pages that were served from the cache.
+    uint64_t page_hits;
+    // The number of pages that had to be fetched from the device.
+    uint64_t page_misses;
+    // The number of bytes fetched from the device to fill the cache.
+    uint64_t bytes_fetched;
+    // The number of pages that were invalidated.
+    uint64_t invalidations;
+};
+
+// A page-granular copy of target memory, which is used to avoid reading the same memory from
+// the device over and over again.
+// Flash pages stay valid until they are written or erased through glydb. RAM pages are only
+// cached while the Z80 is stopped, since it may change RAM whenever the coprocessor releases
+// the bus to it.
+struct cache {
+    // Whether the cache should be used at all.
+    bool enabled;
+    // Whether the Z80 may run whenever the coprocessor releases the bus. While set, RAM pages
+    // are never considered valid.
+    bool z80_running;
+    // Address-space sized copy of target memory. Only valid pages hold meaningful data.
+    uint8_t* data;
+    // Whether each page of `data` is up to date.
+    bool valid[CACHE_PAGES];
+    struct cache_stats stats;
+};
+
+void cache_init(struct cache* cache);
+
+void cache_deinit(struct cache* cache);
+
+// Return whether the page that contains `address` holds up to date data.
+bool cache_page_valid(const struct cache* cache, gly_addr_t address);
+
+// Mark the pages in [`address`, `address + len`) as filled from the device, after their
+// contents have been stored in `cache->data`. Both bounds must be page aligned. RAM pages are
+// only marked valid if the Z80 is stopped.
+void cache_fill(struct cache* cache, gly_addr_t address, size_t len);
+
+// Store data that was written to the device in the cache. Pages that are not cached are left
+// alone.
+void cache_update(struct cache* cache, gly_addr_t address, size_t len, const uint8_t buffer[]);
+
+// Drop all pages that overlap [`address`, `address + len`). Ranges that extend past the end of
+// the address space wrap around, like they do on the device.
+void cache_invalidate(struct cache* cache, gly_addr_t address, size_t len);
+
+// Drop all cached pages.
+void cache_invalidate_all(struct cache* cache);
+
+// Record whether the Z80 is running. Letting it run invalidates all cached RAM.
+void cache_set_z80_running(struct cache* cache, bool running);
+
+// Return the number of pages that currently hold valid data.
+size_t cache_valid_pages(const struct cache* cache);
+
+#endif
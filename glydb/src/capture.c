@@ -0,0 +1,146 @@
+#include "capture.h"
+#include "clock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+void capture_init(struct capture* capture) {
+    capture->f = NULL;
+    capture->path = NULL;
+}
+
+bool capture_start(struct capture* capture, const char* path) {
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    if (fwrite(CAPTURE_MAGIC, 4, 1, f) != 1 || fputc(CAPTURE_VERSION, f) == EOF) {
+        int err = errno;
+        fclose(f);
+        errno = err;
+        return false;
+    }
+
+    capture->f = f;
+    capture->path = strdup(path);
+    capture->last_us = clock_now_us();
+    capture->tx.len = 0;
+    capture->rx.len = 0;
+    capture->frames = 0;
+    capture->error = 0;
+    return true;
+}
+
+bool capture_stop(struct capture* capture) {
+    int err = capture->error;
+    if (fclose(capture->f) != 0 && err == 0)
+        err = errno;
+
+    capture->f = NULL;
+    free(capture->path);
+    capture->path = NULL;
+    errno = err;
+    return err == 0;
+}
+
+// Write the start of a record.
+static void capture_write_record(struct capture* capture, enum capture_kind kind) {
+    uint64_t now = clock_now_us();
+    uint64_t delta = now - capture->last_us;
+    capture->last_us = now;
+
+    uint8_t buf[1 + 10];
+    size_t len = 0;
+    buf[len++] = kind;
+    do {
+        buf[len++] = (delta & 0x7F) | (delta >= 0x80 ? 0x80 : 0);
+        delta >>= 7;
+    } while (delta > 0);
+
+    if (fwrite(buf, len, 1, capture->f) != 1 && capture->error == 0)
+        capture->error = errno;
+}
+
+// Add a byte to a framer, and record the frame once it is complete.
+static void capture_frame_byte(struct capture* capture, struct capture_framer* framer, enum capture_kind kind, uint8_t byte) {
+    framer->frame[framer->len++] = byte;
+    if (framer->len < BDBP_MIN_MSG_LENGTH || framer->len < BDBP_MIN_MSG_LENGTH + framer->frame[BDBP_FIELD_DATA_LEN])
+        return;
+
+    capture_write_record(capture, kind);
+    if (fwrite(framer->frame, framer->len, 1, capture->f) != 1 && capture->error == 0)
+        capture->error = errno;
+    framer->len = 0;
+    ++capture->frames;
+}
+
+void capture_tx(struct capture* capture, size_t len, const uint8_t data[]) {
+    if (!capture->f)
+        return;
+
+    for (size_t i = 0; i < len; ++i)
+        capture_frame_byte(capture, &capture->tx, CAPTURE_REQUEST, data[i]);
+}
+
+void capture_rx(struct capture* capture, uint8_t byte) {
+    if (capture->f)
+        capture_frame_byte(capture, &capture->rx, CAPTURE_RESPONSE, byte);
+}
+
+void capture_event(struct capture* capture, enum capture_kind kind) {
+    if (!capture->f)
+        return;
+
+    capture->rx.len = 0;
+    if (kind == CAPTURE_OPEN)
+        capture->tx.len = 0;
+    capture_write_record(capture, kind);
+}
+
+bool capture_read_header(FILE* f) {
+    uint8_t header[5];
+    if (fread(header, sizeof header, 1, f) != 1 || memcmp(header, CAPTURE_MAGIC, 4) != 0 || header[4] != CAPTURE_VERSION) {
+        errno = EINVAL;
+        return false;
+    }
+
+    return true;
+}
+
+int capture_read_record(FILE* f, struct capture_record* rec) {
+    int kind = fgetc(f);
+    if (kind == EOF)
+        return ferror(f) ? -1 : 0;
+
+    uint64_t delta = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        int byte = fgetc(f);
+        if (byte == EOF || shift > 63)
+            goto damaged;
+        delta |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+
+    rec->kind = kind;
+    rec->time_us += delta;
+    switch (rec->kind) {
+        case CAPTURE_REQUEST:
+        case CAPTURE_RESPONSE:
+            if (fread(rec->frame, BDBP_MIN_MSG_LENGTH, 1, f) != 1)
+                goto damaged;
+            size_t len = rec->frame[BDBP_FIELD_DATA_LEN];
+            if (len > 0 && fread(&rec->frame[BDBP_FIELD_DATA], len, 1, f) != 1)
+                goto damaged;
+            return 1;
+        case CAPTURE_OPEN:
+        case CAPTURE_DISCARD:
+            return 1;
+    }
+
+damaged:
+    if (!ferror(f))
+        errno = EINVAL;
+    return -1;
+}
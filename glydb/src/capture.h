@@ -0,0 +1,100 @@
+#ifndef GLYDB_SRC_CAPTURE_H
+#define GLYDB_SRC_CAPTURE_H
+
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Captures of the BDBP traffic on a connection, so that it can be analyzed offline and replayed
+// against a device, see replay.h.
+//
+// A capture file (.glc) starts with a header:
+//
+// | "GLYC" | VERSION (1 byte) |
+//
+// which is followed by records:
+//
+// | KIND (1 byte) | DELTA (LEB128) | FRAME (2 + DLEN bytes, only for frame records) |
+//
+// DELTA is the time in microseconds since the previous record, or since the capture started
+// for the first record. Requests are recorded once they were handed to the connection, and
+// responses once their last byte was received.
+
+#define CAPTURE_MAGIC "GLYC"
+#define CAPTURE_VERSION (1)
+
+enum capture_kind {
+    // A frame sent from the host to the device.
+    CAPTURE_REQUEST = 0,
+    // A frame sent from the device to the host.
+    CAPTURE_RESPONSE = 1,
+    // A connection was opened. Carries no frame.
+    CAPTURE_OPEN = 2,
+    // Received data that was not read yet was discarded. Carries no frame.
+    CAPTURE_DISCARD = 3,
+};
+
+// Reassembles frames from the bytes going in one direction.
+struct capture_framer {
+    uint8_t frame[BDBP_MAX_MSG_LENGTH];
+    size_t len;
+};
+
+// A capture that is being written. Capturing is inactive while `f` is `NULL`.
+struct capture {
+    FILE* f;
+    // The path of the capture file.
+    char* path;
+    // The time of the last record, from `clock_now_us`.
+    uint64_t last_us;
+    struct capture_framer tx;
+    struct capture_framer rx;
+    // The number of frames recorded so far.
+    size_t frames;
+    // The `errno` of the first write to the file that failed, or 0.
+    int error;
+};
+
+// A single record, as read back from a capture file.
+struct capture_record {
+    enum capture_kind kind;
+    // Time since the capture started, in microseconds.
+    uint64_t time_us;
+    // The frame, for CAPTURE_REQUEST and CAPTURE_RESPONSE records.
+    uint8_t frame[BDBP_MAX_MSG_LENGTH];
+};
+
+// Initialize an inactive capture.
+void capture_init(struct capture* capture);
+
+// Start capturing to a new file at `path`. If successful, returns `true`, otherwise returns
+// `false` and sets `errno` to indicate the error.
+bool capture_start(struct capture* capture, const char* path);
+
+// Stop capturing, and close the file. If writing the file failed at any point, returns `false`
+// and sets `errno` to indicate the error. Frames that were only partially transferred are not
+// recorded.
+bool capture_stop(struct capture* capture);
+
+// Record bytes that were sent to the device.
+void capture_tx(struct capture* capture, size_t len, const uint8_t data[]);
+
+// Record a byte that was received from the device.
+void capture_rx(struct capture* capture, uint8_t byte);
+
+// Record a CAPTURE_OPEN or CAPTURE_DISCARD event. Partially received frames are dropped.
+void capture_event(struct capture* capture, enum capture_kind kind);
+
+// Check the header of a capture file that was opened for reading. Returns `false` and sets
+// `errno` if it is not a capture file.
+bool capture_read_header(FILE* f);
+
+// Read the next record of a capture file into `rec`. `rec->time_us` must hold the time of the
+// previous record, or 0 for the first one. Returns 1 if a record was read, 0 at the end of the
+// file, and -1 if the file is damaged or could not be read, in which case `errno` is set.
+int capture_read_record(FILE* f, struct capture_record* rec);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef GLYDB_SRC_CLOCK_H
+#define GLYDB_SRC_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Return a monotonic timestamp in microseconds.
+static inline uint64_t clock_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
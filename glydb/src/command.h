@@ -68,6 +68,9 @@ struct cmd_leaf {
     const struct cmd_positional* positionals;
     // User-defined payload for this leaf. This can be useful to tell the matched command apart.
     void* payload;
+    // Set if this command does not use the connection to the device. Such commands run right
+    // away, even while background jobs use the connection.
+    bool local;
 };
 
 // A structure describing a particular command.
@@ -0,0 +1,362 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "buffer.h"
+#include "target.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define ANALYZER_DEFAULT_COUNT (32)
+
+// The state of the device's analyzer, as reported by the last BDBP_CMD_ANALYZER response.
+struct analyzer_status {
+    uint8_t state;
+    uint16_t samples;
+    uint16_t cpu_khz;
+    uint32_t cycles;
+};
+
+// A decoded sample, see BDBP_ANALYZER_SAMPLE_M1.
+struct analyzer_sample {
+    gly_addr_t address;
+    uint8_t data;
+    bool m1;
+    bool ioreq;
+};
+
+static const char* analyzer_state_to_str(uint8_t state) {
+    switch (state) {
+        case BDBP_ANALYZER_STATE_IDLE:
+            return "idle";
+        case BDBP_ANALYZER_STATE_ARMED:
+            return "waiting for the trigger";
+        case BDBP_ANALYZER_STATE_DONE:
+            return "done";
+        default:
+            return "unknown";
+    }
+}
+
+// Send a BDBP_CMD_ANALYZER request with the operation and arguments in `pkt`. On success, the
+// response is left in `pkt`.
+static bool analyzer_exec(struct debugger* dbg, uint8_t* pkt, struct analyzer_status* status) {
+    if (!target_supports(dbg, BDBP_CMD_ANALYZER)) {
+        debugger_print_error(dbg, "The device firmware does not support the logic analyzer.");
+        return true;
+    }
+
+    if (target_exec_cmd(dbg, pkt))
+        return true;
+
+    uint8_t len = pkt[BDBP_FIELD_DATA_LEN];
+    if (len < BDBP_ANALYZER_HEADER_LENGTH || (len - BDBP_ANALYZER_HEADER_LENGTH) % BDBP_ANALYZER_SAMPLE_SIZE != 0) {
+        debugger_print_error(dbg, "Device returned a malformed capture.");
+        return true;
+    }
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    status->state = data[0];
+    status->samples = data[1] | data[2] << 8;
+    status->cpu_khz = data[3] | data[4] << 8;
+    status->cycles = bdbp_read_u32(&data[5]);
+    return false;
+}
+
+static bool analyzer_op(struct debugger* dbg, enum bdbp_analyzer_op op, struct analyzer_status* status) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_ANALYZER);
+    bdbp_pkt_append_u8(pkt, op);
+    return analyzer_exec(dbg, pkt, status);
+}
+
+// Return the time between two samples in nanoseconds.
+static double analyzer_period_ns(const struct analyzer_status* status) {
+    if (status->samples == 0 || status->cpu_khz == 0)
+        return 0;
+    return status->cycles * 1000000.0 / status->cpu_khz / status->samples;
+}
+
+static void analyzer_print_status(const struct analyzer_status* status) {
+    printf("Analyzer is %s", analyzer_state_to_str(status->state));
+    if (status->state == BDBP_ANALYZER_STATE_DONE) {
+        double period_ns = analyzer_period_ns(status);
+        printf(
+            ": %u samples over %.1f us, one every %.0f ns (%.2f MHz)",
+            status->samples,
+            status->samples * period_ns / 1000.0,
+            period_ns,
+            period_ns > 0 ? 1000.0 / period_ns : 0
+        );
+    }
+    puts(".");
+}
+
+// Download the whole capture, and decode it into `samples`.
+static bool analyzer_download(struct debugger* dbg, struct buffer* samples, struct analyzer_status* status) {
+    if (analyzer_op(dbg, BDBP_ANALYZER_OP_STATUS, status))
+        return true;
+    if (status->state != BDBP_ANALYZER_STATE_DONE) {
+        debugger_print_error(dbg, "There is no capture. Start one with `analyzer arm`, and wait for it with `analyzer wait`.");
+        return true;
+    }
+
+    uint16_t total = status->samples;
+    for (uint16_t index = 0; index < total;) {
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_ANALYZER);
+        bdbp_pkt_append_u8(pkt, BDBP_ANALYZER_OP_READ);
+        bdbp_pkt_append_u8(pkt, index & 0xFF);
+        bdbp_pkt_append_u8(pkt, index >> 8);
+        if (analyzer_exec(dbg, pkt, status))
+            return true;
+
+        size_t count = (pkt[BDBP_FIELD_DATA_LEN] - BDBP_ANALYZER_HEADER_LENGTH) / BDBP_ANALYZER_SAMPLE_SIZE;
+        if (count == 0) {
+            debugger_print_error(dbg, "Device returned fewer samples than it reported.");
+            return true;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* raw = &pkt[BDBP_FIELD_DATA + BDBP_ANALYZER_HEADER_LENGTH + i * BDBP_ANALYZER_SAMPLE_SIZE];
+            struct analyzer_sample s = {
+                .address = raw[0] | raw[1] << 8 | (gly_addr_t) (raw[2] & BDBP_ANALYZER_SAMPLE_ADDR_HIGH_MASK) << 16,
+                .data = raw[3],
+                .m1 = (raw[2] & BDBP_ANALYZER_SAMPLE_M1) != 0,
+                .ioreq = (raw[2] & BDBP_ANALYZER_SAMPLE_IOREQ) != 0,
+            };
+            buffer_push_data(samples, sizeof s, &s);
+        }
+        index += count;
+    }
+
+    return false;
+}
+
+static bool analyzer_sample_equal(const struct analyzer_sample* a, const struct analyzer_sample* b) {
+    return a->address == b->address && a->data == b->data && a->m1 == b->m1 && a->ioreq == b->ioreq;
+}
+
+static void analyzer_arm(struct debugger* dbg, const struct cmd_parse_result* args) {
+    uint8_t trigger = BDBP_ANALYZER_TRIGGER_NONE;
+    int64_t value = 0;
+    unsigned triggers = 0;
+    if (args->options[0].present) {
+        trigger = BDBP_ANALYZER_TRIGGER_ADDRESS;
+        value = args->options[0].value.as_int;
+        ++triggers;
+        if (value < 0 || value >= GLYCON_ADDRSPACE_SIZE) {
+            debugger_print_error(dbg, "Address %ld outside of valid range [0, %d).", value, GLYCON_ADDRSPACE_SIZE);
+            return;
+        }
+    }
+    if (args->options[1].present) {
+        trigger = BDBP_ANALYZER_TRIGGER_DATA;
+        value = args->options[1].value.as_int;
+        ++triggers;
+        if (value < 0 || value > UINT8_MAX) {
+            debugger_print_error(dbg, "Data %ld outside of valid range [0, %d].", value, UINT8_MAX);
+            return;
+        }
+    }
+    if (args->options[2].present) {
+        trigger = BDBP_ANALYZER_TRIGGER_IOREQ;
+        ++triggers;
+    }
+    if (triggers > 1) {
+        debugger_print_error(dbg, "Only one trigger can be used at a time.");
+        return;
+    }
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_ANALYZER);
+    bdbp_pkt_append_u8(pkt, BDBP_ANALYZER_OP_ARM);
+    bdbp_pkt_append_u8(pkt, trigger);
+    bdbp_pkt_append_addr(pkt, value);
+
+    struct analyzer_status status;
+    if (!analyzer_exec(dbg, pkt, &status))
+        analyzer_print_status(&status);
+}
+
+static void analyzer_wait(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct analyzer_status status;
+    if (analyzer_op(dbg, BDBP_ANALYZER_OP_STATUS, &status))
+        return;
+
+    // Other events, such as bytes from the mailbox, may arrive first, so the state is checked
+    // after each one.
+    while (status.state == BDBP_ANALYZER_STATE_ARMED) {
+        if (target_await_event(dbg) || analyzer_op(dbg, BDBP_ANALYZER_OP_STATUS, &status))
+            return;
+    }
+
+    if (status.state != BDBP_ANALYZER_STATE_DONE) {
+        debugger_print_error(dbg, "The analyzer is not armed.");
+        return;
+    }
+    analyzer_print_status(&status);
+}
+
+static void analyzer_stop(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct analyzer_status status;
+    if (!analyzer_op(dbg, BDBP_ANALYZER_OP_STOP, &status))
+        analyzer_print_status(&status);
+}
+
+static void analyzer_status(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct analyzer_status status;
+    if (!analyzer_op(dbg, BDBP_ANALYZER_OP_STATUS, &status))
+        analyzer_print_status(&status);
+}
+
+static void analyzer_show(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t first = args->options[0].present ? args->options[0].value.as_int : 0;
+    int64_t count = args->options[1].present ? args->options[1].value.as_int : ANALYZER_DEFAULT_COUNT;
+    if (first < 0 || count < 0) {
+        debugger_print_error(dbg, "Start and count must not be negative.");
+        return;
+    }
+
+    struct buffer samples;
+    buffer_init(&samples);
+    struct analyzer_status status;
+    if (analyzer_download(dbg, &samples, &status)) {
+        buffer_deinit(&samples);
+        return;
+    }
+
+    // Only the samples where something changed are shown, with the time since the trigger.
+    const struct analyzer_sample* s = samples.data;
+    size_t len = samples.size / sizeof *s;
+    double period_ns = analyzer_period_ns(&status);
+    printf("%8s %10s %7s %4s %s\n", "sample", "time (ns)", "address", "data", "lines");
+    int64_t shown = 0;
+    for (size_t i = first; i < len && shown < count; ++i) {
+        if (i > (size_t) first && analyzer_sample_equal(&s[i], &s[i - 1]))
+            continue;
+        printf("%8zu %10.0f   %05X   %02X %s%s\n", i, i * period_ns, s[i].address, s[i].data, s[i].m1 ? " M1" : "", s[i].ioreq ? " IOREQ" : "");
+        ++shown;
+    }
+
+    buffer_deinit(&samples);
+}
+
+// Write the value of a VCD vector variable.
+static void analyzer_vcd_vector(FILE* f, uint32_t value, unsigned bits, char id) {
+    fputc('b', f);
+    for (unsigned i = bits; i-- > 0;)
+        fputc(value >> i & 1 ? '1' : '0', f);
+    fprintf(f, " %c\n", id);
+}
+
+// Write the capture as a Value Change Dump. M1 and IOREQ are active low, as on the bus.
+static void analyzer_write_vcd(FILE* f, const struct analyzer_sample* s, size_t len, double period_ns) {
+    time_t now = time(NULL);
+    fprintf(f, "$date %.24s $end\n", ctime(&now));
+    fputs("$version glydb analyzer $end\n", f);
+    fputs("$timescale 1 ns $end\n", f);
+    fputs("$scope module z80 $end\n", f);
+    fputs("$var wire 18 a address [17:0] $end\n", f);
+    fputs("$var wire 8 d data [7:0] $end\n", f);
+    fputs("$var wire 1 m M1 $end\n", f);
+    fputs("$var wire 1 i IOREQ $end\n", f);
+    fputs("$upscope $end\n", f);
+    fputs("$enddefinitions $end\n", f);
+
+    for (size_t i = 0; i < len; ++i) {
+        const struct analyzer_sample* prev = i > 0 ? &s[i - 1] : NULL;
+        if (prev && analyzer_sample_equal(&s[i], prev))
+            continue;
+
+        fprintf(f, "#%.0f\n", i * period_ns);
+        if (!prev || s[i].address != prev->address)
+            analyzer_vcd_vector(f, s[i].address, 18, 'a');
+        if (!prev || s[i].data != prev->data)
+            analyzer_vcd_vector(f, s[i].data, 8, 'd');
+        if (!prev || s[i].m1 != prev->m1)
+            fprintf(f, "%cm\n", s[i].m1 ? '0' : '1');
+        if (!prev || s[i].ioreq != prev->ioreq)
+            fprintf(f, "%ci\n", s[i].ioreq ? '0' : '1');
+    }
+    fprintf(f, "#%.0f\n", len * period_ns);
+}
+
+static void analyzer_export(struct debugger* dbg, const struct cmd_parse_result* args) {
+    struct buffer samples;
+    buffer_init(&samples);
+    struct analyzer_status status;
+    if (analyzer_download(dbg, &samples, &status)) {
+        buffer_deinit(&samples);
+        return;
+    }
+
+    const char* path = args->positionals[0].as_str;
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        buffer_deinit(&samples);
+        return;
+    }
+
+    size_t len = samples.size / sizeof(struct analyzer_sample);
+    analyzer_write_vcd(f, samples.data, len, analyzer_period_ns(&status));
+    if (fclose(f) != 0)
+        debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+    else
+        printf("Wrote %zu samples to '%s'.\n", len, path);
+
+    buffer_deinit(&samples);
+}
+
+static const struct cmd* analyzer_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "arm", "Discard the last capture, and capture the bus once the trigger fires, or right away without one. This discards the trace, whose buffer the capture uses.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"address", 'a', VALUE_TYPE_INT, "address", "Trigger when the address bus carries this physical address."},
+            {"data", 'd', VALUE_TYPE_INT, "byte", "Trigger when the data bus carries this byte."},
+            {"ioreq", 'i', VALUE_TYPE_BOOL, NULL, "Trigger when IOREQ is asserted."},
+            {}
+        },
+        .payload = analyzer_arm
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "wait", "Wait until the capture is done. Even in the background with `&`, the wait holds the I/O thread, so other commands that use the device queue behind it until the capture is done or the wait is stopped with `cancel`. This keeps them from making the capture miss samples.", {.leaf = {
+        .payload = analyzer_wait
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "stop", "Stop waiting for the trigger.", {.leaf = {
+        .payload = analyzer_stop
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "status", "Show whether the analyzer waits for its trigger, and the sample rate of the capture.", {.leaf = {
+        .payload = analyzer_status
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "show", "Show the samples where the bus changed, with the time since the trigger.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"start", 's', VALUE_TYPE_INT, "sample", "The first sample to show (default: 0)."},
+            {"count", 'n', VALUE_TYPE_INT, "lines", "The number of lines to show (default: 32)."},
+            {}
+        },
+        .payload = analyzer_show
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "export", "Write the capture as a Value Change Dump for a waveform viewer. M1 and IOREQ are active low, as on the bus.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "Path of the .vcd file to write."},
+            {}
+        },
+        .payload = analyzer_export
+    }}},
+    NULL
+};
+
+const struct cmd command_analyzer = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "analyzer",
+    .help = "Sample the address, data, M1 and IOREQ lines of the Z80's bus like a logic analyzer, at about one sample per microsecond. Triggers are checked every few cycles of the device, so values that are on the bus for less than that may be missed.",
+    {.directory = {analyzer_commands}}
+};
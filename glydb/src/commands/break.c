@@ -0,0 +1,242 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "target.h"
+#include "symbols.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// The state of the device's breakpoints, as reported by the last BDBP_CMD_BREAK response.
+struct break_status {
+    uint8_t state;
+    uint8_t count;
+    uint8_t index;
+    gly_addr_t address;
+};
+
+// Send a BDBP_CMD_BREAK request with the operation and arguments in `pkt`. On success, the
+// Z80 is recorded as stopped or running, so that RAM is only cached while it is stopped.
+static bool break_exec(struct debugger* dbg, uint8_t* pkt, struct break_status* status) {
+    if (!target_supports(dbg, BDBP_CMD_BREAK)) {
+        debugger_print_error(dbg, "The device firmware does not support breakpoints.");
+        return true;
+    }
+
+    if (target_exec_cmd(dbg, pkt))
+        return true;
+
+    if (pkt[BDBP_FIELD_DATA_LEN] != BDBP_BREAK_DATA_LENGTH) {
+        debugger_print_error(dbg, "Device returned a malformed breakpoint status.");
+        return true;
+    }
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    status->state = data[0];
+    status->count = data[1];
+    status->index = data[2];
+    status->address = data[3] | data[4] << 8 | (gly_addr_t) data[5] << 16;
+    cache_set_z80_running(&dbg->cache, status->state != BDBP_BREAK_STATE_STOPPED);
+    return false;
+}
+
+static bool break_op(struct debugger* dbg, enum bdbp_break_op op, struct break_status* status) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_BREAK);
+    bdbp_pkt_append_u8(pkt, op);
+    return break_exec(dbg, pkt, status);
+}
+
+// Replace the device's breakpoints with those of the debugger.
+static bool break_sync(struct debugger* dbg) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_BREAK);
+    bdbp_pkt_append_u8(pkt, BDBP_BREAK_OP_SET);
+    bdbp_pkt_append_u8(pkt, dbg->breakpoint_count);
+    for (uint8_t i = 0; i < dbg->breakpoint_count; ++i)
+        bdbp_pkt_append_addr(pkt, dbg->breakpoints[i]);
+
+    struct break_status status;
+    if (break_exec(dbg, pkt, &status))
+        return true;
+
+    if (status.count != dbg->breakpoint_count) {
+        debugger_print_error(dbg, "Device set %u of %u breakpoints.", status.count, dbg->breakpoint_count);
+        return true;
+    }
+    return false;
+}
+
+static void break_print_status(const struct debugger* dbg, const struct break_status* status) {
+    if (status->state != BDBP_BREAK_STATE_STOPPED) {
+        printf("Z80 is running, %u breakpoints set.\n", status->count);
+        return;
+    }
+
+    printf("Z80 is stopped");
+    if (status->index != BDBP_BREAK_NO_INDEX) {
+        printf(" at breakpoint %u, ", status->index);
+        symbols_print_address(&dbg->symbols, status->address);
+    }
+    printf(", %u breakpoints set.\n", status->count);
+}
+
+static void break_add(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t address = args->positionals[0].as_int;
+    if (address < 0 || address >= GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Address %ld outside of valid range [0, %d).", address, GLYCON_ADDRSPACE_SIZE);
+        return;
+    }
+
+    for (uint8_t i = 0; i < dbg->breakpoint_count; ++i) {
+        if (dbg->breakpoints[i] == address) {
+            debugger_print_error(dbg, "Breakpoint %u is already at %05lX.", i, address);
+            return;
+        }
+    }
+
+    if (dbg->breakpoint_count == BDBP_BREAK_MAX_COUNT) {
+        debugger_print_error(dbg, "The device supports at most %d breakpoints.", BDBP_BREAK_MAX_COUNT);
+        return;
+    }
+
+    dbg->breakpoints[dbg->breakpoint_count++] = address;
+    if (break_sync(dbg)) {
+        --dbg->breakpoint_count;
+        return;
+    }
+
+    printf("Breakpoint %u at ", dbg->breakpoint_count - 1);
+    symbols_print_address(&dbg->symbols, address);
+    puts(".");
+}
+
+static void break_delete(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t index = args->positionals[0].as_int;
+    if (index < 0 || index >= dbg->breakpoint_count) {
+        debugger_print_error(dbg, "There is no breakpoint %ld.", index);
+        return;
+    }
+
+    gly_addr_t removed = dbg->breakpoints[index];
+    memmove(&dbg->breakpoints[index], &dbg->breakpoints[index + 1], (dbg->breakpoint_count - index - 1) * sizeof(gly_addr_t));
+    --dbg->breakpoint_count;
+    if (break_sync(dbg)) {
+        memmove(&dbg->breakpoints[index + 1], &dbg->breakpoints[index], (dbg->breakpoint_count - index) * sizeof(gly_addr_t));
+        dbg->breakpoints[index] = removed;
+        ++dbg->breakpoint_count;
+    }
+}
+
+static void break_clear(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    uint8_t count = dbg->breakpoint_count;
+    dbg->breakpoint_count = 0;
+    if (break_sync(dbg))
+        dbg->breakpoint_count = count;
+}
+
+static void break_list(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    if (dbg->breakpoint_count == 0) {
+        puts("No breakpoints.");
+        return;
+    }
+
+    for (uint8_t i = 0; i < dbg->breakpoint_count; ++i) {
+        printf("%u: ", i);
+        symbols_print_address(&dbg->symbols, dbg->breakpoints[i]);
+        puts("");
+    }
+}
+
+static void break_status(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct break_status status;
+    if (!break_op(dbg, BDBP_BREAK_OP_STATUS, &status))
+        break_print_status(dbg, &status);
+}
+
+static void break_continue(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct break_status status;
+    if (!break_op(dbg, BDBP_BREAK_OP_CONTINUE, &status))
+        break_print_status(dbg, &status);
+}
+
+static void break_halt(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct break_status status;
+    if (!break_op(dbg, BDBP_BREAK_OP_HALT, &status))
+        break_print_status(dbg, &status);
+}
+
+static void break_wait(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct break_status status;
+    if (break_op(dbg, BDBP_BREAK_OP_STATUS, &status))
+        return;
+
+    // A hit may have been reported while the status was requested already.
+    if (status.state == BDBP_BREAK_STATE_STOPPED) {
+        break_print_status(dbg, &status);
+        return;
+    }
+
+    if (status.count == 0) {
+        debugger_print_error(dbg, "No breakpoints are set.");
+        return;
+    }
+
+    // Other events, such as bytes from the mailbox, may arrive first.
+    while (dbg->cache.z80_running) {
+        if (target_await_event(dbg))
+            return;
+    }
+}
+
+static const struct cmd* break_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "add", "Stop the Z80 right before it executes the instruction at an address. Breakpoints are numbered in the order they were added.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The physical address of the first byte of the instruction."},
+            {}
+        },
+        .payload = break_add
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "delete", "Remove a breakpoint. The breakpoints after it are renumbered.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "index", "The number of the breakpoint, see `break list`."},
+            {}
+        },
+        .payload = break_delete
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "clear", "Remove all breakpoints.", {.leaf = {
+        .payload = break_clear
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "list", "Show the breakpoints.", {.leaf = {
+        .payload = break_list
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "status", "Show whether the Z80 is stopped, and at which breakpoint.", {.leaf = {
+        .payload = break_status
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "continue", "Let the Z80 run again after it stopped at a breakpoint or was halted.", {.leaf = {
+        .payload = break_continue
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "halt", "Stop the Z80 wherever it is.", {.leaf = {
+        .payload = break_halt
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "wait", "Wait until the Z80 stops at a breakpoint. Even in the background with `&`, the wait holds the I/O thread, so other commands that use the device queue behind it until the Z80 stops or the wait is stopped with `cancel`.", {.leaf = {
+        .payload = break_wait
+    }}},
+    NULL
+};
+
+const struct cmd command_break = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "break",
+    .help = "Stop the Z80 at breakpoints, and inspect memory while it is stopped. Hits are reported whenever the debugger next hears from the device, or by `break wait`. While breakpoints are set, the Z80 is held for a moment after every fetch, so it runs several times slower.",
+    {.directory = {break_commands}}
+};
@@ -0,0 +1,62 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "target.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+
+static void bus_budget(struct debugger* dbg, const struct cmd_parse_result* args) {
+    if (!target_supports(dbg, BDBP_CMD_BUS)) {
+        debugger_print_error(dbg, "The device firmware does not support a bus budget.");
+        return;
+    }
+
+    struct target_bus_usage usage;
+    if (target_bus_usage(dbg, NULL, &usage))
+        return;
+
+    if (args->options[0].present || args->options[1].present) {
+        int64_t burst = args->options[0].present ? args->options[0].value.as_int : usage.burst;
+        if (burst < 0 || burst > UINT8_MAX) {
+            debugger_print_error(dbg, "Burst %ld outside of valid range [0, %d].", burst, UINT8_MAX);
+            return;
+        }
+
+        int64_t gap_us = args->options[1].present ? args->options[1].value.as_int : usage.gap_us;
+        if (gap_us < 0 || gap_us > UINT16_MAX) {
+            debugger_print_error(dbg, "Gap %ld outside of valid range [0, %d].", gap_us, UINT16_MAX);
+            return;
+        }
+
+        struct target_bus_usage set = {.burst = burst, .gap_us = gap_us};
+        if (target_bus_usage(dbg, &set, &usage))
+            return;
+    }
+
+    if (usage.burst == 0) {
+        puts("The bus is held for whole requests.");
+        return;
+    }
+
+    printf("The bus is held for at most %u bytes at once, with %u us between them.\n", usage.burst, usage.gap_us);
+}
+
+static const struct cmd* bus_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "budget", "Show or set how long the device may hold the Z80 off the bus at once, so that it keeps running during large transfers such as `memory load`. Transfers report how long the Z80 was held.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"burst", 'b', VALUE_TYPE_INT, "bytes", "Release the bus after this many bytes, or only after whole requests with 0."},
+            {"gap", 'g', VALUE_TYPE_INT, "us", "Let the Z80 run for this long before the transfer continues."},
+            {}
+        },
+        .payload = bus_budget
+    }}},
+    NULL
+};
+
+const struct cmd command_bus = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "bus",
+    .help = "Control how the device shares the Z80's bus.",
+    {.directory = {bus_commands}}
+};
@@ -0,0 +1,70 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "cache.h"
+
+#include <stdio.h>
+
+static void cache_stats(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    const struct cache* cache = &dbg->cache;
+    const struct cache_stats* stats = &cache->stats;
+
+    printf("Cache: %s", cache->enabled ? "enabled" : "disabled");
+    if (cache->enabled && conn_is_open(&dbg->conn) && dbg->conn.transport == CONN_TRANSPORT_SOCKET)
+        printf(" (not used on bridge connections)");
+    puts("");
+    printf("RAM: %s\n", cache->z80_running ? "not cached while the Z80 runs" : "cached");
+
+    size_t valid = cache_valid_pages(cache);
+    printf("Valid pages: %zu of %d (%zu bytes)\n", valid, CACHE_PAGES, valid * CACHE_PAGE_SIZE);
+
+    uint64_t lookups = stats->page_hits + stats->page_misses;
+    printf(
+        "Page hits: %llu, misses: %llu (%.1f%% hit rate)\n",
+        (unsigned long long) stats->page_hits,
+        (unsigned long long) stats->page_misses,
+        lookups ? stats->page_hits * 100.0 / lookups : 0.0
+    );
+    printf("Bytes fetched: %llu\n", (unsigned long long) stats->bytes_fetched);
+    printf("Pages invalidated: %llu\n", (unsigned long long) stats->invalidations);
+}
+
+static void cache_clear(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    cache_invalidate_all(&dbg->cache);
+}
+
+static void cache_enable(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    dbg->cache.enabled = true;
+}
+
+static void cache_disable(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    dbg->cache.enabled = false;
+    // Nothing keeps the cache up to date while it is disabled.
+    cache_invalidate_all(&dbg->cache);
+}
+
+static const struct cmd* cache_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "stats", "Show how effective the cache is.", {.leaf = {
+        .payload = cache_stats
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "clear", "Drop all cached memory, so that it is read from the device again.", {.leaf = {
+        .payload = cache_clear
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "enable", "Serve memory reads from the cache where possible.", {.leaf = {
+        .payload = cache_enable
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "disable", "Always read memory from the device.", {.leaf = {
+        .payload = cache_disable
+    }}},
+    NULL
+};
+
+const struct cmd command_cache = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "cache",
+    .help = "Control the cache of target memory. Flash is cached until it is written or erased, RAM only while the Z80 is stopped.",
+    {.directory = {cache_commands}}
+};
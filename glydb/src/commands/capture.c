@@ -0,0 +1,84 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "capture.h"
+#include "replay.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+static void capture_start_cmd(struct debugger* dbg, const struct cmd_parse_result* args) {
+    const char* path = args->positionals[0].as_str;
+    struct capture* capture = &dbg->conn.capture;
+    if (capture->f) {
+        debugger_print_error(dbg, "Already capturing to '%s'. Stop that first with `capture stop`.", capture->path);
+        return;
+    }
+
+    if (!capture_start(capture, path))
+        debugger_print_error(dbg, "Failed to create file '%s': %s.", path, strerror(errno));
+}
+
+static void capture_stop_cmd(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct capture* capture = &dbg->conn.capture;
+    if (!capture->f) {
+        debugger_print_error(dbg, "Not capturing.");
+        return;
+    }
+
+    size_t frames = capture->frames;
+    char path[strlen(capture->path) + 1];
+    strcpy(path, capture->path);
+    if (!capture_stop(capture)) {
+        debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+        return;
+    }
+
+    printf("Captured %zu frames to '%s'.\n", frames, path);
+}
+
+static void capture_status(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    const struct capture* capture = &dbg->conn.capture;
+    if (capture->f) {
+        printf("Capturing to '%s', %zu frames so far.\n", capture->path, capture->frames);
+    } else {
+        puts("Not capturing.");
+    }
+}
+
+static void capture_replay(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) replay_capture(dbg, args->positionals[0].as_str);
+}
+
+static const struct cmd* capture_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "start", "Record all frames exchanged with the device to a file, with timestamps. Capturing continues across reconnects.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "The capture file to create."},
+            {}
+        },
+        .payload = capture_start_cmd
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "stop", "Stop capturing, and close the capture file.", {.leaf = {
+        .payload = capture_stop_cmd
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "status", "Show whether a capture is being recorded.", {.leaf = {
+        .payload = capture_status
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "replay", "Send the requests of a capture to the connected device again, and compare the latencies per command. Note that this repeats any writes and erases in the capture.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "The capture file to replay."},
+            {}
+        },
+        .payload = capture_replay
+    }}},
+    NULL
+};
+
+const struct cmd command_capture = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "capture",
+    .help = "Record the traffic with the device, and replay it for performance analysis.",
+    {.directory = {capture_commands}}
+};
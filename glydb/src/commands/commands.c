@@ -1,6 +1,8 @@
 #include "commands/commands.h"
 #include "debugger.h"
 #include "connection.h"
+#include "target.h"
+#include "clock.h"
 
 #include "common/glycon.h"
 
@@ -14,8 +16,23 @@ const struct cmd* commands[] = {
     &command_memory,
     &command_connection,
     &command_ping,
+    &command_bench,
     &command_flash,
     &command_disassemble,
+    &command_cache,
+    &command_jobs,
+    &command_wait,
+    &command_cancel,
+    &command_stats,
+    &command_capture,
+    &command_markers,
+    &command_profile,
+    &command_symbols,
+    &command_trace,
+    &command_break,
+    &command_bus,
+    &command_mailbox,
+    &command_analyzer,
     NULL
 };
 
@@ -70,7 +87,7 @@ bool subcommand_write(struct debugger* dbg, const struct cmd_parse_result* args,
 }
 
 const struct cmd_option subcommand_load_opts[] = {
-    {"type", 't', VALUE_TYPE_STR, "file type", "Override file type to either ihx or bin (default: infer from filename)."},
+    {"type", 't', VALUE_TYPE_STR, "file type", "Override file type to ihx, bin or gli (default: infer from filename)."},
     {}
 };
 
@@ -97,14 +114,62 @@ bool subcommand_load(struct debugger* dbg, const struct cmd_parse_result* args,
     return debugger_load_file(dbg, &opts, ops, buffer);
 }
 
-bool subcommand_open(struct debugger* dbg, const char* port) {
+void subcommand_transfer_begin(struct debugger* dbg, struct subcommand_transfer* t) {
+    t->has_bus_usage = target_supports(dbg, BDBP_CMD_BUS) && !target_bus_usage(dbg, NULL, &t->bus);
+    t->start_us = clock_now_us();
+}
+
+void subcommand_transfer_end(struct debugger* dbg, struct subcommand_transfer* t, const struct debugger_write_op* ops) {
+    double seconds = (clock_now_us() - t->start_us) / 1e6;
+    size_t bytes = 0;
+    for (const struct debugger_write_op* op = ops; op->len > 0; ++op)
+        bytes += op->len;
+
+    printf("Transferred %zu bytes in %.2f s", bytes, seconds);
+    if (seconds > 0)
+        printf(" (%.1f KiB/s)", bytes / 1024.0 / seconds);
+    puts(".");
+
+    struct target_bus_usage end;
+    if (!t->has_bus_usage || target_bus_usage(dbg, NULL, &end))
+        return;
+
+    uint32_t holds = end.holds - t->bus.holds;
+    double stall_ms = (uint32_t) (end.hold_ticks - t->bus.hold_ticks) / end.ticks_per_us / 1000;
+    printf("The Z80 was held off the bus for %.1f ms in %lu holds", stall_ms, (unsigned long) holds);
+    if (seconds > 0)
+        printf(", %.1f%% of the time", stall_ms / 10 / seconds);
+    if (end.burst > 0)
+        printf(", with at most %u bytes per hold and %u us between them", end.burst, end.gap_us);
+    puts(".");
+}
+
+bool subcommand_open(struct debugger* dbg, const char* port, bool reset) {
     if (conn_is_open(&dbg->conn)) {
         debugger_print_error(dbg, "A connection is already open. Close it first with `connection close`.");
         return true;
-    } else if (!conn_open_serial(&dbg->conn, port)) {
-        debugger_print_error(dbg, "Failed to open serial port '%s': %s.", port, strerror(errno));
+    } else if (!conn_open(&dbg->conn, port)) {
+        debugger_print_error(dbg, "Failed to open '%s': %s.", port, strerror(errno));
         return true;
     }
 
+    target_forget(dbg);
+
+    if (reset) {
+        if (!conn_reset_device(&dbg->conn)) {
+            debugger_print_error(dbg, "Failed to reset device: %s.", strerror(errno));
+            goto err_close;
+        }
+        dbg->conn.reset_on_open = true;
+    }
+
+    if (target_sync(dbg))
+        goto err_close;
+
+    printf("Device ready after %.1f ms%s.\n", dbg->conn.ready_time_us / 1000.0, dbg->conn.reset_on_open ? " (device was reset)" : "");
     return false;
+
+err_close:
+    conn_close(&dbg->conn);
+    return true;
 }
@@ -4,9 +4,11 @@
 #include "common/glycon.h"
 
 #include "command.h"
+#include "target.h"
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 struct debugger;
 struct debugger_write_op;
@@ -23,8 +25,23 @@ extern const struct cmd command_quit;
 extern const struct cmd command_memory;
 extern const struct cmd command_connection;
 extern const struct cmd command_ping;
+extern const struct cmd command_bench;
 extern const struct cmd command_flash;
 extern const struct cmd command_disassemble;
+extern const struct cmd command_cache;
+extern const struct cmd command_jobs;
+extern const struct cmd command_wait;
+extern const struct cmd command_cancel;
+extern const struct cmd command_stats;
+extern const struct cmd command_capture;
+extern const struct cmd command_markers;
+extern const struct cmd command_profile;
+extern const struct cmd command_symbols;
+extern const struct cmd command_trace;
+extern const struct cmd command_break;
+extern const struct cmd command_bus;
+extern const struct cmd command_mailbox;
+extern const struct cmd command_analyzer;
 
 // A structure describing the target location of some amount of bytes that needs
 // to be written. Bytes themselves are stored externally.
@@ -59,13 +76,32 @@ extern const struct cmd_positional subcommand_load_pos[];
 // Note that a file may return multiple disjoint regions that need to be written to the device. For this reason
 // this function accepts a pointer to a buffer that will be allocated with an array of `write` operations, each
 // containing some number of bytes and a base address. The actual data for these operations will be written to `buffer`
-// in a packed sequence, in the same order as appears in `areas`.
+// in a packed sequence, in the same order as appears in `ops`. The array is sorted by address and terminated
+// by an operation of length 0.
 // Returns `true` if an error occurred, or `false` on success. In the former case, an error message
 // is already printed.
 bool subcommand_load(struct debugger* dbg, const struct cmd_parse_result* args, struct debugger_write_op** ops, uint8_t* buffer);
 
-// Handle the common `open` command. This attempts to open a connection to `port`, and prints
-// an error message on failure. Returns `true` if an error occurred, or `false` on success.
-bool subcommand_open(struct debugger* dbg, const char* port);
+// Shared reporting of large transfers between memory/flash commands.
+
+// A transfer that is measured with `subcommand_transfer_begin`.
+struct subcommand_transfer {
+    uint64_t start_us;
+    // Whether the device reports how long it holds the bus, and the report at the start.
+    bool has_bus_usage;
+    struct target_bus_usage bus;
+};
+
+// Start measuring a transfer.
+void subcommand_transfer_begin(struct debugger* dbg, struct subcommand_transfer* t);
+
+// Print the throughput of a transfer of the data of `ops` that succeeded, and how long the Z80
+// was held off the bus meanwhile, if the device reports that.
+void subcommand_transfer_end(struct debugger* dbg, struct subcommand_transfer* t, const struct debugger_write_op* ops);
+
+// Handle the common `open` command. This attempts to open a connection to `port` and waits
+// until the device is ready, and prints an error message on failure. If `reset` is set, the device
+// is reset after opening the port. Returns `true` if an error occurred, or `false` on success.
+bool subcommand_open(struct debugger* dbg, const char* port, bool reset);
 
 #endif
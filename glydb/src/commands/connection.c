@@ -1,6 +1,7 @@
 #include "commands/commands.h"
 #include "debugger.h"
 #include "connection.h"
+#include "target.h"
 
 #include <stdio.h>
 #include <errno.h>
@@ -8,28 +9,69 @@
 
 static void connection_open(struct debugger* dbg, const struct cmd_parse_result* args) {
     const char* path = args->positionals_len == 0 ? "/dev/ttyUSB0" : args->positionals[0].as_str;
-    (void) subcommand_open(dbg, path);
+    bool reset = args->options[0].present;
+    (void) subcommand_open(dbg, path, reset);
 }
 
 static void connection_close(struct debugger* dbg, const struct cmd_parse_result* args) {
     (void) args;
     conn_close(&dbg->conn);
+    target_forget(dbg);
 }
 
 static void connection_status(struct debugger* dbg, const struct cmd_parse_result* args) {
     (void) args;
     if (conn_is_open(&dbg->conn)) {
-        printf("Currently connected to serial device on port '%s'.\n", dbg->conn.port);
+        switch (dbg->conn.transport) {
+            case CONN_TRANSPORT_SERIAL:
+                printf("Currently connected to serial device on port '%s'.\n", dbg->conn.port);
+                break;
+            case CONN_TRANSPORT_SOCKET:
+                printf("Currently connected to bridge at '%s'.\n", dbg->conn.port);
+                break;
+        }
+        printf("Device became ready %.1f ms after opening%s.\n", dbg->conn.ready_time_us / 1000.0, dbg->conn.reset_on_open ? " (device was reset)" : "");
     } else {
         puts("No active connection.");
     }
 }
 
+static void connection_info(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    const struct target_info* info = target_get_info(dbg);
+    if (!info)
+        return;
+
+    if (info->version == 0) {
+        puts("Device firmware predates capability reporting.");
+        return;
+    }
+
+    printf("Protocol version: %u\n", info->version);
+    printf("Firmware build: %08X\n", info->build_id);
+    printf("Maximum message length: %u bytes\n", info->max_msg_len);
+    printf("Receive buffer: %u bytes\n", info->rx_buffer_size);
+    if (info->tx_buffer_size == 0) {
+        puts("Transmit buffer: none");
+    } else {
+        printf("Transmit buffer: %u bytes\n", info->tx_buffer_size);
+    }
+    printf("Supported commands:");
+    for (unsigned cmd = 0; cmd < 64; ++cmd) {
+        if (info->commands & BDBP_CMD_BIT(cmd))
+            printf(" %02X", cmd);
+    }
+    puts("");
+}
+
 static const struct cmd* connection_commands[] = {
     &(struct cmd){CMD_TYPE_LEAF, "open", "Open a new connection.", {.leaf = {
-        .options = NULL, // TODO: Serial port options?
+        .options = (struct cmd_option[]){
+            {"reset", 'r', VALUE_TYPE_BOOL, NULL, "Reset the device after opening the port. By default, the device is only reset if opening the port does so."},
+            {}
+        },
         .positionals = (struct cmd_positional[]){
-            {VALUE_TYPE_STR, "port", "The serial port to connect to (default: /dev/ttyUSB0).", CMD_OPTIONAL},
+            {VALUE_TYPE_STR, "port", "The serial port or bridge socket to connect to (default: /dev/ttyUSB0).", CMD_OPTIONAL},
             {}
         },
         .payload = connection_open
@@ -40,6 +82,9 @@ static const struct cmd* connection_commands[] = {
     &(struct cmd){CMD_TYPE_LEAF, "status", "Show information about the currently active connection.", {.leaf = {
         .payload = connection_status
     }}},
+    &(struct cmd){CMD_TYPE_LEAF, "info", "Show the capabilities of the connected device's firmware.", {.leaf = {
+        .payload = connection_info
+    }}},
     NULL
 };
 
@@ -9,24 +9,35 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-// TODO: handle multiple
-static void flash_write_op(struct debugger* dbg, const struct debugger_write_op* op) {
+// Check that `op` lies within flash. Returns `true` and prints an error if it does not.
+static bool flash_check_op(struct debugger* dbg, const struct debugger_write_op* op) {
     if (!glycon_is_flash_addr(op->address)) {
-        debugger_print_error(dbg, "Base address does not lie within flash address space. Use `memory write` to write to ram.");
-        return;
+        debugger_print_error(dbg, "Base address %05X does not lie within flash address space. Use `memory write` to write to ram.", op->address);
+        return true;
     } else if (op->address + op->len > GLYCON_FLASH_END) {
         debugger_print_error(dbg, "Write overflows flash address space.");
+        return true;
     }
 
-    target_write_flash(dbg, op->address, op->len, dbg->scratch);
+    return false;
+}
+
+// Check all operations in `ops`, see `flash_check_op`.
+static bool flash_check_ops(struct debugger* dbg, const struct debugger_write_op* ops) {
+    for (const struct debugger_write_op* op = ops; op->len > 0; ++op) {
+        if (flash_check_op(dbg, op))
+            return true;
+    }
+
+    return false;
 }
 
 static void flash_write(struct debugger* dbg, const struct cmd_parse_result* args) {
     struct debugger_write_op op;
-    if (subcommand_write(dbg, args, &op, dbg->scratch))
+    if (subcommand_write(dbg, args, &op, dbg->scratch) || flash_check_op(dbg, &op))
         return;
 
-    flash_write_op(dbg, &op);
+    target_write_flash(dbg, op.address, op.len, dbg->scratch);
 }
 
 static void flash_info(struct debugger* dbg, const struct cmd_parse_result* args) {
@@ -49,16 +60,23 @@ static void flash_erase_sector(struct debugger* dbg, const struct cmd_parse_resu
         return;
     }
 
-    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
-    bdbp_pkt_init(pkt, BDBP_CMD_ERASE_SECTOR);
-    bdbp_pkt_append_addr(pkt, address);
-    target_exec_cmd(dbg, pkt);
+    target_erase_flash(dbg, address, 1);
 }
 
 static void flash_erase_chip(struct debugger* dbg, const struct cmd_parse_result* args) {
-    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
-    bdbp_pkt_init(pkt, BDBP_CMD_ERASE_CHIP);
-    target_exec_cmd(dbg, pkt);
+    target_erase_flash(dbg, GLYCON_FLASH_START, GLYCON_FLASH_SIZE);
+}
+
+// Write all operations in `ops`, whose data is packed into the scratch buffer, and report the
+// throughput. Nothing is written unless all operations are valid.
+static void flash_write_ops(struct debugger* dbg, const struct debugger_write_op* ops, bool erase) {
+    if (flash_check_ops(dbg, ops))
+        return;
+
+    struct subcommand_transfer t;
+    subcommand_transfer_begin(dbg, &t);
+    if (!target_write_ops(dbg, ops, dbg->scratch, erase))
+        subcommand_transfer_end(dbg, &t, ops);
 }
 
 static void flash_load(struct debugger* dbg, const struct cmd_parse_result* args) {
@@ -66,7 +84,7 @@ static void flash_load(struct debugger* dbg, const struct cmd_parse_result* args
     if (subcommand_load(dbg, args, &ops, dbg->scratch))
         return;
 
-    flash_write_op(dbg, &ops[0]);
+    flash_write_ops(dbg, ops, false);
     free(ops);
 }
 
@@ -75,19 +93,7 @@ static void flash_program(struct debugger* dbg, struct cmd_parse_result* args) {
     if (subcommand_load(dbg, args, &ops, dbg->scratch))
         return;
 
-    // TODO: Verify file before erasing?
-    // TODO: Move this to target.c
-    for (size_t address = GLYCON_FLASH_START; address < GLYCON_FLASH_END; address += GLYCON_FLASH_SECTOR_SIZE) {
-        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
-        bdbp_pkt_init(pkt, BDBP_CMD_ERASE_SECTOR);
-        bdbp_pkt_append_addr(pkt, address);
-        if (target_exec_cmd(dbg, pkt)) {
-            goto free_ops;
-        }
-    }
-
-    flash_write_op(dbg, &ops[0]);
-free_ops:
+    flash_write_ops(dbg, ops, true);
     free(ops);
 }
 
@@ -125,7 +131,7 @@ static const struct cmd* flash_commands[] = {
         .positionals = subcommand_load_pos,
         .payload = flash_load
     }}},
-    &(struct cmd){CMD_TYPE_LEAF, "program", "Erase flash address space and load file.", {.leaf = {
+    &(struct cmd){CMD_TYPE_LEAF, "program", "Erase the flash sectors that a file occupies and load it.", {.leaf = {
         .options = subcommand_load_opts,
         .positionals = subcommand_load_pos,
         .payload = flash_program
@@ -170,6 +170,7 @@ const struct cmd command_help = {
             {VALUE_TYPE_STR, "command", "Command to get help for.", CMD_OPTIONAL | CMD_VARIADIC},
             {}
         },
-        .payload = help
+        .payload = help,
+        .local = true
     }
 }};
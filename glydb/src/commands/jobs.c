@@ -0,0 +1,79 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "jobs.h"
+
+#include <stdio.h>
+
+// Return the job ID given as the first positional, or 0 if none was given. Returns -1 and prints
+// an error if the ID is invalid.
+static int64_t job_id_arg(struct debugger* dbg, const struct cmd_parse_result* args) {
+    if (args->positionals_len == 0)
+        return 0;
+
+    int64_t id = args->positionals[0].as_int;
+    if (id < 1) {
+        debugger_print_error(dbg, "Invalid job ID %ld.", id);
+        return -1;
+    }
+
+    return id;
+}
+
+static void list_jobs(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    jobs_list(&dbg->jobs);
+}
+
+static void wait_for_jobs(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t id = job_id_arg(dbg, args);
+    if (id >= 0 && jobs_wait(&dbg->jobs, id) && id != 0)
+        debugger_print_error(dbg, "Job %ld did not complete.", id);
+}
+
+static void cancel_jobs(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t id = job_id_arg(dbg, args);
+    if (id >= 0)
+        jobs_cancel(&dbg->jobs, id);
+}
+
+const struct cmd command_jobs = {
+    .type = CMD_TYPE_LEAF,
+    .name = "jobs",
+    .help = "List background jobs with their progress and throughput. Run a command in the background by ending it with '&'.",
+    {.leaf = {
+        .options = NULL,
+        .positionals = NULL,
+        .payload = list_jobs,
+        .local = true
+    }
+}};
+
+const struct cmd command_wait = {
+    .type = CMD_TYPE_LEAF,
+    .name = "wait",
+    .help = "Wait for background jobs to finish.",
+    {.leaf = {
+        .options = NULL,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "id", "The job to wait for (default: all jobs).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = wait_for_jobs,
+        .local = true
+    }
+}};
+
+const struct cmd command_cancel = {
+    .type = CMD_TYPE_LEAF,
+    .name = "cancel",
+    .help = "Cancel background jobs. A running job stops after the packet it is transferring.",
+    {.leaf = {
+        .options = NULL,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "id", "The job to cancel (default: all jobs).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = cancel_jobs,
+        .local = true
+    }
+}};
@@ -0,0 +1,303 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "buffer.h"
+#include "clock.h"
+#include "target.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// How long `mailbox send` waits before it tries again when the Z80's ring is full.
+#define MAILBOX_RETRY_US (1000)
+
+// The Z80 maps physical memory in pages of this size, which the mailbox must not cross.
+#define MAILBOX_PAGE_SIZE (0x4000)
+
+// The state of the device's mailbox, as reported by the last BDBP_CMD_MAILBOX response.
+struct mailbox_status {
+    bool open;
+    uint8_t sent;
+    gly_addr_t address;
+};
+
+// Send a BDBP_CMD_MAILBOX request with the operation and arguments in `pkt`.
+static bool mailbox_exec(struct debugger* dbg, uint8_t* pkt, struct mailbox_status* status) {
+    if (!target_supports(dbg, BDBP_CMD_MAILBOX)) {
+        debugger_print_error(dbg, "The device firmware does not support a mailbox.");
+        return true;
+    }
+
+    if (target_exec_cmd(dbg, pkt))
+        return true;
+
+    if (pkt[BDBP_FIELD_DATA_LEN] != BDBP_MAILBOX_DATA_LENGTH) {
+        debugger_print_error(dbg, "Device returned a malformed mailbox status.");
+        return true;
+    }
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    status->open = data[0] != 0;
+    status->sent = data[1];
+    status->address = data[2] | data[3] << 8 | (gly_addr_t) data[4] << 16;
+    return false;
+}
+
+static bool mailbox_op(struct debugger* dbg, enum bdbp_mailbox_op op, struct mailbox_status* status) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_MAILBOX);
+    bdbp_pkt_append_u8(pkt, op);
+    return mailbox_exec(dbg, pkt, status);
+}
+
+// Return the time between `start_us` and `end_us` in seconds, and the rate of `len` bytes in
+// KiB/s.
+static double mailbox_rate(size_t len, uint64_t start_us, uint64_t end_us, double* seconds) {
+    *seconds = (end_us - start_us) / 1000000.0;
+    return *seconds > 0 ? len / 1024.0 / *seconds : 0;
+}
+
+static void mailbox_open(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t address = args->positionals[0].as_int;
+    if (address < GLYCON_RAM_START || address + GLYCON_MAILBOX_SIZE > GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "The mailbox must be in RAM, at [%05X, %05X].", GLYCON_RAM_START, GLYCON_ADDRSPACE_SIZE - GLYCON_MAILBOX_SIZE);
+        return;
+    }
+
+    if (address % 0x100 != 0 || address / MAILBOX_PAGE_SIZE != (address + GLYCON_MAILBOX_SIZE - 1) / MAILBOX_PAGE_SIZE) {
+        debugger_print_error(dbg, "The mailbox must start at a multiple of 0x100, and must not cross a page.");
+        return;
+    }
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_MAILBOX);
+    bdbp_pkt_append_u8(pkt, BDBP_MAILBOX_OP_OPEN);
+    bdbp_pkt_append_addr(pkt, address);
+
+    struct mailbox_status status;
+    if (mailbox_exec(dbg, pkt, &status))
+        return;
+
+    dbg->mailbox.size = 0;
+    dbg->mailbox_dropped = 0;
+    printf("Mailbox open at %05X.\n", status.address);
+}
+
+static void mailbox_close(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct mailbox_status status;
+    (void) mailbox_op(dbg, BDBP_MAILBOX_OP_CLOSE, &status);
+}
+
+static void mailbox_status(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct mailbox_status status;
+    if (mailbox_op(dbg, BDBP_MAILBOX_OP_STATUS, &status))
+        return;
+
+    if (status.open)
+        printf("Mailbox open at %05X", status.address);
+    else
+        printf("Mailbox closed");
+    printf(", %zu bytes received and not yet shown", dbg->mailbox.size);
+    if (dbg->mailbox_dropped > 0)
+        printf(", %zu bytes dropped", dbg->mailbox_dropped);
+    puts(".");
+}
+
+// Read the whole file at `path` into `buf`. Returns `true` and prints an error on failure.
+static bool mailbox_read_file(struct debugger* dbg, const char* path, struct buffer* buf) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    uint8_t chunk[4096];
+    size_t len;
+    while ((len = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        buffer_push_data(buf, len, chunk);
+
+    bool failed = ferror(f);
+    if (failed)
+        debugger_print_error(dbg, "Failed to read file '%s': %s.", path, strerror(errno));
+    fclose(f);
+    return failed;
+}
+
+// Send all of `data` to the Z80, waiting while its ring is full. Bytes that the Z80 sends
+// meanwhile are kept for `mailbox receive`.
+static bool mailbox_send_data(struct debugger* dbg, size_t len, const uint8_t* data) {
+    size_t offset = 0;
+    while (offset < len) {
+        size_t chunk = len - offset < GLYCON_MAILBOX_RING_SIZE ? len - offset : GLYCON_MAILBOX_RING_SIZE;
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_MAILBOX);
+        bdbp_pkt_append_u8(pkt, BDBP_MAILBOX_OP_SEND);
+        for (size_t i = 0; i < chunk; ++i)
+            bdbp_pkt_append_u8(pkt, data[offset + i]);
+
+        struct mailbox_status status;
+        if (mailbox_exec(dbg, pkt, &status))
+            return true;
+
+        if (!status.open) {
+            debugger_print_error(dbg, "The mailbox is closed, see `mailbox open`.");
+            return true;
+        }
+
+        offset += status.sent;
+        if (status.sent == 0 && target_await_event_until(dbg, clock_now_us() + MAILBOX_RETRY_US) < 0)
+            return true;
+    }
+
+    return false;
+}
+
+static void mailbox_send(struct debugger* dbg, const struct cmd_parse_result* args) {
+    struct buffer data;
+    buffer_init(&data);
+    if (args->positionals_len > 0) {
+        const char* text = args->positionals[0].as_str;
+        buffer_push_data(&data, strlen(text), text);
+    }
+
+    if (args->options[1].present && mailbox_read_file(dbg, args->options[1].value.as_str, &data)) {
+        buffer_deinit(&data);
+        return;
+    }
+
+    if (args->options[0].present)
+        buffer_push_data(&data, 1, "\n");
+
+    uint64_t start = clock_now_us();
+    if (!mailbox_send_data(dbg, data.size, data.data) && data.size > GLYCON_MAILBOX_RING_SIZE) {
+        double seconds;
+        double rate = mailbox_rate(data.size, start, clock_now_us(), &seconds);
+        printf("Sent %zu bytes in %.3f s (%.1f KiB/s).\n", data.size, seconds, rate);
+    }
+
+    buffer_deinit(&data);
+}
+
+// Write the bytes received so far to `f`, and forget them. Adds their number to `received`.
+static bool mailbox_flush(struct debugger* dbg, FILE* f, const char* path, size_t* received) {
+    if (dbg->mailbox.size == 0)
+        return false;
+
+    size_t len = dbg->mailbox.size;
+    dbg->mailbox.size = 0;
+    if (fwrite(dbg->mailbox.data, 1, len, f) != len) {
+        debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+        return true;
+    }
+    fflush(f);
+    *received += len;
+    return false;
+}
+
+static void mailbox_receive(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t idle_ms = args->options[1].present ? args->options[1].value.as_int : -1;
+    if (args->options[1].present && idle_ms < 0) {
+        debugger_print_error(dbg, "Idle time must not be negative.");
+        return;
+    }
+
+    struct mailbox_status status;
+    if (mailbox_op(dbg, BDBP_MAILBOX_OP_STATUS, &status))
+        return;
+
+    if (!status.open && dbg->mailbox.size == 0) {
+        debugger_print_error(dbg, "The mailbox is closed, see `mailbox open`.");
+        return;
+    }
+
+    const char* path = args->options[0].present ? args->options[0].value.as_str : "<stdout>";
+    FILE* f = stdout;
+    if (args->options[0].present) {
+        f = fopen(path, "wb");
+        if (!f) {
+            debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+            return;
+        }
+    }
+
+    size_t dropped = dbg->mailbox_dropped;
+    size_t received = 0;
+    uint64_t start = clock_now_us();
+    uint64_t last = start;
+    bool failed = mailbox_flush(dbg, f, path, &received);
+    while (!failed && status.open) {
+        uint64_t until = idle_ms < 0 ? UINT64_MAX : last + (uint64_t) idle_ms * 1000;
+        int result = target_await_event_until(dbg, until);
+        if (result < 0)
+            failed = true;
+        if (result <= 0)
+            break;
+        if (dbg->mailbox.size > 0)
+            last = clock_now_us();
+        failed = mailbox_flush(dbg, f, path, &received);
+    }
+
+    if (f != stdout) {
+        if (fclose(f) != 0 && !failed)
+            debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+
+        // Up to the last byte, so that the idle time isn't counted.
+        double seconds;
+        double rate = mailbox_rate(received, start, last, &seconds);
+        printf("Received %zu bytes in %.3f s (%.1f KiB/s).\n", received, seconds, rate);
+    }
+
+    if (dbg->mailbox_dropped > dropped)
+        debugger_print_error(dbg, "%zu bytes were dropped because nothing took them in time.", dbg->mailbox_dropped - dropped);
+}
+
+static const struct cmd* mailbox_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "open", "Start exchanging bytes through the mailbox at an address. The Z80 must have cleared its indices, and should keep its code out of the way of the mailbox.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The physical address of the mailbox, in RAM and a multiple of 0x100."},
+            {}
+        },
+        .payload = mailbox_open
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "close", "Stop polling the mailbox, so that the Z80 is no longer held off the bus for it.", {.leaf = {
+        .payload = mailbox_close
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "status", "Show whether the mailbox is open, and how many received bytes are waiting.", {.leaf = {
+        .payload = mailbox_status
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "send", "Send text or a file to the Z80, waiting while its ring is full. Use `\\ ` for spaces in the text.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"newline", 'n', VALUE_TYPE_BOOL, NULL, "Send a newline after the text or file."},
+            {"file", 'f', VALUE_TYPE_STR, "path", "Send the contents of a file after the text."},
+            {}
+        },
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "text", "The text to send.", CMD_OPTIONAL},
+            {}
+        },
+        .payload = mailbox_send
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "receive", "Show the bytes that the Z80 sent, and keep showing them as they arrive. Run it in the background with `&` to watch the Z80's output, and stop it with `cancel` before other commands use the device. Through a bridge, every client receives all of the bytes.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"output", 'o', VALUE_TYPE_STR, "path", "Write the bytes to a file instead, and report the throughput."},
+            {"idle", 'i', VALUE_TYPE_INT, "ms", "Stop when no bytes arrived for this long (default: until cancelled)."},
+            {}
+        },
+        .payload = mailbox_receive
+    }}},
+    NULL
+};
+
+const struct cmd command_mailbox = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "mailbox",
+    .help = "Exchange bytes with Z80 code through a mailbox in RAM, as a console or a data channel. While it is open, the device checks it every millisecond and whenever it is idle, holding the Z80 off the bus for a few microseconds each time. Bytes are only collected while the debugger talks to the device.",
+    {.directory = {mailbox_commands}}
+};
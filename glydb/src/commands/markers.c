@@ -0,0 +1,214 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "buffer.h"
+#include "target.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// A benchmark marker, as fetched from the device.
+struct marker {
+    uint8_t id;
+    // The device's cycle counter when the marker was seen.
+    uint32_t cycles;
+};
+
+// The state of the device's recording, as reported by the last BDBP_CMD_MARKERS response.
+struct marker_state {
+    bool recording;
+    unsigned cpu_khz;
+    unsigned dropped;
+};
+
+// Statistics of the time between two consecutive markers with particular IDs.
+struct marker_pair {
+    uint8_t from;
+    uint8_t to;
+    size_t count;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+};
+
+// Send a BDBP_CMD_MARKERS request with `flags`, and keep fetching until the device's log is
+// empty. The markers are appended to `markers`.
+static bool markers_fetch(struct debugger* dbg, uint8_t flags, struct buffer* markers, struct marker_state* state) {
+    if (!target_supports(dbg, BDBP_CMD_MARKERS)) {
+        debugger_print_error(dbg, "The device firmware does not support benchmark markers.");
+        return true;
+    }
+
+    uint8_t count;
+    do {
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_MARKERS);
+        bdbp_pkt_append_u8(pkt, flags);
+        if (target_exec_cmd(dbg, pkt))
+            return true;
+        flags = 0;
+
+        const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+        count = pkt[BDBP_FIELD_DATA_LEN] >= BDBP_MARKERS_HEADER_LENGTH ? data[5] : 0;
+        if (pkt[BDBP_FIELD_DATA_LEN] != BDBP_MARKERS_HEADER_LENGTH + count * BDBP_MARKERS_ENTRY_LENGTH) {
+            debugger_print_error(dbg, "Device returned a malformed marker log.");
+            return true;
+        }
+
+        state->recording = (data[0] & BDBP_MARKERS_STATE_RECORDING) != 0;
+        state->cpu_khz = bdbp_read_u16(&data[1]);
+        state->dropped = bdbp_read_u16(&data[3]);
+        for (uint8_t i = 0; i < count; ++i) {
+            const uint8_t* entry = &data[BDBP_MARKERS_HEADER_LENGTH + i * BDBP_MARKERS_ENTRY_LENGTH];
+            struct marker m = {.id = entry[0], .cycles = bdbp_read_u32(&entry[1])};
+            buffer_push_data(markers, sizeof m, &m);
+        }
+    } while (count == BDBP_MARKERS_MAX_COUNT);
+
+    return false;
+}
+
+// Print the markers that were fetched, and the time between each pair of consecutive markers.
+static void markers_report(struct debugger* dbg, const struct buffer* buf, const struct marker_state* state, bool list) {
+    const struct marker* markers = buf->data;
+    size_t len = buf->size / sizeof(struct marker);
+    if (state->cpu_khz == 0) {
+        debugger_print_error(dbg, "Device reported an invalid clock.");
+        return;
+    }
+
+    double cycles_per_us = state->cpu_khz / 1000.0;
+    double z80_per_cycle = GLYCON_Z80_CLOCK_HZ / (state->cpu_khz * 1000.0);
+
+    printf("%zu markers", len);
+    if (state->dropped > 0)
+        printf(", %u more dropped because the device's log was full", state->dropped);
+    printf(". Recording is %s.\n", state->recording ? "still running" : "stopped");
+
+    if (list && len > 0) {
+        printf("%6s %4s %14s %12s %12s\n", "marker", "id", "time us", "delta us", "Z80 cycles");
+        uint64_t time = 0;
+        for (size_t i = 0; i < len; ++i) {
+            // The counter wraps around, but consecutive markers are never that far apart.
+            uint32_t delta = i > 0 ? markers[i].cycles - markers[i - 1].cycles : 0;
+            time += delta;
+            printf("%6zu %4u %14.3f", i, markers[i].id, time / cycles_per_us);
+            if (i > 0)
+                printf(" %12.3f %12.0f", delta / cycles_per_us, delta * z80_per_cycle);
+            puts("");
+        }
+    }
+
+    if (len < 2)
+        return;
+
+    struct buffer pairs_buf;
+    buffer_init(&pairs_buf);
+    for (size_t i = 1; i < len; ++i) {
+        uint8_t from = markers[i - 1].id;
+        uint8_t to = markers[i].id;
+        uint32_t delta = markers[i].cycles - markers[i - 1].cycles;
+
+        struct marker_pair* pairs = pairs_buf.data;
+        size_t n = pairs_buf.size / sizeof(struct marker_pair);
+        size_t j = 0;
+        while (j < n && (pairs[j].from != from || pairs[j].to != to))
+            ++j;
+        if (j == n) {
+            struct marker_pair p = {.from = from, .to = to, .min_cycles = UINT32_MAX};
+            buffer_push_data(&pairs_buf, sizeof p, &p);
+            pairs = pairs_buf.data;
+        }
+
+        struct marker_pair* p = &pairs[j];
+        ++p->count;
+        p->total_cycles += delta;
+        if (delta < p->min_cycles)
+            p->min_cycles = delta;
+        if (delta > p->max_cycles)
+            p->max_cycles = delta;
+    }
+
+    printf("%4s %4s %7s %12s %12s %12s %12s\n", "from", "to", "count", "mean us", "min cycles", "mean cycles", "max cycles");
+    const struct marker_pair* pairs = pairs_buf.data;
+    size_t n = pairs_buf.size / sizeof(struct marker_pair);
+    for (size_t j = 0; j < n; ++j) {
+        const struct marker_pair* p = &pairs[j];
+        double mean = p->total_cycles / (double) p->count;
+        printf(
+            "%4u %4u %7zu %12.3f %12.0f %12.1f %12.0f\n",
+            p->from,
+            p->to,
+            p->count,
+            mean / cycles_per_us,
+            p->min_cycles * z80_per_cycle,
+            mean * z80_per_cycle,
+            p->max_cycles * z80_per_cycle
+        );
+    }
+    puts("Cycles are Z80 cycles, and include the 18 cycles of emitting the later marker.");
+
+    buffer_deinit(&pairs_buf);
+}
+
+static void markers_start(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct buffer markers;
+    buffer_init(&markers);
+    struct marker_state state;
+    if (!markers_fetch(dbg, BDBP_MARKERS_FLAG_START, &markers, &state)) {
+        printf(
+            "Recording markers. Z80 code emits marker ID with `ld a, ID` and `in a, (0x%02X)`.\n",
+            GLYCON_MARKER_PORT
+        );
+    }
+    buffer_deinit(&markers);
+}
+
+static void markers_fetch_and_report(struct debugger* dbg, const struct cmd_parse_result* args, uint8_t flags) {
+    bool list = args->options[0].present;
+    struct buffer markers;
+    buffer_init(&markers);
+    struct marker_state state;
+    if (!markers_fetch(dbg, flags, &markers, &state))
+        markers_report(dbg, &markers, &state, list);
+    buffer_deinit(&markers);
+}
+
+static void markers_stop(struct debugger* dbg, const struct cmd_parse_result* args) {
+    markers_fetch_and_report(dbg, args, BDBP_MARKERS_FLAG_STOP);
+}
+
+static void markers_show(struct debugger* dbg, const struct cmd_parse_result* args) {
+    markers_fetch_and_report(dbg, args, 0);
+}
+
+static const struct cmd_option markers_report_opts[] = {
+    {"list", 'l', VALUE_TYPE_BOOL, NULL, "Also list every marker with its time."},
+    {}
+};
+
+static const struct cmd* markers_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "start", "Clear the device's marker log and start recording markers.", {.leaf = {
+        .payload = markers_start
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "stop", "Stop recording, and show the markers that were not shown yet.", {.leaf = {
+        .options = markers_report_opts,
+        .payload = markers_stop
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "show", "Show the markers recorded since they were last shown, and keep recording. The device holds a limited number of markers, and misses markers while it handles requests.", {.leaf = {
+        .options = markers_report_opts,
+        .payload = markers_show
+    }}},
+    NULL
+};
+
+const struct cmd command_markers = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "markers",
+    .help = "Time Z80 code on the device with benchmark markers: reads from a reserved I/O port, which the coprocessor timestamps. Shows the time between consecutive markers.",
+    {.directory = {markers_commands}}
+};
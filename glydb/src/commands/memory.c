@@ -1,30 +1,61 @@
 #include "commands/commands.h"
 #include "debugger.h"
 #include "target.h"
+#include "image.h"
+#include "clock.h"
 
 #include "common/glycon.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 
-// TODO: handle multiple
-static void memory_write_op(struct debugger* dbg, const struct debugger_write_op* op) {
+// Check that `op` lies within ram. Returns `true` and prints an error if it does not.
+static bool memory_check_op(struct debugger* dbg, const struct debugger_write_op* op) {
     if (!glycon_is_ram_addr(op->address)) {
-        debugger_print_error(dbg, "Base address does not lie within ram address space. Use `flash write` to write to flash storage.");
-        return;
+        debugger_print_error(dbg, "Base address %05X does not lie within ram address space. Use `flash write` to write to flash storage.", op->address);
+        return true;
     } else if (op->address + op->len > GLYCON_RAM_END) {
         debugger_print_error(dbg, "Write overflows ram address space.");
+        return true;
+    }
+
+    return false;
+}
+
+// Write all operations in `ops`, whose data is packed into the scratch buffer, and report the
+// throughput. Nothing is written unless all operations are valid.
+static void memory_write_ops(struct debugger* dbg, const struct debugger_write_op* ops) {
+    for (const struct debugger_write_op* op = ops; op->len > 0; ++op) {
+        if (memory_check_op(dbg, op))
+            return;
     }
 
-    target_write_memory(dbg, op->address, op->len, dbg->scratch);
+    struct subcommand_transfer t;
+    subcommand_transfer_begin(dbg, &t);
+    if (!target_write_ops(dbg, ops, dbg->scratch, false))
+        subcommand_transfer_end(dbg, &t, ops);
 }
 
 static void memory_write(struct debugger* dbg, const struct cmd_parse_result* args) {
     struct debugger_write_op op;
-    if (subcommand_write(dbg, args, &op, dbg->scratch))
+    if (subcommand_write(dbg, args, &op, dbg->scratch) || memory_check_op(dbg, &op))
         return;
 
-    memory_write_op(dbg, &op);
+    target_write_memory(dbg, op.address, op.len, dbg->scratch);
+}
+
+// Print `len` bytes of memory that start at `address`, 16 to a line.
+static void memory_print_hex(gly_addr_t address, size_t len, const uint8_t data[]) {
+    uint8_t bytes_per_line = 16;
+    for (size_t i = 0; i < len; i += bytes_per_line) {
+        printf("%05X:", (gly_addr_t)(address + i));
+        for (uint8_t j = 0; j < bytes_per_line && j + i < len; ++j) {
+            printf(" %02X", data[j + i]);
+        }
+        puts("");
+    }
 }
 
 static void memory_read(struct debugger* dbg, const struct cmd_parse_result* args) {
@@ -43,14 +74,7 @@ static void memory_read(struct debugger* dbg, const struct cmd_parse_result* arg
     if (target_read_memory(dbg, address, amt, dbg->scratch))
         return;
 
-    uint8_t bytes_per_line = 16;
-    for (size_t i = 0; i < amt; i += bytes_per_line) {
-        printf("%05X:", (gly_addr_t)(address + i));
-        for (uint8_t j = 0; j < bytes_per_line && j + i < amt; ++j) {
-            printf(" %02X", dbg->scratch[j + i]);
-        }
-        puts("");
-    }
+    memory_print_hex(address, amt, dbg->scratch);
 }
 
 static void memory_load(struct debugger* dbg, const struct cmd_parse_result* args) {
@@ -58,10 +82,361 @@ static void memory_load(struct debugger* dbg, const struct cmd_parse_result* arg
     if (subcommand_load(dbg, args, &ops, dbg->scratch))
         return;
 
-    memory_write_op(dbg, &ops[0]);
+    memory_write_ops(dbg, ops);
     free(ops);
 }
 
+// The amount of memory that is read before it is written to the image.
+#define DUMP_CHUNK_SIZE (GLYCON_FLASH_SECTOR_SIZE)
+
+// State of a dump that is in progress. The memory that was read is kept in the debugger's scratch
+// buffer, at its own address.
+struct dump {
+    struct image_writer w;
+    // Whether a record is open, and where it starts.
+    bool in_run;
+    gly_addr_t run_start;
+    // Erased flash bytes at the end of the open record, which may yet be left out.
+    gly_addr_t erased_start;
+    size_t erased_len;
+};
+
+// Write the open record up to `end`, leaving out erased flash at its end.
+static bool dump_close_run(struct debugger* dbg, struct dump* d, gly_addr_t end) {
+    if (!d->in_run)
+        return false;
+
+    d->in_run = false;
+    if (d->erased_len > 0)
+        end = d->erased_start;
+    return image_write_record(dbg, &d->w, d->run_start, end - d->run_start, &dbg->scratch[d->run_start]);
+}
+
+// Add the bytes in [`address`, `address + len`) to the dump. Erased flash is left out where that
+// saves space, RAM is always kept.
+static bool dump_add(struct debugger* dbg, struct dump* d, gly_addr_t address, size_t len) {
+    for (gly_addr_t addr = address; addr < address + len; ++addr) {
+        bool flash = glycon_is_flash_addr(addr);
+        if (d->in_run && flash != glycon_is_flash_addr(d->run_start) && dump_close_run(dbg, d, addr))
+            return true;
+
+        if (flash && dbg->scratch[addr] == 0xFF) {
+            if (d->in_run && d->erased_len++ == 0)
+                d->erased_start = addr;
+            continue;
+        }
+
+        // Starting a new record costs a record header.
+        if (d->in_run && d->erased_len > IMAGE_RECORD_HEADER_SIZE && dump_close_run(dbg, d, addr))
+            return true;
+
+        if (!d->in_run) {
+            d->in_run = true;
+            d->run_start = addr;
+        }
+        d->erased_len = 0;
+    }
+
+    return false;
+}
+
+static void memory_dump(struct debugger* dbg, const struct cmd_parse_result* args) {
+    const char* path = args->positionals[0].as_str;
+    int64_t address = args->positionals_len > 1 ? args->positionals[1].as_int : 0;
+    if (address < 0 || address >= GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Address %ld outside of valid range [0, %d).", address, GLYCON_ADDRSPACE_SIZE);
+        return;
+    }
+
+    int64_t len = args->positionals_len > 2 ? args->positionals[2].as_int : GLYCON_ADDRSPACE_SIZE - address;
+    if (len < 1 || address + len > GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Length %ld outside of valid range [1, %ld].", len, GLYCON_ADDRSPACE_SIZE - address);
+        return;
+    }
+
+    // Restoring erases flash by sector, so flash is dumped in whole sectors.
+    int64_t end = address + len;
+    if (address < GLYCON_FLASH_END)
+        address -= address % GLYCON_FLASH_SECTOR_SIZE;
+    if (end < GLYCON_FLASH_END && end % GLYCON_FLASH_SECTOR_SIZE != 0)
+        end += GLYCON_FLASH_SECTOR_SIZE - end % GLYCON_FLASH_SECTOR_SIZE;
+
+    struct dump d = {};
+    if (image_write_begin(dbg, &d.w, path, address, end - address)) {
+        if (d.w.f)
+            image_write_end(dbg, &d.w, true);
+        return;
+    }
+
+    uint64_t start = clock_now_us();
+    bool failed = false;
+    for (gly_addr_t chunk = address; chunk < end && !failed; chunk += DUMP_CHUNK_SIZE) {
+        size_t chunk_len = end - chunk < DUMP_CHUNK_SIZE ? end - chunk : DUMP_CHUNK_SIZE;
+        failed = target_read_memory(dbg, chunk, chunk_len, &dbg->scratch[chunk])
+            || dump_add(dbg, &d, chunk, chunk_len);
+    }
+
+    failed = failed || dump_close_run(dbg, &d, end);
+    if (image_write_end(dbg, &d.w, failed) || failed)
+        return;
+
+    double ms = (clock_now_us() - start) / 1000.0;
+    printf(
+        "Dumped %05lX-%05lX to '%s': %zu bytes in %zu records, %.1f ms.\n",
+        address,
+        end - 1,
+        path,
+        d.w.bytes,
+        d.w.records,
+        ms
+    );
+}
+
+static void memory_restore(struct debugger* dbg, const struct cmd_parse_result* args) {
+    const char* path = args->positionals[0].as_str;
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        return;
+    }
+
+    gly_addr_t address;
+    size_t len;
+    struct debugger_write_op* ops;
+    if (image_read(dbg, path, f, &address, &len, &ops, dbg->scratch))
+        return;
+
+    // Flash that the image leaves out is erased.
+    struct subcommand_transfer t;
+    subcommand_transfer_begin(dbg, &t);
+    if (address < GLYCON_FLASH_END) {
+        size_t flash_len = address + len < GLYCON_FLASH_END ? len : GLYCON_FLASH_END - address;
+        if (target_erase_flash(dbg, address, flash_len))
+            goto free_ops;
+    }
+
+    if (!target_write_ops(dbg, ops, dbg->scratch, false))
+        subcommand_transfer_end(dbg, &t, ops);
+free_ops:
+    free(ops);
+}
+
+// Estimated time for which the coprocessor holds the Z80 off the bus to acquire it, and to read
+// a single byte, see glyco/src/bus.c and TIMING_PIN_DELAY_US. Used to report how much bus time a
+// watch takes from the Z80.
+#define WATCH_BUS_ACQUIRE_US (10)
+#define WATCH_BUS_BYTE_US (1)
+
+// Size of the blocks that a watch digests on the device. Only blocks whose digest changed are
+// read. The device holds the bus for one block at a time.
+#define WATCH_BLOCK_SIZE (32)
+
+// Changed bytes that are at most this many bytes apart are reported together, so that a
+// multi-byte variable is printed as a whole.
+#define WATCH_MERGE_GAP (3)
+
+#define WATCH_DEFAULT_INTERVAL_MS (100)
+
+struct watch {
+    gly_addr_t address;
+    size_t len;
+    // Whether the device digests the watched memory, in which case only changed blocks are read.
+    // Otherwise, all of it is read on every poll.
+    bool use_digests;
+    size_t blocks;
+    // The last known contents of the watched memory, and the latest poll.
+    uint8_t* data;
+    uint8_t* fresh;
+    // Digests of the blocks in `data`, and of the latest poll.
+    uint16_t* digests;
+    uint16_t* fresh_digests;
+    uint64_t start_us;
+    uint64_t polls;
+    uint64_t changes;
+    // Payload bytes received from the device.
+    uint64_t link_bytes;
+    // Bus usage, to estimate the time taken from the Z80.
+    uint64_t bus_acquires;
+    uint64_t bus_bytes;
+};
+
+// Read [`offset`, `offset + len`) of the watched memory into `w->fresh`.
+static bool watch_read(struct debugger* dbg, struct watch* w, size_t offset, size_t len) {
+    if (target_read_memory_uncached(dbg, w->address + offset, len, &w->fresh[offset]))
+        return true;
+
+    w->link_bytes += len;
+    w->bus_acquires += (len + BDBP_MAX_DATA_LENGTH - 1) / BDBP_MAX_DATA_LENGTH;
+    w->bus_bytes += len;
+    return false;
+}
+
+// Digest all blocks into `w->fresh_digests`.
+static bool watch_digest(struct debugger* dbg, struct watch* w) {
+    if (target_digest_memory(dbg, w->address, WATCH_BLOCK_SIZE, w->blocks, w->fresh_digests))
+        return true;
+
+    w->link_bytes += 2 * w->blocks;
+    w->bus_acquires += w->blocks;
+    w->bus_bytes += w->blocks * WATCH_BLOCK_SIZE;
+    return false;
+}
+
+// Fetch the current contents of the watched memory into `w->fresh`. With digests, only the
+// blocks whose digest changed are read, and the rest of `w->fresh` is left alone. Blocks are
+// digested before they are read, so that a change that happens in between is caught by the
+// next poll.
+static bool watch_poll(struct debugger* dbg, struct watch* w) {
+    ++w->polls;
+    if (!w->use_digests)
+        return watch_read(dbg, w, 0, w->len);
+
+    if (watch_digest(dbg, w))
+        return true;
+
+    for (size_t b = 0; b < w->blocks;) {
+        if (w->fresh_digests[b] == w->digests[b]) {
+            ++b;
+            continue;
+        }
+
+        // Read consecutive changed blocks at once.
+        size_t end = b + 1;
+        while (end < w->blocks && w->fresh_digests[end] != w->digests[end])
+            ++end;
+
+        size_t offset = b * WATCH_BLOCK_SIZE;
+        size_t stop = end * WATCH_BLOCK_SIZE < w->len ? end * WATCH_BLOCK_SIZE : w->len;
+        if (watch_read(dbg, w, offset, stop - offset))
+            return true;
+        b = end;
+    }
+
+    memcpy(w->digests, w->fresh_digests, w->blocks * sizeof w->digests[0]);
+    return false;
+}
+
+// Print every change between `w->data` and `w->fresh`, and take over the fresh data.
+static void watch_report(struct watch* w, uint64_t now_us) {
+    double t = (now_us - w->start_us) / 1e6;
+    for (size_t i = 0; i < w->len;) {
+        if (w->data[i] == w->fresh[i]) {
+            ++i;
+            continue;
+        }
+
+        size_t end = i + 1;
+        for (size_t j = end; j < w->len && j <= end + WATCH_MERGE_GAP; ++j) {
+            if (w->data[j] != w->fresh[j])
+                end = j + 1;
+        }
+
+        printf("[%9.3f s] %05X:", t, (gly_addr_t)(w->address + i));
+        for (size_t j = i; j < end; ++j)
+            printf(" %02X", w->data[j]);
+        printf(" ->");
+        for (size_t j = i; j < end; ++j)
+            printf(" %02X", w->fresh[j]);
+        puts("");
+
+        ++w->changes;
+        i = end;
+    }
+
+    fflush(stdout);
+    memcpy(w->data, w->fresh, w->len);
+}
+
+static void memory_watch(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t address = args->positionals[0].as_int;
+    if (address < 0 || address >= GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Address %ld outside of valid range [0, %d).", address, GLYCON_ADDRSPACE_SIZE);
+        return;
+    }
+
+    int64_t len = args->positionals_len > 1 ? args->positionals[1].as_int : 1;
+    if (len < 1 || address + len > GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Length %ld outside of valid range [1, %ld].", len, GLYCON_ADDRSPACE_SIZE - address);
+        return;
+    }
+
+    int64_t interval_ms = args->options[0].present ? args->options[0].value.as_int : WATCH_DEFAULT_INTERVAL_MS;
+    if (interval_ms < 0) {
+        debugger_print_error(dbg, "Interval must not be negative.");
+        return;
+    }
+
+    int64_t count = args->options[1].present ? args->options[1].value.as_int : 0;
+    if (count < 0) {
+        debugger_print_error(dbg, "Count must not be negative.");
+        return;
+    }
+
+    struct watch w = {
+        .address = address,
+        .len = len,
+        // Digests only pay off once they save reading more than they cost to transfer.
+        .use_digests = len > WATCH_BLOCK_SIZE && target_supports(dbg, BDBP_CMD_DIGEST),
+        .blocks = (len + WATCH_BLOCK_SIZE - 1) / WATCH_BLOCK_SIZE,
+    };
+    w.data = malloc(len);
+    w.fresh = malloc(len);
+    w.digests = malloc(w.blocks * sizeof w.digests[0]);
+    w.fresh_digests = malloc(w.blocks * sizeof w.fresh_digests[0]);
+    if (!w.data || !w.fresh || !w.digests || !w.fresh_digests) {
+        debugger_print_error(dbg, "Out of memory.");
+        goto free_watch;
+    }
+
+    // The first poll reads everything.
+    w.start_us = clock_now_us();
+    if ((w.use_digests && watch_digest(dbg, &w)) || watch_read(dbg, &w, 0, w.len))
+        goto free_watch;
+    ++w.polls;
+    memcpy(w.data, w.fresh, w.len);
+    memcpy(w.digests, w.fresh_digests, w.blocks * sizeof w.digests[0]);
+
+    printf(
+        "Watching %05lX-%05lX every %ld ms%s.\n",
+        address,
+        address + len - 1,
+        interval_ms,
+        w.use_digests ? ", reading only blocks whose digest changed" : ""
+    );
+    memory_print_hex(address, len, w.data);
+    fflush(stdout);
+
+    uint64_t next_us = w.start_us;
+    while (count == 0 || w.polls < (uint64_t) count) {
+        // Polls that take longer than the interval are not made up for.
+        uint64_t now = clock_now_us();
+        next_us = next_us + interval_ms * 1000 > now ? next_us + interval_ms * 1000 : now;
+        if (target_sleep_until(dbg, next_us) || watch_poll(dbg, &w))
+            break;
+        watch_report(&w, clock_now_us());
+    }
+
+    double seconds = (clock_now_us() - w.start_us) / 1e6;
+    double bus_us = w.bus_acquires * WATCH_BUS_ACQUIRE_US + w.bus_bytes * WATCH_BUS_BYTE_US;
+    printf(
+        "Watched for %.1f s: %lu polls, %lu changes, %lu bytes received.\n",
+        seconds,
+        w.polls,
+        w.changes,
+        w.link_bytes
+    );
+    printf("Estimated bus time taken from the Z80: %.1f us per poll", bus_us / w.polls);
+    if (seconds > 0)
+        printf(", %.0f us/s (%.3f%%)", bus_us / seconds, bus_us / seconds / 1e4);
+    puts(".");
+
+free_watch:
+    free(w.data);
+    free(w.fresh);
+    free(w.digests);
+    free(w.fresh_digests);
+}
+
 static const struct cmd* memory_commands[] = {
     &(struct cmd){CMD_TYPE_LEAF, "write", "Write to target memory.", {.leaf = {
         .options = subcommand_write_opts,
@@ -77,11 +452,42 @@ static const struct cmd* memory_commands[] = {
         },
         .payload = memory_read
     }}},
+    &(struct cmd){CMD_TYPE_LEAF, "watch", "Poll target memory while the Z80 runs, and print the bytes that change. Run it in the background with `&` and stop it with `cancel`, or give --count.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"interval", 'i', VALUE_TYPE_INT, "ms", "Time between polls (default: 100)."},
+            {"count", 'n', VALUE_TYPE_INT, "polls", "Stop after this many polls (default: until cancelled)."},
+            {}
+        },
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The address to watch."},
+            {VALUE_TYPE_INT, "length", "The number of bytes to watch (default: 1).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = memory_watch
+    }}},
     &(struct cmd){CMD_TYPE_LEAF, "load", "Load a file and write it to target memory.", {.leaf = {
         .options = subcommand_load_opts,
         .positionals = subcommand_load_pos,
         .payload = memory_load
     }}},
+    &(struct cmd){CMD_TYPE_LEAF, "dump", "Save target memory and flash to a sparse image file (.gli), which `memory restore` can write back.", {.leaf = {
+        .options = NULL,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "Path of the image to write."},
+            {VALUE_TYPE_INT, "address", "The address to start at (default: 0). Flash is dumped in whole sectors.", CMD_OPTIONAL},
+            {VALUE_TYPE_INT, "length", "The number of bytes to dump (default: up to the end of the address space).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = memory_dump
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "restore", "Write an image saved by `memory dump` back to the target. Flash in the image's range is erased first.", {.leaf = {
+        .options = NULL,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "Path of the image to restore."},
+            {}
+        },
+        .payload = memory_restore
+    }}},
     NULL
 };
 
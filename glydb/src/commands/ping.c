@@ -2,13 +2,18 @@
 #include "debugger.h"
 #include "bdbp_util.h"
 #include "target.h"
+#include "stats.h"
+#include "clock.h"
 
 #include "common/binary_debug_protocol.h"
+#include "common/glycon.h"
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 static void ping(struct debugger* dbg, const struct cmd_parse_result* args) {
     uint8_t pkt[BDBP_MAX_MSG_LENGTH];
@@ -28,3 +33,303 @@ const struct cmd command_ping = {
         .payload = ping
     }
 }};
+
+// The number of pings that `bench latency` sends by default.
+#define BENCH_DEFAULT_PINGS (100)
+
+#define BENCH_DEFAULT_READ_SIZE (0x4000)
+#define BENCH_DEFAULT_WRITE_SIZE (0x4000)
+#define BENCH_DEFAULT_FLASH_SIZE (GLYCON_FLASH_SECTOR_SIZE)
+
+// The number of bytes per second that the serial link carries in one direction.
+#define BENCH_LINE_RATE (1000000.0 / STATS_SERIAL_BYTE_US)
+
+// Open the file that results are appended to, if the user asked for one. Returns `true` and
+// prints an error if it could not be opened.
+static bool bench_open_output(struct debugger* dbg, const struct cmd_parsed_optional* opt, FILE** f) {
+    *f = NULL;
+    if (!opt->present)
+        return false;
+
+    *f = fopen(opt->value.as_str, "a");
+    if (!*f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", opt->value.as_str, strerror(errno));
+        return true;
+    }
+
+    return false;
+}
+
+// Start a JSON line describing a result of benchmark `test`. Results identify the port and the
+// firmware, so that runs with different adapters and firmware can be told apart.
+static void bench_begin_record(struct debugger* dbg, FILE* f, const char* test) {
+    const struct target_info* info = target_get_info(dbg);
+    fprintf(
+        f,
+        "{\"test\":\"%s\",\"time\":%lld,\"port\":\"%s\",\"build_id\":\"%08X\",\"line_rate\":%.0f",
+        test,
+        (long long) time(NULL),
+        dbg->conn.port ? dbg->conn.port : "",
+        info ? info->build_id : 0,
+        BENCH_LINE_RATE
+    );
+}
+
+// Finish writing a result, and close the file.
+static void bench_end_record(struct debugger* dbg, FILE* f, const char* path) {
+    fprintf(f, "}\n");
+    if (fclose(f) != 0)
+        debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+}
+
+// Report the throughput of a transfer of `len` bytes of payload that took `us`. `efficiency` is
+// the fraction of the bytes on the busiest direction of the link that is payload, which gives
+// the best throughput that the link allows.
+static void bench_report_throughput(struct debugger* dbg, const struct cmd_parsed_optional* output, const char* test, size_t len, uint64_t us, double efficiency) {
+    double rate = us ? len / (us / 1e6) : 0;
+    double limit = BENCH_LINE_RATE * efficiency;
+    printf(
+        "%s: %zu bytes in %.1f ms, %.0f B/s (line rate %.0f B/s, at most %.0f B/s of payload: %.0f%%)\n",
+        test,
+        len,
+        us / 1000.0,
+        rate,
+        BENCH_LINE_RATE,
+        limit,
+        rate * 100 / limit
+    );
+
+    FILE* f;
+    if (bench_open_output(dbg, output, &f) || !f)
+        return;
+    bench_begin_record(dbg, f, test);
+    fprintf(f, ",\"bytes\":%zu,\"us\":%llu,\"bytes_per_s\":%.0f,\"payload_limit\":%.0f", len, (unsigned long long) us, rate, limit);
+    bench_end_record(dbg, f, output->value.as_str);
+}
+
+static int bench_compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_latency(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t count = args->options[0].present ? args->options[0].value.as_int : BENCH_DEFAULT_PINGS;
+    if (count < 1 || count > 1000000) {
+        debugger_print_error(dbg, "Count %ld outside of valid range [1, 1000000].", count);
+        return;
+    }
+
+    uint64_t* times = malloc(count * sizeof times[0]);
+    if (!times) {
+        debugger_print_error(dbg, "Out of memory.");
+        return;
+    }
+
+    for (int64_t i = 0; i < count; ++i) {
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_PING);
+        uint64_t start = clock_now_us();
+        if (target_exec_cmd(dbg, pkt))
+            goto free_times;
+        times[i] = clock_now_us() - start;
+    }
+
+    qsort(times, count, sizeof times[0], bench_compare_u64);
+    uint64_t min = times[0];
+    uint64_t median = times[count / 2];
+    uint64_t p99 = times[(count * 99 + 99) / 100 - 1];
+    uint64_t max = times[count - 1];
+    // A ping is two bytes in each direction.
+    double wire = 2 * BDBP_MIN_MSG_LENGTH * STATS_SERIAL_BYTE_US;
+    printf(
+        "latency: %ld pings, min %llu us, median %llu us, p99 %llu us, max %llu us (line time %.0f us)\n",
+        count,
+        (unsigned long long) min,
+        (unsigned long long) median,
+        (unsigned long long) p99,
+        (unsigned long long) max,
+        wire
+    );
+
+    FILE* f;
+    if (bench_open_output(dbg, &args->options[1], &f) || !f)
+        goto free_times;
+    bench_begin_record(dbg, f, "latency");
+    fprintf(
+        f,
+        ",\"count\":%ld,\"min_us\":%llu,\"median_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu",
+        count,
+        (unsigned long long) min,
+        (unsigned long long) median,
+        (unsigned long long) p99,
+        (unsigned long long) max
+    );
+    bench_end_record(dbg, f, args->options[1].value.as_str);
+
+free_times:
+    free(times);
+}
+
+// Parse the address and size of a throughput benchmark, and check that they lie within
+// [`start`, `end`). Returns `true` and prints an error if they don't.
+static bool bench_parse_range(struct debugger* dbg, const struct cmd_parse_result* args, gly_addr_t start, gly_addr_t end, int64_t default_size, gly_addr_t* address, size_t* size) {
+    int64_t addr = args->positionals_len > 0 ? args->positionals[0].as_int : start;
+    int64_t len = args->positionals_len > 1 ? args->positionals[1].as_int : default_size;
+    if (addr < start || addr >= end) {
+        debugger_print_error(dbg, "Address %ld outside of valid range [%d, %d).", addr, start, end);
+        return true;
+    } else if (len < 1 || addr + len > end) {
+        debugger_print_error(dbg, "Size %ld outside of valid range [1, %ld].", len, end - addr);
+        return true;
+    }
+
+    *address = addr;
+    *size = len;
+    return false;
+}
+
+static void bench_fill_random(size_t len, uint8_t buffer[]) {
+    for (size_t i = 0; i < len; ++i)
+        buffer[i] = rand();
+}
+
+// Read back [`address`, `address + len`) and compare it with `expected`, so that a benchmark
+// can't report the speed of a transfer that didn't work.
+static bool bench_verify(struct debugger* dbg, gly_addr_t address, size_t len, const uint8_t expected[]) {
+    uint8_t* actual = malloc(len);
+    if (!actual) {
+        debugger_print_error(dbg, "Out of memory.");
+        return true;
+    }
+
+    bool failed = target_read_memory_uncached(dbg, address, len, actual);
+    if (!failed && memcmp(actual, expected, len) != 0) {
+        debugger_print_error(dbg, "Data read back from %05X differs from what was written.", address);
+        failed = true;
+    }
+
+    free(actual);
+    return failed;
+}
+
+static void bench_read(struct debugger* dbg, const struct cmd_parse_result* args) {
+    gly_addr_t address;
+    size_t size;
+    if (bench_parse_range(dbg, args, 0, GLYCON_ADDRSPACE_SIZE, BENCH_DEFAULT_READ_SIZE, &address, &size))
+        return;
+
+    uint64_t start = clock_now_us();
+    if (target_read_memory_uncached(dbg, address, size, dbg->scratch))
+        return;
+    uint64_t us = clock_now_us() - start;
+
+    double efficiency = BDBP_MAX_DATA_LENGTH / (double) BDBP_MAX_MSG_LENGTH;
+    bench_report_throughput(dbg, &args->options[0], "read", size, us, efficiency);
+}
+
+static void bench_write(struct debugger* dbg, const struct cmd_parse_result* args) {
+    gly_addr_t address;
+    size_t size;
+    if (bench_parse_range(dbg, args, GLYCON_RAM_START, GLYCON_RAM_END, BENCH_DEFAULT_WRITE_SIZE, &address, &size))
+        return;
+
+    // The RAM that is written to is restored afterwards.
+    uint8_t* saved = malloc(size);
+    if (!saved) {
+        debugger_print_error(dbg, "Out of memory.");
+        return;
+    }
+    if (target_read_memory_uncached(dbg, address, size, saved))
+        goto free_saved;
+
+    bench_fill_random(size, dbg->scratch);
+    uint64_t start = clock_now_us();
+    bool failed = target_write_memory(dbg, address, size, dbg->scratch);
+    uint64_t us = clock_now_us() - start;
+
+    if (!failed && !bench_verify(dbg, address, size, dbg->scratch)) {
+        double efficiency = (BDBP_MAX_DATA_LENGTH - BDBP_ADDR_SIZE) / (double) BDBP_MAX_MSG_LENGTH;
+        bench_report_throughput(dbg, &args->options[0], "write", size, us, efficiency);
+    }
+
+    target_write_memory(dbg, address, size, saved);
+free_saved:
+    free(saved);
+}
+
+static void bench_flash(struct debugger* dbg, const struct cmd_parse_result* args) {
+    gly_addr_t address;
+    size_t size;
+    if (bench_parse_range(dbg, args, GLYCON_FLASH_START, GLYCON_FLASH_END, BENCH_DEFAULT_FLASH_SIZE, &address, &size))
+        return;
+
+    uint64_t start = clock_now_us();
+    if (target_erase_flash(dbg, address, size))
+        return;
+    uint64_t erase_us = clock_now_us() - start;
+
+    bench_fill_random(size, dbg->scratch);
+    start = clock_now_us();
+    if (target_write_flash(dbg, address, size, dbg->scratch))
+        return;
+    uint64_t us = clock_now_us() - start;
+
+    if (bench_verify(dbg, address, size, dbg->scratch))
+        return;
+
+    printf("erase: %.1f ms\n", erase_us / 1000.0);
+    double efficiency = (BDBP_MAX_DATA_LENGTH - BDBP_ADDR_SIZE) / (double) BDBP_MAX_MSG_LENGTH;
+    bench_report_throughput(dbg, &args->options[0], "flash", size, us, efficiency);
+}
+
+static const struct cmd_option bench_output_opts[] = {
+    {"output", 'o', VALUE_TYPE_STR, "file", "Append the results to this file, as one JSON object per line."},
+    {}
+};
+
+static const struct cmd* bench_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "latency", "Measure the round trip time of pings.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"count", 'n', VALUE_TYPE_INT, "pings", "The number of pings to send (default: 100)."},
+            {"output", 'o', VALUE_TYPE_STR, "file", "Append the results to this file, as one JSON object per line."},
+            {}
+        },
+        .payload = bench_latency
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "read", "Measure the throughput of reading memory. The cache is bypassed.", {.leaf = {
+        .options = bench_output_opts,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The address to read from (default: 0).", CMD_OPTIONAL},
+            {VALUE_TYPE_INT, "size", "The number of bytes to read (default: 16 KiB).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = bench_read
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "write", "Measure the throughput of writing RAM. The RAM is restored afterwards.", {.leaf = {
+        .options = bench_output_opts,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The address to write to (default: start of RAM).", CMD_OPTIONAL},
+            {VALUE_TYPE_INT, "size", "The number of bytes to write (default: 16 KiB).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = bench_write
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "flash", "Measure the throughput of programming flash. The sectors in the range are erased and overwritten.", {.leaf = {
+        .options = bench_output_opts,
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The address to program. This is required, since flash is erased."},
+            {VALUE_TYPE_INT, "size", "The number of bytes to program (default: 4 KiB).", CMD_OPTIONAL},
+            {}
+        },
+        .payload = bench_flash
+    }}},
+    NULL
+};
+
+const struct cmd command_bench = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "bench",
+    .help = "Measure the latency and throughput of the link to the device.",
+    {.directory = {bench_commands}}
+};
@@ -0,0 +1,239 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "target.h"
+#include "symbols.h"
+#include "clock.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_DEFAULT_PERIOD_US (1000)
+#define PROFILE_DEFAULT_TOP (20)
+
+// Samples are fetched whenever about this many were taken, which is half of what the device
+// buffers, but at least every PROFILE_FETCH_INTERVAL_US.
+#define PROFILE_FETCH_SAMPLES (128)
+#define PROFILE_FETCH_INTERVAL_US (100000)
+
+struct profile {
+    // The number of samples per address.
+    uint32_t* counts;
+    uint64_t samples;
+    // The latest counters reported by the device, see BDBP_CMD_PROFILE.
+    unsigned dropped;
+    unsigned missed;
+};
+
+// A line of a hot list.
+struct profile_entry {
+    uint64_t count;
+    // An address, or an index into the symbol table.
+    size_t key;
+};
+
+// Send a BDBP_CMD_PROFILE request with `flags` and `period_us`, and keep fetching until the
+// device's buffer is empty.
+static bool profile_fetch(struct debugger* dbg, struct profile* p, uint8_t flags, uint16_t period_us) {
+    uint8_t count;
+    do {
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_PROFILE);
+        bdbp_pkt_append_u8(pkt, flags);
+        bdbp_pkt_append_u8(pkt, period_us & 0xFF);
+        bdbp_pkt_append_u8(pkt, period_us >> 8);
+        if (target_exec_cmd(dbg, pkt))
+            return true;
+        flags = 0;
+
+        const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+        count = pkt[BDBP_FIELD_DATA_LEN] >= BDBP_PROFILE_HEADER_LENGTH ? data[5] : 0;
+        if (pkt[BDBP_FIELD_DATA_LEN] != BDBP_PROFILE_HEADER_LENGTH + count * BDBP_ADDR_SIZE) {
+            debugger_print_error(dbg, "Device returned malformed samples.");
+            return true;
+        }
+
+        p->dropped = bdbp_read_u16(&data[1]);
+        p->missed = bdbp_read_u16(&data[3]);
+        for (uint8_t i = 0; i < count; ++i) {
+            const uint8_t* sample = &data[BDBP_PROFILE_HEADER_LENGTH + i * BDBP_ADDR_SIZE];
+            gly_addr_t address = sample[0] | sample[1] << 8 | (gly_addr_t) sample[2] << 16;
+            ++p->counts[address % GLYCON_ADDRSPACE_SIZE];
+            ++p->samples;
+        }
+    } while (count == BDBP_PROFILE_MAX_COUNT);
+
+    return false;
+}
+
+static int profile_compare_entries(const void* a, const void* b) {
+    const struct profile_entry* x = a;
+    const struct profile_entry* y = b;
+    if (x->count != y->count)
+        return x->count > y->count ? -1 : 1;
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Print an address as a symbol and offset, if there is a symbol for it.
+static void profile_print_location(const struct symbols* syms, gly_addr_t address) {
+    const struct symbol* sym = symbols_lookup(syms, address);
+    if (!sym)
+        return;
+
+    printf("  ");
+    symbols_print_offset(sym, address);
+}
+
+static void profile_report(const struct symbols* syms, const struct profile* p, size_t top) {
+    if (p->samples == 0)
+        return;
+    double percent = 100.0 / p->samples;
+
+    struct profile_entry* entries = malloc(GLYCON_ADDRSPACE_SIZE * sizeof(struct profile_entry));
+    size_t len = 0;
+    for (gly_addr_t address = 0; address < GLYCON_ADDRSPACE_SIZE; ++address) {
+        if (p->counts[address] > 0)
+            entries[len++] = (struct profile_entry){p->counts[address], address};
+    }
+    qsort(entries, len, sizeof entries[0], profile_compare_entries);
+
+    puts("Hot addresses:");
+    printf("%9s %7s %7s  %s\n", "samples", "%", "address", "location");
+    for (size_t i = 0; i < len && i < top; ++i) {
+        printf("%9lu %6.2f%%   %05X", (unsigned long) entries[i].count, entries[i].count * percent, (gly_addr_t) entries[i].key);
+        profile_print_location(syms, entries[i].key);
+        puts("");
+    }
+
+    if (syms->len == 0) {
+        puts("Load symbols with `symbols load` to see the time per symbol.");
+        free(entries);
+        return;
+    }
+
+    // Samples without a symbol are counted for the index past the last symbol.
+    uint64_t* sym_counts = calloc(syms->len + 1, sizeof(uint64_t));
+    for (size_t i = 0; i < len; ++i) {
+        const struct symbol* sym = symbols_lookup(syms, entries[i].key);
+        sym_counts[sym ? (size_t) (sym - syms->items) : syms->len] += entries[i].count;
+    }
+
+    len = 0;
+    for (size_t i = 0; i <= syms->len; ++i) {
+        if (sym_counts[i] > 0)
+            entries[len++] = (struct profile_entry){sym_counts[i], i};
+    }
+    qsort(entries, len, sizeof entries[0], profile_compare_entries);
+
+    puts("Hot symbols:");
+    printf("%9s %7s  %s\n", "samples", "%", "symbol");
+    for (size_t i = 0; i < len && i < top; ++i) {
+        size_t key = entries[i].key;
+        printf(
+            "%9lu %6.2f%%  %s\n",
+            (unsigned long) entries[i].count,
+            entries[i].count * percent,
+            key < syms->len ? syms->items[key].name : "(no symbol)"
+        );
+    }
+
+    free(sym_counts);
+    free(entries);
+}
+
+static void profile_run(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t period_us = args->options[0].present ? args->options[0].value.as_int : PROFILE_DEFAULT_PERIOD_US;
+    if (period_us < BDBP_PROFILE_MIN_PERIOD_US || period_us > BDBP_PROFILE_MAX_PERIOD_US) {
+        debugger_print_error(dbg, "Period %ld outside of valid range [%d, %d].", period_us, BDBP_PROFILE_MIN_PERIOD_US, BDBP_PROFILE_MAX_PERIOD_US);
+        return;
+    }
+
+    int64_t duration_ms = args->options[1].present ? args->options[1].value.as_int : 0;
+    if (duration_ms < 0) {
+        debugger_print_error(dbg, "Duration must not be negative.");
+        return;
+    }
+
+    int64_t top = args->options[2].present ? args->options[2].value.as_int : PROFILE_DEFAULT_TOP;
+    if (top < 1) {
+        debugger_print_error(dbg, "Top must be at least 1.");
+        return;
+    }
+
+    if (!target_supports(dbg, BDBP_CMD_PROFILE)) {
+        debugger_print_error(dbg, "The device firmware does not support profiling.");
+        return;
+    }
+
+    struct profile p = {.counts = calloc(GLYCON_ADDRSPACE_SIZE, sizeof(uint32_t))};
+    if (!p.counts) {
+        debugger_print_error(dbg, "Out of memory.");
+        return;
+    }
+
+    uint64_t interval_us = period_us * PROFILE_FETCH_SAMPLES;
+    if (interval_us > PROFILE_FETCH_INTERVAL_US)
+        interval_us = PROFILE_FETCH_INTERVAL_US;
+
+    uint64_t start_us = clock_now_us();
+    uint64_t end_us = start_us + duration_ms * 1000;
+    if (profile_fetch(dbg, &p, BDBP_PROFILE_FLAG_START, period_us))
+        goto free_profile;
+
+    printf("Sampling every %ld us", period_us);
+    if (duration_ms > 0)
+        printf(" for %ld ms", duration_ms);
+    else
+        printf(" until cancelled");
+    puts(".");
+    fflush(stdout);
+
+    // Samples are reported when the command is cancelled as well.
+    uint64_t next_us = start_us;
+    while (duration_ms == 0 || next_us < end_us) {
+        next_us += interval_us;
+        if (duration_ms > 0 && next_us > end_us)
+            next_us = end_us;
+        if (target_sleep_until(dbg, next_us) || profile_fetch(dbg, &p, 0, 0))
+            break;
+    }
+
+    if (profile_fetch(dbg, &p, BDBP_PROFILE_FLAG_STOP, 0))
+        goto free_profile;
+
+    printf(
+        "Profiled for %.2f s: %lu samples, %u missed while the Z80 was stopped, %u dropped.\n",
+        (clock_now_us() - start_us) / 1e6,
+        (unsigned long) p.samples,
+        p.missed,
+        p.dropped
+    );
+    profile_report(&dbg->symbols, &p, top);
+
+free_profile:
+    free(p.counts);
+}
+
+static const struct cmd* profile_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "run", "Sample the address of the instruction that the Z80 executes at random times, without stopping it, and show where it spends its time. Run it in the background with `&` and stop it with `cancel`, or give --duration. Samples may point into the middle of instructions with a prefix.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"period", 'p', VALUE_TYPE_INT, "us", "Mean time between samples (default: 1000)."},
+            {"duration", 'd', VALUE_TYPE_INT, "ms", "Stop after this long (default: until cancelled)."},
+            {"top", 'n', VALUE_TYPE_INT, "count", "The number of addresses and symbols to show (default: 20)."},
+            {}
+        },
+        .payload = profile_run
+    }}},
+    NULL
+};
+
+const struct cmd command_profile = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "profile",
+    .help = "Statistical profiling of the code that runs on the Z80.",
+    {.directory = {profile_commands}}
+};
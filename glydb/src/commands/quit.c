@@ -13,6 +13,7 @@ const struct cmd command_quit = {
     {.leaf = {
         .options = NULL,
         .positionals = NULL,
-        .payload = quit
+        .payload = quit,
+        .local = true
     }
 }};
@@ -0,0 +1,299 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "stats.h"
+#include "target.h"
+#include "clock.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// Width of the longest histogram bar.
+#define STATS_BAR_WIDTH (40)
+
+static const char* stats_cmd_name(size_t cmd) {
+    const char* name = bdbp_cmd_to_string(cmd);
+    return name ? name : "other";
+}
+
+static void stats_show(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct stats s;
+    stats_snapshot(&dbg->stats, &s);
+
+    printf(
+        "Over the last %.1f s: %llu syncs, %llu sync retries.\n",
+        (clock_now_us() - s.since_us) / 1e6,
+        (unsigned long long) s.syncs,
+        (unsigned long long) s.sync_retries
+    );
+    printf(
+        "%-13s %9s %7s %10s %10s %9s %9s %9s %9s %9s %9s\n",
+        "command",
+        "requests",
+        "failed",
+        "tx bytes",
+        "rx bytes",
+        "send us",
+        "first us",
+        "done us",
+        "p99 us",
+        "wire us",
+        "KiB/s"
+    );
+
+    for (size_t cmd = 0; cmd < STATS_CMDS; ++cmd) {
+        const struct stats_cmd* c = &s.cmds[cmd];
+        if (c->requests == 0)
+            continue;
+
+        // Times are averaged over the requests that were answered.
+        uint64_t answered = 0;
+        for (size_t i = 0; i < STATS_BUCKETS; ++i)
+            answered += c->complete_hist[i];
+        double n = answered ? answered : 1;
+
+        uint64_t bytes = c->tx_bytes + c->rx_bytes;
+        printf(
+            "%-13s %9llu %7llu %10llu %10llu %9.1f %9.1f %9.1f %9llu %9.1f %9.1f\n",
+            stats_cmd_name(cmd),
+            (unsigned long long) c->requests,
+            (unsigned long long) c->failures,
+            (unsigned long long) c->tx_bytes,
+            (unsigned long long) c->rx_bytes,
+            c->send_us / (double) c->requests,
+            c->first_byte_us / n,
+            c->complete_us / n,
+            (unsigned long long) stats_percentile(c->complete_hist, answered, 0.99),
+            bytes * STATS_SERIAL_BYTE_US / (double) c->requests,
+            c->complete_us ? bytes / 1024.0 / (c->complete_us / 1e6) : 0.0
+        );
+    }
+
+    puts("");
+    puts("send: handing the request to the connection. first: until the first response byte arrived.");
+    puts("done: until the response was complete. wire: time the bytes need on the serial link.");
+}
+
+// Print one histogram, leaving out empty buckets at either end.
+static void stats_print_hist(const char* title, const uint64_t hist[]) {
+    size_t first = STATS_BUCKETS;
+    size_t last = 0;
+    uint64_t max = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; ++i) {
+        if (hist[i] == 0)
+            continue;
+        if (first == STATS_BUCKETS)
+            first = i;
+        last = i;
+        if (hist[i] > max)
+            max = hist[i];
+    }
+
+    printf("  %s:\n", title);
+    if (max == 0) {
+        puts("    (none)");
+        return;
+    }
+
+    for (size_t i = first; i <= last; ++i) {
+        char bar[STATS_BAR_WIDTH + 1];
+        size_t width = (hist[i] * STATS_BAR_WIDTH + max - 1) / max;
+        memset(bar, '#', width);
+        bar[width] = 0;
+
+        if (i == STATS_BUCKETS - 1)
+            printf("    %8llu us and up     ", (unsigned long long) stats_bucket_start(i));
+        else
+            printf("    %8llu - %8llu us ", (unsigned long long) stats_bucket_start(i), (unsigned long long) stats_bucket_start(i + 1));
+        printf("%9llu %s\n", (unsigned long long) hist[i], bar);
+    }
+}
+
+static void stats_histogram(struct debugger* dbg, const struct cmd_parse_result* args) {
+    const char* only = args->positionals_len > 0 ? args->positionals[0].as_str : NULL;
+    if (only) {
+        bool known = false;
+        for (size_t cmd = 0; cmd < STATS_CMDS; ++cmd)
+            known = known || strcmp(only, stats_cmd_name(cmd)) == 0;
+        if (!known) {
+            debugger_print_error(dbg, "Unknown command '%s'.", only);
+            return;
+        }
+    }
+
+    struct stats s;
+    stats_snapshot(&dbg->stats, &s);
+
+    bool any = false;
+    for (size_t cmd = 0; cmd < STATS_CMDS; ++cmd) {
+        const struct stats_cmd* c = &s.cmds[cmd];
+        if (c->requests == 0 || (only && strcmp(only, stats_cmd_name(cmd)) != 0))
+            continue;
+
+        printf("%s (%llu requests):\n", stats_cmd_name(cmd), (unsigned long long) c->requests);
+        stats_print_hist("Time to first response byte", c->first_byte_hist);
+        stats_print_hist("Time to complete response", c->complete_hist);
+        any = true;
+    }
+
+    if (!any)
+        puts("No requests recorded.");
+}
+
+static void stats_dump(struct debugger* dbg, const struct cmd_parse_result* args) {
+    struct stats s;
+    stats_snapshot(&dbg->stats, &s);
+
+    if (args->positionals_len == 0) {
+        stats_write_json(&s, stdout);
+        return;
+    }
+
+    const char* path = args->positionals[0].as_str;
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        return;
+    }
+
+    stats_write_json(&s, f);
+    if (fclose(f) != 0)
+        debugger_print_error(dbg, "Failed to write file '%s': %s.", path, strerror(errno));
+}
+
+// Print a row for a duration in a BDBP_CMD_STATS response, unless it is empty and `skip_empty`
+// is set.
+static void stats_print_device_duration(const char* name, const uint8_t* field, double ticks_per_us, unsigned tick_cycles, bool skip_empty) {
+    uint32_t count = bdbp_read_u32(&field[0]);
+    uint32_t ticks = bdbp_read_u32(&field[4]);
+    uint32_t max_ticks = bdbp_read_u32(&field[8]);
+    if (count == 0 && skip_empty)
+        return;
+
+    double n = count ? count : 1;
+    printf(
+        "%-18s %9lu %12.3f %10.1f %10.1f %12.0f\n",
+        name,
+        (unsigned long) count,
+        ticks / ticks_per_us / 1000,
+        ticks / ticks_per_us / n,
+        max_ticks / ticks_per_us,
+        (double) ticks * tick_cycles / n
+    );
+}
+
+static void stats_device(struct debugger* dbg, const struct cmd_parse_result* args) {
+    bool reset = args->options[0].present;
+    if (!target_supports(dbg, BDBP_CMD_STATS)) {
+        debugger_print_error(dbg, "The device firmware does not keep performance counters.");
+        return;
+    }
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_STATS);
+    bdbp_pkt_append_u8(pkt, reset ? BDBP_STATS_FLAG_RESET : 0);
+    if (target_exec_cmd(dbg, pkt))
+        return;
+
+    if (pkt[BDBP_FIELD_DATA_LEN] < BDBP_STATS_DATA_LENGTH) {
+        debugger_print_error(dbg, "Device returned %u bytes of counters, expected %u.", pkt[BDBP_FIELD_DATA_LEN], BDBP_STATS_DATA_LENGTH);
+        return;
+    }
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    unsigned cpu_khz = bdbp_read_u16(&data[0]);
+    unsigned tick_cycles = data[2];
+    if (cpu_khz == 0 || tick_cycles == 0) {
+        debugger_print_error(dbg, "Device reported an invalid clock.");
+        return;
+    }
+    double ticks_per_us = cpu_khz / 1000.0 / tick_cycles;
+    data += 3;
+
+    printf("Coprocessor clock: %.3f MHz, %u cycles per tick.\n", cpu_khz / 1000.0, tick_cycles);
+    printf("%-18s %9s %12s %10s %10s %12s\n", "operation", "count", "total ms", "mean us", "max us", "mean cycles");
+    stats_print_device_duration("bus acquire", data, ticks_per_us, tick_cycles, false);
+    data += BDBP_STATS_DURATION_LENGTH;
+    stats_print_device_duration("bus hold", data, ticks_per_us, tick_cycles, false);
+    data += BDBP_STATS_DURATION_LENGTH;
+
+    uint16_t rx_high_water = bdbp_read_u16(&data[0]);
+    uint32_t rx_dropped = bdbp_read_u32(&data[2]);
+    data += 6;
+
+    stats_print_device_duration("flash program", data, ticks_per_us, tick_cycles, false);
+    data += BDBP_STATS_DURATION_LENGTH;
+    stats_print_device_duration("flash erase", data, ticks_per_us, tick_cycles, false);
+    data += BDBP_STATS_DURATION_LENGTH;
+
+    // Requests with unknown commands and with commands past the table are counted together for
+    // command 0, see BDBP_CMD_STATS.
+    size_t cmds = *data++;
+    if (cmds > BDBP_STATS_CMDS)
+        cmds = BDBP_STATS_CMDS;
+    for (size_t cmd = 0; cmd < cmds; ++cmd) {
+        char name[32];
+        if (cmd == 0)
+            snprintf(name, sizeof name, "cmd 0x%02zX+/unknown", cmds);
+        else
+            snprintf(name, sizeof name, "cmd %s", stats_cmd_name(cmd));
+        stats_print_device_duration(name, &data[cmd * BDBP_STATS_DURATION_LENGTH], ticks_per_us, tick_cycles, true);
+    }
+
+    const struct target_info* info = target_get_info(dbg);
+    printf("Receive buffer: at most %u", rx_high_water);
+    if (info && info->rx_buffer_size > 0)
+        printf(" of %u", info->rx_buffer_size);
+    printf(" bytes used, %lu bytes dropped.\n", (unsigned long) rx_dropped);
+}
+
+static void stats_clear(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    stats_reset(&dbg->stats);
+}
+
+static const struct cmd* stats_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "show", "Show request counts, latencies and throughput per BDBP command.", {.leaf = {
+        .payload = stats_show,
+        .local = true
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "histogram", "Show histograms of the latencies per BDBP command.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "command", "Only show this BDBP command, such as `read` or `write_flash`.", CMD_OPTIONAL},
+            {}
+        },
+        .payload = stats_histogram,
+        .local = true
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "dump", "Write all statistics as a single JSON object.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "Write to this file instead of the terminal.", CMD_OPTIONAL},
+            {}
+        },
+        .payload = stats_dump,
+        .local = true
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "device", "Show the performance counters that the coprocessor keeps: time spent acquiring and holding the bus, flash operations and handling each command, and use of its receive buffer. Commands from 0x10 on, such as mailbox and analyzer, are counted together with unknown ones.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"reset", 'r', VALUE_TYPE_BOOL, NULL, "Clear the device's counters after showing them."},
+            {}
+        },
+        .payload = stats_device
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "reset", "Clear all statistics kept by glydb. The device's counters are cleared with `stats device --reset`.", {.leaf = {
+        .payload = stats_clear,
+        .local = true
+    }}},
+    NULL
+};
+
+const struct cmd command_stats = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "stats",
+    .help = "Timing of the transactions with the device, per BDBP command.",
+    {.directory = {stats_commands}}
+};
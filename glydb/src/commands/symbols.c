@@ -0,0 +1,71 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "symbols.h"
+
+#include "common/glycon.h"
+
+#include <stdio.h>
+
+static void symbols_load_cmd(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t offset = args->options[0].present ? args->options[0].value.as_int : 0;
+    if (offset < 0 || offset >= GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Offset %ld outside of valid range [0, %d).", offset, GLYCON_ADDRSPACE_SIZE);
+        return;
+    }
+
+    size_t loaded;
+    if (symbols_load(dbg, &dbg->symbols, args->positionals[0].as_str, offset, &loaded))
+        return;
+
+    printf("Loaded %zu symbols, %zu in total.\n", loaded, dbg->symbols.len);
+}
+
+static void symbols_clear_cmd(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    symbols_clear(&dbg->symbols);
+}
+
+static void symbols_lookup_cmd(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t address = args->positionals[0].as_int;
+    const struct symbol* sym = symbols_lookup(&dbg->symbols, address);
+    if (!sym) {
+        printf("%05lX: no symbol.\n", address);
+        return;
+    }
+
+    printf("%05lX: %s+0x%lX\n", address, sym->name, address - sym->address);
+}
+
+// These commands don't use the device, but they are not local either: other commands use the
+// symbols from background jobs.
+static const struct cmd* symbols_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "load", "Load symbols from a file with a name and a hexadecimal address on every line, such as sdcc's .noi files. Symbols are added to those that were loaded before.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"offset", 'o', VALUE_TYPE_INT, "offset", "Add this to the address of every symbol, such as the address the program was loaded at (default: 0)."},
+            {}
+        },
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_STR, "filename", "The symbol file to load."},
+            {}
+        },
+        .payload = symbols_load_cmd
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "clear", "Forget all symbols.", {.leaf = {
+        .payload = symbols_clear_cmd
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "lookup", "Show the symbol that an address belongs to.", {.leaf = {
+        .positionals = (struct cmd_positional[]){
+            {VALUE_TYPE_INT, "address", "The address to look up."},
+            {}
+        },
+        .payload = symbols_lookup_cmd
+    }}},
+    NULL
+};
+
+const struct cmd command_symbols = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "symbols",
+    .help = "Names for addresses on the device, used by the profiler and the trace.",
+    {.directory = {symbols_commands}}
+};
@@ -0,0 +1,357 @@
+#include "commands/commands.h"
+#include "debugger.h"
+#include "bdbp_util.h"
+#include "buffer.h"
+#include "target.h"
+#include "symbols.h"
+#include "z80/z80.h"
+#include "z80/disassemble.h"
+
+#include "common/glycon.h"
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_DEFAULT_COUNT (64)
+
+// The state of the device's trace, as reported by the last BDBP_CMD_TRACE response.
+struct trace_status {
+    uint8_t state;
+    uint8_t blocks;
+    uint32_t fetches;
+};
+
+enum trace_entry_kind {
+    TRACE_ENTRY_FETCH,
+    TRACE_ENTRY_INTERRUPT,
+    TRACE_ENTRY_GAP,
+};
+
+struct trace_entry {
+    enum trace_entry_kind kind;
+    gly_addr_t address;
+};
+
+static const char* trace_state_to_str(uint8_t state) {
+    switch (state) {
+        case BDBP_TRACE_STATE_IDLE:
+            return "stopped";
+        case BDBP_TRACE_STATE_ARMED:
+            return "waiting for the start address";
+        case BDBP_TRACE_STATE_TRACING:
+            return "tracing";
+        case BDBP_TRACE_STATE_DONE:
+            return "done";
+        default:
+            return "unknown";
+    }
+}
+
+// Send a BDBP_CMD_TRACE request with the operation and arguments in `pkt`. On success, the
+// response is left in `pkt`.
+static bool trace_exec(struct debugger* dbg, uint8_t* pkt, struct trace_status* status) {
+    if (!target_supports(dbg, BDBP_CMD_TRACE)) {
+        debugger_print_error(dbg, "The device firmware does not support tracing.");
+        return true;
+    }
+
+    if (target_exec_cmd(dbg, pkt))
+        return true;
+
+    uint8_t len = pkt[BDBP_FIELD_DATA_LEN];
+    if (len < BDBP_TRACE_HEADER_LENGTH || (len - BDBP_TRACE_HEADER_LENGTH) % BDBP_TRACE_BLOCK_SIZE != 0) {
+        debugger_print_error(dbg, "Device returned a malformed trace.");
+        return true;
+    }
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    status->state = data[0];
+    status->blocks = data[1];
+    status->fetches = bdbp_read_u32(&data[2]);
+    return false;
+}
+
+static bool trace_op(struct debugger* dbg, enum bdbp_trace_op op, struct trace_status* status) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_TRACE);
+    bdbp_pkt_append_u8(pkt, op);
+    return trace_exec(dbg, pkt, status);
+}
+
+static void trace_print_status(const struct trace_status* status) {
+    printf(
+        "Trace is %s: %lu fetches traced, %u blocks in the device's buffer.\n",
+        trace_state_to_str(status->state),
+        (unsigned long) status->fetches,
+        status->blocks
+    );
+}
+
+// Decode a block of the trace, see BDBP_TRACE_DELTA, and append its entries to `entries`.
+// `address` carries the last address from one block to the next.
+static bool trace_decode_block(struct debugger* dbg, const uint8_t* block, gly_addr_t* address, struct buffer* entries) {
+    size_t pos = 0;
+    while (pos < BDBP_TRACE_BLOCK_SIZE && block[pos] != BDBP_TRACE_END) {
+        uint8_t b = block[pos];
+        struct trace_entry e = {.kind = TRACE_ENTRY_FETCH};
+        size_t size = 1;
+        if ((b & BDBP_TRACE_DELTA_MASK) == BDBP_TRACE_DELTA) {
+            *address += (int8_t) (b << 1) / 2;
+        } else if ((b & BDBP_TRACE_DELTA14_MASK) == BDBP_TRACE_DELTA14) {
+            size = 2;
+            if (pos + size <= BDBP_TRACE_BLOCK_SIZE)
+                *address += (int16_t) ((b << 8 | block[pos + 1]) << 2) / 4;
+        } else if ((b & BDBP_TRACE_ABSOLUTE_MASK) == BDBP_TRACE_ABSOLUTE) {
+            size = 3;
+            if (pos + size <= BDBP_TRACE_BLOCK_SIZE)
+                *address = (gly_addr_t) (b & 0x03) << 16 | block[pos + 1] << 8 | block[pos + 2];
+        } else if (b == BDBP_TRACE_INTERRUPT) {
+            e.kind = TRACE_ENTRY_INTERRUPT;
+        } else if (b == BDBP_TRACE_GAP) {
+            e.kind = TRACE_ENTRY_GAP;
+        } else {
+            size = 0;
+        }
+
+        if (size == 0 || pos + size > BDBP_TRACE_BLOCK_SIZE) {
+            debugger_print_error(dbg, "Device returned a malformed trace block.");
+            return true;
+        }
+
+        *address %= GLYCON_ADDRSPACE_SIZE;
+        e.address = *address;
+        buffer_push_data(entries, sizeof e, &e);
+        pos += size;
+    }
+    return false;
+}
+
+// Download and decode the whole trace buffer.
+static bool trace_download(struct debugger* dbg, struct buffer* entries, struct trace_status* status) {
+    if (trace_op(dbg, BDBP_TRACE_OP_STATUS, status))
+        return true;
+    if (status->state == BDBP_TRACE_STATE_TRACING) {
+        debugger_print_error(dbg, "The trace is still running. Stop it with `trace stop`, or wait for the stop address.");
+        return true;
+    }
+
+    gly_addr_t address = 0;
+    uint8_t blocks = status->blocks;
+    for (uint8_t index = 0; index < blocks;) {
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_TRACE);
+        bdbp_pkt_append_u8(pkt, BDBP_TRACE_OP_READ);
+        bdbp_pkt_append_u8(pkt, index);
+        if (trace_exec(dbg, pkt, status))
+            return true;
+
+        uint8_t count = (pkt[BDBP_FIELD_DATA_LEN] - BDBP_TRACE_HEADER_LENGTH) / BDBP_TRACE_BLOCK_SIZE;
+        if (count == 0) {
+            debugger_print_error(dbg, "Device returned fewer trace blocks than it reported.");
+            return true;
+        }
+
+        for (uint8_t i = 0; i < count; ++i) {
+            const uint8_t* block = &pkt[BDBP_FIELD_DATA + BDBP_TRACE_HEADER_LENGTH + i * BDBP_TRACE_BLOCK_SIZE];
+            if (trace_decode_block(dbg, block, &address, entries))
+                return true;
+        }
+        index += count;
+    }
+
+    return false;
+}
+
+// Print the symbol that `address` belongs to, if it differs from that of the previous line.
+static void trace_print_symbol(const struct symbols* syms, gly_addr_t address, const struct symbol** current) {
+    const struct symbol* sym = symbols_lookup(syms, address);
+    if (sym == *current)
+        return;
+    *current = sym;
+    if (!sym)
+        return;
+
+    symbols_print_offset(sym, address);
+    puts(":");
+}
+
+static void trace_print_repeats(size_t repeats) {
+    if (repeats > 0)
+        printf("%8s  (%zu more times)\n", "", repeats);
+}
+
+// Print the instruction at each traced address. Instructions with a prefix are fetched in two
+// steps, and are only printed once. Runs of the same instruction, such as a HALT or a block
+// instruction, are folded.
+static bool trace_render(struct debugger* dbg, const struct trace_entry* entries, size_t len, size_t first_index) {
+    const struct symbol* current_sym = NULL;
+    // The instruction that was printed last, and the next address that would be a fetch in the
+    // middle of it.
+    gly_addr_t inst_address = GLYCON_ADDRSPACE_SIZE;
+    gly_addr_t inst_next = GLYCON_ADDRSPACE_SIZE;
+    gly_addr_t inst_end = GLYCON_ADDRSPACE_SIZE;
+    size_t repeats = 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        const struct trace_entry* e = &entries[i];
+        if (e->kind != TRACE_ENTRY_FETCH) {
+            trace_print_repeats(repeats);
+            repeats = 0;
+            inst_address = inst_next = inst_end = GLYCON_ADDRSPACE_SIZE;
+            puts(e->kind == TRACE_ENTRY_INTERRUPT ? "--- interrupt acknowledged ---" : "--- fetches not traced ---");
+            continue;
+        }
+
+        if (e->address == inst_next && e->address < inst_end) {
+            ++inst_next;
+            continue;
+        }
+
+        if (e->address == inst_address) {
+            ++repeats;
+            inst_next = inst_address + 1;
+            continue;
+        }
+
+        trace_print_repeats(repeats);
+        repeats = 0;
+
+        uint8_t code[Z80_MAX_INST_SIZE];
+        if (target_read_memory(dbg, e->address, sizeof code, code))
+            return true;
+        struct z80_inst inst;
+        z80_disassemble(&inst, sizeof code, code);
+
+        trace_print_symbol(&dbg->symbols, e->address, &current_sym);
+        printf("%8zu  %05X: ", first_index + i, e->address);
+        for (size_t j = 0; j < Z80_MAX_INST_SIZE; ++j) {
+            if (j < inst.size)
+                printf(" %02X", code[j]);
+            else
+                printf("   ");
+        }
+        printf("   ");
+        z80_print_inst(&inst, stdout);
+        puts("");
+
+        inst_address = e->address;
+        inst_next = e->address + 1;
+        inst_end = e->address + inst.size;
+    }
+
+    trace_print_repeats(repeats);
+    return false;
+}
+
+static void trace_start(struct debugger* dbg, const struct cmd_parse_result* args) {
+    uint8_t mode = 0;
+    int64_t addresses[2] = {0, 0};
+    for (size_t i = 0; i < 2; ++i) {
+        if (!args->options[i].present)
+            continue;
+        addresses[i] = args->options[i].value.as_int;
+        if (addresses[i] < 0 || addresses[i] >= GLYCON_ADDRSPACE_SIZE) {
+            debugger_print_error(dbg, "Address %ld outside of valid range [0, %d).", addresses[i], GLYCON_ADDRSPACE_SIZE);
+            return;
+        }
+        mode |= i == 0 ? BDBP_TRACE_MODE_START_TRIGGER : BDBP_TRACE_MODE_STOP_TRIGGER;
+    }
+    if (args->options[2].present)
+        mode |= BDBP_TRACE_MODE_STOP_WHEN_FULL;
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_TRACE);
+    bdbp_pkt_append_u8(pkt, BDBP_TRACE_OP_START);
+    bdbp_pkt_append_u8(pkt, mode);
+    bdbp_pkt_append_addr(pkt, addresses[0]);
+    bdbp_pkt_append_addr(pkt, addresses[1]);
+    struct trace_status status;
+    if (trace_exec(dbg, pkt, &status))
+        return;
+
+    trace_print_status(&status);
+    puts("The Z80 runs several times slower while its fetches are watched.");
+}
+
+static void trace_stop(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct trace_status status;
+    if (!trace_op(dbg, BDBP_TRACE_OP_STOP, &status))
+        trace_print_status(&status);
+}
+
+static void trace_status(struct debugger* dbg, const struct cmd_parse_result* args) {
+    (void) args;
+    struct trace_status status;
+    if (!trace_op(dbg, BDBP_TRACE_OP_STATUS, &status))
+        trace_print_status(&status);
+}
+
+static void trace_show(struct debugger* dbg, const struct cmd_parse_result* args) {
+    int64_t count = args->options[0].present ? args->options[0].value.as_int : TRACE_DEFAULT_COUNT;
+    if (count < 0) {
+        debugger_print_error(dbg, "Count must not be negative.");
+        return;
+    }
+
+    struct buffer buf;
+    buffer_init(&buf);
+    struct trace_status status;
+    if (trace_download(dbg, &buf, &status))
+        goto deinit_buf;
+
+    const struct trace_entry* entries = buf.data;
+    size_t len = buf.size / sizeof(struct trace_entry);
+    size_t fetches = 0;
+    for (size_t i = 0; i < len; ++i)
+        fetches += entries[i].kind == TRACE_ENTRY_FETCH;
+
+    trace_print_status(&status);
+    printf("The buffer holds the last %zu of them", fetches);
+    size_t first = 0;
+    if (count > 0 && (size_t) count < len) {
+        first = len - count;
+        printf(", showing the last %ld entries", count);
+    }
+    puts(".");
+
+    // Entries are numbered from the oldest one in the buffer.
+    trace_render(dbg, entries + first, len - first, first);
+
+deinit_buf:
+    buffer_deinit(&buf);
+}
+
+static const struct cmd* trace_commands[] = {
+    &(struct cmd){CMD_TYPE_LEAF, "start", "Clear the device's trace buffer and start tracing the address of every instruction that the Z80 fetches. The device keeps the last few thousand fetches.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"start", 's', VALUE_TYPE_INT, "address", "Only start tracing at the first fetch from this address."},
+            {"end", 'e', VALUE_TYPE_INT, "address", "Stop tracing after a fetch from this address."},
+            {"fill", 'f', VALUE_TYPE_BOOL, NULL, "Stop tracing when the buffer is full, instead of dropping the oldest fetches."},
+            {}
+        },
+        .payload = trace_start
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "stop", "Stop tracing. The trace is kept until the next start.", {.leaf = {
+        .payload = trace_stop
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "status", "Show the state of the trace.", {.leaf = {
+        .payload = trace_status
+    }}},
+    &(struct cmd){CMD_TYPE_LEAF, "show", "Download the trace and show the traced instructions. The trace must not be running.", {.leaf = {
+        .options = (struct cmd_option[]){
+            {"count", 'n', VALUE_TYPE_INT, "count", "Show only the last count entries, or all with 0 (default: 64)."},
+            {}
+        },
+        .payload = trace_show
+    }}},
+    NULL
+};
+
+const struct cmd command_trace = {
+    .type = CMD_TYPE_DIRECTORY,
+    .name = "trace",
+    .help = "Trace the exact sequence of instructions that the Z80 executes. Addresses are physical, as they appear on the bus. Tracing holds the Z80 for a moment after every fetch, so its timing is not preserved.",
+    {.directory = {trace_commands}}
+};
@@ -1,8 +1,14 @@
 #include "connection.h"
+#include "clock.h"
 
 #include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -26,9 +32,11 @@ static bool set_serial_attribs(int fd, speed_t speed, int parity) {
     // Turn of output processing
     tty.c_oflag = 0;
     // Turn of line processing
-    tty.c_lflag = ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
-    // Disable pararity checking, clear char size mask, force 8 bit char size mask
-    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tty.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+    // Disable pararity checking, clear char size mask, force 8 bit char size mask.
+    // Also keep the modem control lines raised on close, so that the next open doesn't
+    // reset the device.
+    tty.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS | HUPCL);
     tty.c_cflag |= CS8 | CLOCAL | CREAD | parity;
 
     // Reads block until a 2-second timeout has been elapsed.
@@ -45,27 +53,123 @@ static bool set_serial_attribs(int fd, speed_t speed, int parity) {
 void conn_init(struct connection* conn) {
     conn->port = NULL;
     conn->fd = -1;
+    conn->reset_on_open = false;
+    conn->opened_at_us = 0;
+    conn->ready_time_us = 0;
+    capture_init(&conn->capture);
 }
 
 bool conn_open_serial(struct connection* conn, const char* path) {
     assert(!conn_is_open(conn));
+    uint64_t opened_at = clock_now_us();
 
-    int fd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
+    // Open non-blocking so that the open doesn't wait for carrier detect.
+    int fd = open(path, O_RDWR | O_NOCTTY | O_SYNC | O_NONBLOCK);
     if (fd == -1) {
         return false;
     }
 
+    // If the port hangs up on close, DTR was dropped when it was last closed, and the
+    // open above raised it again. On an Arduino, that means the device is now resetting.
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        goto err_close;
+    }
+    bool reset = (tty.c_cflag & HUPCL) != 0;
+
     // TODO: Don't hardcode serial attributes
     if (!set_serial_attribs(fd, B1000000, 0)) {
-        close(fd);
+        goto err_close;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+        goto err_close;
+    }
+
+    conn->fd = fd;
+    conn->port = strdup(path);
+    conn->transport = CONN_TRANSPORT_SERIAL;
+    conn->reset_on_open = reset;
+    conn->opened_at_us = opened_at;
+    conn->ready_time_us = 0;
+    capture_event(&conn->capture, CAPTURE_OPEN);
+    return true;
+
+err_close:;
+    int err = errno;
+    close(fd);
+    errno = err;
+    return false;
+}
+
+bool conn_open_socket(struct connection* conn, const char* path) {
+    assert(!conn_is_open(conn));
+    uint64_t opened_at = clock_now_us();
+
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
         return false;
     }
+    strcpy(addr.sun_path, path);
 
-    // Wait until the arduino has started
-    sleep(1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+
+    // Mirror the read timeout of serial connections.
+    struct timeval timeout = {
+        .tv_sec = 2,
+        .tv_usec = 0,
+    };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+        || connect(fd, (const struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return false;
+    }
 
     conn->fd = fd;
     conn->port = strdup(path);
+    conn->transport = CONN_TRANSPORT_SOCKET;
+    // The bridge keeps the device running.
+    conn->reset_on_open = false;
+    conn->opened_at_us = opened_at;
+    conn->ready_time_us = 0;
+    capture_event(&conn->capture, CAPTURE_OPEN);
+    return true;
+}
+
+bool conn_open(struct connection* conn, const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        return conn_open_socket(conn, path);
+    }
+
+    return conn_open_serial(conn, path);
+}
+
+bool conn_reset_device(struct connection* conn) {
+    if (conn->transport != CONN_TRANSPORT_SERIAL) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    // The Arduino's reset line is capacitively coupled to DTR, so it resets on the edge
+    // where DTR is raised again.
+    int dtr = TIOCM_DTR;
+    if (ioctl(conn->fd, TIOCMBIC, &dtr) == -1) {
+        return false;
+    }
+    usleep(10000);
+    if (ioctl(conn->fd, TIOCMBIS, &dtr) == -1) {
+        return false;
+    }
     return true;
 }
 
@@ -91,6 +195,7 @@ int conn_write_byte(struct connection* conn, uint8_t byte) {
         return -1;
     }
 
+    capture_tx(&conn->capture, 1, &byte);
     return 0;
 }
 
@@ -98,36 +203,77 @@ int conn_read_byte(struct connection* conn) {
     uint8_t byte;
     ssize_t r = read(conn->fd, &byte, 1);
     if (r < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // The receive timeout of a socket expired.
+            errno = ETIMEDOUT;
+        }
         return -1;
     } else if (r == 0) {
-        errno = ETIMEDOUT;
+        // A tty read returns nothing when it times out, a socket does so when the bridge is gone.
+        errno = conn->transport == CONN_TRANSPORT_SOCKET ? ECONNRESET : ETIMEDOUT;
         return -1;
     } else {
+        capture_rx(&conn->capture, byte);
         return byte;
     }
 }
 
 int conn_write_all(struct connection* conn, size_t len, const uint8_t data[]) {
-    for (size_t i = 0; i < len; ++i) {
-        if (conn_write_byte(conn, data[i]) < 0) {
+    size_t offset = 0;
+    while (offset < len) {
+        ssize_t written;
+        if (conn->transport == CONN_TRANSPORT_SOCKET) {
+            // Don't get killed by SIGPIPE if the bridge goes away.
+            written = send(conn->fd, &data[offset], len - offset, MSG_NOSIGNAL);
+        } else {
+            written = write(conn->fd, &data[offset], len - offset);
+        }
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        } else if (written == 0) {
+            errno = ETIMEDOUT;
             return -1;
         }
+        offset += written;
     }
 
+    capture_tx(&conn->capture, len, data);
     return 0;
 }
 
-// int conn_write_all(struct connection* conn, size_t len, const uint8_t data[]) {
-//     size_t offset = 0;
-//     while (offset < len) {
-//         ssize_t written = write(conn->fd, &data[offset], len - offset);
-//         if (written < 0) {
-//             return -1;
-//         } else if (written == 0) {
-//             errno = ETIMEDOUT;
-//             return -1;
-//         }
-//     }
-
-//     return 0;
-// }
+int conn_wait_readable(struct connection* conn, int timeout_ms) {
+    struct pollfd pfd = {
+        .fd = conn->fd,
+        .events = POLLIN,
+    };
+
+    int result;
+    do {
+        result = poll(&pfd, 1, timeout_ms);
+    } while (result < 0 && errno == EINTR);
+
+    if (result > 0 && (pfd.revents & POLLIN) == 0) {
+        errno = EIO;
+        return -1;
+    }
+
+    return result;
+}
+
+void conn_discard_input(struct connection* conn) {
+    switch (conn->transport) {
+        case CONN_TRANSPORT_SERIAL:
+            tcflush(conn->fd, TCIFLUSH);
+            break;
+        case CONN_TRANSPORT_SOCKET: {
+            uint8_t discard[256];
+            while (recv(conn->fd, discard, sizeof(discard), MSG_DONTWAIT) > 0)
+                continue;
+            break;
+        }
+    }
+    capture_event(&conn->capture, CAPTURE_DISCARD);
+}
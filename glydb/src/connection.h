@@ -1,18 +1,40 @@
 #ifndef _GLYDB_CONNECTION_H
 #define _GLYDB_CONNECTION_H
 
+#include "capture.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+// The different ways that a connection can reach the coprocessor.
+enum conn_transport {
+    // The coprocessor is attached directly through a serial port.
+    CONN_TRANSPORT_SERIAL,
+    // The coprocessor is reached through a bridge (see bridge.h) that listens on a Unix socket.
+    CONN_TRANSPORT_SOCKET,
+};
+
 // This structure represents a connection to a coprocessor.
 struct connection {
     // Path of the port of this connection.
     // `NULL` if no current connection.
     char* port;
+    // How the coprocessor is reached. Only valid if the connection is open.
+    enum conn_transport transport;
     // File descriptor of the connection.
     // -1 if no current connection.
     int fd;
+    // Whether opening the connection most likely reset the device. Opening a serial port raises
+    // DTR, which resets the Arduino if the line was dropped when the port was last closed.
+    bool reset_on_open;
+    // When opening the connection started, see `clock_now_us`.
+    uint64_t opened_at_us;
+    // Time in microseconds between starting to open the connection and the device first responding
+    // to `target_sync`. 0 until then.
+    uint64_t ready_time_us;
+    // Records all traffic on this connection while active. Stays active across reconnects.
+    struct capture capture;
 };
 
 // Initialize a closed connection.
@@ -21,10 +43,28 @@ void conn_init(struct connection* conn);
 // Attempt to open a connection to a serial device `path`, which for example could
 // look like `/dev/ttyUSB0`. The device is communicated with using 115200 baud,
 // 8 bits, 1 stop bit and no parity.
+// The port is configured to keep DTR raised when it is closed, so that opening it again
+// does not reset the device. This function does not wait for the device to become ready.
 // If successfull, returns `true`, otherwise returns `false` and sets `errno` to indicate
 // the error.
 bool conn_open_serial(struct connection* conn, const char* path);
 
+// Attempt to open a connection to a bridge listening on the Unix socket at `path`.
+// If successfull, returns `true`, otherwise returns `false` and sets `errno` to indicate
+// the error.
+bool conn_open_socket(struct connection* conn, const char* path);
+
+// Open a connection to `path`, which may either be a serial device or the socket of a
+// bridge. The transport is chosen based on the type of file at `path`.
+// If successfull, returns `true`, otherwise returns `false` and sets `errno` to indicate
+// the error.
+bool conn_open(struct connection* conn, const char* path);
+
+// Reset the device by pulsing DTR. This is not possible through a bridge.
+// If successfull, returns `true`, otherwise returns `false` and sets `errno` to indicate
+// the error.
+bool conn_reset_device(struct connection* conn);
+
 // Close a connection.
 void conn_close(struct connection* conn);
 
@@ -45,4 +85,12 @@ int conn_read_byte(struct connection* conn);
 // Returns -1 on error, in which case `errno` holds a describing error.
 int conn_write_all(struct connection* conn, size_t len, const uint8_t data[]);
 
+// Wait until data is available to be read, for at most `timeout_ms` milliseconds.
+// Returns 1 if data is available, 0 on timeout, and -1 on error, in which case `errno`
+// holds a describing error.
+int conn_wait_readable(struct connection* conn, int timeout_ms);
+
+// Discard any data that was received but not yet read.
+void conn_discard_input(struct connection* conn);
+
 #endif
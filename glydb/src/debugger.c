@@ -2,6 +2,9 @@
 #include "command.h"
 #include "parser.h"
 #include "bdbp_util.h"
+#include "target.h"
+#include "clock.h"
+#include "image.h"
 #include "commands/commands.h"
 
 #include "common/binary_debug_protocol.h"
@@ -17,30 +20,87 @@
 
 static const char* prompt = "(glydb) ";
 
+// See `debugger_thread_errors`.
+static _Thread_local size_t thread_errors;
+
 void debugger_init(struct debugger* dbg, const char* initial_port) {
     dbg->quit = false;
     conn_init(&dbg->conn);
     dbg->scratch = malloc(GLYCON_ADDRSPACE_SIZE);
+    cache_init(&dbg->cache);
+    dbg->name = NULL;
+    dbg->errors = 0;
+    target_progress_reset(dbg);
+    stats_init(&dbg->stats);
+    symbols_init(&dbg->symbols);
+    buffer_init(&dbg->mailbox);
+    dbg->mailbox_dropped = 0;
+    dbg->event_handler = NULL;
+    dbg->event_arg = NULL;
+    jobs_init(&dbg->jobs, dbg);
+    target_forget(dbg);
 
     if (initial_port) {
-        (void) subcommand_open(dbg, initial_port);
+        (void) subcommand_open(dbg, initial_port, false);
     }
 }
 
 void debugger_deinit(struct debugger* dbg) {
+    // Jobs may still be using the connection.
+    jobs_deinit(&dbg->jobs);
     conn_close(&dbg->conn);
+    if (dbg->conn.capture.f && !capture_stop(&dbg->conn.capture))
+        debugger_print_error(dbg, "Failed to write capture file: %s.", strerror(errno));
     free(dbg->scratch);
+    cache_deinit(&dbg->cache);
+    stats_deinit(&dbg->stats);
+    symbols_deinit(&dbg->symbols);
+    buffer_deinit(&dbg->mailbox);
+}
+
+// Return the length of `line` without trailing whitespace.
+static size_t debugger_trim_end(size_t len, const char line[]) {
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t'))
+        --len;
+    return len;
 }
 
-void debugger_do_line(struct debugger* dbg, size_t len, const char line[]) {
+// If `line` ends with '&', strip it and return `true`.
+static bool debugger_strip_background(size_t* len, const char line[]) {
+    size_t end = debugger_trim_end(*len, line);
+    if (end == 0 || line[end - 1] != '&')
+        return false;
+    *len = debugger_trim_end(end - 1, line);
+    return true;
+}
+
+bool debugger_do_line(struct debugger* dbg, size_t len, const char line[]) {
+    bool background = debugger_strip_background(&len, line);
     struct parser p;
     parser_init(&p, len, line);
 
+    size_t errors = debugger_thread_errors();
     struct cmd_parse_result result;
-    if (cmd_parse(&result, &p, commands) && result.matched_command) {
+    bool parsed = cmd_parse(&result, &p, commands);
+    if (parsed && result.matched_command) {
         switch (result.matched_command->type) {
             case CMD_TYPE_LEAF: {
-                command_handler_t handler = result.matched_command->leaf.payload;
+                const struct cmd_leaf* leaf = &result.matched_command->leaf;
+                // The job takes ownership of `result`, and keeps a copy of the line.
+                char* text = strndup(line, len);
+                if (background && !leaf->local) {
+                    size_t id = jobs_start(&dbg->jobs, text, &result);
+                    printf("[%zu] %s\n", id, text);
+                    free(text);
+                    return false;
+                } else if (!leaf->local && jobs_busy(&dbg->jobs)) {
+                    bool failed = jobs_run_foreground(&dbg->jobs, text, &result);
+                    free(text);
+                    return failed;
+                }
+                free(text);
+
+                command_handler_t handler = leaf->payload;
                 handler(dbg, &result);
                 break;
             }
@@ -51,6 +111,7 @@ void debugger_do_line(struct debugger* dbg, size_t len, const char line[]) {
     }
 
     cmd_parse_result_deinit(&result);
+    return !parsed || debugger_thread_errors() != errors;
 }
 
 void debugger_repl(struct debugger* dbg) {
@@ -70,6 +131,45 @@ void debugger_repl(struct debugger* dbg) {
     rl_uninitialize();
 }
 
+bool debugger_batch_line(struct debugger* dbg, const char* line) {
+    uint64_t start = clock_now_us();
+    bool failed = debugger_do_line(dbg, strlen(line), line);
+    // Make sure the command's output comes before its timing.
+    fflush(stdout);
+    fprintf(stderr, "[%9.1f ms] %s%s\n", (clock_now_us() - start) / 1000.0, line, failed ? " (failed)" : "");
+    return failed;
+}
+
+bool debugger_batch_script(struct debugger* dbg, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open script '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    bool failed = false;
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while (!failed && !dbg->quit && (len = getline(&line, &cap, f)) >= 0) {
+        line[strcspn(line, "\r\n")] = 0;
+        const char* text = line + strspn(line, " \t");
+        if (*text == 0 || *text == '#')
+            continue;
+
+        failed = debugger_batch_line(dbg, text);
+    }
+
+    if (!failed && ferror(f)) {
+        debugger_print_error(dbg, "Failed to read script '%s'.", path);
+        failed = true;
+    }
+
+    free(line);
+    fclose(f);
+    return failed;
+}
+
 bool debugger_require_connection(struct debugger* dbg) {
     if (!conn_is_open(&dbg->conn)) {
         debugger_print_error(dbg, "No active connection. Connect to a device using `connection open`.");
@@ -80,15 +180,24 @@ bool debugger_require_connection(struct debugger* dbg) {
 }
 
 void debugger_print_error(struct debugger* dbg, const char* fmt, ...) {
-    (void) dbg;
     va_list args;
     va_start(args, fmt);
+    ++dbg->errors;
+    ++thread_errors;
+    flockfile(stdout);
+    if (dbg->name)
+        printf("%s: ", dbg->name);
     printf("error: ");
     vprintf(fmt, args);
     puts("");
+    funlockfile(stdout);
     va_end(args);
 }
 
+size_t debugger_thread_errors(void) {
+    return thread_errors;
+}
+
 static bool load_bin(struct debugger* dbg, const struct debugger_load_file_options* opts, struct debugger_write_op** ops, FILE* f, uint8_t* buffer) {
     if (fseek(f, 0, SEEK_END) || ferror(f)) {
         debugger_print_error(dbg, "Failed to seek.");
@@ -101,13 +210,13 @@ static bool load_bin(struct debugger* dbg, const struct debugger_load_file_optio
         goto err_close_file;
     }
 
-    if (size > GLYCON_ADDRSPACE_SIZE) {
+    if (opts->relocation + size > GLYCON_ADDRSPACE_SIZE) {
         debugger_print_error(dbg, "Binary file '%s' overflows address space.", opts->path);
         goto err_close_file;
     }
 
     rewind(f);
-    if (fread(buffer, 1, size, f) < 0 || ferror(f)) {
+    if (fread(buffer, 1, size, f) < size || ferror(f)) {
         debugger_print_error(dbg, "Failed to read '%s'", opts->path);
         goto err_close_file;
     }
@@ -126,11 +235,170 @@ err_close_file:
     return true;
 }
 
+// Intel HEX record types, see https://en.wikipedia.org/wiki/Intel_HEX.
+enum ihex_record_type {
+    IHEX_DATA = 0x00,
+    IHEX_END_OF_FILE = 0x01,
+    IHEX_EXTENDED_SEGMENT_ADDRESS = 0x02,
+    IHEX_START_SEGMENT_ADDRESS = 0x03,
+    IHEX_EXTENDED_LINEAR_ADDRESS = 0x04,
+    IHEX_START_LINEAR_ADDRESS = 0x05,
+};
+
+// The longest record: start code, 5 header bytes, 255 data bytes and a checksum, line ending.
+#define IHEX_MAX_LINE_LENGTH (1 + (5 + 255) * 2 + 2)
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    else if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Decode `len` bytes of hexadecimal digits from `str` into `bytes`. Returns `true` if `str`
+// contains anything other than hex digits.
+static bool hex_decode(size_t len, const char* str, uint8_t* bytes) {
+    for (size_t i = 0; i < len; ++i) {
+        int hi = hex_digit(str[i * 2]);
+        int lo = hex_digit(str[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return true;
+        bytes[i] = hi << 4 | lo;
+    }
+    return false;
+}
+
+// Convert the addresses marked in `populated` into an array of write operations, with
+// adjacent bytes coalesced into a single operation. The array is sorted by address, and
+// terminated by an operation of length 0. `buffer` holds the data at its target address,
+// and is packed in place.
+static struct debugger_write_op* ops_from_populated(const bool* populated, uint8_t* buffer) {
+    size_t n = 0;
+    for (gly_addr_t addr = 0; addr < GLYCON_ADDRSPACE_SIZE; ++addr) {
+        if (populated[addr] && (addr == 0 || !populated[addr - 1]))
+            ++n;
+    }
+
+    struct debugger_write_op* ops = calloc(n + 1, sizeof(struct debugger_write_op));
+    assert(ops);
+
+    size_t i = 0;
+    for (gly_addr_t addr = 0; addr < GLYCON_ADDRSPACE_SIZE; ++addr) {
+        if (!populated[addr])
+            continue;
+        if (addr == 0 || !populated[addr - 1])
+            ops[i++].address = addr;
+        ++ops[i - 1].len;
+    }
+
+    // Operations are sorted, so data is only ever moved down over data that was already moved.
+    size_t packed = 0;
+    for (size_t j = 0; j < n; ++j) {
+        memmove(&buffer[packed], &buffer[ops[j].address], ops[j].len);
+        packed += ops[j].len;
+    }
+
+    return ops;
+}
+
 static bool load_ihex(struct debugger* dbg, const struct debugger_load_file_options* opts, struct debugger_write_op** ops, FILE* f, uint8_t* buffer) {
-    (void) opts;
-    (void) buffer;
+    // Whether each byte of the address space is written to by the file.
+    bool* populated = calloc(GLYCON_ADDRSPACE_SIZE, sizeof(bool));
+    assert(populated);
+
+    char line[IHEX_MAX_LINE_LENGTH + 1];
+    size_t lineno = 0;
+    uint32_t base = 0;
+    bool eof = false;
+    while (!eof && fgets(line, sizeof line, f)) {
+        ++lineno;
+        size_t len = strcspn(line, "\r\n");
+        if (len == 0)
+            continue;
+
+        if (line[len] == 0 && !feof(f)) {
+            debugger_print_error(dbg, "%s:%zu: Record too long.", opts->path, lineno);
+            goto err;
+        } else if (line[0] != ':' || len % 2 == 0 || len < 1 + 5 * 2) {
+            debugger_print_error(dbg, "%s:%zu: Malformed record.", opts->path, lineno);
+            goto err;
+        }
+
+        uint8_t record[(IHEX_MAX_LINE_LENGTH - 1) / 2];
+        size_t record_len = (len - 1) / 2;
+        if (hex_decode(record_len, &line[1], record) || record_len != 5 + record[0]) {
+            debugger_print_error(dbg, "%s:%zu: Malformed record.", opts->path, lineno);
+            goto err;
+        }
+
+        uint8_t checksum = 0;
+        for (size_t i = 0; i < record_len; ++i) {
+            checksum += record[i];
+        }
+
+        if (checksum != 0) {
+            debugger_print_error(dbg, "%s:%zu: Checksum mismatch.", opts->path, lineno);
+            goto err;
+        }
+
+        uint8_t data_len = record[0];
+        uint16_t offset = record[1] << 8 | record[2];
+        uint8_t type = record[3];
+        const uint8_t* data = &record[4];
+        switch (type) {
+            case IHEX_DATA: {
+                uint32_t address = opts->relocation + base + offset;
+                if (address + data_len > GLYCON_ADDRSPACE_SIZE) {
+                    debugger_print_error(dbg, "%s:%zu: Data at %05X overflows address space.", opts->path, lineno, address);
+                    goto err;
+                }
+
+                memcpy(&buffer[address], data, data_len);
+                memset(&populated[address], true, data_len);
+                break;
+            }
+            case IHEX_END_OF_FILE:
+                eof = true;
+                break;
+            case IHEX_EXTENDED_SEGMENT_ADDRESS:
+            case IHEX_EXTENDED_LINEAR_ADDRESS:
+                if (data_len != 2) {
+                    debugger_print_error(dbg, "%s:%zu: Malformed address record.", opts->path, lineno);
+                    goto err;
+                }
+
+                base = data[0] << 8 | data[1];
+                base <<= type == IHEX_EXTENDED_SEGMENT_ADDRESS ? 4 : 16;
+                break;
+            case IHEX_START_SEGMENT_ADDRESS:
+            case IHEX_START_LINEAR_ADDRESS:
+                // Entry points mean nothing to the Z80, which always starts at 0.
+                break;
+            default:
+                debugger_print_error(dbg, "%s:%zu: Unknown record type %02X.", opts->path, lineno, type);
+                goto err;
+        }
+    }
+
+    if (ferror(f)) {
+        debugger_print_error(dbg, "Failed to read '%s'", opts->path);
+        goto err;
+    } else if (!eof) {
+        debugger_print_error(dbg, "%s: Missing end of file record.", opts->path);
+        goto err;
+    }
+
+    *ops = ops_from_populated(populated, buffer);
+    free(populated);
+    fclose(f);
+    return false;
+
+err:
+    free(populated);
     fclose(f);
-    debugger_print_error(dbg, "TODO: ihex loading.");
     return true;
 }
 
@@ -152,6 +420,16 @@ bool debugger_load_file(struct debugger* dbg, const struct debugger_load_file_op
         return load_bin(dbg, opts, ops, f, buffer);
     } else if (strcmp(ext, "ihx") == 0) {
         return load_ihex(dbg, opts, ops, f, buffer);
+    } else if (strcmp(ext, "gli") == 0) {
+        if (opts->relocation != 0) {
+            debugger_print_error(dbg, "Images can't be relocated.");
+            fclose(f);
+            return true;
+        }
+
+        gly_addr_t address;
+        size_t len;
+        return image_read(dbg, opts->path, f, &address, &len, ops, buffer);
     } else {
         debugger_print_error(dbg, "Unknown file type '%s'.", ext);
         fclose(f);
@@ -4,10 +4,17 @@
 #include "common/glycon.h"
 
 #include "connection.h"
+#include "target.h"
+#include "cache.h"
+#include "jobs.h"
+#include "stats.h"
+#include "symbols.h"
+#include "buffer.h"
 
 #include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 
 // This structure represents the current state of the debugger.
 struct debugger {
@@ -17,6 +24,41 @@ struct debugger {
     struct connection conn;
     // Address-space sized buffer that can be used to store data for reading/writing.
     uint8_t* scratch;
+    // Information about the currently connected device. Only valid if `info_valid` is set,
+    // use `target_get_info` to access it.
+    struct target_info info;
+    // Whether `info` was queried from the currently connected device.
+    bool info_valid;
+    // Cached target memory, see cache.h. Accessed through the target_* functions.
+    struct cache cache;
+    // Name that is prepended to error messages, or `NULL`. Used to tell debuggers apart when
+    // several of them run at once, see farm.h.
+    const char* name;
+    // The number of errors reported through `debugger_print_error`, on any thread. Whether a
+    // single command failed is told by `debugger_thread_errors` instead.
+    atomic_size_t errors;
+    // Progress of the command that is currently running.
+    struct target_progress progress;
+    // Commands running in the background, see jobs.h.
+    struct jobs jobs;
+    // Timing of the transactions with the device, see stats.h.
+    struct stats stats;
+    // Symbols that were loaded with `symbols load`. Only used by commands that need the
+    // connection, so that background jobs never see it change.
+    struct symbols symbols;
+    // Breakpoints set with `break add`, numbered like the device numbers them, see
+    // BDBP_CMD_BREAK. Forgotten together with the connection.
+    gly_addr_t breakpoints[BDBP_BREAK_MAX_COUNT];
+    uint8_t breakpoint_count;
+    // Bytes that the Z80 sent through the mailbox (see BDBP_CMD_MAILBOX), which no command took
+    // yet. They arrive whenever the debugger reads from the device. At most
+    // TARGET_MAILBOX_BUFFER_SIZE bytes are kept, the rest are counted as dropped.
+    struct buffer mailbox;
+    size_t mailbox_dropped;
+    // If set, events from the device (see BDBP_STATUS_EVENT) are passed to this function with
+    // `event_arg`, instead of being handled. Used by the bridge to forward them to its clients.
+    void (*event_handler)(void* arg, const uint8_t* pkt);
+    void* event_arg;
 };
 
 // Initialize a debugger. If `initial_port` is not `NULL`, attempt to open this
@@ -26,19 +68,35 @@ void debugger_init(struct debugger* dbg, const char* initial_port);
 // Deinitialize resources owned by the debugger, and close any connection.
 void debugger_deinit(struct debugger* dbg);
 
-// Evaluate a single line.
-void debugger_do_line(struct debugger* dbg, size_t len, const char line[]);
+// Evaluate a single line. Returns `true` if the line could not be parsed or the command
+// reported an error.
+bool debugger_do_line(struct debugger* dbg, size_t len, const char line[]);
 
 // REPL loop that executes until the `quit` command is invoked.
 void debugger_repl(struct debugger* dbg);
 
+// Evaluate a single line non-interactively. The line is echoed to stderr together with the time
+// it took. Returns `true` if the line failed, see `debugger_do_line`.
+bool debugger_batch_line(struct debugger* dbg, const char* line);
+
+// Evaluate the lines of the script at `path` with `debugger_batch_line`, until one fails or the
+// `quit` command is invoked. Blank lines and lines starting with '#' are skipped. Returns `true`
+// if a line failed or the script could not be read.
+bool debugger_batch_script(struct debugger* dbg, const char* path);
+
 // Check that the debugger has a connection currently open. If not, this function returns `true` and
 // prints an explanatory message to the user.
 bool debugger_require_connection(struct debugger* dbg);
 
-// Print an error message to the user.
+// Print an error message to the user. The message is printed at once, even if other threads
+// print at the same time.
 void debugger_print_error(struct debugger* dbg, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
 
+// Return the number of errors reported through `debugger_print_error` on the calling thread. A
+// command runs on a single thread from start to end, so this changes while it runs only if the
+// command itself failed, and not if a background job fails at the same time.
+size_t debugger_thread_errors(void);
+
 // A structure describing the target location of some amount of bytes that needs
 // to be written. Bytes themselves are stored externally.
 struct debugger_write_op {
@@ -51,7 +109,7 @@ struct debugger_load_file_options {
     // The path that the file should be found at.
     const char* path;
     // Override the extension type. If `NULL`, the file type is guessed from the path extension.
-    // May be either `"ihx"` or `"bin"`.
+    // May be `"ihx"`, `"bin"` or `"gli"`, see image.h.
     const char* ext_override;
     // Relocation address to add to the binary's intended location.
     gly_addr_t relocation;
@@ -60,8 +118,11 @@ struct debugger_load_file_options {
 // Load a binary file of data that is intended to be written somewhere.
 // `opts` is a structure describing some loading options.
 // `ops` is a pointer to a variable that will be used to store the array of write operations
-// generated by this file.
-// `buffer` will be filled with the data to write. This buffer should be able to hold the entire address space, 64KiB.
+// generated by this file. The array is sorted by address, operations don't overlap or touch,
+// and it is terminated by an operation of length 0. The caller must free it.
+// The data of the operations is packed into `buffer` in the same order.
+// `buffer` will be filled with the data to write. This buffer should be able to hold the entire
+// address space, see `GLYCON_ADDRSPACE_SIZE`.
 bool debugger_load_file(struct debugger* dbg, const struct debugger_load_file_options* opts, struct debugger_write_op** ops, uint8_t* buffer);
 
 #endif
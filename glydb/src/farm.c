@@ -0,0 +1,207 @@
+#include "farm.h"
+#include "debugger.h"
+#include "target.h"
+#include "clock.h"
+
+#include "common/glycon.h"
+
+#include <pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+// How far a single board got.
+enum farm_result {
+    FARM_RESULT_CONNECT_FAILED,
+    FARM_RESULT_PROGRAM_FAILED,
+    FARM_RESULT_VERIFY_FAILED,
+    FARM_RESULT_MISMATCH,
+    FARM_RESULT_OK,
+};
+
+// The image that is programmed, shared read-only by all boards.
+struct farm_image {
+    const struct debugger_write_op* ops;
+    const uint8_t* data;
+    size_t len;
+};
+
+struct farm_board {
+    struct debugger dbg;
+    pthread_t thread;
+    const char* port;
+    const struct farm_image* image;
+    enum farm_result result;
+    // The first address that read back differently, if `result` is `FARM_RESULT_MISMATCH`.
+    gly_addr_t mismatch;
+    uint64_t program_us;
+    uint64_t verify_us;
+};
+
+static const char* farm_result_to_string(enum farm_result result) {
+    switch (result) {
+        case FARM_RESULT_CONNECT_FAILED: return "no connection";
+        case FARM_RESULT_PROGRAM_FAILED: return "program failed";
+        case FARM_RESULT_VERIFY_FAILED: return "verify failed";
+        case FARM_RESULT_MISMATCH: return "mismatch";
+        case FARM_RESULT_OK: return "ok";
+    }
+    return "unknown";
+}
+
+// Read back the image from the board. Returns `true` if the board could not be read.
+static bool farm_verify(struct farm_board* board) {
+    struct debugger* dbg = &board->dbg;
+    size_t offset = 0;
+    for (const struct debugger_write_op* op = board->image->ops; op->len > 0; ++op) {
+        if (target_read_memory(dbg, op->address, op->len, dbg->scratch))
+            return true;
+
+        const uint8_t* expected = &board->image->data[offset];
+        for (size_t i = 0; i < op->len; ++i) {
+            if (dbg->scratch[i] != expected[i]) {
+                board->result = FARM_RESULT_MISMATCH;
+                board->mismatch = op->address + i;
+                return false;
+            }
+        }
+        offset += op->len;
+    }
+
+    return false;
+}
+
+static void* farm_board_main(void* arg) {
+    struct farm_board* board = arg;
+    struct debugger* dbg = &board->dbg;
+
+    board->result = FARM_RESULT_CONNECT_FAILED;
+    if (!conn_open(&dbg->conn, board->port)) {
+        debugger_print_error(dbg, "Failed to open: %s.", strerror(errno));
+        return NULL;
+    }
+
+    target_forget(dbg);
+    if (target_sync(dbg))
+        return NULL;
+
+    board->result = FARM_RESULT_PROGRAM_FAILED;
+    uint64_t start = clock_now_us();
+    if (target_write_ops(dbg, board->image->ops, board->image->data, true))
+        return NULL;
+    board->program_us = clock_now_us() - start;
+
+    board->result = FARM_RESULT_VERIFY_FAILED;
+    start = clock_now_us();
+    if (farm_verify(board))
+        return NULL;
+    board->verify_us = clock_now_us() - start;
+
+    if (board->result != FARM_RESULT_MISMATCH)
+        board->result = FARM_RESULT_OK;
+    return NULL;
+}
+
+// Load the image and check that it fits in flash. `dbg` is only used to report errors.
+static bool farm_load_image(struct debugger* dbg, const char* path, struct farm_image* image, uint8_t* data) {
+    struct debugger_write_op* ops;
+    struct debugger_load_file_options opts = {
+        .path = path,
+        .ext_override = NULL,
+        .relocation = 0,
+    };
+    if (debugger_load_file(dbg, &opts, &ops, data))
+        return true;
+
+    image->ops = ops;
+    image->data = data;
+    image->len = 0;
+    for (const struct debugger_write_op* op = ops; op->len > 0; ++op) {
+        if (!glycon_is_flash_addr(op->address) || op->address + op->len > GLYCON_FLASH_END) {
+            debugger_print_error(dbg, "Image '%s' does not fit in flash.", path);
+            free(ops);
+            return true;
+        }
+        image->len += op->len;
+    }
+
+    return false;
+}
+
+static void farm_report(size_t n, const struct farm_board boards[], const struct farm_image* image, uint64_t wall_us) {
+    printf("%-24s %-16s %12s %12s %12s\n", "port", "result", "program ms", "KiB/s", "verify ms");
+
+    uint64_t sequential_us = 0;
+    size_t ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const struct farm_board* board = &boards[i];
+        printf("%-24s %-16s", board->port, farm_result_to_string(board->result));
+        if (board->result >= FARM_RESULT_VERIFY_FAILED) {
+            double kib_per_s = image->len / 1024.0 / (board->program_us / 1e6);
+            printf(" %12.1f %12.1f", board->program_us / 1000.0, kib_per_s);
+        }
+        if (board->result >= FARM_RESULT_MISMATCH)
+            printf(" %12.1f", board->verify_us / 1000.0);
+        if (board->result == FARM_RESULT_MISMATCH)
+            printf("  (first difference at %05X)", board->mismatch);
+        puts("");
+
+        sequential_us += board->program_us + board->verify_us;
+        ok += board->result == FARM_RESULT_OK;
+    }
+
+    printf("%zu of %zu boards programmed, %zu bytes each.\n", ok, n, image->len);
+    printf("Total time: %.1f ms (%.1f ms one board after another).\n", wall_us / 1000.0, sequential_us / 1000.0);
+}
+
+bool farm_program(size_t n, const char* const ports[], const char* image_path) {
+    struct farm_board* boards = calloc(n, sizeof(struct farm_board));
+    assert(boards);
+
+    for (size_t i = 0; i < n; ++i) {
+        debugger_init(&boards[i].dbg, NULL);
+        boards[i].dbg.name = ports[i];
+        // Verification has to see what is actually on the board.
+        boards[i].dbg.cache.enabled = false;
+        boards[i].port = ports[i];
+    }
+
+    bool failed = true;
+    struct farm_image image;
+    uint8_t* data = malloc(GLYCON_ADDRSPACE_SIZE);
+    assert(data);
+    if (farm_load_image(&boards[0].dbg, image_path, &image, data))
+        goto deinit;
+
+    uint64_t start = clock_now_us();
+    size_t started = 0;
+    for (; started < n; ++started) {
+        boards[started].image = &image;
+        int err = pthread_create(&boards[started].thread, NULL, farm_board_main, &boards[started]);
+        if (err != 0) {
+            debugger_print_error(&boards[started].dbg, "Failed to start thread: %s.", strerror(err));
+            break;
+        }
+    }
+
+    // Boards that were started still need to be waited for.
+    failed = started < n;
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(boards[i].thread, NULL);
+        failed = failed || boards[i].result != FARM_RESULT_OK;
+    }
+
+    farm_report(started, boards, &image, clock_now_us() - start);
+    free((void*) image.ops);
+
+deinit:
+    free(data);
+    for (size_t i = 0; i < n; ++i) {
+        debugger_deinit(&boards[i].dbg);
+    }
+    free(boards);
+    return failed;
+}
@@ -0,0 +1,16 @@
+#ifndef GLYDB_SRC_FARM_H
+#define GLYDB_SRC_FARM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Farm mode programs the same image into the flash of many boards at once, for example on a
+// production bench. Every board is driven by its own thread with its own debugger, so the
+// total time is that of the slowest board rather than the sum of all of them.
+
+// Program the image at `image_path` into every board in `ports`, and verify it by reading it
+// back. A report with the result and throughput of each board is printed at the end. Returns
+// `true` if any board failed.
+bool farm_program(size_t n, const char* const ports[], const char* image_path);
+
+#endif
@@ -0,0 +1,135 @@
+#include "image.h"
+#include "debugger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+static const char image_magic[4] = {'G', 'L', 'Y', 'I'};
+
+static void image_put_u24(uint8_t* data, uint32_t value) {
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+}
+
+static uint32_t image_get_u24(const uint8_t* data) {
+    return data[0] | data[1] << 8 | data[2] << 16;
+}
+
+bool image_write_begin(struct debugger* dbg, struct image_writer* w, const char* path, gly_addr_t address, size_t len) {
+    w->f = fopen(path, "wb");
+    w->path = path;
+    w->records = 0;
+    w->bytes = 0;
+    if (!w->f) {
+        debugger_print_error(dbg, "Failed to create '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    uint8_t header[IMAGE_HEADER_SIZE];
+    memcpy(header, image_magic, sizeof image_magic);
+    header[4] = IMAGE_VERSION;
+    image_put_u24(&header[5], address);
+    image_put_u24(&header[8], len);
+    if (fwrite(header, 1, sizeof header, w->f) < sizeof header) {
+        debugger_print_error(dbg, "Failed to write '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    return false;
+}
+
+bool image_write_record(struct debugger* dbg, struct image_writer* w, gly_addr_t address, size_t len, const uint8_t data[]) {
+    uint8_t header[IMAGE_RECORD_HEADER_SIZE];
+    image_put_u24(&header[0], address);
+    image_put_u24(&header[3], len);
+    if (fwrite(header, 1, sizeof header, w->f) < sizeof header || fwrite(data, 1, len, w->f) < len) {
+        debugger_print_error(dbg, "Failed to write '%s': %s.", w->path, strerror(errno));
+        return true;
+    }
+
+    ++w->records;
+    w->bytes += len;
+    return false;
+}
+
+bool image_write_end(struct debugger* dbg, struct image_writer* w, bool discard) {
+    bool failed = fclose(w->f) != 0;
+    if (failed && !discard)
+        debugger_print_error(dbg, "Failed to write '%s': %s.", w->path, strerror(errno));
+    if (discard || failed)
+        remove(w->path);
+    return failed;
+}
+
+bool image_read(struct debugger* dbg, const char* path, FILE* f, gly_addr_t* address, size_t* len, struct debugger_write_op** ops, uint8_t* buffer) {
+    uint8_t header[IMAGE_HEADER_SIZE];
+    if (fread(header, 1, sizeof header, f) < sizeof header || memcmp(header, image_magic, sizeof image_magic) != 0) {
+        debugger_print_error(dbg, "'%s' is not a glycon image.", path);
+        fclose(f);
+        return true;
+    } else if (header[4] != IMAGE_VERSION) {
+        debugger_print_error(dbg, "Image '%s' has unsupported version %u.", path, header[4]);
+        fclose(f);
+        return true;
+    }
+
+    *address = image_get_u24(&header[5]);
+    *len = image_get_u24(&header[8]);
+    if (*address + *len > GLYCON_ADDRSPACE_SIZE) {
+        debugger_print_error(dbg, "Image '%s' overflows address space.", path);
+        fclose(f);
+        return true;
+    }
+
+    size_t n = 0;
+    size_t cap = 16;
+    *ops = malloc(cap * sizeof(struct debugger_write_op));
+    assert(*ops);
+
+    gly_addr_t prev_end = *address;
+    size_t offset = 0;
+    uint8_t record[IMAGE_RECORD_HEADER_SIZE];
+    size_t got;
+    while ((got = fread(record, 1, sizeof record, f)) == sizeof record) {
+        gly_addr_t record_address = image_get_u24(&record[0]);
+        size_t record_len = image_get_u24(&record[3]);
+        if (record_address < prev_end || record_address + record_len > *address + *len || record_len == 0) {
+            debugger_print_error(dbg, "Image '%s' has a malformed record at %05X.", path, record_address);
+            goto err;
+        } else if (fread(&buffer[offset], 1, record_len, f) < record_len) {
+            debugger_print_error(dbg, "Image '%s' is truncated.", path);
+            goto err;
+        }
+
+        // Keep room for the terminating operation.
+        if (n + 1 == cap) {
+            cap *= 2;
+            *ops = realloc(*ops, cap * sizeof(struct debugger_write_op));
+            assert(*ops);
+        }
+
+        (*ops)[n].address = record_address;
+        (*ops)[n].len = record_len;
+        ++n;
+        offset += record_len;
+        prev_end = record_address + record_len;
+    }
+
+    if (got != 0 || ferror(f)) {
+        debugger_print_error(dbg, "Failed to read '%s'.", path);
+        goto err;
+    }
+
+    (*ops)[n].address = 0;
+    (*ops)[n].len = 0;
+    fclose(f);
+    return false;
+
+err:
+    free(*ops);
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef GLYDB_SRC_IMAGE_H
+#define GLYDB_SRC_IMAGE_H
+
+#include "common/glycon.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Glycon images (.gli) are sparse snapshots of a range of the target's address space, as
+// written by `memory dump`. All values are little endian, addresses and lengths are 3 bytes.
+//
+//   | "GLYI" | VERSION | RANGE ADDR | RANGE LEN | RECORD... |
+//
+// Every record holds the contents of a part of the range:
+//
+//   | ADDR | LEN | DATA |
+//
+// Records are sorted and don't overlap. Flash in the range that is not covered by a record is
+// erased, while RAM is always covered completely. Restoring an image therefore erases the flash
+// sectors in the range, and only writes the records.
+
+struct debugger;
+struct debugger_write_op;
+
+#define IMAGE_VERSION (1)
+
+// The size of the file header and of the header of a single record.
+#define IMAGE_HEADER_SIZE (4 + 1 + 3 + 3)
+#define IMAGE_RECORD_HEADER_SIZE (3 + 3)
+
+// State of an image that is being written.
+struct image_writer {
+    FILE* f;
+    const char* path;
+    // The number of records and payload bytes written so far.
+    size_t records;
+    size_t bytes;
+};
+
+// Create an image of [`address`, `address + len`) at `path`. Returns `true` and prints an error
+// if the file could not be created.
+bool image_write_begin(struct debugger* dbg, struct image_writer* w, const char* path, gly_addr_t address, size_t len);
+
+// Append a record to the image. Records must be appended in address order.
+bool image_write_record(struct debugger* dbg, struct image_writer* w, gly_addr_t address, size_t len, const uint8_t data[]);
+
+// Finish writing the image, and close it. If `discard` is set, the file is removed instead.
+bool image_write_end(struct debugger* dbg, struct image_writer* w, bool discard);
+
+// Read the image in `f`, which is closed afterwards. The range that the image covers is stored
+// in `address` and `len`. The records are returned like `debugger_load_file` does: as a sorted
+// array of write operations terminated by one of length 0, with their data packed into `buffer`.
+bool image_read(struct debugger* dbg, const char* path, FILE* f, gly_addr_t* address, size_t* len, struct debugger_write_op** ops, uint8_t* buffer);
+
+#endif
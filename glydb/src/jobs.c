@@ -0,0 +1,289 @@
+#include "jobs.h"
+#include "debugger.h"
+#include "target.h"
+#include "clock.h"
+#include "commands/commands.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static const char* job_state_to_string(enum job_state state) {
+    switch (state) {
+        case JOB_QUEUED: return "queued";
+        case JOB_RUNNING: return "running";
+        case JOB_DONE: return "done";
+        case JOB_FAILED: return "failed";
+        case JOB_CANCELLED: return "cancelled";
+    }
+    return "unknown";
+}
+
+static bool job_finished(const struct job* job) {
+    return job->state >= JOB_DONE;
+}
+
+void jobs_init(struct jobs* jobs, struct debugger* dbg) {
+    jobs->dbg = dbg;
+    pthread_mutex_init(&jobs->lock, NULL);
+    pthread_cond_init(&jobs->changed, NULL);
+    jobs->thread_started = false;
+    jobs->quit = false;
+    jobs->head = NULL;
+    jobs->next_id = 1;
+}
+
+// Unlink a job from the list and free it. Requires `jobs->lock`.
+static void jobs_remove(struct jobs* jobs, struct job* job) {
+    struct job** link = &jobs->head;
+    while (*link != job)
+        link = &(*link)->next;
+    *link = job->next;
+
+    if (!job_finished(job))
+        cmd_parse_result_deinit(&job->cmd);
+    free(job->line);
+    free(job);
+}
+
+// Return the background job with ID `id`, or `NULL`. Requires `jobs->lock`.
+static struct job* jobs_find(struct jobs* jobs, size_t id) {
+    for (struct job* job = jobs->head; job; job = job->next) {
+        if (job->id == id)
+            return job;
+    }
+    return NULL;
+}
+
+// Print a line about a job. Requires `jobs->lock`.
+static void jobs_print(struct jobs* jobs, const struct job* job) {
+    const struct target_progress* progress = &jobs->dbg->progress;
+    uint64_t done = job->bytes_done;
+    uint64_t total = job->bytes_total;
+    uint64_t elapsed_us = 0;
+    if (job->state == JOB_RUNNING) {
+        done = atomic_load(&progress->bytes_done);
+        total = atomic_load(&progress->bytes_total);
+        elapsed_us = clock_now_us() - job->start_us;
+    } else if (job_finished(job)) {
+        elapsed_us = job->end_us - job->start_us;
+    }
+
+    printf("[%zu] %-9s %9.1f s", job->id, job_state_to_string(job->state), elapsed_us / 1e6);
+    if (total > 0) {
+        printf(" %8.1f/%.1f KiB (%3.0f%%)", done / 1024.0, total / 1024.0, done * 100.0 / total);
+        if (elapsed_us > 0)
+            printf(" %8.1f KiB/s", done / 1024.0 / (elapsed_us / 1e6));
+    }
+    printf("  %s\n", job->line);
+}
+
+static void* jobs_thread_main(void* arg) {
+    struct jobs* jobs = arg;
+    struct debugger* dbg = jobs->dbg;
+
+    pthread_mutex_lock(&jobs->lock);
+    while (true) {
+        struct job* job = jobs->head;
+        while (job && job->state != JOB_QUEUED)
+            job = job->next;
+
+        if (!job) {
+            if (jobs->quit)
+                break;
+            pthread_cond_wait(&jobs->changed, &jobs->lock);
+            continue;
+        }
+
+        job->state = JOB_RUNNING;
+        job->start_us = clock_now_us();
+        target_progress_reset(dbg);
+        pthread_mutex_unlock(&jobs->lock);
+
+        size_t errors = debugger_thread_errors();
+        command_handler_t handler = job->cmd.matched_command->leaf.payload;
+        handler(dbg, &job->cmd);
+        bool failed = debugger_thread_errors() != errors;
+        cmd_parse_result_deinit(&job->cmd);
+
+        pthread_mutex_lock(&jobs->lock);
+        job->end_us = clock_now_us();
+        job->bytes_done = atomic_load(&dbg->progress.bytes_done);
+        job->bytes_total = atomic_load(&dbg->progress.bytes_total);
+        if (atomic_load(&dbg->progress.cancel))
+            job->state = JOB_CANCELLED;
+        else
+            job->state = failed ? JOB_FAILED : JOB_DONE;
+        // Commands that run directly on the REPL's thread later must not see the request.
+        atomic_store(&dbg->progress.cancel, false);
+
+        if (job->id != 0) {
+            fflush(stdout);
+            jobs_print(jobs, job);
+            fflush(stdout);
+        }
+        pthread_cond_broadcast(&jobs->changed);
+    }
+    pthread_mutex_unlock(&jobs->lock);
+    return NULL;
+}
+
+// Append a job to the queue, starting the I/O thread if needed. Requires `jobs->lock`.
+static struct job* jobs_enqueue(struct jobs* jobs, size_t id, const char* line, struct cmd_parse_result* cmd) {
+    struct job* job = calloc(1, sizeof(struct job));
+    assert(job);
+    job->id = id;
+    job->state = JOB_QUEUED;
+    job->line = strdup(line);
+    job->cmd = *cmd;
+
+    struct job** link = &jobs->head;
+    while (*link)
+        link = &(*link)->next;
+    *link = job;
+
+    if (!jobs->thread_started) {
+        int err = pthread_create(&jobs->thread, NULL, jobs_thread_main, jobs);
+        assert(err == 0);
+        jobs->thread_started = true;
+    }
+
+    pthread_cond_broadcast(&jobs->changed);
+    return job;
+}
+
+void jobs_deinit(struct jobs* jobs) {
+    pthread_mutex_lock(&jobs->lock);
+    jobs->quit = true;
+    for (struct job* job = jobs->head; job; job = job->next) {
+        if (job->state == JOB_QUEUED) {
+            cmd_parse_result_deinit(&job->cmd);
+            job->state = JOB_CANCELLED;
+        } else if (job->state == JOB_RUNNING) {
+            atomic_store(&jobs->dbg->progress.cancel, true);
+        }
+    }
+    pthread_cond_broadcast(&jobs->changed);
+    pthread_mutex_unlock(&jobs->lock);
+
+    if (jobs->thread_started)
+        pthread_join(jobs->thread, NULL);
+
+    while (jobs->head)
+        jobs_remove(jobs, jobs->head);
+    pthread_cond_destroy(&jobs->changed);
+    pthread_mutex_destroy(&jobs->lock);
+}
+
+bool jobs_busy(struct jobs* jobs) {
+    pthread_mutex_lock(&jobs->lock);
+    bool busy = false;
+    for (struct job* job = jobs->head; job; job = job->next) {
+        busy = busy || !job_finished(job);
+    }
+    pthread_mutex_unlock(&jobs->lock);
+    return busy;
+}
+
+size_t jobs_start(struct jobs* jobs, const char* line, struct cmd_parse_result* cmd) {
+    pthread_mutex_lock(&jobs->lock);
+    size_t id = jobs->next_id++;
+    jobs_enqueue(jobs, id, line, cmd);
+    pthread_mutex_unlock(&jobs->lock);
+    return id;
+}
+
+bool jobs_run_foreground(struct jobs* jobs, const char* line, struct cmd_parse_result* cmd) {
+    pthread_mutex_lock(&jobs->lock);
+    struct job* job = jobs_enqueue(jobs, 0, line, cmd);
+    while (!job_finished(job))
+        pthread_cond_wait(&jobs->changed, &jobs->lock);
+
+    bool failed = job->state != JOB_DONE;
+    jobs_remove(jobs, job);
+    pthread_mutex_unlock(&jobs->lock);
+    return failed;
+}
+
+bool jobs_wait(struct jobs* jobs, size_t id) {
+    pthread_mutex_lock(&jobs->lock);
+    if (id != 0 && !jobs_find(jobs, id)) {
+        pthread_mutex_unlock(&jobs->lock);
+        debugger_print_error(jobs->dbg, "No job with ID %zu.", id);
+        return true;
+    }
+
+    bool failed = false;
+    while (true) {
+        // Finished jobs have already been announced, so they are just forgotten.
+        struct job* pending = NULL;
+        struct job* job = jobs->head;
+        while (job) {
+            struct job* next = job->next;
+            if (id != 0 && job->id != id) {
+                // Not waited for.
+            } else if (job_finished(job) && job->id != 0) {
+                failed = failed || job->state != JOB_DONE;
+                jobs_remove(jobs, job);
+            } else if (job->id != 0) {
+                pending = job;
+            }
+            job = next;
+        }
+
+        if (!pending)
+            break;
+        pthread_cond_wait(&jobs->changed, &jobs->lock);
+    }
+
+    pthread_mutex_unlock(&jobs->lock);
+    return failed;
+}
+
+bool jobs_cancel(struct jobs* jobs, size_t id) {
+    pthread_mutex_lock(&jobs->lock);
+    if (id != 0 && !jobs_find(jobs, id)) {
+        pthread_mutex_unlock(&jobs->lock);
+        debugger_print_error(jobs->dbg, "No job with ID %zu.", id);
+        return true;
+    }
+
+    for (struct job* job = jobs->head; job; job = job->next) {
+        if (job->id == 0 || (id != 0 && job->id != id))
+            continue;
+
+        if (job->state == JOB_QUEUED) {
+            cmd_parse_result_deinit(&job->cmd);
+            job->state = JOB_CANCELLED;
+            jobs_print(jobs, job);
+        } else if (job->state == JOB_RUNNING) {
+            // The I/O thread reports the job once it stops.
+            atomic_store(&jobs->dbg->progress.cancel, true);
+        }
+    }
+
+    pthread_cond_broadcast(&jobs->changed);
+    pthread_mutex_unlock(&jobs->lock);
+    return false;
+}
+
+void jobs_list(struct jobs* jobs) {
+    pthread_mutex_lock(&jobs->lock);
+    bool any = false;
+    struct job* job = jobs->head;
+    while (job) {
+        struct job* next = job->next;
+        if (job->id != 0) {
+            jobs_print(jobs, job);
+            any = true;
+            if (job_finished(job))
+                jobs_remove(jobs, job);
+        }
+        job = next;
+    }
+
+    if (!any)
+        puts("No jobs.");
+    pthread_mutex_unlock(&jobs->lock);
+}
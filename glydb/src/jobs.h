@@ -0,0 +1,93 @@
+#ifndef GLYDB_SRC_JOBS_H
+#define GLYDB_SRC_JOBS_H
+
+#include "command.h"
+
+#include <pthread.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Jobs let long running commands, such as programming flash, run in the background while the
+// REPL stays responsive. Jobs are run one at a time, in order, by an I/O thread that owns the
+// connection to the device while it is busy. Foreground commands that use the connection are
+// queued behind any background jobs, and the REPL waits for them to finish; commands that don't
+// use the connection (see `cmd_leaf.local`) run right away.
+
+struct debugger;
+
+enum job_state {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED,
+};
+
+struct job {
+    // Number that the user refers to this job by. Foreground jobs have ID 0.
+    size_t id;
+    enum job_state state;
+    // The command line that started this job.
+    char* line;
+    // The parsed command, owned by the job.
+    struct cmd_parse_result cmd;
+    // When the job started and finished running, from `clock_now_us`.
+    uint64_t start_us;
+    uint64_t end_us;
+    // Progress at the end of the job, see `target_progress`.
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    struct job* next;
+};
+
+struct jobs {
+    struct debugger* dbg;
+    // Protects everything below.
+    pthread_mutex_t lock;
+    // Signalled when a job is queued, finishes, or the I/O thread should exit.
+    pthread_cond_t changed;
+    // Whether the I/O thread was started. It is started once the first job is queued.
+    bool thread_started;
+    pthread_t thread;
+    // Set to make the I/O thread exit.
+    bool quit;
+    // All jobs that were not yet reported to the user, in the order they were queued.
+    struct job* head;
+    // The ID of the next background job.
+    size_t next_id;
+};
+
+// Initialize the jobs of `dbg`.
+void jobs_init(struct jobs* jobs, struct debugger* dbg);
+
+// Cancel all jobs, wait for the I/O thread to exit, and free all resources.
+void jobs_deinit(struct jobs* jobs);
+
+// Return whether any job is queued or running.
+bool jobs_busy(struct jobs* jobs);
+
+// Queue a command to run in the background. Ownership of `cmd` passes to the job. Returns the
+// ID of the new job.
+size_t jobs_start(struct jobs* jobs, const char* line, struct cmd_parse_result* cmd);
+
+// Queue a command behind all background jobs and wait for it to finish. Ownership of `cmd`
+// passes to the job. Returns `true` if the command failed or was cancelled.
+bool jobs_run_foreground(struct jobs* jobs, const char* line, struct cmd_parse_result* cmd);
+
+// Wait for the background job with ID `id`, or for all of them if `id` is 0. Returns `true` if
+// any of them failed or was cancelled, or if there is no job with that ID, in which case an error
+// message has been printed.
+bool jobs_wait(struct jobs* jobs, size_t id);
+
+// Cancel the background job with ID `id`, or all of them if `id` is 0. A queued job is dropped,
+// while a running job is asked to stop after the packet it is transferring. Returns `true` and
+// prints an error if there is no such job.
+bool jobs_cancel(struct jobs* jobs, size_t id);
+
+// Print the state, progress and throughput of all background jobs. Jobs that finished are
+// forgotten after they have been listed once.
+void jobs_list(struct jobs* jobs);
+
+#endif
@@ -1,32 +1,152 @@
 #include "connection.h"
 #include "debugger.h"
+#include "bridge.h"
+#include "farm.h"
+#include "commands/commands.h"
 
 #include <unistd.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+// A command or script that is run instead of the REPL, see -c and -x.
+struct batch_item {
+    bool script;
+    const char* arg;
+};
+
+// Run all batch items in order, stopping at the first that fails. Returns `true` on failure.
+static bool run_batch(struct debugger* dbg, size_t n, const struct batch_item items[]) {
+    // Failing to connect to the initial port also counts.
+    if (dbg->errors > 0)
+        return true;
+
+    for (size_t i = 0; i < n && !dbg->quit; ++i) {
+        bool failed = items[i].script
+            ? debugger_batch_script(dbg, items[i].arg)
+            : debugger_batch_line(dbg, items[i].arg);
+        if (failed)
+            return true;
+    }
+
+    // Let background jobs finish before exiting, rather than cancelling them.
+    return !dbg->quit && jobs_wait(&dbg->jobs, 0);
+}
 
 int main(int argc, char* argv[]) {
     const char* initial_port = NULL;
+    const char* bridge_socket = NULL;
+    const char* farm_image = NULL;
+    const char* capture_path = NULL;
+    bool no_cache = false;
+    // All ports that were passed, only farm mode accepts more than one.
+    const char* ports[argc];
+    size_t ports_len = 0;
+    // Commands and scripts to run instead of the REPL, in order.
+    struct batch_item batch[argc];
+    size_t batch_len = 0;
     for (int i = 1; i < argc; ++i) {
         const char* arg = argv[i];
         if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
-            puts("usage: glydb [-h|--help] [port]");
+            puts("usage: glydb [-h|--help] [-b|--bridge <socket>] [-f|--farm <image>] [-c <command>] [-x <script>] [--capture <file>] [--no-cache] [port...]");
             puts("options:");
             puts("-h, --help    Show this message and exit.");
+            puts("-b, --bridge <socket>");
+            puts("              Instead of starting the debugger, share the device on [port]");
+            puts("              with other glydb instances through a Unix socket at <socket>.");
+            puts("              Connect to it by passing <socket> as port.");
+            puts("-f, --farm <image>");
+            puts("              Instead of starting the debugger, program <image> into the flash of");
+            puts("              the boards on all given ports at once, and verify it.");
+            puts("-c <command>  Run <command> instead of starting the REPL.");
+            puts("-x <script>   Run the commands in <script>, one per line, instead of starting the REPL.");
+            puts("              -c and -x may be repeated and are run in order. Execution stops at the");
+            puts("              first command that fails, and glydb exits with a nonzero status.");
+            puts("--capture <file>");
+            puts("              Record all traffic with the device to <file>, starting with the initial");
+            puts("              connection, see `help capture`.");
+            puts("--no-cache    Always read target memory from the device, see `help cache`.");
             puts("[port]        Port to connect to, for example /dev/ttyUSB0.");
             return EXIT_SUCCESS;
-        } else if (!initial_port) {
-            initial_port = arg;
+        } else if (strcmp(arg, "-b") == 0 || strcmp(arg, "--bridge") == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "error: missing argument <socket> to option '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+            bridge_socket = argv[i];
+        } else if (strcmp(arg, "-f") == 0 || strcmp(arg, "--farm") == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "error: missing argument <image> to option '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+            farm_image = argv[i];
+        } else if (strcmp(arg, "-c") == 0 || strcmp(arg, "-x") == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "error: missing argument to option '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+            batch[batch_len++] = (struct batch_item){arg[1] == 'x', argv[i]};
+        } else if (strcmp(arg, "--capture") == 0) {
+            if (++i == argc) {
+                fprintf(stderr, "error: missing argument <file> to option '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+            capture_path = argv[i];
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            no_cache = true;
         } else {
-            fprintf(stderr, "error: unexpected argument '%s'\n", arg);
+            ports[ports_len++] = arg;
         }
     }
 
+    if (farm_image) {
+        if (bridge_socket || batch_len > 0 || ports_len == 0) {
+            fprintf(stderr, "error: --farm requires one or more ports, and no --bridge, -c or -x\n");
+            return EXIT_FAILURE;
+        }
+
+        return farm_program(ports_len, ports, farm_image) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    initial_port = ports_len > 0 ? ports[0] : NULL;
+    for (size_t i = 1; i < ports_len; ++i) {
+        fprintf(stderr, "error: unexpected argument '%s'\n", ports[i]);
+    }
+
+    if (bridge_socket && !initial_port) {
+        fprintf(stderr, "error: --bridge requires a port\n");
+        return EXIT_FAILURE;
+    } else if (bridge_socket && batch_len > 0) {
+        fprintf(stderr, "error: --bridge can't be combined with -c or -x\n");
+        return EXIT_FAILURE;
+    }
+
     struct debugger dbg;
-    debugger_init(&dbg, initial_port);
-    debugger_repl(&dbg);
+    debugger_init(&dbg, NULL);
+    dbg.cache.enabled = !no_cache;
+
+    // Start capturing before connecting, so that the capture includes synchronizing.
+    if (capture_path && !capture_start(&dbg.conn.capture, capture_path)) {
+        fprintf(stderr, "error: failed to create capture file '%s': %s\n", capture_path, strerror(errno));
+        debugger_deinit(&dbg);
+        return EXIT_FAILURE;
+    }
+
+    if (initial_port)
+        (void) subcommand_open(&dbg, initial_port, false);
+
+    int status = EXIT_SUCCESS;
+    if (batch_len > 0) {
+        if (run_batch(&dbg, batch_len, batch))
+            status = EXIT_FAILURE;
+    } else if (!bridge_socket) {
+        debugger_repl(&dbg);
+    } else if (!conn_is_open(&dbg.conn) || bridge_serve(&dbg, bridge_socket)) {
+        status = EXIT_FAILURE;
+    }
+
     debugger_deinit(&dbg);
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -0,0 +1,224 @@
+#include "replay.h"
+#include "capture.h"
+#include "debugger.h"
+#include "target.h"
+#include "buffer.h"
+#include "bdbp_util.h"
+#include "stats.h"
+#include "clock.h"
+
+#include "common/binary_debug_protocol.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+// A request from the capture, together with the response it received there.
+struct replay_request {
+    uint8_t request[BDBP_MAX_MSG_LENGTH];
+    uint8_t response[BDBP_MAX_MSG_LENGTH];
+    bool answered;
+    // When the request was sent and when its response was complete, relative to the start of
+    // the capture.
+    uint64_t sent_us;
+    uint64_t done_us;
+    // The number of responses that had been received before the request was sent.
+    size_t responses_before;
+};
+
+// Totals of the requests with a particular command.
+struct replay_cmd {
+    size_t requests;
+    uint64_t capture_us;
+    uint64_t replay_us;
+};
+
+static size_t replay_msg_len(const uint8_t msg[]) {
+    return BDBP_MIN_MSG_LENGTH + msg[BDBP_FIELD_DATA_LEN];
+}
+
+// Read the capture at `path`, and keep the requests that were answered in `reqs`. Responses are
+// matched to requests in order, skipping events; whatever was outstanding when input was
+// discarded or the connection was reopened is considered unanswered.
+static bool replay_load(struct debugger* dbg, const char* path, struct buffer* reqs, size_t* skipped) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    if (!capture_read_header(f)) {
+        debugger_print_error(dbg, "File '%s' is not a glydb capture.", path);
+        fclose(f);
+        return true;
+    }
+
+    struct buffer all;
+    buffer_init(&all);
+    size_t first_pending = 0;
+    size_t responses = 0;
+
+    struct capture_record rec = {.time_us = 0};
+    int result;
+    while ((result = capture_read_record(f, &rec)) > 0) {
+        struct replay_request* pending = (struct replay_request*) all.data + first_pending;
+        size_t len = all.size / sizeof(struct replay_request);
+        switch (rec.kind) {
+            case CAPTURE_REQUEST: {
+                struct replay_request req = {
+                    .answered = false,
+                    .sent_us = rec.time_us,
+                    .responses_before = responses,
+                };
+                memcpy(req.request, rec.frame, replay_msg_len(rec.frame));
+                buffer_push_data(&all, sizeof req, &req);
+                break;
+            }
+            case CAPTURE_RESPONSE:
+                // Frames that the device sends on its own, such as events or the announcement
+                // of a freshly reset device, answer no request. Neither do responses without
+                // a request.
+                if (rec.frame[BDBP_FIELD_HDR] == BDBP_STATUS_EVENT || rec.frame[BDBP_FIELD_HDR] == BDBP_STATUS_READY)
+                    break;
+                if (first_pending == len)
+                    break;
+                memcpy(pending->response, rec.frame, replay_msg_len(rec.frame));
+                pending->answered = true;
+                pending->done_us = rec.time_us;
+                ++first_pending;
+                ++responses;
+                break;
+            case CAPTURE_OPEN:
+            case CAPTURE_DISCARD:
+                first_pending = len;
+                break;
+        }
+    }
+
+    if (result < 0) {
+        if (errno == EINVAL)
+            debugger_print_error(dbg, "Capture '%s' is truncated or damaged.", path);
+        else
+            debugger_print_error(dbg, "Failed to read file '%s': %s.", path, strerror(errno));
+        buffer_deinit(&all);
+        fclose(f);
+        return true;
+    }
+    fclose(f);
+
+    struct replay_request* all_reqs = all.data;
+    size_t len = all.size / sizeof(struct replay_request);
+    *skipped = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (all_reqs[i].answered)
+            buffer_push_data(reqs, sizeof(struct replay_request), &all_reqs[i]);
+        else
+            ++*skipped;
+    }
+
+    buffer_deinit(&all);
+    return false;
+}
+
+bool replay_capture(struct debugger* dbg, const char* path) {
+    if (debugger_require_connection(dbg))
+        return true;
+
+    struct buffer buf;
+    buffer_init(&buf);
+    size_t skipped;
+    if (replay_load(dbg, path, &buf, &skipped)) {
+        buffer_deinit(&buf);
+        return true;
+    }
+
+    struct replay_request* reqs = buf.data;
+    size_t len = buf.size / sizeof(struct replay_request);
+    if (len == 0) {
+        debugger_print_error(dbg, "The capture holds no answered requests.");
+        buffer_deinit(&buf);
+        return true;
+    }
+
+    printf("Replaying %zu requests (%zu unanswered ones skipped)...\n", len, skipped);
+
+    struct replay_cmd cmds[STATS_CMDS] = {};
+    uint64_t sent_at[STATS_MAX_IN_FLIGHT];
+    size_t sent = 0;
+    size_t received = 0;
+    size_t differing = 0;
+    size_t status_changed = 0;
+    bool failed = false;
+
+    uint64_t start = clock_now_us();
+    while (received < sent || (sent < len && !failed)) {
+        // Send the next request once the device is as far along as in the capture.
+        bool can_send = sent < len && !failed
+            && received >= reqs[sent].responses_before
+            && sent - received < STATS_MAX_IN_FLIGHT;
+        if (can_send) {
+            if (target_check_cancel(dbg) || target_send_cmd(dbg, reqs[sent].request)) {
+                // Responses to the requests that were sent are still received.
+                failed = true;
+                continue;
+            }
+            sent_at[sent % STATS_MAX_IN_FLIGHT] = clock_now_us();
+            ++sent;
+            continue;
+        }
+
+        uint8_t resp[BDBP_MAX_MSG_LENGTH];
+        if (target_recv_response(dbg, resp)) {
+            failed = true;
+            break;
+        }
+
+        const struct replay_request* req = &reqs[received];
+        uint8_t cmd = req->request[BDBP_FIELD_HDR];
+        struct replay_cmd* c = &cmds[cmd < STATS_CMDS ? cmd : 0];
+        ++c->requests;
+        c->capture_us += req->done_us - req->sent_us;
+        c->replay_us += clock_now_us() - sent_at[received % STATS_MAX_IN_FLIGHT];
+
+        if (memcmp(resp, req->response, replay_msg_len(resp)) != 0) {
+            ++differing;
+            status_changed += resp[BDBP_FIELD_HDR] != req->response[BDBP_FIELD_HDR];
+        }
+        ++received;
+    }
+    uint64_t replay_span = clock_now_us() - start;
+
+    // Whatever was cached may have been overwritten.
+    cache_invalidate_all(&dbg->cache);
+
+    if (received > 0) {
+        uint64_t capture_span = reqs[received - 1].done_us - reqs[0].sent_us;
+        printf("%-13s %9s %12s %12s %8s\n", "command", "requests", "capture us", "replay us", "delta");
+        for (size_t cmd = 0; cmd < STATS_CMDS; ++cmd) {
+            const struct replay_cmd* c = &cmds[cmd];
+            if (c->requests == 0)
+                continue;
+
+            const char* name = bdbp_cmd_to_string(cmd);
+            printf(
+                "%-13s %9zu %12.1f %12.1f %+7.1f%%\n",
+                name ? name : "other",
+                c->requests,
+                c->capture_us / (double) c->requests,
+                c->replay_us / (double) c->requests,
+                c->capture_us ? (c->replay_us / (double) c->capture_us - 1) * 100 : 0.0
+            );
+        }
+
+        printf(
+            "Total: %.3f s in the capture, %.3f s replayed (%+.1f%%). The capture includes pauses of the host.\n",
+            capture_span / 1e6,
+            replay_span / 1e6,
+            capture_span ? (replay_span / (double) capture_span - 1) * 100 : 0.0
+        );
+        printf("%zu of %zu responses differ from the capture, %zu of them in status.\n", differing, received, status_changed);
+    }
+
+    buffer_deinit(&buf);
+    return failed;
+}
@@ -0,0 +1,20 @@
+#ifndef GLYDB_SRC_REPLAY_H
+#define GLYDB_SRC_REPLAY_H
+
+#include <stdbool.h>
+
+// Replaying the host side of a capture (see capture.h) against a device or simulator, to
+// reproduce latency problems and to measure the effect of protocol and firmware changes on
+// real-world traffic.
+
+struct debugger;
+
+// Send the requests in the capture file at `path` to the connected device, and print how their
+// latencies compare with those in the capture, per BDBP command. Requests go out as soon as the
+// device has answered as many requests as it had when they were sent originally, so pipelined
+// transfers stay pipelined, but pauses of the host are left out. Requests that were never
+// answered in the capture, such as pings lost while synchronizing, are skipped.
+// Note that writes and erases in the capture are carried out again.
+bool replay_capture(struct debugger* dbg, const char* path);
+
+#endif
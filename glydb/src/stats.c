@@ -0,0 +1,193 @@
+#include "stats.h"
+#include "bdbp_util.h"
+#include "clock.h"
+
+#include <string.h>
+
+void stats_init(struct stats* stats) {
+    pthread_mutex_init(&stats->lock, NULL);
+    stats->in_flight_first = 0;
+    stats->in_flight_len = 0;
+    stats_reset(stats);
+}
+
+void stats_deinit(struct stats* stats) {
+    pthread_mutex_destroy(&stats->lock);
+}
+
+void stats_reset(struct stats* stats) {
+    pthread_mutex_lock(&stats->lock);
+    memset(stats->cmds, 0, sizeof stats->cmds);
+    stats->syncs = 0;
+    stats->sync_retries = 0;
+    stats->since_us = clock_now_us();
+    // Outstanding requests are still matched with their responses, and counted once complete.
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_snapshot(struct stats* stats, struct stats* out) {
+    pthread_mutex_lock(&stats->lock);
+    memcpy(out->cmds, stats->cmds, sizeof out->cmds);
+    out->syncs = stats->syncs;
+    out->sync_retries = stats->sync_retries;
+    out->since_us = stats->since_us;
+    out->in_flight_first = 0;
+    out->in_flight_len = 0;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+static struct stats_cmd* stats_cmd(struct stats* stats, uint8_t cmd) {
+    return &stats->cmds[cmd < STATS_CMDS ? cmd : 0];
+}
+
+static size_t stats_bucket(uint64_t us) {
+    size_t bucket = 0;
+    while (us >= 2 && bucket < STATS_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+uint64_t stats_bucket_start(size_t bucket) {
+    return bucket == 0 ? 0 : (uint64_t) 1 << bucket;
+}
+
+uint64_t stats_percentile(const uint64_t hist[], uint64_t count, double p) {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_BUCKETS - 1; ++i) {
+        seen += hist[i];
+        if (seen > 0 && seen >= p * count)
+            return stats_bucket_start(i + 1);
+    }
+    return stats_bucket_start(STATS_BUCKETS - 1);
+}
+
+// Remove the oldest outstanding request.
+static struct stats_request stats_pop(struct stats* stats) {
+    struct stats_request req = stats->in_flight[stats->in_flight_first];
+    stats->in_flight_first = (stats->in_flight_first + 1) % STATS_MAX_IN_FLIGHT;
+    --stats->in_flight_len;
+    return req;
+}
+
+void stats_request_sent(struct stats* stats, uint8_t cmd, size_t len, uint64_t start_us, uint64_t end_us) {
+    pthread_mutex_lock(&stats->lock);
+    struct stats_cmd* c = stats_cmd(stats, cmd);
+    ++c->requests;
+    c->tx_bytes += len;
+    c->send_us += end_us - start_us;
+
+    // Should never happen, but the oldest request is the least likely to still be answered.
+    if (stats->in_flight_len == STATS_MAX_IN_FLIGHT)
+        ++stats_cmd(stats, stats_pop(stats).cmd)->failures;
+
+    size_t i = (stats->in_flight_first + stats->in_flight_len++) % STATS_MAX_IN_FLIGHT;
+    stats->in_flight[i] = (struct stats_request){
+        .cmd = cmd,
+        .start_us = start_us,
+        .first_byte_at_us = 0,
+    };
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_response_started(struct stats* stats, uint64_t now_us) {
+    pthread_mutex_lock(&stats->lock);
+    if (stats->in_flight_len > 0)
+        stats->in_flight[stats->in_flight_first].first_byte_at_us = now_us;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_response_received(struct stats* stats, size_t len, bool success, uint64_t now_us) {
+    pthread_mutex_lock(&stats->lock);
+    if (stats->in_flight_len == 0) {
+        pthread_mutex_unlock(&stats->lock);
+        return;
+    }
+
+    struct stats_request req = stats_pop(stats);
+    if (req.first_byte_at_us == 0)
+        req.first_byte_at_us = now_us;
+
+    struct stats_cmd* c = stats_cmd(stats, req.cmd);
+    uint64_t first_byte = req.first_byte_at_us - req.start_us;
+    uint64_t complete = now_us - req.start_us;
+    c->rx_bytes += len;
+    c->failures += !success;
+    c->first_byte_us += first_byte;
+    c->complete_us += complete;
+    if (complete > c->max_complete_us)
+        c->max_complete_us = complete;
+    ++c->first_byte_hist[stats_bucket(first_byte)];
+    ++c->complete_hist[stats_bucket(complete)];
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_drop_in_flight(struct stats* stats) {
+    pthread_mutex_lock(&stats->lock);
+    while (stats->in_flight_len > 0)
+        ++stats_cmd(stats, stats_pop(stats).cmd)->failures;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stats_sync(struct stats* stats, unsigned retries) {
+    pthread_mutex_lock(&stats->lock);
+    ++stats->syncs;
+    stats->sync_retries += retries;
+    pthread_mutex_unlock(&stats->lock);
+}
+
+static void stats_write_hist_json(const uint64_t hist[], FILE* f) {
+    fputc('[', f);
+    for (size_t i = 0; i < STATS_BUCKETS; ++i)
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long) hist[i]);
+    fputc(']', f);
+}
+
+void stats_write_json(const struct stats* stats, FILE* f) {
+    fprintf(
+        f,
+        "{\"elapsed_us\":%llu,\"syncs\":%llu,\"sync_retries\":%llu,\"serial_byte_us\":%d,\"bucket_starts_us\":",
+        (unsigned long long) (clock_now_us() - stats->since_us),
+        (unsigned long long) stats->syncs,
+        (unsigned long long) stats->sync_retries,
+        STATS_SERIAL_BYTE_US
+    );
+
+    fputc('[', f);
+    for (size_t i = 0; i < STATS_BUCKETS; ++i)
+        fprintf(f, "%s%llu", i ? "," : "", (unsigned long long) stats_bucket_start(i));
+    fprintf(f, "],\"commands\":[");
+
+    bool first = true;
+    for (size_t cmd = 0; cmd < STATS_CMDS; ++cmd) {
+        const struct stats_cmd* c = &stats->cmds[cmd];
+        if (c->requests == 0)
+            continue;
+
+        const char* name = bdbp_cmd_to_string(cmd);
+        fprintf(
+            f,
+            "%s{\"cmd\":%zu,\"name\":\"%s\",\"requests\":%llu,\"failures\":%llu,\"tx_bytes\":%llu,\"rx_bytes\":%llu,"
+            "\"send_us\":%llu,\"first_byte_us\":%llu,\"complete_us\":%llu,\"max_complete_us\":%llu,\"first_byte_hist\":",
+            first ? "" : ",",
+            cmd,
+            name ? name : "other",
+            (unsigned long long) c->requests,
+            (unsigned long long) c->failures,
+            (unsigned long long) c->tx_bytes,
+            (unsigned long long) c->rx_bytes,
+            (unsigned long long) c->send_us,
+            (unsigned long long) c->first_byte_us,
+            (unsigned long long) c->complete_us,
+            (unsigned long long) c->max_complete_us
+        );
+        stats_write_hist_json(c->first_byte_hist, f);
+        fprintf(f, ",\"complete_hist\":");
+        stats_write_hist_json(c->complete_hist, f);
+        fputc('}', f);
+        first = false;
+    }
+
+    fprintf(f, "]}\n");
+}
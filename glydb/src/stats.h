@@ -0,0 +1,114 @@
+#ifndef GLYDB_SRC_STATS_H
+#define GLYDB_SRC_STATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Timing of every transaction with the device, bucketed by BDBP command. For each request, this
+// records how long it took to hand it to the connection, how long until the first byte of the
+// response arrived, and how long until the response was complete. Comparing those with the time
+// the bytes need on the serial link tells apart slowness of the host's serial driver, of the
+// coprocessor, and of the link itself.
+
+// Commands below this value are tracked separately. Larger ones are counted in slot 0, which no
+// command uses.
+#define STATS_CMDS (32)
+
+// Latency histograms have logarithmic buckets: bucket 0 counts latencies below 2 us, bucket `i`
+// counts [2^i, 2^(i+1)) us, and the last bucket counts everything from 2^(STATS_BUCKETS - 1) us.
+#define STATS_BUCKETS (24)
+
+// The maximum number of requests whose response is awaited at once. Pipelines never send more
+// requests ahead than this, see target.c.
+#define STATS_MAX_IN_FLIGHT (32)
+
+// Time to transfer a byte over the serial link: 1 Mbaud with 10 bits per byte, see connection.c.
+#define STATS_SERIAL_BYTE_US (10)
+
+// Statistics of the requests with a particular command.
+struct stats_cmd {
+    // The number of requests that were sent, and how many of them failed: either the device
+    // returned an error status, or no response was received.
+    uint64_t requests;
+    uint64_t failures;
+    // Bytes sent and received, including packet headers.
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    // Total time spent handing requests to the connection.
+    uint64_t send_us;
+    // Total time from starting to send a request until the first byte of its response arrived,
+    // and until the response was complete. Pipelined requests include the time spent waiting
+    // for the responses to earlier requests.
+    uint64_t first_byte_us;
+    uint64_t complete_us;
+    uint64_t max_complete_us;
+    uint64_t first_byte_hist[STATS_BUCKETS];
+    uint64_t complete_hist[STATS_BUCKETS];
+};
+
+// A request whose response was not received yet.
+struct stats_request {
+    uint8_t cmd;
+    uint64_t start_us;
+    // When the first byte of the response arrived, or 0.
+    uint64_t first_byte_at_us;
+};
+
+struct stats {
+    // Protects everything below, so that statistics can be shown while a background job runs.
+    pthread_mutex_t lock;
+    struct stats_cmd cmds[STATS_CMDS];
+    // The number of times that the debugger synchronized with the device, and the number of
+    // pings that went unanswered while doing so and had to be retried.
+    uint64_t syncs;
+    uint64_t sync_retries;
+    // When the statistics were last reset, from `clock_now_us`.
+    uint64_t since_us;
+    // Requests that await their response, oldest first. Responses arrive in the order in which
+    // the requests were sent.
+    struct stats_request in_flight[STATS_MAX_IN_FLIGHT];
+    size_t in_flight_first;
+    size_t in_flight_len;
+};
+
+void stats_init(struct stats* stats);
+
+void stats_deinit(struct stats* stats);
+
+// Clear all statistics.
+void stats_reset(struct stats* stats);
+
+// Copy the statistics to `out`, which must not be used with the other stats_* functions.
+void stats_snapshot(struct stats* stats, struct stats* out);
+
+// Record that a request of `len` bytes was handed to the connection between `start_us` and
+// `end_us`.
+void stats_request_sent(struct stats* stats, uint8_t cmd, size_t len, uint64_t start_us, uint64_t end_us);
+
+// Record that the first byte of the response to the oldest outstanding request arrived.
+void stats_response_started(struct stats* stats, uint64_t now_us);
+
+// Record that the response to the oldest outstanding request is complete. The response was
+// `len` bytes long, and `success` tells whether the device reported success.
+void stats_response_received(struct stats* stats, size_t len, bool success, uint64_t now_us);
+
+// Count all outstanding requests as failed, because their responses will never be received.
+void stats_drop_in_flight(struct stats* stats);
+
+// Record a synchronization with the device, which took `retries` unanswered pings.
+void stats_sync(struct stats* stats, unsigned retries);
+
+// Return the lower bound of histogram bucket `bucket`, in microseconds.
+uint64_t stats_bucket_start(size_t bucket);
+
+// Estimate the `p`-quantile of the `count` samples in `hist`. Returns the upper bound of the
+// bucket that holds it in microseconds, or the lower bound if that is the last bucket.
+uint64_t stats_percentile(const uint64_t hist[], uint64_t count, double p);
+
+// Write a snapshot taken with `stats_snapshot` to `f` as a single JSON object.
+void stats_write_json(const struct stats* stats, FILE* f);
+
+#endif
@@ -0,0 +1,166 @@
+#include "symbols.h"
+#include "debugger.h"
+#include "buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+void symbols_init(struct symbols* syms) {
+    syms->items = NULL;
+    syms->len = 0;
+}
+
+void symbols_deinit(struct symbols* syms) {
+    symbols_clear(syms);
+}
+
+void symbols_clear(struct symbols* syms) {
+    for (size_t i = 0; i < syms->len; ++i)
+        free(syms->items[i].name);
+    free(syms->items);
+    symbols_init(syms);
+}
+
+// Parse a hexadecimal address in one of the forms described in symbols.h.
+static bool symbols_parse_address(const char* token, gly_addr_t* address) {
+    size_t len = strlen(token);
+    if (strncasecmp(token, "0x", 2) == 0) {
+        token += 2;
+        len -= 2;
+    } else if (token[0] == '$') {
+        ++token;
+        --len;
+    } else if (len > 1 && tolower((unsigned char) token[len - 1]) == 'h') {
+        --len;
+    }
+
+    if (len == 0 || len > 5)
+        return false;
+
+    gly_addr_t value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (!isxdigit((unsigned char) token[i]))
+            return false;
+        int c = tolower((unsigned char) token[i]);
+        value = value * 16 + (isdigit(c) ? c - '0' : c - 'a' + 10);
+    }
+
+    *address = value;
+    return true;
+}
+
+static bool symbols_is_name(const char* token) {
+    if (!isalpha((unsigned char) token[0]) && token[0] != '_' && token[0] != '.')
+        return false;
+
+    for (const char* c = token; *c; ++c) {
+        if (!isalnum((unsigned char) *c) && *c != '_' && *c != '.' && *c != '$')
+            return false;
+    }
+    return true;
+}
+
+static int symbols_compare(const void* a, const void* b) {
+    const struct symbol* x = a;
+    const struct symbol* y = b;
+    if (x->address != y->address)
+        return x->address < y->address ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+bool symbols_load(struct debugger* dbg, struct symbols* syms, const char* path, gly_addr_t offset, size_t* loaded) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        debugger_print_error(dbg, "Failed to open file '%s': %s.", path, strerror(errno));
+        return true;
+    }
+
+    struct buffer buf;
+    buffer_init(&buf);
+    if (syms->len > 0)
+        buffer_push_data(&buf, syms->len * sizeof(struct symbol), syms->items);
+    free(syms->items);
+    *loaded = 0;
+
+    char line[512];
+    while (fgets(line, sizeof line, f)) {
+        char* tokens[2];
+        size_t n = 0;
+        bool valid = true;
+        for (char* token = strtok(line, " \t\r\n=:"); token; token = strtok(NULL, " \t\r\n=:")) {
+            if (n == 0 && strcmp(token, "DEF") == 0)
+                continue;
+            if (n == 2) {
+                valid = false;
+                break;
+            }
+            tokens[n++] = token;
+        }
+        if (!valid || n != 2)
+            continue;
+
+        struct symbol sym;
+        if (symbols_is_name(tokens[0]) && symbols_parse_address(tokens[1], &sym.address)) {
+            sym.name = tokens[0];
+        } else if (symbols_is_name(tokens[1]) && symbols_parse_address(tokens[0], &sym.address)) {
+            sym.name = tokens[1];
+        } else {
+            continue;
+        }
+
+        sym.name = strdup(sym.name);
+        sym.address += offset;
+        buffer_push_data(&buf, sizeof sym, &sym);
+        ++*loaded;
+    }
+
+    bool failed = ferror(f);
+    if (failed)
+        debugger_print_error(dbg, "Failed to read file '%s': %s.", path, strerror(errno));
+    fclose(f);
+
+    syms->items = buf.data;
+    syms->len = buf.size / sizeof(struct symbol);
+    qsort(syms->items, syms->len, sizeof(struct symbol), symbols_compare);
+    return failed;
+}
+
+const struct symbol* symbols_lookup(const struct symbols* syms, gly_addr_t address) {
+    // Find the first symbol above `address`.
+    size_t lo = 0;
+    size_t hi = syms->len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (syms->items[mid].address <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return NULL;
+
+    const struct symbol* sym = &syms->items[lo - 1];
+    return glycon_is_ram_addr(sym->address) == glycon_is_ram_addr(address) ? sym : NULL;
+}
+
+void symbols_print_offset(const struct symbol* sym, gly_addr_t address) {
+    printf("%s", sym->name);
+    if (address != sym->address)
+        printf("+0x%X", address - sym->address);
+}
+
+void symbols_print_address(const struct symbols* syms, gly_addr_t address) {
+    printf("%05X", address);
+    const struct symbol* sym = symbols_lookup(syms, address);
+    if (!sym)
+        return;
+
+    printf(" (");
+    symbols_print_offset(sym, address);
+    printf(")");
+}
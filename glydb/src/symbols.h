@@ -0,0 +1,55 @@
+#ifndef GLYDB_SRC_SYMBOLS_H
+#define GLYDB_SRC_SYMBOLS_H
+
+#include "common/glycon.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Symbols of the programs on the device, so that addresses can be shown by name.
+//
+// Symbol files are text files with a symbol on every line: a name and an address, separated by
+// whitespace, '=' or ':', in either order. Addresses are hexadecimal, optionally with a "0x" or
+// "$" prefix or an "h" suffix. A leading "DEF" is ignored, so that sdcc's .noi files can be
+// loaded as well. Other lines, such as comments, are skipped.
+
+struct debugger;
+
+struct symbol {
+    char* name;
+    gly_addr_t address;
+};
+
+struct symbols {
+    // Sorted by address.
+    struct symbol* items;
+    size_t len;
+};
+
+// Initialize an empty symbol table.
+void symbols_init(struct symbols* syms);
+
+// Deinitialize `syms`, and free its internal resources.
+void symbols_deinit(struct symbols* syms);
+
+// Remove all symbols.
+void symbols_clear(struct symbols* syms);
+
+// Add the symbols in the file at `path` to `syms`, with `offset` added to their addresses. The
+// number of symbols that were added is stored in `loaded`. Returns `true` and prints an error
+// message if the file could not be read.
+bool symbols_load(struct debugger* dbg, struct symbols* syms, const char* path, gly_addr_t offset, size_t* loaded);
+
+// Return the symbol with the highest address at or below `address`, or `NULL` if there is none.
+// Symbols don't extend from flash into RAM.
+const struct symbol* symbols_lookup(const struct symbols* syms, gly_addr_t address);
+
+// Print `address` relative to `sym`, the symbol that it belongs to: the name of the symbol,
+// followed by the offset from it if there is one, like "main+0x1A".
+void symbols_print_offset(const struct symbol* sym, gly_addr_t address);
+
+// Print `address`, followed by its symbol and offset if there is a symbol for it, like
+// "0041A (main+0x1A)".
+void symbols_print_address(const struct symbols* syms, gly_addr_t address);
+
+#endif
@@ -1,52 +1,180 @@
 #include "target.h"
+#include "debugger.h"
 #include "bdbp_util.h"
+#include "clock.h"
+#include "symbols.h"
 
 #include "common/binary_debug_protocol.h"
 #include "common/glycon.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <assert.h>
 
-bool target_exec_cmd(struct debugger* dbg, uint8_t* buf) {
+// How long to wait for a freshly reset device to announce itself before probing it. This
+// should cover the bootloader's timeout. Probing a device that is still in its bootloader
+// keeps it there for longer, so this is done quietly.
+#define TARGET_SYNC_BOOT_TIMEOUT_MS (2500)
+
+// How often a command that sleeps with `target_sleep_until` checks whether it was cancelled.
+#define TARGET_CANCEL_CHECK_US (10000)
+
+// How long to wait for the response to a single ping while synchronizing.
+#define TARGET_SYNC_PROBE_TIMEOUT_MS (50)
+
+// The number of pings sent before giving up on synchronizing.
+#define TARGET_SYNC_PROBES (5)
+
+bool target_send_cmd(struct debugger* dbg, const uint8_t* pkt) {
     if (debugger_require_connection(dbg))
         return true;
 
-    size_t len = BDBP_MIN_MSG_LENGTH + buf[BDBP_FIELD_DATA_LEN];
-
-    int result = conn_write_all(&dbg->conn, len, buf);
+    size_t len = BDBP_MIN_MSG_LENGTH + pkt[BDBP_FIELD_DATA_LEN];
+    uint64_t start = clock_now_us();
+    int result = conn_write_all(&dbg->conn, len, pkt);
+    stats_request_sent(&dbg->stats, pkt[BDBP_FIELD_HDR], len, start, clock_now_us());
     if (result < 0) {
         debugger_print_error(dbg, "Failed to write: %s.", strerror(errno));
+        stats_drop_in_flight(&dbg->stats);
         return true;
     }
 
-    // TODO: Improve this to ideally a single read call
-    result = conn_read_byte(&dbg->conn);
+    return false;
+}
+
+static bool target_read_byte(struct debugger* dbg, uint8_t* byte) {
+    int result = conn_read_byte(&dbg->conn);
     if (result < 0) {
         debugger_print_error(dbg, "Failed to read: %s.", strerror(errno));
         return true;
     }
-    buf[0] = result;
+    *byte = result;
+    return false;
+}
 
-    result = conn_read_byte(&dbg->conn);
-    // TODO: Remove this code duplication also
-    if (result < 0) {
-        debugger_print_error(dbg, "Failed to read: %s.", strerror(errno));
+// Read the length and data of a packet whose header was read already.
+static bool target_read_pkt_data(struct debugger* dbg, uint8_t* buf) {
+    if (target_read_byte(dbg, &buf[BDBP_FIELD_DATA_LEN]))
         return true;
-    }
-    buf[1] = result;
 
-    len = result;
+    size_t len = buf[BDBP_FIELD_DATA_LEN];
     for (size_t i = 0; i < len; ++i) {
-        result = conn_read_byte(&dbg->conn);
-        // TODO: Remove this code duplication also
+        if (target_read_byte(dbg, &buf[BDBP_FIELD_DATA + i]))
+            return true;
+    }
+    return false;
+}
+
+// Keep the bytes of a BDBP_EVENT_MAILBOX event for the mailbox commands.
+static void target_handle_mailbox(struct debugger* dbg, size_t len, const uint8_t* data) {
+    size_t room = TARGET_MAILBOX_BUFFER_SIZE - dbg->mailbox.size;
+    if (len > room) {
+        dbg->mailbox_dropped += len - room;
+        len = room;
+    }
+    buffer_push_data(&dbg->mailbox, len, data);
+}
+
+static void target_handle_event(struct debugger* dbg, const uint8_t* buf) {
+    if (dbg->event_handler) {
+        dbg->event_handler(dbg->event_arg, buf);
+        return;
+    }
+
+    const uint8_t* data = &buf[BDBP_FIELD_DATA];
+    uint8_t len = buf[BDBP_FIELD_DATA_LEN];
+    if (len >= 1 && data[0] == BDBP_EVENT_MAILBOX) {
+        target_handle_mailbox(dbg, len - 1, &data[1]);
+        return;
+    } else if (len < 2 + BDBP_ADDR_SIZE || data[0] != BDBP_EVENT_BREAKPOINT) {
+        return;
+    }
+
+    gly_addr_t address = data[2] | data[3] << 8 | (gly_addr_t) data[4] << 16;
+    printf("Breakpoint %u hit at ", data[1]);
+    symbols_print_address(&dbg->symbols, address);
+    puts(".");
+    fflush(stdout);
+
+    // The Z80 stays stopped until it is told to continue.
+    cache_set_z80_running(&dbg->cache, false);
+}
+
+bool target_recv_response(struct debugger* dbg, uint8_t* buf) {
+    // TODO: Improve this to ideally a single read call
+    while (true) {
+        if (target_read_byte(dbg, &buf[BDBP_FIELD_HDR]))
+            goto fail;
+        if (buf[BDBP_FIELD_HDR] != BDBP_STATUS_EVENT)
+            break;
+        if (target_read_pkt_data(dbg, buf))
+            goto fail;
+        target_handle_event(dbg, buf);
+    }
+
+    stats_response_started(&dbg->stats, clock_now_us());
+    if (target_read_pkt_data(dbg, buf))
+        goto fail;
+
+    bool success = buf[BDBP_FIELD_HDR] == BDBP_STATUS_SUCCESS;
+    stats_response_received(&dbg->stats, BDBP_MIN_MSG_LENGTH + buf[BDBP_FIELD_DATA_LEN], success, clock_now_us());
+    return false;
+
+fail:
+    // The connection is broken, so no further responses will arrive either.
+    stats_drop_in_flight(&dbg->stats);
+    return true;
+}
+
+bool target_recv_unsolicited(struct debugger* dbg, uint8_t* buf) {
+    if (target_read_byte(dbg, &buf[BDBP_FIELD_HDR]) || target_read_pkt_data(dbg, buf))
+        return true;
+
+    if (buf[BDBP_FIELD_HDR] == BDBP_STATUS_EVENT)
+        target_handle_event(dbg, buf);
+    return false;
+}
+
+int target_await_event_until(struct debugger* dbg, uint64_t until_us) {
+    if (debugger_require_connection(dbg))
+        return -1;
+
+    while (!target_check_cancel(dbg)) {
+        uint64_t now = clock_now_us();
+        if (now >= until_us)
+            return 0;
+
+        uint64_t us = until_us - now < TARGET_CANCEL_CHECK_US ? until_us - now : TARGET_CANCEL_CHECK_US;
+        int result = conn_wait_readable(&dbg->conn, (us + 999) / 1000);
+        if (result == 0)
+            continue;
         if (result < 0) {
             debugger_print_error(dbg, "Failed to read: %s.", strerror(errno));
-            return true;
+            return -1;
+        }
+
+        uint8_t buf[BDBP_MAX_MSG_LENGTH];
+        if (target_recv_unsolicited(dbg, buf))
+            return -1;
+        if (buf[BDBP_FIELD_HDR] != BDBP_STATUS_EVENT) {
+            debugger_print_error(dbg, "Device sent an unexpected packet with status %s.", bdbp_status_to_string(buf[BDBP_FIELD_HDR]));
+            return -1;
         }
-        buf[i + 2] = result;
+
+        return 1;
     }
 
-    enum bdbp_status status = buf[0];
+    return -1;
+}
+
+bool target_await_event(struct debugger* dbg) {
+    return target_await_event_until(dbg, UINT64_MAX) < 0;
+}
+
+static bool target_check_status(struct debugger* dbg, const uint8_t* buf) {
+    enum bdbp_status status = buf[BDBP_FIELD_HDR];
     if (status != BDBP_STATUS_SUCCESS) {
         debugger_print_error(dbg, "Device returned status %s.", bdbp_status_to_string(status));
         return true;
@@ -55,44 +183,634 @@ bool target_exec_cmd(struct debugger* dbg, uint8_t* buf) {
     return false;
 }
 
-static bool target_write(struct debugger* dbg, enum bdbp_cmd cmd, gly_addr_t address, size_t len, const uint8_t buffer[]) {
+void target_progress_reset(struct debugger* dbg) {
+    atomic_store(&dbg->progress.bytes_done, 0);
+    atomic_store(&dbg->progress.bytes_total, 0);
+    atomic_store(&dbg->progress.cancel, false);
+}
+
+bool target_check_cancel(struct debugger* dbg) {
+    if (atomic_load(&dbg->progress.cancel)) {
+        debugger_print_error(dbg, "Cancelled.");
+        return true;
+    }
+
+    return false;
+}
+
+bool target_sleep_until(struct debugger* dbg, uint64_t until_us) {
+    while (!atomic_load(&dbg->progress.cancel)) {
+        uint64_t now = clock_now_us();
+        if (now >= until_us)
+            return false;
+
+        uint64_t us = until_us - now < TARGET_CANCEL_CHECK_US ? until_us - now : TARGET_CANCEL_CHECK_US;
+        nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = us * 1000}, NULL);
+    }
+
+    return true;
+}
+
+bool target_transact(struct debugger* dbg, uint8_t* buf) {
+    return target_send_cmd(dbg, buf) || target_recv_response(dbg, buf);
+}
+
+bool target_exec_cmd(struct debugger* dbg, uint8_t* buf) {
+    return target_transact(dbg, buf) || target_check_status(dbg, buf);
+}
+
+// Wait for an empty packet with header `hdr`, skipping anything else that is received. Returns 1
+// if the packet was received, 0 if it wasn't received within `timeout_ms`, and -1 on error.
+static int target_await_empty_pkt(struct debugger* dbg, uint8_t hdr, int timeout_ms) {
+    uint64_t deadline = clock_now_us() + (uint64_t) timeout_ms * 1000;
+    int prev = -1;
+    while (true) {
+        uint64_t now = clock_now_us();
+        if (now >= deadline)
+            return 0;
+
+        int result = conn_wait_readable(&dbg->conn, (deadline - now + 999) / 1000);
+        if (result == 0) {
+            return 0;
+        } else if (result < 0) {
+            debugger_print_error(dbg, "Failed to read: %s.", strerror(errno));
+            return -1;
+        }
+
+        int byte = conn_read_byte(&dbg->conn);
+        if (byte < 0) {
+            debugger_print_error(dbg, "Failed to read: %s.", strerror(errno));
+            return -1;
+        } else if (prev == hdr && byte == 0) {
+            return 1;
+        }
+        prev = byte;
+    }
+}
+
+bool target_sync(struct debugger* dbg) {
+    if (debugger_require_connection(dbg))
+        return true;
+
+    conn_discard_input(&dbg->conn);
+
+    if (dbg->conn.reset_on_open) {
+        int result = target_await_empty_pkt(dbg, BDBP_STATUS_READY, TARGET_SYNC_BOOT_TIMEOUT_MS);
+        if (result < 0)
+            return true;
+        // If nothing was received, the firmware may just be too old to announce itself.
+    }
+
+    // Responses to requests that are still outstanding are discarded below.
+    stats_drop_in_flight(&dbg->stats);
+
+    // Even if the device announced itself, ping it to make sure nothing else is pending.
+    for (int i = 0; i < TARGET_SYNC_PROBES; ++i) {
+        conn_discard_input(&dbg->conn);
+
+        uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+        bdbp_pkt_init(pkt, BDBP_CMD_PING);
+        if (target_send_cmd(dbg, pkt))
+            return true;
+
+        int result = target_await_empty_pkt(dbg, BDBP_STATUS_SUCCESS, TARGET_SYNC_PROBE_TIMEOUT_MS);
+        if (result < 0) {
+            stats_drop_in_flight(&dbg->stats);
+            return true;
+        } else if (result > 0) {
+            stats_response_received(&dbg->stats, BDBP_MIN_MSG_LENGTH, true, clock_now_us());
+            stats_sync(&dbg->stats, i);
+            if (dbg->conn.ready_time_us == 0)
+                dbg->conn.ready_time_us = clock_now_us() - dbg->conn.opened_at_us;
+            return false;
+        }
+
+        stats_drop_in_flight(&dbg->stats);
+    }
+
+    stats_sync(&dbg->stats, TARGET_SYNC_PROBES);
+    debugger_print_error(dbg, "Device did not respond.");
+    return true;
+}
+
+const struct target_info* target_get_info(struct debugger* dbg) {
+    if (dbg->info_valid)
+        return &dbg->info;
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_INFO);
+    if (target_transact(dbg, pkt))
+        return NULL;
+
+    struct target_info* info = &dbg->info;
+    if (pkt[BDBP_FIELD_HDR] == BDBP_STATUS_UNKNOWN_CMD) {
+        // Firmware from before BDBP_CMD_INFO: assume the original command set.
+        info->version = 0;
+        info->max_msg_len = BDBP_MAX_MSG_LENGTH;
+        info->rx_buffer_size = 0;
+        info->tx_buffer_size = 0;
+        info->commands = BDBP_LEGACY_CMDS;
+        info->build_id = 0;
+    } else if (target_check_status(dbg, pkt)) {
+        return NULL;
+    } else if (pkt[BDBP_FIELD_DATA_LEN] < BDBP_INFO_DATA_LENGTH) {
+        debugger_print_error(dbg, "Device returned malformed info response.");
+        return NULL;
+    } else {
+        const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+        info->version = data[0];
+        info->max_msg_len = bdbp_read_u16(&data[1]);
+        info->rx_buffer_size = bdbp_read_u16(&data[3]);
+        info->tx_buffer_size = bdbp_read_u16(&data[5]);
+        info->commands = bdbp_read_u64(&data[7]);
+        info->build_id = bdbp_read_u32(&data[15]);
+
+        if (info->max_msg_len < BDBP_MIN_MSG_LENGTH + BDBP_ADDR_SIZE + 1 || info->max_msg_len > BDBP_MAX_MSG_LENGTH)
+            info->max_msg_len = BDBP_MAX_MSG_LENGTH;
+    }
+
+    dbg->info_valid = true;
+    return info;
+}
+
+void target_forget(struct debugger* dbg) {
+    dbg->info_valid = false;
+    dbg->breakpoint_count = 0;
+    cache_invalidate_all(&dbg->cache);
+    cache_set_z80_running(&dbg->cache, true);
+}
+
+bool target_supports(struct debugger* dbg, enum bdbp_cmd cmd) {
+    const struct target_info* info = target_get_info(dbg);
+    return info && (info->commands & BDBP_CMD_BIT(cmd)) != 0;
+}
+
+bool target_bus_usage(struct debugger* dbg, const struct target_bus_usage* set, struct target_bus_usage* usage) {
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    bdbp_pkt_init(pkt, BDBP_CMD_BUS);
+    if (set) {
+        bdbp_pkt_append_u8(pkt, set->burst);
+        bdbp_pkt_append_u8(pkt, set->gap_us & 0xFF);
+        bdbp_pkt_append_u8(pkt, set->gap_us >> 8);
+    }
+    if (target_exec_cmd(dbg, pkt))
+        return true;
+
+    const uint8_t* data = &pkt[BDBP_FIELD_DATA];
+    if (pkt[BDBP_FIELD_DATA_LEN] < BDBP_BUS_DATA_LENGTH || bdbp_read_u16(&data[3]) == 0 || data[5] == 0) {
+        debugger_print_error(dbg, "Device returned a malformed bus report.");
+        return true;
+    }
+
+    usage->burst = data[0];
+    usage->gap_us = bdbp_read_u16(&data[1]);
+    usage->ticks_per_us = bdbp_read_u16(&data[3]) / 1000.0 / data[5];
+    usage->holds = bdbp_read_u32(&data[6]);
+    usage->hold_ticks = bdbp_read_u32(&data[10]);
+    return false;
+}
+
+// Return the maximum number of data bytes that a single request packet may carry.
+static uint8_t target_max_data_len(struct debugger* dbg) {
+    const struct target_info* info = target_get_info(dbg);
+    return info ? info->max_msg_len - BDBP_MIN_MSG_LENGTH : BDBP_MAX_DATA_LENGTH;
+}
+
+// Return the number of requests that may be outstanding at once. The device reads a request
+// completely before processing it, so while it processes one, further requests can queue up
+// in its receive buffer as long as they fit. Sending those ahead of time hides the round trip
+// latency of the serial link.
+static size_t target_pipeline_depth(struct debugger* dbg) {
+    const struct target_info* info = target_get_info(dbg);
+    size_t depth = info ? 1 + info->rx_buffer_size / info->max_msg_len : 1;
+    // Responses are matched with their requests to time them, see stats.h.
+    return depth < STATS_MAX_IN_FLIGHT ? depth : STATS_MAX_IN_FLIGHT;
+}
+
+// Requests that were sent to the device ahead of time, see `target_pipeline_depth`.
+struct target_pipeline {
+    // The maximum number of outstanding requests.
+    size_t depth;
+    // The number of requests whose response was not received yet.
+    size_t in_flight;
+    // Whether a request failed. No further requests are sent after that.
+    bool failed;
+};
+
+static void target_pipeline_init(struct debugger* dbg, struct target_pipeline* pl) {
+    pl->depth = target_pipeline_depth(dbg);
+    pl->in_flight = 0;
+    pl->failed = false;
+}
+
+// Receive the response to the oldest outstanding request.
+static void target_pipeline_recv(struct debugger* dbg, struct target_pipeline* pl) {
+    uint8_t resp[BDBP_MAX_MSG_LENGTH];
+    if (target_recv_response(dbg, resp)) {
+        // Nothing more can be received on a broken connection.
+        pl->in_flight = 0;
+        pl->failed = true;
+        return;
+    }
+
+    --pl->in_flight;
+    // Stop sending on device errors, but keep receiving the responses to outstanding requests.
+    pl->failed = target_check_status(dbg, resp) || pl->failed;
+}
+
+// Send a request, first waiting for a response if too many are outstanding. Returns `true` if
+// a request failed, in which case nothing more should be sent.
+static bool target_pipeline_send(struct debugger* dbg, struct target_pipeline* pl, const uint8_t* pkt) {
+    if (pl->in_flight == pl->depth)
+        target_pipeline_recv(dbg, pl);
+
+    if (pl->failed)
+        return true;
+
+    if (target_check_cancel(dbg) || target_send_cmd(dbg, pkt)) {
+        pl->failed = true;
+        return true;
+    }
+
+    ++pl->in_flight;
+    return false;
+}
+
+// Receive the responses to all outstanding requests. Returns `true` if any request failed.
+static bool target_pipeline_finish(struct debugger* dbg, struct target_pipeline* pl) {
+    while (pl->in_flight > 0)
+        target_pipeline_recv(dbg, pl);
+    return pl->failed;
+}
+
+// Queue writes of [`address`, `address + len`) with as few packets as possible.
+static bool target_pipeline_write(struct debugger* dbg, struct target_pipeline* pl, enum bdbp_cmd cmd, gly_addr_t address, size_t len, const uint8_t buffer[]) {
+    uint8_t max_data_len = target_max_data_len(dbg);
     uint8_t pkt[BDBP_MAX_MSG_LENGTH];
     for (size_t i = 0; i < len;) {
         bdbp_pkt_init(pkt, cmd);
         bdbp_pkt_append_addr(pkt, address + i);
-        uint8_t cap = bdbp_pkt_data_free(pkt);
+        uint8_t cap = max_data_len - bdbp_pkt_data_size(pkt);
         size_t bytes_left = len - i;
         uint8_t bytes_in_pkt = cap < bytes_left ? cap : bytes_left;
         bdbp_pkt_append_data(pkt, bytes_in_pkt, &buffer[i]);
         i += bytes_in_pkt;
-        if (target_exec_cmd(dbg, pkt))
+
+        if (target_pipeline_send(dbg, pl, pkt))
             return true;
+        atomic_fetch_add(&dbg->progress.bytes_done, bytes_in_pkt);
     }
 
-    return true;
+    return false;
+}
+
+static bool target_write(struct debugger* dbg, enum bdbp_cmd cmd, gly_addr_t address, size_t len, const uint8_t buffer[]) {
+    atomic_fetch_add(&dbg->progress.bytes_total, len);
+    struct target_pipeline pl;
+    target_pipeline_init(dbg, &pl);
+    target_pipeline_write(dbg, &pl, cmd, address, len, buffer);
+    return target_pipeline_finish(dbg, &pl);
 }
 
 bool target_write_memory(struct debugger* dbg, gly_addr_t address, size_t len, const uint8_t buffer[]) {
-    return target_write(dbg, BDBP_CMD_WRITE, address, len, buffer);
+    if (target_write(dbg, BDBP_CMD_WRITE, address, len, buffer)) {
+        // Some of the packets may have been written.
+        cache_invalidate(&dbg->cache, address, len);
+        return true;
+    }
+
+    cache_update(&dbg->cache, address, len, buffer);
+    return false;
 }
 
 bool target_write_flash(struct debugger* dbg, gly_addr_t address, size_t len, const uint8_t buffer[]) {
+    // Programming only clears bits, so the result depends on what was there before.
+    cache_invalidate(&dbg->cache, address, len);
     return target_write(dbg, BDBP_CMD_WRITE_FLASH, address, len, buffer);
 }
 
+// Read directly from the device, bypassing the cache. Read requests are pipelined like writes,
+// so that the link keeps streaming responses.
+static bool target_read_uncached(struct debugger* dbg, gly_addr_t address, size_t len, uint8_t buffer[]) {
+    size_t depth = target_pipeline_depth(dbg);
+    size_t in_flight = 0;
+    bool failed = false;
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    size_t sent = 0;
+    size_t received = 0;
+    while (received < sent || (sent < len && !failed)) {
+        if (sent < len && !failed && in_flight < depth) {
+            bdbp_pkt_init(pkt, BDBP_CMD_READ);
+            bdbp_pkt_append_addr(pkt, address + sent);
+            size_t bytes_left = len - sent;
+            uint8_t bytes_in_pkt = BDBP_MAX_DATA_LENGTH < bytes_left ? BDBP_MAX_DATA_LENGTH : bytes_left;
+            bdbp_pkt_append_u8(pkt, bytes_in_pkt);
+            if (target_check_cancel(dbg) || target_send_cmd(dbg, pkt)) {
+                // Responses to the requests that were sent are still received.
+                failed = true;
+                continue;
+            }
+            sent += bytes_in_pkt;
+            ++in_flight;
+            continue;
+        }
+
+        if (target_recv_response(dbg, pkt))
+            return true;
+        --in_flight;
+
+        size_t bytes_left = len - received;
+        uint8_t expected = BDBP_MAX_DATA_LENGTH < bytes_left ? BDBP_MAX_DATA_LENGTH : bytes_left;
+        if (failed || target_check_status(dbg, pkt)) {
+            failed = true;
+        } else if (pkt[BDBP_FIELD_DATA_LEN] != expected) {
+            debugger_print_error(dbg, "Device returned %u bytes instead of %u.", pkt[BDBP_FIELD_DATA_LEN], expected);
+            failed = true;
+        } else {
+            memcpy(&buffer[received], &pkt[BDBP_FIELD_DATA], expected);
+            atomic_fetch_add(&dbg->progress.bytes_done, expected);
+        }
+        received += expected;
+    }
+
+    return failed;
+}
+
+// Return whether reads may be served from the cache. Other clients of a bridge can change
+// memory behind our back, so shared connections are never cached.
+static bool target_cache_usable(struct debugger* dbg) {
+    return dbg->cache.enabled && dbg->conn.transport == CONN_TRANSPORT_SERIAL;
+}
+
+bool target_read_memory_uncached(struct debugger* dbg, gly_addr_t address, size_t len, uint8_t buffer[]) {
+    atomic_fetch_add(&dbg->progress.bytes_total, len);
+    return target_read_uncached(dbg, address, len, buffer);
+}
+
 bool target_read_memory(struct debugger* dbg, gly_addr_t address, size_t len, uint8_t buffer[]) {
+    struct cache* cache = &dbg->cache;
+    if (!target_cache_usable(dbg) || address + len > GLYCON_ADDRSPACE_SIZE)
+        return target_read_memory_uncached(dbg, address, len, buffer);
+
+    gly_addr_t first = address - address % CACHE_PAGE_SIZE;
+    gly_addr_t end = address + len;
+    for (gly_addr_t page = first; page < end; page += CACHE_PAGE_SIZE) {
+        if (!cache_page_valid(cache, page))
+            atomic_fetch_add(&dbg->progress.bytes_total, CACHE_PAGE_SIZE);
+    }
+
+    gly_addr_t page = first;
+    while (page < end) {
+        if (cache_page_valid(cache, page)) {
+            ++cache->stats.page_hits;
+            page += CACHE_PAGE_SIZE;
+            continue;
+        }
+
+        // Fetch consecutive missing pages at once, so that the packets are filled up.
+        gly_addr_t run_end = page + CACHE_PAGE_SIZE;
+        while (run_end < end && !cache_page_valid(cache, run_end))
+            run_end += CACHE_PAGE_SIZE;
+
+        if (target_read_uncached(dbg, page, run_end - page, &cache->data[page]))
+            return true;
+        cache_fill(cache, page, run_end - page);
+        page = run_end;
+    }
+
+    memcpy(buffer, &cache->data[address], len);
+    return false;
+}
+
+bool target_digest_memory(struct debugger* dbg, gly_addr_t address, uint8_t block_size, size_t count, uint16_t digests[]) {
     uint8_t pkt[BDBP_MAX_MSG_LENGTH];
-    for (size_t i = 0; i < len; i += BDBP_MAX_DATA_LENGTH) {
-        bdbp_pkt_init(pkt, BDBP_CMD_READ);
-        bdbp_pkt_append_addr(pkt, address + i);
-        size_t bytes_left = len - i;
-        uint8_t bytes_in_pkt = BDBP_MAX_DATA_LENGTH < bytes_left ? BDBP_MAX_DATA_LENGTH : bytes_left;
-        bdbp_pkt_append_u8(pkt, bytes_in_pkt);
-        if (target_exec_cmd(dbg, pkt))
+    for (size_t done = 0; done < count;) {
+        size_t blocks_left = count - done;
+        uint8_t blocks = BDBP_DIGEST_MAX_BLOCKS < blocks_left ? BDBP_DIGEST_MAX_BLOCKS : blocks_left;
+        bdbp_pkt_init(pkt, BDBP_CMD_DIGEST);
+        bdbp_pkt_append_addr(pkt, address + done * block_size);
+        bdbp_pkt_append_u8(pkt, block_size);
+        bdbp_pkt_append_u8(pkt, blocks);
+        if (target_check_cancel(dbg) || target_exec_cmd(dbg, pkt))
+            return true;
+
+        if (pkt[BDBP_FIELD_DATA_LEN] != 2 * blocks) {
+            debugger_print_error(dbg, "Device returned %u digests instead of %u.", pkt[BDBP_FIELD_DATA_LEN] / 2, blocks);
+            return true;
+        }
+
+        for (uint8_t i = 0; i < blocks; ++i) {
+            const uint8_t* digest = &pkt[BDBP_FIELD_DATA + 2 * i];
+            digests[done + i] = digest[0] | digest[1] << 8;
+        }
+        done += blocks;
+    }
+
+    return false;
+}
+
+bool target_erase_flash(struct debugger* dbg, gly_addr_t address, size_t len) {
+    if (len == 0)
+        return false;
+
+    gly_addr_t first = address - address % GLYCON_FLASH_SECTOR_SIZE;
+    gly_addr_t end = address + len;
+    // Whole sectors are erased, even if the range covers only part of them.
+    gly_addr_t sectors_end = end + (GLYCON_FLASH_SECTOR_SIZE - end % GLYCON_FLASH_SECTOR_SIZE) % GLYCON_FLASH_SECTOR_SIZE;
+    cache_invalidate(&dbg->cache, first, sectors_end - first);
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    if (first == GLYCON_FLASH_START && end >= GLYCON_FLASH_END && target_supports(dbg, BDBP_CMD_ERASE_CHIP)) {
+        // A chip erase takes about as long as erasing a few sectors.
+        bdbp_pkt_init(pkt, BDBP_CMD_ERASE_CHIP);
+        return target_exec_cmd(dbg, pkt);
+    }
+
+    for (gly_addr_t sector = first; sector < end && sector < GLYCON_FLASH_END; sector += GLYCON_FLASH_SECTOR_SIZE) {
+        bdbp_pkt_init(pkt, BDBP_CMD_ERASE_SECTOR);
+        bdbp_pkt_append_addr(pkt, sector);
+        if (target_check_cancel(dbg) || target_exec_cmd(dbg, pkt))
+            return true;
+    }
+
+    return false;
+}
+
+// Gaps between writes up to this size are written over rather than starting a new packet, as
+// a packet's header and address take up about as much time on the link.
+#define TARGET_SCHED_MAX_GAP (BDBP_MIN_MSG_LENGTH + BDBP_ADDR_SIZE)
+
+#define TARGET_FLASH_SECTORS (GLYCON_FLASH_SIZE / GLYCON_FLASH_SECTOR_SIZE)
+
+// The plan for a batch of writes: the final contents of every byte that is written, laid out
+// like the address space.
+struct target_sched {
+    uint8_t* image;
+    // Whether each byte of `image` must be written.
+    bool* populated;
+    // Whether each flash sector must be erased first.
+    bool erase[TARGET_FLASH_SECTORS];
+};
+
+// Return whether the bytes in [`address`, `address + len`), which lie between two writes to
+// the same chip, may be written over with the contents of `sched->image`.
+static bool target_sched_fill_gap(struct debugger* dbg, struct target_sched* sched, gly_addr_t address, size_t len) {
+    if (glycon_is_flash_addr(address)) {
+        // Programming only clears bits, so programming 0xFF leaves any byte as it is.
+        memset(&sched->image[address], 0xFF, len);
+        return true;
+    }
+
+    // RAM can only be written over with its current contents, if they are known.
+    struct cache* cache = &dbg->cache;
+    if (!target_cache_usable(dbg))
+        return false;
+
+    for (gly_addr_t page = address - address % CACHE_PAGE_SIZE; page < address + len; page += CACHE_PAGE_SIZE) {
+        if (!cache_page_valid(cache, page))
+            return false;
+    }
+
+    memcpy(&sched->image[address], &cache->data[address], len);
+    return true;
+}
+
+// Turn the populated bytes of `sched` into runs that need as few packets as possible.
+static void target_sched_plan(struct debugger* dbg, struct target_sched* sched) {
+    bool* populated = sched->populated;
+
+    for (gly_addr_t addr = GLYCON_FLASH_START; addr < GLYCON_FLASH_END; ++addr) {
+        if (!populated[addr])
+            continue;
+        size_t sector = (addr - GLYCON_FLASH_START) / GLYCON_FLASH_SECTOR_SIZE;
+        // Erased bytes already read 0xFF, so they need not be programmed.
+        if (sched->erase[sector] && sched->image[addr] == 0xFF)
+            populated[addr] = false;
+    }
+
+    gly_addr_t prev_end = 0;
+    bool have_prev = false;
+    for (gly_addr_t addr = 0; addr < GLYCON_ADDRSPACE_SIZE; ++addr) {
+        if (!populated[addr])
+            continue;
+
+        if (have_prev && addr > prev_end) {
+            size_t gap = addr - prev_end;
+            bool same_chip = glycon_is_flash_addr(prev_end - 1) == glycon_is_flash_addr(addr);
+            if (gap <= TARGET_SCHED_MAX_GAP && same_chip && target_sched_fill_gap(dbg, sched, prev_end, gap))
+                memset(&populated[prev_end], true, gap);
+        }
+
+        while (addr < GLYCON_ADDRSPACE_SIZE && populated[addr])
+            ++addr;
+        prev_end = addr;
+        have_prev = true;
+    }
+}
+
+// Queue the erases planned in `sched`, each sector only once.
+static bool target_sched_erase(struct debugger* dbg, struct target_sched* sched, struct target_pipeline* pl) {
+    size_t sectors = 0;
+    for (size_t i = 0; i < TARGET_FLASH_SECTORS; ++i) {
+        sectors += sched->erase[i];
+    }
+
+    if (sectors == 0)
+        return false;
+
+    uint8_t pkt[BDBP_MAX_MSG_LENGTH];
+    if (sectors == TARGET_FLASH_SECTORS && target_supports(dbg, BDBP_CMD_ERASE_CHIP)) {
+        cache_invalidate(&dbg->cache, GLYCON_FLASH_START, GLYCON_FLASH_SIZE);
+        bdbp_pkt_init(pkt, BDBP_CMD_ERASE_CHIP);
+        return target_pipeline_send(dbg, pl, pkt);
+    }
+
+    for (size_t i = 0; i < TARGET_FLASH_SECTORS; ++i) {
+        if (!sched->erase[i])
+            continue;
+
+        gly_addr_t sector = GLYCON_FLASH_START + i * GLYCON_FLASH_SECTOR_SIZE;
+        cache_invalidate(&dbg->cache, sector, GLYCON_FLASH_SECTOR_SIZE);
+        bdbp_pkt_init(pkt, BDBP_CMD_ERASE_SECTOR);
+        bdbp_pkt_append_addr(pkt, sector);
+        if (target_pipeline_send(dbg, pl, pkt))
+            return true;
+    }
+
+    return false;
+}
+
+// Queue the writes planned in `sched`, in address order.
+static bool target_sched_write(struct debugger* dbg, struct target_sched* sched, struct target_pipeline* pl) {
+    for (gly_addr_t addr = 0; addr < GLYCON_ADDRSPACE_SIZE; ++addr) {
+        if (!sched->populated[addr])
+            continue;
+
+        // Runs never cross from flash into RAM, which are written with different commands.
+        bool flash = glycon_is_flash_addr(addr);
+        gly_addr_t end = addr;
+        while (end < GLYCON_ADDRSPACE_SIZE && sched->populated[end] && glycon_is_flash_addr(end) == flash)
+            ++end;
+
+        // Programming only clears bits, so the result depends on what was there before.
+        if (flash)
+            cache_invalidate(&dbg->cache, addr, end - addr);
+        enum bdbp_cmd cmd = flash ? BDBP_CMD_WRITE_FLASH : BDBP_CMD_WRITE;
+        if (target_pipeline_write(dbg, pl, cmd, addr, end - addr, &sched->image[addr]))
             return true;
 
-        memcpy(&buffer[i], &pkt[BDBP_FIELD_DATA], bytes_in_pkt);
+        addr = end - 1;
     }
 
     return false;
 }
+
+bool target_write_ops(struct debugger* dbg, const struct debugger_write_op* ops, const uint8_t data[], bool erase) {
+    struct target_sched sched = {};
+    sched.image = malloc(GLYCON_ADDRSPACE_SIZE);
+    sched.populated = calloc(GLYCON_ADDRSPACE_SIZE, sizeof(bool));
+    assert(sched.image && sched.populated);
+
+    // Later operations take precedence over earlier ones that they overlap.
+    size_t offset = 0;
+    for (const struct debugger_write_op* op = ops; op->len > 0; ++op) {
+        assert(op->address + op->len <= GLYCON_ADDRSPACE_SIZE);
+        memcpy(&sched.image[op->address], &data[offset], op->len);
+        memset(&sched.populated[op->address], true, op->len);
+        offset += op->len;
+    }
+
+    for (gly_addr_t addr = GLYCON_FLASH_START; erase && addr < GLYCON_FLASH_END; ++addr) {
+        if (sched.populated[addr])
+            sched.erase[(addr - GLYCON_FLASH_START) / GLYCON_FLASH_SECTOR_SIZE] = true;
+    }
+
+    target_sched_plan(dbg, &sched);
+    size_t total = 0;
+    for (gly_addr_t addr = 0; addr < GLYCON_ADDRSPACE_SIZE; ++addr) {
+        total += sched.populated[addr];
+    }
+    atomic_fetch_add(&dbg->progress.bytes_total, total);
+
+    // The device handles requests in order, so every erase is done before the writes.
+    struct target_pipeline pl;
+    target_pipeline_init(dbg, &pl);
+    if (!target_sched_erase(dbg, &sched, &pl))
+        target_sched_write(dbg, &sched, &pl);
+    bool failed = target_pipeline_finish(dbg, &pl);
+
+    // If a request failed, some of the RAM writes may not have happened.
+    for (gly_addr_t addr = GLYCON_RAM_START; addr < GLYCON_RAM_END; ++addr) {
+        if (!sched.populated[addr])
+            continue;
+        if (failed)
+            cache_invalidate(&dbg->cache, addr, 1);
+        else
+            cache_update(&dbg->cache, addr, 1, &sched.image[addr]);
+    }
+
+    free(sched.image);
+    free(sched.populated);
+    return failed;
+}
@@ -2,13 +2,101 @@
 #define GLYDB_SRC_TARGET_H
 
 #include "common/glycon.h"
-#include "debugger.h"
+#include "common/binary_debug_protocol.h"
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 
 // The functions in this header are used for medium-level target functionality that is useful
 // for implementing different commands.
 
+struct debugger;
+struct debugger_write_op;
+
+// Information about the firmware of the connected device, as reported by BDBP_CMD_INFO.
+struct target_info {
+    // The BDBP version that the device implements. 0 if the device does not support BDBP_CMD_INFO.
+    uint8_t version;
+    // The maximum length of a request message, including header, that the device accepts.
+    uint16_t max_msg_len;
+    // The size of the device's receive buffer. 0 if unknown.
+    uint16_t rx_buffer_size;
+    // The size of the device's transmit buffer. 0 if unbuffered.
+    uint16_t tx_buffer_size;
+    // Bitmap of commands supported by the device, see `BDBP_CMD_BIT`.
+    uint64_t commands;
+    // Identifier of the firmware build.
+    uint32_t build_id;
+};
+
+// Progress of the transfers made by the current command, so that other threads can report on a
+// command that runs in the background, see jobs.h.
+struct target_progress {
+    // The number of payload bytes that the command transferred so far.
+    atomic_uint_least64_t bytes_done;
+    // The number of payload bytes that the command is known to transfer. This grows whenever
+    // the command starts another transfer.
+    atomic_uint_least64_t bytes_total;
+    // Set by another thread to ask the running command to stop. Transfers check this between
+    // packets, and fail with an error if it is set.
+    atomic_bool cancel;
+};
+
+// The budget for holding the Z80 off the bus, and how long the device held it, as reported by
+// BDBP_CMD_BUS.
+struct target_bus_usage {
+    // The bytes transferred per bus acquisition, or 0 for whole requests, and the time the Z80
+    // runs between them.
+    uint8_t burst;
+    uint16_t gap_us;
+    // The number of times the bus was held, and for how many ticks in total. These wrap around,
+    // so only the difference between two queries is meaningful.
+    uint32_t holds;
+    uint32_t hold_ticks;
+    double ticks_per_us;
+};
+
+// Reset the progress of `dbg`, before a new command runs.
+void target_progress_reset(struct debugger* dbg);
+
+// Return `true` and print an error if the running command was asked to stop.
+bool target_check_cancel(struct debugger* dbg);
+
+// Sleep until `until_us`, see `clock_now_us`. Returns `true` without printing anything if the
+// running command was asked to stop in the meantime.
+bool target_sleep_until(struct debugger* dbg, uint64_t until_us);
+
+// Send a request packet to the device without waiting for the response. Responses arrive in
+// the order in which the requests were sent, and must each be received with
+// `target_recv_response`.
+bool target_send_cmd(struct debugger* dbg, const uint8_t* pkt);
+
+// Receive a single response packet from the device into `buf`. The status is not checked.
+// Events that the device reports before the response are handled on the way, see
+// `target_await_event`.
+bool target_recv_response(struct debugger* dbg, uint8_t* buf);
+
+// The most bytes from the mailbox that are kept for commands to take, see `debugger.mailbox`.
+#define TARGET_MAILBOX_BUFFER_SIZE (1024 * 1024)
+
+// Wait until the device reports an event with BDBP_STATUS_EVENT and handle it: a breakpoint hit
+// is printed, and RAM is cached until the Z80 continues, and bytes from the mailbox are kept in
+// `debugger.mailbox`. Requires that no responses are outstanding. Returns `true` and prints an
+// error if the command was cancelled in the meantime.
+bool target_await_event(struct debugger* dbg);
+
+// Like `target_await_event`, but give up at `until_us`, see `clock_now_us`. Returns 1 if an
+// event was handled, 0 if none arrived in time, and -1 if the command was cancelled or failed,
+// in which case an error has been printed.
+int target_await_event_until(struct debugger* dbg, uint64_t until_us);
+
+// Receive a packet that the device sent while no responses are outstanding into `buf`, without
+// waiting for it to start. Events are handled like `target_await_event` does, other packets are
+// only returned. Returns `true` and prints an error on failure.
+bool target_recv_unsolicited(struct debugger* dbg, uint8_t* buf);
+
 // Invoke a remove command, encoded as a BDBP packet. This function handles both
 // sending and receiving: When the function returns success (`false`), `buf` is
 // filled with the data returned from the currently connected device. If `true` is
@@ -16,6 +104,33 @@
 // so the handler function should just exit.
 bool target_exec_cmd(struct debugger* dbg, uint8_t* buf);
 
+// Like `target_exec_cmd`, but the status returned by the device is not checked. If `false` is
+// returned, `buf` holds the complete response packet, whatever its status.
+bool target_transact(struct debugger* dbg, uint8_t* buf);
+
+// Wait until the device on a freshly opened connection is ready to receive requests, and
+// make sure that both ends agree on where packets start. If the device was reset by opening
+// the connection, this waits for the firmware to announce itself; otherwise the device is
+// probed with pings right away. Returns `true` and prints an error message if the device does
+// not respond.
+bool target_sync(struct debugger* dbg);
+
+// Return information about the currently connected device. The result is queried once per
+// connection and cached afterwards. Returns `NULL` if the device could not be queried, in which
+// case an error message has already been printed.
+const struct target_info* target_get_info(struct debugger* dbg);
+
+// Drop any information cached about the currently connected device. This must be called
+// whenever the connection is opened or closed.
+void target_forget(struct debugger* dbg);
+
+// Return whether the currently connected device supports a particular command.
+bool target_supports(struct debugger* dbg, enum bdbp_cmd cmd);
+
+// Query the bus budget and usage of the device into `usage`. If `set` is not `NULL`, the budget
+// is changed to its `burst` and `gap_us` first. Requires BDBP_CMD_BUS, see `target_supports`.
+bool target_bus_usage(struct debugger* dbg, const struct target_bus_usage* set, struct target_bus_usage* usage);
+
 // Write a buffer of arbitrary length to the target memory. This will split up
 // the write into multiple packets as needed.
 bool target_write_memory(struct debugger* dbg, gly_addr_t address, size_t len, const uint8_t buffer[]);
@@ -30,4 +145,26 @@ bool target_write_flash(struct debugger* dbg, gly_addr_t address, size_t len, co
 // This function can also be used to read out flash memory areas.
 bool target_read_memory(struct debugger* dbg, gly_addr_t address, size_t len, uint8_t buffer[]);
 
+// Like `target_read_memory`, but always reads from the device, even if the memory is cached.
+// Use this for memory that the Z80 may change while it runs.
+bool target_read_memory_uncached(struct debugger* dbg, gly_addr_t address, size_t len, uint8_t buffer[]);
+
+// Compute a digest of each of `count` consecutive blocks of `block_size` bytes starting at
+// `address` on the device, without transferring the memory itself. Comparing digests tells
+// which blocks changed. Requires BDBP_CMD_DIGEST, see `target_supports`.
+bool target_digest_memory(struct debugger* dbg, gly_addr_t address, uint8_t block_size, size_t count, uint16_t digests[]);
+
+// Write a batch of operations to target memory and flash, whose data is packed into `data` in
+// the same order. `ops` is terminated by an operation of length 0. Operations may be given in
+// any order and may overlap, in which case later ones take precedence.
+// The writes are planned as a whole: adjacent and overlapping operations are merged, small gaps
+// between them are written over where that is harmless, and everything is sent in address
+// order through a single pipeline. If `erase` is set, every flash sector that is written to is
+// erased once beforehand, and bytes that would be programmed to 0xFF are skipped.
+bool target_write_ops(struct debugger* dbg, const struct debugger_write_op* ops, const uint8_t data[], bool erase);
+
+// Erase all flash sectors overlapping with [`address`, `address + len`), using the fastest
+// erase method that the device supports.
+bool target_erase_flash(struct debugger* dbg, gly_addr_t address, size_t len);
+
 #endif
@@ -104,7 +104,7 @@ static uint8_t read_u8(struct disas_ctx* ctx) {
 
 static void op_n(struct disas_ctx* ctx) {
     struct z80_op* op = next_operand(ctx);
-    op->type = Z80_OP_U16;
+    op->type = Z80_OP_U8;
     op->imm8 = read_u8(ctx);
 }
 
@@ -549,37 +549,39 @@ static enum z80_mnemoric disassemble_extended(struct disas_ctx* ctx) {
             case 6:
                 op_im(ctx, ctx->opcode.y);
                 return Z80_IM;
-            }
-        case 2:
-            switch (ctx->opcode.y) {
-            case 0:
-                op_reg8(ctx, Z80_R8_I);
-                op_reg8(ctx, Z80_R8_A);
-                return Z80_LD;
-            case 1:
-                op_reg8(ctx, Z80_R8_R);
-                op_reg8(ctx, Z80_R8_A);
-                return Z80_LD;
-            case 2:
-                op_reg8(ctx, Z80_R8_A);
-                op_reg8(ctx, Z80_R8_I);
-                return Z80_LD;
-            case 3:
-                op_reg8(ctx, Z80_R8_A);
-                op_reg8(ctx, Z80_R8_I);
-                return Z80_LD;
-            case 4:
-                return Z80_RRD;
-            case 5:
-                return Z80_RLD;
-            case 6:
             case 7:
-                return Z80_NOP;
+                switch (ctx->opcode.y) {
+                case 0:
+                    op_reg8(ctx, Z80_R8_I);
+                    op_reg8(ctx, Z80_R8_A);
+                    return Z80_LD;
+                case 1:
+                    op_reg8(ctx, Z80_R8_R);
+                    op_reg8(ctx, Z80_R8_A);
+                    return Z80_LD;
+                case 2:
+                    op_reg8(ctx, Z80_R8_A);
+                    op_reg8(ctx, Z80_R8_I);
+                    return Z80_LD;
+                case 3:
+                    op_reg8(ctx, Z80_R8_A);
+                    op_reg8(ctx, Z80_R8_R);
+                    return Z80_LD;
+                case 4:
+                    return Z80_RRD;
+                case 5:
+                    return Z80_RLD;
+                case 6:
+                case 7:
+                    return Z80_NOP;
+                }
             }
-        case 3:
+        case 2:
             if (ctx->opcode.z <= 3 && ctx->opcode.y >= 4)
                 return bli_tab[ctx->opcode.y - 4][ctx->opcode.z];
             return Z80_INVALID;
+        case 3:
+            return Z80_INVALID;
     }
     assert(false);
 }
@@ -634,7 +636,7 @@ void z80_disassemble(struct z80_inst* inst, size_t len, const uint8_t code[]) {
 
     uint8_t opcode = read_u8(&ctx);
     ctx.is_ix = opcode == 0xDD;
-    ctx.is_iy = opcode == 0xDF;
+    ctx.is_iy = opcode == 0xFD;
     ctx.is_extended = opcode == 0xED;
     ctx.is_bit = opcode == 0xCB;
 
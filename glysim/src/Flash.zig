@@ -0,0 +1,85 @@
+//! Model of the SST39SF010A flash chip. Reads return the contents of the chip, while writes
+//! drive the chip's software command interface: commands are issued by writing particular
+//! values to particular addresses, see doc/manuals/ROM.pdf.
+
+const Flash = @This();
+
+/// Sectors of the SST39SF010A are 4 KiB.
+pub const sector_size = 0x1000;
+
+/// Identifiers returned in software ID mode.
+pub const manufacturer_id = 0xBF;
+pub const device_id = 0xB5;
+
+const State = enum {
+    idle,
+    unlock1,
+    unlock2,
+    program,
+    erase_setup,
+    erase_unlock1,
+    erase_unlock2,
+};
+
+/// The contents of the chip.
+data: []u8,
+/// How far along a command sequence the chip is.
+state: State = .idle,
+/// Whether the chip is in software ID mode, in which reads return the chip's identifiers.
+software_id: bool = false,
+
+pub fn read(self: *const Flash, addr: u32) u8 {
+    if (self.software_id) {
+        return if ((addr & 1) == 0) manufacturer_id else device_id;
+    }
+    return self.data[addr % self.data.len];
+}
+
+pub fn write(self: *Flash, addr: u32, value: u8) void {
+    // Only A14-A0 are decoded for command cycles.
+    const cmd_addr = addr & 0x7FFF;
+    const state = self.state;
+    // Any unexpected cycle aborts the current command sequence.
+    self.state = .idle;
+    switch (state) {
+        .idle => {
+            if (cmd_addr == 0x5555 and value == 0xAA) {
+                self.state = .unlock1;
+            } else if (value == 0xF0) {
+                // Single-cycle software ID exit.
+                self.software_id = false;
+            }
+        },
+        .unlock1 => {
+            if (cmd_addr == 0x2AAA and value == 0x55) self.state = .unlock2;
+        },
+        .unlock2 => {
+            if (cmd_addr != 0x5555) return;
+            switch (value) {
+                0xA0 => self.state = .program,
+                0x80 => self.state = .erase_setup,
+                0x90 => self.software_id = true,
+                0xF0 => self.software_id = false,
+                else => {},
+            }
+        },
+        .program => {
+            // Programming can only clear bits, setting them requires an erase.
+            self.data[addr % self.data.len] &= value;
+        },
+        .erase_setup => {
+            if (cmd_addr == 0x5555 and value == 0xAA) self.state = .erase_unlock1;
+        },
+        .erase_unlock1 => {
+            if (cmd_addr == 0x2AAA and value == 0x55) self.state = .erase_unlock2;
+        },
+        .erase_unlock2 => {
+            if (value == 0x30) {
+                const start = (addr % self.data.len) / sector_size * sector_size;
+                @memset(self.data[start .. start + sector_size], 0xFF);
+            } else if (cmd_addr == 0x5555 and value == 0x10) {
+                @memset(self.data, 0xFF);
+            }
+        },
+    }
+}
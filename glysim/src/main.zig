@@ -1,9 +1,395 @@
+//! glysim is a virtual Glycon coprocessor. It implements BDBP behind a pseudo-terminal, so that
+//! glydb can be used, tested and benchmarked without hardware. The address space is modelled
+//! after common/glycon.h, with the flash part backed by a model of the SST39SF010A.
+//!
+//! Responses are not sent immediately, but when the real coprocessor would have sent them: the
+//! simulation accounts for the time it takes to transfer each byte over the serial link, the pin
+//! delays of glyco's bus functions and the fixed flash program and erase delays. Requests that
+//! the host sends ahead of time are received while earlier ones are being processed, like they
+//! would be on the real device. Overflowing the device's receive buffer is not modelled.
+
 const std = @import("std");
+const Flash = @import("Flash.zig");
 const c = @cImport({
+    @cDefine("_GNU_SOURCE", {});
     @cInclude("pty.h");
+    @cInclude("poll.h");
+    @cInclude("termios.h");
+    @cInclude("common/glycon.h");
+    @cInclude("common/binary_debug_protocol.h");
 });
 
+const addrspace_size: u32 = c.GLYCON_ADDRSPACE_SIZE;
+const flash_size: u32 = c.GLYCON_FLASH_SIZE;
+
+const min_msg_len: usize = c.BDBP_MIN_MSG_LENGTH;
+const max_msg_len: usize = c.BDBP_MAX_MSG_LENGTH;
+const field_hdr: usize = c.BDBP_FIELD_HDR;
+const field_data_len: usize = c.BDBP_FIELD_DATA_LEN;
+const field_data: usize = c.BDBP_FIELD_DATA;
+
+const cmd_ping: u8 = c.BDBP_CMD_PING;
+const cmd_write: u8 = c.BDBP_CMD_WRITE;
+const cmd_read: u8 = c.BDBP_CMD_READ;
+const cmd_write_flash: u8 = c.BDBP_CMD_WRITE_FLASH;
+const cmd_flash_id: u8 = c.BDBP_CMD_FLASH_ID;
+const cmd_erase_sector: u8 = c.BDBP_CMD_ERASE_SECTOR;
+const cmd_erase_chip: u8 = c.BDBP_CMD_ERASE_CHIP;
+const cmd_info: u8 = c.BDBP_CMD_INFO;
+const cmd_digest: u8 = c.BDBP_CMD_DIGEST;
+
+const digest_max_blocks: u8 = c.BDBP_DIGEST_MAX_BLOCKS;
+
+const status_success: u8 = c.BDBP_STATUS_SUCCESS;
+const status_unknown_cmd: u8 = c.BDBP_STATUS_UNKNOWN_CMD;
+const status_ready: u8 = c.BDBP_STATUS_READY;
+
+/// Commands that the simulator implements, reported through BDBP_CMD_INFO.
+const supported_cmds = [_]u8{
+    cmd_ping,
+    cmd_write,
+    cmd_read,
+    cmd_write_flash,
+    cmd_flash_id,
+    cmd_erase_sector,
+    cmd_erase_chip,
+    cmd_info,
+    cmd_digest,
+};
+
+/// Receive buffer size of the coprocessor, see glyco/src/serial.h.
+const rx_buffer_size: u16 = 512;
+
+/// Build identifier reported through BDBP_CMD_INFO, so that glydb can tell it is talking to
+/// the simulator.
+const build_id: u32 = 0x5150_0000;
+
+/// How often to check whether glydb has connected.
+const poll_interval_ns = 10 * std.time.ns_per_ms;
+
+const usage =
+    \\usage: glysim [options]
+    \\
+    \\Create a pseudo-terminal that behaves like a Glycon coprocessor, and print its path.
+    \\Connect to it using `glydb <path>`. All timing options default to the timing of the
+    \\real coprocessor.
+    \\
+    \\options:
+    \\-h, --help                Show this message and exit.
+    \\--flash <file>            Initialize flash with the contents of a binary file.
+    \\--byte-time-ns <ns>       Time to transfer a byte over the serial link (default: 10000).
+    \\--pin-delay-ns <ns>       Settle time after writing bus pins (default: 1000).
+    \\--program-us <us>         Time to program a flash byte (default: 20).
+    \\--erase-sector-ms <ms>    Time to erase a flash sector (default: 25).
+    \\--erase-chip-ms <ms>      Time to erase the flash chip (default: 100).
+    \\--boot-ms <ms>            Time to boot when glydb resets the device (default: 0).
+    \\
+;
+
+const Config = struct {
+    /// Time to transfer a single byte over the serial link, in either direction. The
+    /// coprocessor runs at 1 Mbaud, with 10 bits per byte.
+    byte_time_ns: u64 = 10 * std.time.ns_per_us,
+    /// Settle time after writing to the bus pins, see TIMING_PIN_DELAY_US.
+    pin_delay_ns: u64 = 1 * std.time.ns_per_us,
+    /// Flash delays, see glyco/src/timing.h.
+    program_ns: u64 = 20 * std.time.ns_per_us,
+    erase_sector_ns: u64 = 25 * std.time.ns_per_ms,
+    erase_chip_ns: u64 = 100 * std.time.ns_per_ms,
+    /// Time between a reset and the firmware announcing itself.
+    boot_ns: u64 = 0,
+    /// Binary file to initialize flash with.
+    flash_image: ?[]const u8 = null,
+};
+
+/// A response that is waiting to be sent until the device would have sent it.
+const Response = struct {
+    due: u64,
+    len: usize,
+    data: [max_msg_len]u8,
+};
+
+const Sim = struct {
+    config: Config,
+    /// The entire address space. RAM is backed directly, flash through `flash`.
+    memory: []u8,
+    flash: Flash,
+    /// Simulated time taken by the request that is currently being handled.
+    cost_ns: u64 = 0,
+    /// The time at which the serial link has finished receiving all bytes sent so far.
+    rx_free: u64 = 0,
+    /// The time at which the device is done with all requests received so far.
+    dev_free: u64 = 0,
+    /// The number of requests handled since the last connect.
+    requests: u64 = 0,
+
+    fn pinDelay(self: *Sim, n: u64) void {
+        self.cost_ns += n * self.config.pin_delay_ns;
+    }
+
+    /// Read from memory, like `bus_read`.
+    fn busRead(self: *Sim, addr: u32) u8 {
+        self.pinDelay(1);
+        if (c.glycon_is_ram_addr(addr)) return self.memory[addr];
+        return self.flash.read(addr);
+    }
+
+    /// Write to RAM, like `bus_write` followed by `bus_pulse_ram_write`. The RAM chip is only
+    /// selected by RAM addresses.
+    fn ramWrite(self: *Sim, addr: u32, value: u8) void {
+        self.pinDelay(3);
+        if (c.glycon_is_ram_addr(addr)) self.memory[addr] = value;
+    }
+
+    /// Write a command cycle to flash, like `flash_cmd`. The flash chip is only selected by flash
+    /// addresses.
+    fn flashCmd(self: *Sim, addr: u32, value: u8) void {
+        self.pinDelay(3);
+        if (c.glycon_is_flash_addr(addr)) self.flash.write(addr, value);
+    }
+
+    fn flashProgram(self: *Sim, addr: u32, value: u8) void {
+        if (!c.glycon_is_flash_addr(addr)) return;
+        self.flashCmd(0x5555, 0xAA);
+        self.flashCmd(0x2AAA, 0x55);
+        self.flashCmd(0x5555, 0xA0);
+        self.flashCmd(addr, value);
+        self.cost_ns += self.config.program_ns;
+    }
+
+    fn flashEraseSetup(self: *Sim) void {
+        self.flashCmd(0x5555, 0xAA);
+        self.flashCmd(0x2AAA, 0x55);
+        self.flashCmd(0x5555, 0x80);
+        self.flashCmd(0x5555, 0xAA);
+        self.flashCmd(0x2AAA, 0x55);
+    }
+
+    fn flashSoftwareIdCmd(self: *Sim, value: u8) void {
+        self.flashCmd(0x5555, 0xAA);
+        self.flashCmd(0x2AAA, 0x55);
+        self.flashCmd(0x5555, value);
+    }
+
+    /// Handle a single request packet, and write the response packet into `resp`. Returns the
+    /// length of the response packet.
+    fn handle(self: *Sim, req: []const u8, resp: *[max_msg_len]u8) usize {
+        const cmd = req[field_hdr];
+        const data = req[field_data..];
+        resp[field_hdr] = status_success;
+        resp[field_data_len] = 0;
+
+        switch (cmd) {
+            cmd_ping => {},
+            cmd_write => {
+                if (data.len < 3) return min_msg_len;
+                const base = readAddr(data);
+                for (data[3..], 0..) |byte, i| {
+                    self.ramWrite(wrapAddr(base, i), byte);
+                }
+            },
+            cmd_read => {
+                if (data.len < 4) return min_msg_len;
+                const base = readAddr(data);
+                const amt = data[3];
+                resp[field_data_len] = amt;
+                for (0..amt) |i| {
+                    resp[field_data + i] = self.busRead(wrapAddr(base, i));
+                }
+            },
+            cmd_digest => {
+                if (data.len < 5) return min_msg_len;
+                const base = readAddr(data);
+                const block_size: usize = data[3];
+                const count = @min(data[4], digest_max_blocks);
+                resp[field_data_len] = 2 * count;
+                for (0..count) |block| {
+                    var crc: u16 = 0xFFFF;
+                    for (0..block_size) |i| {
+                        crc = crc16Update(crc, self.busRead(wrapAddr(base, block * block_size + i)));
+                    }
+                    std.mem.writeInt(u16, resp[field_data + 2 * block ..][0..2], crc, .little);
+                }
+            },
+            cmd_write_flash => {
+                if (data.len < 3) return min_msg_len;
+                const base = readAddr(data);
+                for (data[3..], 0..) |byte, i| {
+                    self.flashProgram(wrapAddr(base, i), byte);
+                }
+            },
+            cmd_flash_id => {
+                self.flashSoftwareIdCmd(0x90);
+                resp[field_data_len] = 2;
+                resp[field_data + 0] = self.busRead(0x0000);
+                resp[field_data + 1] = self.busRead(0x0001);
+                self.flashSoftwareIdCmd(0xF0);
+            },
+            cmd_erase_sector => {
+                if (data.len < 3) return min_msg_len;
+                const addr = readAddr(data) % addrspace_size;
+                if (c.glycon_is_flash_addr(addr)) {
+                    self.flashEraseSetup();
+                    self.flashCmd(addr, 0x30);
+                    self.cost_ns += self.config.erase_sector_ns;
+                }
+            },
+            cmd_erase_chip => {
+                self.flashEraseSetup();
+                self.flashCmd(0x5555, 0x10);
+                self.cost_ns += self.config.erase_chip_ns;
+            },
+            cmd_info => {
+                var bitmap: u64 = 0;
+                for (supported_cmds) |supported| {
+                    bitmap |= @as(u64, 1) << @as(u6, @intCast(supported));
+                }
+
+                resp[field_data_len] = c.BDBP_INFO_DATA_LENGTH;
+                resp[field_data + 0] = c.BDBP_VERSION;
+                std.mem.writeInt(u16, resp[field_data + 1 ..][0..2], max_msg_len, .little);
+                std.mem.writeInt(u16, resp[field_data + 3 ..][0..2], rx_buffer_size, .little);
+                std.mem.writeInt(u16, resp[field_data + 5 ..][0..2], 0, .little);
+                std.mem.writeInt(u64, resp[field_data + 7 ..][0..8], bitmap, .little);
+                std.mem.writeInt(u32, resp[field_data + 15 ..][0..4], build_id, .little);
+            },
+            else => resp[field_hdr] = status_unknown_cmd,
+        }
+
+        return min_msg_len + resp[field_data_len];
+    }
+
+    /// Handle a request whose last byte arrived at `arrival`, and return the response
+    /// together with the time that the device would have finished sending it.
+    fn execute(self: *Sim, req: []const u8, arrival: u64) Response {
+        var resp = Response{ .due = 0, .len = 0, .data = undefined };
+        self.cost_ns = 0;
+        resp.len = self.handle(req, &resp.data);
+
+        // The device handles requests one at a time, and blocks while transmitting.
+        const start = @max(arrival, self.dev_free);
+        const tx_ns = @as(u64, @intCast(resp.len)) * self.config.byte_time_ns;
+        resp.due = start + self.cost_ns + tx_ns;
+        self.dev_free = resp.due;
+        self.requests += 1;
+        return resp;
+    }
+};
+
+/// Add a byte to a BDBP_CMD_DIGEST digest, like `bdbp_crc16_update`.
+fn crc16Update(crc: u16, byte: u8) u16 {
+    var data = byte ^ @as(u8, @truncate(crc));
+    data ^= data << 4;
+    return ((@as(u16, data) << 8) | (crc >> 8)) ^ @as(u16, data >> 4) ^ (@as(u16, data) << 3);
+}
+
+fn readAddr(data: []const u8) u32 {
+    return @as(u32, data[0]) | @as(u32, data[1]) << 8 | @as(u32, data[2]) << 16;
+}
+
+/// Return the address `offset` bytes after `base`. Like on the device, addresses wrap around
+/// at the end of the address space.
+fn wrapAddr(base: u32, offset: usize) u32 {
+    return @intCast((base + offset) % addrspace_size);
+}
+
+fn timestamp() u64 {
+    return @intCast(std.time.nanoTimestamp());
+}
+
+/// Return whether the terminal drops its modem lines when it is closed. If it does, the next
+/// open raises DTR, which resets a real coprocessor.
+fn hangsUpOnClose(fd: std.posix.fd_t) bool {
+    var tio: c.struct_termios = undefined;
+    if (c.tcgetattr(fd, &tio) != 0) return true;
+    return (tio.c_cflag & @as(c.tcflag_t, c.HUPCL)) != 0;
+}
+
+fn writeAll(fd: std.posix.fd_t, bytes: []const u8) void {
+    var offset: usize = 0;
+    while (offset < bytes.len) {
+        // If glydb went away, the response is simply lost.
+        offset += std.posix.write(fd, bytes[offset..]) catch return;
+    }
+}
+
+fn loadImage(dest: []u8, path: []const u8) !void {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    _ = try file.readAll(dest);
+}
+
+fn optionValue(args: []const [:0]u8, i: *usize) ![]const u8 {
+    const option = args[i.*];
+    i.* += 1;
+    if (i.* == args.len) {
+        std.log.err("missing value for option '{s}'", .{option});
+        return error.InvalidArgs;
+    }
+    return args[i.*];
+}
+
+fn numericOption(args: []const [:0]u8, i: *usize) !u64 {
+    const value = try optionValue(args, i);
+    return std.fmt.parseInt(u64, value, 0) catch {
+        std.log.err("invalid value '{s}' for option '{s}'", .{ value, args[i.* - 1] });
+        return error.InvalidArgs;
+    };
+}
+
+fn parseArgs(args: []const [:0]u8) !Config {
+    var config = Config{};
+    var i: usize = 1;
+    while (i < args.len) : (i += 1) {
+        const arg = args[i];
+        if (std.mem.eql(u8, arg, "-h") or std.mem.eql(u8, arg, "--help")) {
+            std.io.getStdOut().writeAll(usage) catch {};
+            std.process.exit(0);
+        } else if (std.mem.eql(u8, arg, "--flash")) {
+            config.flash_image = try optionValue(args, &i);
+        } else if (std.mem.eql(u8, arg, "--byte-time-ns")) {
+            config.byte_time_ns = try numericOption(args, &i);
+        } else if (std.mem.eql(u8, arg, "--pin-delay-ns")) {
+            config.pin_delay_ns = try numericOption(args, &i);
+        } else if (std.mem.eql(u8, arg, "--program-us")) {
+            config.program_ns = (try numericOption(args, &i)) * std.time.ns_per_us;
+        } else if (std.mem.eql(u8, arg, "--erase-sector-ms")) {
+            config.erase_sector_ns = (try numericOption(args, &i)) * std.time.ns_per_ms;
+        } else if (std.mem.eql(u8, arg, "--erase-chip-ms")) {
+            config.erase_chip_ns = (try numericOption(args, &i)) * std.time.ns_per_ms;
+        } else if (std.mem.eql(u8, arg, "--boot-ms")) {
+            config.boot_ns = (try numericOption(args, &i)) * std.time.ns_per_ms;
+        } else {
+            std.log.err("unknown option '{s}'", .{arg});
+            return error.InvalidArgs;
+        }
+    }
+    return config;
+}
+
 pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+    const config = parseArgs(args) catch std.process.exit(1);
+
+    const memory = try allocator.alloc(u8, addrspace_size);
+    defer allocator.free(memory);
+    @memset(memory[0..flash_size], 0xFF);
+    @memset(memory[flash_size..], 0x00);
+    if (config.flash_image) |path| {
+        try loadImage(memory[0..flash_size], path);
+    }
+
+    var sim = Sim{
+        .config = config,
+        .memory = memory,
+        .flash = .{ .data = memory[0..flash_size] },
+    };
+
     var master: std.posix.fd_t = undefined;
     var slave: std.posix.fd_t = undefined;
 
@@ -11,21 +397,105 @@ pub fn main() !void {
     // buffer should be. We need the name so that we can
     // give it to the user, so that they may connect glydb to it.
     var name: [1024]u8 = undefined;
-    const result = c.openpty(&master, &slave, &name, null, null);
-    std.log.debug("result: {}", .{result});
-    std.log.debug("name: {s}", .{std.mem.sliceTo(&name, 0)});
-
-    defer {
-        std.posix.close(master);
-        std.posix.close(slave);
+    if (c.openpty(&master, &slave, &name, null, null) != 0) {
+        return error.OpenPtyFailed;
     }
+    defer std.posix.close(master);
+    // Don't keep the slave side open, so that the master side can tell when glydb connects
+    // and disconnects.
+    std.posix.close(slave);
+
+    try std.io.getStdOut().writer().print("{s}\n", .{std.mem.sliceTo(&name, 0)});
 
-    var tty = std.fs.File{.handle = master};
-    const reader = tty.reader();
+    var responses = std.ArrayList(Response).init(allocator);
+    defer responses.deinit();
+
+    var connected = false;
+    // A fresh terminal hangs up on close, so the first connection behaves like opening the
+    // port of a real coprocessor for the first time.
+    var reset_on_connect = true;
+    // The time until which received bytes are discarded, because the device is booting.
+    var booted_at: u64 = 0;
+
+    var request: [max_msg_len]u8 = undefined;
+    var request_len: usize = 0;
 
-    var buf: [1024]u8 = undefined;
     while (true) {
-        const nread = try reader.read(&buf);
-        std.log.debug("nread: {}", .{nread});
+        // Wake up when the next response is due, or periodically while disconnected.
+        var timeout_ns: ?u64 = null;
+        if (!connected) {
+            timeout_ns = poll_interval_ns;
+        } else if (responses.items.len > 0) {
+            timeout_ns = responses.items[0].due -| timestamp();
+        }
+
+        var ts: c.struct_timespec = undefined;
+        if (timeout_ns) |ns| {
+            ts.tv_sec = @intCast(ns / std.time.ns_per_s);
+            ts.tv_nsec = @intCast(ns % std.time.ns_per_s);
+        }
+
+        var pfd = c.struct_pollfd{
+            .fd = master,
+            .events = c.POLLIN,
+            .revents = 0,
+        };
+        if (c.ppoll(&pfd, 1, if (timeout_ns != null) &ts else null, null) < 0) {
+            continue;
+        }
+
+        const now = timestamp();
+        if ((pfd.revents & @as(c_short, c.POLLHUP)) != 0) {
+            if (connected) {
+                std.log.info("disconnected after {d} requests", .{sim.requests});
+                connected = false;
+                reset_on_connect = hangsUpOnClose(master);
+                responses.clearRetainingCapacity();
+                request_len = 0;
+            }
+            // The master side keeps reporting the hangup until glydb connects again.
+            std.time.sleep(poll_interval_ns);
+            continue;
+        }
+
+        if (!connected) {
+            connected = true;
+            sim.requests = 0;
+            sim.rx_free = now;
+            sim.dev_free = now;
+            if (reset_on_connect) {
+                std.log.info("connected, resetting", .{});
+                booted_at = now + config.boot_ns;
+                sim.dev_free = booted_at;
+                var ready = Response{ .due = booted_at, .len = min_msg_len, .data = undefined };
+                ready.data[field_hdr] = status_ready;
+                ready.data[field_data_len] = 0;
+                try responses.append(ready);
+            } else {
+                std.log.info("connected", .{});
+            }
+        }
+
+        if ((pfd.revents & @as(c_short, c.POLLIN)) != 0) {
+            var chunk: [4096]u8 = undefined;
+            const n = std.posix.read(master, &chunk) catch 0;
+            for (chunk[0..n]) |byte| {
+                sim.rx_free = @max(now, sim.rx_free) + config.byte_time_ns;
+                // Bytes sent while the device is still booting are lost.
+                if (sim.rx_free <= booted_at) continue;
+
+                request[request_len] = byte;
+                request_len += 1;
+                if (request_len >= min_msg_len and request_len == min_msg_len + request[field_data_len]) {
+                    try responses.append(sim.execute(request[0..request_len], sim.rx_free));
+                    request_len = 0;
+                }
+            }
+        }
+
+        while (responses.items.len > 0 and responses.items[0].due <= timestamp()) {
+            const resp = responses.orderedRemove(0);
+            writeAll(master, resp.data[0..resp.len]);
+        }
     }
 }